@@ -36,6 +36,15 @@ const OptionInfoRec intel_options[] = {
 	{OPTION_TEAR_FREE,	"TearFree",	OPTV_BOOLEAN,	{0},	0},
 	{OPTION_THROTTLE,	"Throttle",	OPTV_BOOLEAN,	{0},	1},
 	{OPTION_CRTC_PIXMAPS,	"PerCrtcPixmaps", OPTV_BOOLEAN,	{0},	0},
+	{OPTION_GRADIENT_CACHE,	"GradientCacheSize", OPTV_INTEGER,	{0},	0},
+	{OPTION_TILED_DAMAGE,	"TiledDamage",	OPTV_BOOLEAN,	{0},	0},
+	{OPTION_ASYNC_SUBMIT,	"AsyncSubmit",	OPTV_BOOLEAN,	{0},	0},
+	{OPTION_STATISTICS,	"Statistics",	OPTV_BOOLEAN,	{0},	0},
+	{OPTION_BATCH_CAPTURE,	"BatchCapture",	OPTV_STRING,	{0},	0},
+	{OPTION_BATCH_CAPTURE_BUFFERS,	"BatchCaptureBuffers",	OPTV_BOOLEAN,	{0},	0},
+	{OPTION_CACHE_BUDGET,	"CacheBudget",	OPTV_INTEGER,	{0},	0},
+	{OPTION_MEMORY_PRESSURE,	"MemoryPressure",	OPTV_BOOLEAN,	{0},	1},
+	{OPTION_KERNEL_CACHE,	"KernelCache",	OPTV_STRING,	{0},	0},
 #endif
 #ifdef USE_UXA
 	{OPTION_FALLBACKDEBUG,	"FallbackDebug",OPTV_BOOLEAN,	{0},	0},
@@ -40,6 +40,15 @@ enum intel_options {
 	OPTION_TEAR_FREE,
 	OPTION_THROTTLE,
 	OPTION_CRTC_PIXMAPS,
+	OPTION_GRADIENT_CACHE,
+	OPTION_TILED_DAMAGE,
+	OPTION_ASYNC_SUBMIT,
+	OPTION_STATISTICS,
+	OPTION_BATCH_CAPTURE,
+	OPTION_BATCH_CAPTURE_BUFFERS,
+	OPTION_CACHE_BUDGET,
+	OPTION_MEMORY_PRESSURE,
+	OPTION_KERNEL_CACHE,
 #endif
 #ifdef USE_UXA
 	OPTION_FALLBACKDEBUG,
@@ -631,6 +631,700 @@ memcpy_between_tiled_x__swizzle_0__sse2(const void *src, void *dst, int bpp,
 	}
 }
 
+/* Bit-6 swizzling permutes the tile in 64 byte units, so each aligned
+ * 64 byte span is still contiguous and can be moved with a single
+ * run of vector loads and stores.
+ */
+#define memcpy_to_tiled_x__sse2(swizzle) \
+static void \
+memcpy_to_tiled_x__##swizzle##__sse2(const void *src, void *dst, int bpp, \
+				     int32_t src_stride, int32_t dst_stride, \
+				     int16_t src_x, int16_t src_y, \
+				     int16_t dst_x, int16_t dst_y, \
+				     uint16_t width, uint16_t height) \
+{ \
+	const unsigned tile_width = 512; \
+	const unsigned tile_height = 8; \
+	const unsigned tile_size = 4096; \
+	const unsigned cpp = bpp / 8; \
+	const unsigned stride_tiles = dst_stride / tile_width; \
+	const unsigned swizzle_pixels = 64 / cpp; \
+	const unsigned tile_pixels = ffs(tile_width / cpp) - 1; \
+	const unsigned tile_mask = (1 << tile_pixels) - 1; \
+	unsigned x, y; \
+	DBG(("%s(bpp=%d): src=(%d, %d), dst=(%d, %d), size=%dx%d, pitch=%d/%d\n", \
+	     __FUNCTION__, bpp, src_x, src_y, dst_x, dst_y, width, height, src_stride, dst_stride)); \
+	src = (const uint8_t *)src + src_y * src_stride + src_x * cpp; \
+	for (y = 0; y < height; ++y) { \
+		const uint32_t dy = y + dst_y; \
+		const uint32_t tile_row = \
+			(dy / tile_height * stride_tiles * tile_size + \
+			 (dy & (tile_height-1)) * tile_width); \
+		const uint8_t *src_row = (const uint8_t *)src + src_stride * y; \
+		uint32_t dx = dst_x; \
+		x = width * cpp; \
+		if (dx & (swizzle_pixels - 1)) { \
+			const uint32_t swizzle_bound_pixels = ALIGN(dx + 1, swizzle_pixels); \
+			const uint32_t length = min(dst_x + width, swizzle_bound_pixels) - dx; \
+			uint32_t offset = \
+				tile_row + \
+				(dx >> tile_pixels) * tile_size + \
+				(dx & tile_mask) * cpp; \
+			memcpy((char *)dst + swizzle(offset), src_row, length * cpp); \
+			src_row += length * cpp; \
+			x -= length * cpp; \
+			dx += length; \
+		} \
+		while (x >= 64) { \
+			uint32_t offset = \
+				tile_row + \
+				(dx >> tile_pixels) * tile_size + \
+				(dx & tile_mask) * cpp; \
+			to_sse64(assume_aligned((uint8_t *)dst + swizzle(offset), 64), \
+				 src_row); \
+			src_row += 64; \
+			x -= 64; \
+			dx += swizzle_pixels; \
+		} \
+		if (x) { \
+			uint32_t offset = \
+				tile_row + \
+				(dx >> tile_pixels) * tile_size + \
+				(dx & tile_mask) * cpp; \
+			memcpy(assume_aligned((char *)dst + swizzle(offset), 64), src_row, x); \
+		} \
+	} \
+}
+
+#define memcpy_from_tiled_x__sse2(swizzle) \
+static void \
+memcpy_from_tiled_x__##swizzle##__sse2(const void *src, void *dst, int bpp, \
+				       int32_t src_stride, int32_t dst_stride, \
+				       int16_t src_x, int16_t src_y, \
+				       int16_t dst_x, int16_t dst_y, \
+				       uint16_t width, uint16_t height) \
+{ \
+	const unsigned tile_width = 512; \
+	const unsigned tile_height = 8; \
+	const unsigned tile_size = 4096; \
+	const unsigned cpp = bpp / 8; \
+	const unsigned stride_tiles = src_stride / tile_width; \
+	const unsigned swizzle_pixels = 64 / cpp; \
+	const unsigned tile_pixels = ffs(tile_width / cpp) - 1; \
+	const unsigned tile_mask = (1 << tile_pixels) - 1; \
+	unsigned x, y; \
+	DBG(("%s(bpp=%d): src=(%d, %d), dst=(%d, %d), size=%dx%d, pitch=%d/%d\n", \
+	     __FUNCTION__, bpp, src_x, src_y, dst_x, dst_y, width, height, src_stride, dst_stride)); \
+	dst = (uint8_t *)dst + dst_y * dst_stride + dst_x * cpp; \
+	for (y = 0; y < height; ++y) { \
+		const uint32_t sy = y + src_y; \
+		const uint32_t tile_row = \
+			(sy / tile_height * stride_tiles * tile_size + \
+			 (sy & (tile_height-1)) * tile_width); \
+		uint8_t *dst_row = (uint8_t *)dst + dst_stride * y; \
+		uint32_t sx = src_x; \
+		x = width * cpp; \
+		if (sx & (swizzle_pixels - 1)) { \
+			const uint32_t swizzle_bound_pixels = ALIGN(sx + 1, swizzle_pixels); \
+			const uint32_t length = min(src_x + width, swizzle_bound_pixels) - sx; \
+			uint32_t offset = \
+				tile_row + \
+				(sx >> tile_pixels) * tile_size + \
+				(sx & tile_mask) * cpp; \
+			memcpy(dst_row, (const char *)src + swizzle(offset), length * cpp); \
+			dst_row += length * cpp; \
+			x -= length * cpp; \
+			sx += length; \
+		} \
+		while (x >= 64) { \
+			uint32_t offset = \
+				tile_row + \
+				(sx >> tile_pixels) * tile_size + \
+				(sx & tile_mask) * cpp; \
+			from_sse64u(dst_row, \
+				    assume_aligned((const uint8_t *)src + swizzle(offset), 64)); \
+			dst_row += 64; \
+			x -= 64; \
+			sx += swizzle_pixels; \
+		} \
+		if (x) { \
+			uint32_t offset = \
+				tile_row + \
+				(sx >> tile_pixels) * tile_size + \
+				(sx & tile_mask) * cpp; \
+			memcpy(dst_row, assume_aligned((const char *)src + swizzle(offset), 64), x); \
+		} \
+	} \
+}
+
+#define swizzle_9(X) ((X) ^ (((X) >> 3) & 64))
+memcpy_to_tiled_x__sse2(swizzle_9)
+memcpy_from_tiled_x__sse2(swizzle_9)
+#undef swizzle_9
+
+#define swizzle_9_10(X) ((X) ^ ((((X) ^ ((X) >> 1)) >> 3) & 64))
+memcpy_to_tiled_x__sse2(swizzle_9_10)
+memcpy_from_tiled_x__sse2(swizzle_9_10)
+#undef swizzle_9_10
+
+#define swizzle_9_11(X) ((X) ^ ((((X) ^ ((X) >> 2)) >> 3) & 64))
+memcpy_to_tiled_x__sse2(swizzle_9_11)
+memcpy_from_tiled_x__sse2(swizzle_9_11)
+#undef swizzle_9_11
+
+#define swizzle_9_10_11(X) ((X) ^ ((((X) ^ ((X) >> 1) ^ ((X) >> 2)) >> 3) & 64))
+memcpy_to_tiled_x__sse2(swizzle_9_10_11)
+memcpy_from_tiled_x__sse2(swizzle_9_10_11)
+#undef swizzle_9_10_11
+
+#pragma GCC pop_options
+#endif
+
+#if defined(avx2)
+#pragma GCC push_options
+#pragma GCC target("avx2,avx,sse4.2,sse2,inline-all-stringops,fpmath=sse")
+#pragma GCC optimize("Ofast")
+#include <immintrin.h>
+
+static force_inline __m256i
+ymm_load_256u(const __m256i *src)
+{
+	return _mm256_loadu_si256(src);
+}
+
+static force_inline __m256i
+ymm_stream_load_256(const __m256i *src)
+{
+	return _mm256_stream_load_si256((__m256i *)src);
+}
+
+static force_inline void
+ymm_save_256u(__m256i *dst, __m256i data)
+{
+	_mm256_storeu_si256(dst, data);
+}
+
+static force_inline void
+ymm_stream_256(__m256i *dst, __m256i data)
+{
+	_mm256_stream_si256(dst, data);
+}
+
+/* Writes into the tile use non-temporal stores. The destination is
+ * either a WC mapping or a buffer that is about to be handed to the
+ * GPU, so there is no point in allocating those lines in our caches.
+ * Every writer must finish with an sfence before returning.
+ */
+static force_inline void
+to_avx64(uint8_t *dst, const uint8_t *src)
+{
+	__m256i ymm0, ymm1;
+
+	assert(((uintptr_t)dst & 31) == 0);
+
+	ymm0 = ymm_load_256u((const __m256i*)src + 0);
+	ymm1 = ymm_load_256u((const __m256i*)src + 1);
+
+	ymm_stream_256((__m256i*)dst + 0, ymm0);
+	ymm_stream_256((__m256i*)dst + 1, ymm1);
+}
+
+static force_inline void
+to_avx128xN(uint8_t *dst, const uint8_t *src, int bytes)
+{
+	int i;
+
+	assert(((uintptr_t)dst & 31) == 0);
+
+	for (i = 0; i < bytes / 128; i++) {
+		__m256i ymm0, ymm1, ymm2, ymm3;
+
+		ymm0 = ymm_load_256u((const __m256i*)src + 0);
+		ymm1 = ymm_load_256u((const __m256i*)src + 1);
+		ymm2 = ymm_load_256u((const __m256i*)src + 2);
+		ymm3 = ymm_load_256u((const __m256i*)src + 3);
+
+		ymm_stream_256((__m256i*)dst + 0, ymm0);
+		ymm_stream_256((__m256i*)dst + 1, ymm1);
+		ymm_stream_256((__m256i*)dst + 2, ymm2);
+		ymm_stream_256((__m256i*)dst + 3, ymm3);
+
+		dst += 128;
+		src += 128;
+	}
+}
+
+static void to_avx_memcpy(uint8_t *dst, const uint8_t *src, unsigned len)
+{
+	assert(len);
+	if ((uintptr_t)dst & 31) {
+		unsigned head = 32 - ((uintptr_t)dst & 31);
+		if (len <= head) {
+			memcpy(dst, src, len);
+			return;
+		}
+
+		memcpy(dst, src, head);
+		dst += head;
+		src += head;
+		len -= head;
+	}
+
+	assert(((uintptr_t)dst & 31) == 0);
+	while (len >= 64) {
+		to_avx64(dst, src);
+		dst += 64;
+		src += 64;
+		len -= 64;
+	}
+	if (len & 32) {
+		ymm_stream_256((__m256i*)dst, ymm_load_256u((const __m256i*)src));
+		dst += 32;
+		src += 32;
+	}
+	if (len & 31)
+		memcpy(dst, src, len & 31);
+}
+
+/* Reads from the tile use streaming loads, which avoid the uncached
+ * penalty on WC mappings and behave as ordinary loads elsewhere.
+ */
+static force_inline void
+from_avx64(uint8_t *dst, const uint8_t *src)
+{
+	__m256i ymm0, ymm1;
+
+	assert(((uintptr_t)src & 31) == 0);
+
+	ymm0 = ymm_stream_load_256((const __m256i*)src + 0);
+	ymm1 = ymm_stream_load_256((const __m256i*)src + 1);
+
+	ymm_save_256u((__m256i*)dst + 0, ymm0);
+	ymm_save_256u((__m256i*)dst + 1, ymm1);
+}
+
+static force_inline void
+from_avx128xN(uint8_t *dst, const uint8_t *src, int bytes)
+{
+	int i;
+
+	assert(((uintptr_t)src & 31) == 0);
+
+	for (i = 0; i < bytes / 128; i++) {
+		__m256i ymm0, ymm1, ymm2, ymm3;
+
+		ymm0 = ymm_stream_load_256((const __m256i*)src + 0);
+		ymm1 = ymm_stream_load_256((const __m256i*)src + 1);
+		ymm2 = ymm_stream_load_256((const __m256i*)src + 2);
+		ymm3 = ymm_stream_load_256((const __m256i*)src + 3);
+
+		ymm_save_256u((__m256i*)dst + 0, ymm0);
+		ymm_save_256u((__m256i*)dst + 1, ymm1);
+		ymm_save_256u((__m256i*)dst + 2, ymm2);
+		ymm_save_256u((__m256i*)dst + 3, ymm3);
+
+		dst += 128;
+		src += 128;
+	}
+}
+
+static force_inline void
+between_avx128xN(uint8_t *dst, const uint8_t *src, int bytes)
+{
+	int i;
+
+	assert(((uintptr_t)dst & 31) == 0);
+	assert(((uintptr_t)src & 31) == 0);
+
+	for (i = 0; i < bytes / 128; i++) {
+		__m256i ymm0, ymm1, ymm2, ymm3;
+
+		ymm0 = ymm_stream_load_256((const __m256i*)src + 0);
+		ymm1 = ymm_stream_load_256((const __m256i*)src + 1);
+		ymm2 = ymm_stream_load_256((const __m256i*)src + 2);
+		ymm3 = ymm_stream_load_256((const __m256i*)src + 3);
+
+		ymm_stream_256((__m256i*)dst + 0, ymm0);
+		ymm_stream_256((__m256i*)dst + 1, ymm1);
+		ymm_stream_256((__m256i*)dst + 2, ymm2);
+		ymm_stream_256((__m256i*)dst + 3, ymm3);
+
+		dst += 128;
+		src += 128;
+	}
+}
+
+static void
+memcpy_to_tiled_x__swizzle_0__avx2(const void *src, void *dst, int bpp,
+				   int32_t src_stride, int32_t dst_stride,
+				   int16_t src_x, int16_t src_y,
+				   int16_t dst_x, int16_t dst_y,
+				   uint16_t width, uint16_t height)
+{
+	const unsigned tile_width = 512;
+	const unsigned tile_height = 8;
+	const unsigned tile_size = 4096;
+
+	const unsigned cpp = bpp / 8;
+	const unsigned tile_pixels = tile_width / cpp;
+	const unsigned tile_shift = ffs(tile_pixels) - 1;
+	const unsigned tile_mask = tile_pixels - 1;
+
+	unsigned offset_x, length_x;
+
+	DBG(("%s(bpp=%d): src=(%d, %d), dst=(%d, %d), size=%dx%d, pitch=%d/%d\n",
+	     __FUNCTION__, bpp, src_x, src_y, dst_x, dst_y, width, height, src_stride, dst_stride));
+	assert(src != dst);
+
+	if (src_x | src_y)
+		src = (const uint8_t *)src + src_y * src_stride + src_x * cpp;
+	width *= cpp;
+	assert(src_stride >= width);
+
+	if (dst_x & tile_mask) {
+		offset_x = (dst_x & tile_mask) * cpp;
+		length_x = min(tile_width - offset_x, width);
+	} else
+		offset_x = length_x = 0;
+	dst = (uint8_t *)dst + (dst_x >> tile_shift) * tile_size;
+
+	while (height--) {
+		unsigned w = width;
+		const uint8_t *src_row = src;
+		uint8_t *tile_row = dst;
+
+		src = (const uint8_t *)src + src_stride;
+
+		tile_row += dst_y / tile_height * dst_stride * tile_height;
+		tile_row += (dst_y & (tile_height-1)) * tile_width;
+		dst_y++;
+
+		if (length_x) {
+			to_avx_memcpy(tile_row + offset_x, src_row, length_x);
+
+			tile_row += tile_size;
+			src_row = (const uint8_t *)src_row + length_x;
+			w -= length_x;
+		}
+		while (w >= tile_width) {
+			assert(((uintptr_t)tile_row & (tile_width - 1)) == 0);
+			to_avx128xN(assume_aligned(tile_row, tile_width),
+				    src_row, tile_width);
+			tile_row += tile_size;
+			src_row = (const uint8_t *)src_row + tile_width;
+			w -= tile_width;
+		}
+		if (w) {
+			assert(((uintptr_t)tile_row & (tile_width - 1)) == 0);
+			to_avx_memcpy(assume_aligned(tile_row, tile_width),
+				      src_row, w);
+		}
+	}
+
+	_mm_sfence();
+}
+
+static void
+memcpy_from_tiled_x__swizzle_0__avx2(const void *src, void *dst, int bpp,
+				     int32_t src_stride, int32_t dst_stride,
+				     int16_t src_x, int16_t src_y,
+				     int16_t dst_x, int16_t dst_y,
+				     uint16_t width, uint16_t height)
+{
+	const unsigned tile_width = 512;
+	const unsigned tile_height = 8;
+	const unsigned tile_size = 4096;
+
+	const unsigned cpp = bpp / 8;
+	const unsigned tile_pixels = tile_width / cpp;
+	const unsigned tile_shift = ffs(tile_pixels) - 1;
+	const unsigned tile_mask = tile_pixels - 1;
+
+	unsigned offset_x, length_x;
+
+	DBG(("%s(bpp=%d): src=(%d, %d), dst=(%d, %d), size=%dx%d, pitch=%d/%d\n",
+	     __FUNCTION__, bpp, src_x, src_y, dst_x, dst_y, width, height, src_stride, dst_stride));
+	assert(src != dst);
+
+	if (dst_x | dst_y)
+		dst = (uint8_t *)dst + dst_y * dst_stride + dst_x * cpp;
+	width *= cpp;
+	assert(dst_stride >= width);
+
+	if (src_x & tile_mask) {
+		offset_x = (src_x & tile_mask) * cpp;
+		length_x = min(tile_width - offset_x, width);
+	} else
+		offset_x = length_x = 0;
+	src = (const uint8_t *)src + (src_x >> tile_shift) * tile_size;
+
+	while (height--) {
+		unsigned w = width;
+		const uint8_t *tile_row = src;
+		uint8_t *dst_row = dst;
+
+		dst = (uint8_t *)dst + dst_stride;
+
+		tile_row += src_y / tile_height * src_stride * tile_height;
+		tile_row += (src_y & (tile_height-1)) * tile_width;
+		src_y++;
+
+		if (length_x) {
+			memcpy(dst_row, tile_row + offset_x, length_x);
+			tile_row += tile_size;
+			dst_row += length_x;
+			w -= length_x;
+		}
+		while (w >= tile_width) {
+			from_avx128xN(dst_row,
+				      assume_aligned(tile_row, tile_width),
+				      tile_width);
+			tile_row += tile_size;
+			dst_row += tile_width;
+			w -= tile_width;
+		}
+		while (w >= 64) {
+			from_avx64(dst_row, tile_row);
+			tile_row += 64;
+			dst_row += 64;
+			w -= 64;
+		}
+		if (w & 32) {
+			ymm_save_256u((__m256i*)dst_row,
+				      ymm_stream_load_256((const __m256i*)tile_row));
+			tile_row += 32;
+			dst_row += 32;
+		}
+		if (w & 31)
+			memcpy(dst_row, assume_aligned(tile_row, 32), w & 31);
+	}
+}
+
+static void
+memcpy_between_tiled_x__swizzle_0__avx2(const void *src, void *dst, int bpp,
+					int32_t src_stride, int32_t dst_stride,
+					int16_t src_x, int16_t src_y,
+					int16_t dst_x, int16_t dst_y,
+					uint16_t width, uint16_t height)
+{
+	const unsigned tile_width = 512;
+	const unsigned tile_height = 8;
+	const unsigned tile_size = 4096;
+
+	const unsigned cpp = bpp / 8;
+	const unsigned tile_pixels = tile_width / cpp;
+	const unsigned tile_shift = ffs(tile_pixels) - 1;
+	const unsigned tile_mask = tile_pixels - 1;
+
+	unsigned ox, lx;
+
+	DBG(("%s(bpp=%d): src=(%d, %d), dst=(%d, %d), size=%dx%d, pitch=%d/%d\n",
+	     __FUNCTION__, bpp, src_x, src_y, dst_x, dst_y, width, height, src_stride, dst_stride));
+	assert(src != dst);
+
+	width *= cpp;
+	dst_stride *= tile_height;
+	src_stride *= tile_height;
+
+	assert((dst_x & tile_mask) == (src_x & tile_mask));
+	if (dst_x & tile_mask) {
+		ox = (dst_x & tile_mask) * cpp;
+		lx = min(tile_width - ox, width);
+		assert(lx != 0);
+	} else
+		ox = lx = 0;
+
+	if (dst_x)
+		dst = (uint8_t *)dst + (dst_x >> tile_shift) * tile_size;
+	if (src_x)
+		src = (const uint8_t *)src + (src_x >> tile_shift) * tile_size;
+
+	while (height--) {
+		const uint8_t *src_row;
+		uint8_t *dst_row;
+		unsigned w = width;
+
+		dst_row = dst;
+		dst_row += dst_y / tile_height * dst_stride;
+		dst_row += (dst_y & (tile_height-1)) * tile_width;
+		dst_y++;
+
+		src_row = src;
+		src_row += src_y / tile_height * src_stride;
+		src_row += (src_y & (tile_height-1)) * tile_width;
+		src_y++;
+
+		if (lx) {
+			to_avx_memcpy(dst_row + ox, src_row + ox, lx);
+			dst_row += tile_size;
+			src_row += tile_size;
+			w -= lx;
+		}
+		while (w >= tile_width) {
+			assert(((uintptr_t)dst_row & (tile_width - 1)) == 0);
+			assert(((uintptr_t)src_row & (tile_width - 1)) == 0);
+			between_avx128xN(assume_aligned(dst_row, tile_width),
+					 assume_aligned(src_row, tile_width),
+					 tile_width);
+			dst_row += tile_size;
+			src_row += tile_size;
+			w -= tile_width;
+		}
+		if (w) {
+			assert(((uintptr_t)dst_row & (tile_width - 1)) == 0);
+			assert(((uintptr_t)src_row & (tile_width - 1)) == 0);
+			to_avx_memcpy(assume_aligned(dst_row, tile_width),
+				      assume_aligned(src_row, tile_width),
+				      w);
+		}
+	}
+
+	_mm_sfence();
+}
+
+#define memcpy_to_tiled_x__avx2(swizzle) \
+static void \
+memcpy_to_tiled_x__##swizzle##__avx2(const void *src, void *dst, int bpp, \
+				     int32_t src_stride, int32_t dst_stride, \
+				     int16_t src_x, int16_t src_y, \
+				     int16_t dst_x, int16_t dst_y, \
+				     uint16_t width, uint16_t height) \
+{ \
+	const unsigned tile_width = 512; \
+	const unsigned tile_height = 8; \
+	const unsigned tile_size = 4096; \
+	const unsigned cpp = bpp / 8; \
+	const unsigned stride_tiles = dst_stride / tile_width; \
+	const unsigned swizzle_pixels = 64 / cpp; \
+	const unsigned tile_pixels = ffs(tile_width / cpp) - 1; \
+	const unsigned tile_mask = (1 << tile_pixels) - 1; \
+	unsigned x, y; \
+	DBG(("%s(bpp=%d): src=(%d, %d), dst=(%d, %d), size=%dx%d, pitch=%d/%d\n", \
+	     __FUNCTION__, bpp, src_x, src_y, dst_x, dst_y, width, height, src_stride, dst_stride)); \
+	src = (const uint8_t *)src + src_y * src_stride + src_x * cpp; \
+	for (y = 0; y < height; ++y) { \
+		const uint32_t dy = y + dst_y; \
+		const uint32_t tile_row = \
+			(dy / tile_height * stride_tiles * tile_size + \
+			 (dy & (tile_height-1)) * tile_width); \
+		const uint8_t *src_row = (const uint8_t *)src + src_stride * y; \
+		uint32_t dx = dst_x; \
+		x = width * cpp; \
+		if (dx & (swizzle_pixels - 1)) { \
+			const uint32_t swizzle_bound_pixels = ALIGN(dx + 1, swizzle_pixels); \
+			const uint32_t length = min(dst_x + width, swizzle_bound_pixels) - dx; \
+			uint32_t offset = \
+				tile_row + \
+				(dx >> tile_pixels) * tile_size + \
+				(dx & tile_mask) * cpp; \
+			memcpy((char *)dst + swizzle(offset), src_row, length * cpp); \
+			src_row += length * cpp; \
+			x -= length * cpp; \
+			dx += length; \
+		} \
+		while (x >= 64) { \
+			uint32_t offset = \
+				tile_row + \
+				(dx >> tile_pixels) * tile_size + \
+				(dx & tile_mask) * cpp; \
+			to_avx64(assume_aligned((uint8_t *)dst + swizzle(offset), 64), \
+				 src_row); \
+			src_row += 64; \
+			x -= 64; \
+			dx += swizzle_pixels; \
+		} \
+		if (x) { \
+			uint32_t offset = \
+				tile_row + \
+				(dx >> tile_pixels) * tile_size + \
+				(dx & tile_mask) * cpp; \
+			memcpy(assume_aligned((char *)dst + swizzle(offset), 64), src_row, x); \
+		} \
+	} \
+	_mm_sfence(); \
+}
+
+#define memcpy_from_tiled_x__avx2(swizzle) \
+static void \
+memcpy_from_tiled_x__##swizzle##__avx2(const void *src, void *dst, int bpp, \
+				       int32_t src_stride, int32_t dst_stride, \
+				       int16_t src_x, int16_t src_y, \
+				       int16_t dst_x, int16_t dst_y, \
+				       uint16_t width, uint16_t height) \
+{ \
+	const unsigned tile_width = 512; \
+	const unsigned tile_height = 8; \
+	const unsigned tile_size = 4096; \
+	const unsigned cpp = bpp / 8; \
+	const unsigned stride_tiles = src_stride / tile_width; \
+	const unsigned swizzle_pixels = 64 / cpp; \
+	const unsigned tile_pixels = ffs(tile_width / cpp) - 1; \
+	const unsigned tile_mask = (1 << tile_pixels) - 1; \
+	unsigned x, y; \
+	DBG(("%s(bpp=%d): src=(%d, %d), dst=(%d, %d), size=%dx%d, pitch=%d/%d\n", \
+	     __FUNCTION__, bpp, src_x, src_y, dst_x, dst_y, width, height, src_stride, dst_stride)); \
+	dst = (uint8_t *)dst + dst_y * dst_stride + dst_x * cpp; \
+	for (y = 0; y < height; ++y) { \
+		const uint32_t sy = y + src_y; \
+		const uint32_t tile_row = \
+			(sy / tile_height * stride_tiles * tile_size + \
+			 (sy & (tile_height-1)) * tile_width); \
+		uint8_t *dst_row = (uint8_t *)dst + dst_stride * y; \
+		uint32_t sx = src_x; \
+		x = width * cpp; \
+		if (sx & (swizzle_pixels - 1)) { \
+			const uint32_t swizzle_bound_pixels = ALIGN(sx + 1, swizzle_pixels); \
+			const uint32_t length = min(src_x + width, swizzle_bound_pixels) - sx; \
+			uint32_t offset = \
+				tile_row + \
+				(sx >> tile_pixels) * tile_size + \
+				(sx & tile_mask) * cpp; \
+			memcpy(dst_row, (const char *)src + swizzle(offset), length * cpp); \
+			dst_row += length * cpp; \
+			x -= length * cpp; \
+			sx += length; \
+		} \
+		while (x >= 64) { \
+			uint32_t offset = \
+				tile_row + \
+				(sx >> tile_pixels) * tile_size + \
+				(sx & tile_mask) * cpp; \
+			from_avx64(dst_row, \
+				   assume_aligned((const uint8_t *)src + swizzle(offset), 64)); \
+			dst_row += 64; \
+			x -= 64; \
+			sx += swizzle_pixels; \
+		} \
+		if (x) { \
+			uint32_t offset = \
+				tile_row + \
+				(sx >> tile_pixels) * tile_size + \
+				(sx & tile_mask) * cpp; \
+			memcpy(dst_row, assume_aligned((const char *)src + swizzle(offset), 64), x); \
+		} \
+	} \
+}
+
+#define swizzle_9(X) ((X) ^ (((X) >> 3) & 64))
+memcpy_to_tiled_x__avx2(swizzle_9)
+memcpy_from_tiled_x__avx2(swizzle_9)
+#undef swizzle_9
+
+#define swizzle_9_10(X) ((X) ^ ((((X) ^ ((X) >> 1)) >> 3) & 64))
+memcpy_to_tiled_x__avx2(swizzle_9_10)
+memcpy_from_tiled_x__avx2(swizzle_9_10)
+#undef swizzle_9_10
+
+#define swizzle_9_11(X) ((X) ^ ((((X) ^ ((X) >> 2)) >> 3) & 64))
+memcpy_to_tiled_x__avx2(swizzle_9_11)
+memcpy_from_tiled_x__avx2(swizzle_9_11)
+#undef swizzle_9_11
+
+#define swizzle_9_10_11(X) ((X) ^ ((((X) ^ ((X) >> 1) ^ ((X) >> 2)) >> 3) & 64))
+memcpy_to_tiled_x__avx2(swizzle_9_10_11)
+memcpy_from_tiled_x__avx2(swizzle_9_10_11)
+#undef swizzle_9_10_11
+
 #pragma GCC pop_options
 #endif
 
@@ -1171,6 +1865,13 @@ void choose_memcpy_tiled_x(struct kgem *kgem, int swizzling, unsigned cpu)
 		break;
 	case I915_BIT_6_SWIZZLE_NONE:
 		DBG(("%s: no swizzling\n", __FUNCTION__));
+#if defined(avx2)
+		if (cpu & AVX2) {
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_0__avx2;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_0__avx2;
+			kgem->memcpy_between_tiled_x = memcpy_between_tiled_x__swizzle_0__avx2;
+		} else
+#endif
 #if defined(sse2)
 		if (cpu & SSE2) {
 			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_0__sse2;
@@ -1186,23 +1887,79 @@ void choose_memcpy_tiled_x(struct kgem *kgem, int swizzling, unsigned cpu)
 		break;
 	case I915_BIT_6_SWIZZLE_9:
 		DBG(("%s: 6^9 swizzling\n", __FUNCTION__));
-		kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9;
-		kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9;
+#if defined(avx2)
+		if (cpu & AVX2) {
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9__avx2;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9__avx2;
+		} else
+#endif
+#if defined(sse2)
+		if (cpu & SSE2) {
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9__sse2;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9__sse2;
+		} else
+#endif
+		{
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9;
+		}
 		break;
 	case I915_BIT_6_SWIZZLE_9_10:
 		DBG(("%s: 6^9^10 swizzling\n", __FUNCTION__));
-		kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_10;
-		kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_10;
+#if defined(avx2)
+		if (cpu & AVX2) {
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_10__avx2;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_10__avx2;
+		} else
+#endif
+#if defined(sse2)
+		if (cpu & SSE2) {
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_10__sse2;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_10__sse2;
+		} else
+#endif
+		{
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_10;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_10;
+		}
 		break;
 	case I915_BIT_6_SWIZZLE_9_11:
 		DBG(("%s: 6^9^11 swizzling\n", __FUNCTION__));
-		kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_11;
-		kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_11;
+#if defined(avx2)
+		if (cpu & AVX2) {
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_11__avx2;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_11__avx2;
+		} else
+#endif
+#if defined(sse2)
+		if (cpu & SSE2) {
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_11__sse2;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_11__sse2;
+		} else
+#endif
+		{
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_11;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_11;
+		}
 		break;
 	case I915_BIT_6_SWIZZLE_9_10_11:
 		DBG(("%s: 6^9^10^11 swizzling\n", __FUNCTION__));
-		kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_10_11;
-		kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_10_11;
+#if defined(avx2)
+		if (cpu & AVX2) {
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_10_11__avx2;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_10_11__avx2;
+		} else
+#endif
+#if defined(sse2)
+		if (cpu & SSE2) {
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_10_11__sse2;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_10_11__sse2;
+		} else
+#endif
+		{
+			kgem->memcpy_to_tiled_x = memcpy_to_tiled_x__swizzle_9_10_11;
+			kgem->memcpy_from_tiled_x = memcpy_from_tiled_x__swizzle_9_10_11;
+		}
 		break;
 	}
 }
@@ -148,10 +148,11 @@ static const uint32_t ps_kernel_nv12_bt709_static[][4] = {
 };
 
 #define NOKERNEL(kernel_enum, func, masked) \
-    [kernel_enum] = {func, 0, masked}
+    [kernel_enum] = {#kernel_enum, func, 0, masked}
 #define KERNEL(kernel_enum, kernel, masked) \
-    [kernel_enum] = {&kernel, sizeof(kernel), masked}
+    [kernel_enum] = {#kernel_enum, &kernel, sizeof(kernel), masked}
 static const struct wm_kernel_info {
+	const char *name;
 	const void *data;
 	unsigned int size;
 	bool has_mask;
@@ -549,7 +550,7 @@ gen4_bind_bo(struct sna *sna,
 	assert(sna->kgem.gen != 040 || !kgem_bo_is_snoop(bo));
 
 	/* After the first bind, we manage the cache domains within the batch */
-	offset = kgem_bo_get_binding(bo, format | is_dst << 31);
+	offset = kgem_bo_get_binding(&sna->kgem, bo, format | is_dst << 31);
 	if (offset) {
 		assert(offset >= sna->kgem.surface);
 		if (is_dst)
@@ -579,7 +580,7 @@ gen4_bind_bo(struct sna *sna,
 	ss[4] = 0;
 	ss[5] = 0;
 
-	kgem_bo_set_binding(bo, format | is_dst << 31, offset);
+	kgem_bo_set_binding(&sna->kgem, bo, format | is_dst << 31, offset);
 
 	DBG(("[%x] bind bo(handle=%d, addr=%d), format=%d, width=%d, height=%d, pitch=%d, tiling=%d -> %s\n",
 	     offset, bo->handle, ss[1],
@@ -2086,7 +2087,7 @@ gen4_render_composite(struct sna *sna,
 					     tmp->mask.bo != NULL,
 					     tmp->has_component_alpha,
 					     tmp->is_affine);
-	tmp->u.gen4.ve_id = gen4_choose_composite_emitter(sna, tmp);
+	tmp->u.gen4.ve_id = gen4_choose_composite_emitter(sna, tmp, false);
 
 	tmp->blt   = gen4_render_composite_blt;
 	tmp->box   = gen4_render_composite_box;
@@ -3205,7 +3206,8 @@ static bool gen4_render_setup(struct sna *sna)
 	 */
 	null_create(&general);
 
-	sf = sna_static_stream_compile_sf(sna, &general, brw_sf_kernel__mask);
+	sf = sna_static_stream_compile_sf(sna, &general,
+					  "mask", brw_sf_kernel__mask);
 	for (m = 0; m < KERNEL_COUNT; m++) {
 		if (wm_kernels[m].size) {
 			wm[m] = sna_static_stream_add(&general,
@@ -3214,6 +3216,7 @@ static bool gen4_render_setup(struct sna *sna)
 						      64);
 		} else {
 			wm[m] = sna_static_stream_compile_wm(sna, &general,
+							     wm_kernels[m].name,
 							     wm_kernels[m].data,
 							     16);
 		}
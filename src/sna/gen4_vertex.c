@@ -80,6 +80,14 @@ void gen4_vertex_flush(struct sna *sna)
 	sna->render.vertex_offset = 0;
 }
 
+/* Unlike gen8+, we do not carve the vbo out of a persistently mapped
+ * ring (see gen8_vertex.c). gen4-7 share the global GTT with every other
+ * buffer, and so each vbo is checked against the aperture before we map
+ * it: a ring would be charged at its full size in every batch that only
+ * reads from one of its slots. gen4/5 and Baytrail also lack LLC, and
+ * without a WC mmap the vbo must be written through the small mappable
+ * aperture, which a ring would then occupy for the life of the screen.
+ */
 int gen4_vertex_finish(struct sna *sna)
 {
 	struct kgem_bo *bo;
@@ -666,6 +674,57 @@ emit_boxes_identity_source(const struct sna_composite_op *op,
 	} while (--nbox);
 }
 
+/* As for copies, the source is sampled with unnormalized coordinates and
+ * so both the destination and source positions pack into a pair of shorts.
+ */
+sse2 fastcall static void
+emit_primitive_identity_source_2s2s(struct sna *sna,
+				    const struct sna_composite_op *op,
+				    const struct sna_composite_rectangles *r)
+{
+	int16_t *v;
+
+	assert(op->floats_per_rect == 6);
+	assert((sna->render.vertex_used % 2) == 0);
+	v = (int16_t *)(sna->render.vertices + sna->render.vertex_used);
+	sna->render.vertex_used += 6;
+
+	v[0] = r->dst.x + r->width;
+	v[1] = v[5] = r->dst.y + r->height;
+	v[8] = v[4] = r->dst.x;
+	v[9] = r->dst.y;
+
+	v[2] = r->src.x + op->src.offset[0] + r->width;
+	v[3] = v[7] = r->src.y + op->src.offset[1] + r->height;
+	v[10] = v[6] = r->src.x + op->src.offset[0];
+	v[11] = r->src.y + op->src.offset[1];
+}
+
+sse2 fastcall static void
+emit_boxes_identity_source_2s2s(const struct sna_composite_op *op,
+				const BoxRec *box, int nbox,
+				float *vf)
+{
+	int16_t *v = (int16_t *)vf;
+	int16_t dx = op->src.offset[0];
+	int16_t dy = op->src.offset[1];
+
+	do {
+		v[0] = box->x2;
+		v[1] = v[5] = box->y2;
+		v[8] = v[4] = box->x1;
+		v[9] = box->y1;
+
+		v[2] = box->x2 + dx;
+		v[3] = v[7] = box->y2 + dy;
+		v[10] = v[6] = box->x1 + dx;
+		v[11] = box->y1 + dy;
+
+		v += 12;
+		box++;
+	} while (--nbox);
+}
+
 sse2 fastcall static void
 emit_primitive_simple_source(struct sna *sna,
 			     const struct sna_composite_op *op,
@@ -1852,7 +1911,26 @@ emit_boxes_linear_identity_mask__avx2(const struct sna_composite_op *op,
 
 #endif
 
-unsigned gen4_choose_composite_emitter(struct sna *sna, struct sna_composite_op *tmp)
+/* From Ivybridge onwards the backends keep a sampler with unnormalized
+ * coordinates for copies, which an untransformed source without repeat
+ * can share. Only the caller knows the extents of the operation, and so
+ * whether every source coordinate fits within a short.
+ */
+static bool
+use_2s2s_source(struct sna *sna, const struct sna_composite_channel *src,
+		bool short_source)
+{
+	if (sna->kgem.gen < 070)
+		return false;
+
+	if (src->repeat != 0) /* SAMPLER_EXTEND_NONE */
+		return false;
+
+	return short_source;
+}
+
+unsigned gen4_choose_composite_emitter(struct sna *sna, struct sna_composite_op *tmp,
+				       bool short_source)
 {
 	unsigned vb;
 
@@ -1978,6 +2056,13 @@ unsigned gen4_choose_composite_emitter(struct sna *sna, struct sna_composite_op
 			}
 			tmp->floats_per_vertex = 2;
 			vb = 1;
+		} else if (tmp->src.transform == NULL &&
+			   use_2s2s_source(sna, &tmp->src, short_source)) {
+			DBG(("%s: identity src, unnormalized, no mask\n", __FUNCTION__));
+			tmp->prim_emit = emit_primitive_identity_source_2s2s;
+			tmp->emit_boxes = emit_boxes_identity_source_2s2s;
+			tmp->floats_per_vertex = 2;
+			vb = 0;
 		} else if (tmp->src.transform == NULL) {
 			DBG(("%s: identity src, no mask\n", __FUNCTION__));
 #if defined(avx2)
@@ -11,7 +11,21 @@ void gen4_vertex_flush(struct sna *sna);
 int gen4_vertex_finish(struct sna *sna);
 void gen4_vertex_close(struct sna *sna);
 
-unsigned gen4_choose_composite_emitter(struct sna *sna, struct sna_composite_op *tmp);
+unsigned gen4_choose_composite_emitter(struct sna *sna, struct sna_composite_op *tmp,
+				       bool short_source);
 unsigned gen4_choose_spans_emitter(struct sna *sna, struct sna_composite_spans_op *tmp);
 
+/* Does every source coordinate sampled for the w x h rectangle at (x, y)
+ * fit in a short?
+ */
+static inline bool
+gen4_source_is_short(const struct sna_composite_channel *src,
+		     int x, int y, int w, int h)
+{
+	x += src->offset[0];
+	y += src->offset[1];
+	return (x >= INT16_MIN && x + w <= INT16_MAX &&
+		y >= INT16_MIN && y + h <= INT16_MAX);
+}
+
 #endif /* GEN4_VERTEX_H */
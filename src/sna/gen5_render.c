@@ -138,10 +138,11 @@ static const uint32_t ps_kernel_nv12_bt709_static[][4] = {
 };
 
 #define NOKERNEL(kernel_enum, func, masked) \
-    [kernel_enum] = {func, 0, masked}
+    [kernel_enum] = {#kernel_enum, func, 0, masked}
 #define KERNEL(kernel_enum, kernel, masked) \
-    [kernel_enum] = {&kernel, sizeof(kernel), masked}
+    [kernel_enum] = {#kernel_enum, &kernel, sizeof(kernel), masked}
 static const struct wm_kernel_info {
+	const char *name;
 	const void *data;
 	unsigned int size;
 	bool has_mask;
@@ -534,7 +535,7 @@ gen5_bind_bo(struct sna *sna,
 
 	/* After the first bind, we manage the cache domains within the batch */
 	if (!DBG_NO_SURFACE_CACHE) {
-		offset = kgem_bo_get_binding(bo, format | is_dst << 31);
+		offset = kgem_bo_get_binding(&sna->kgem, bo, format | is_dst << 31);
 		if (offset) {
 			if (is_dst)
 				kgem_bo_mark_dirty(bo);
@@ -565,7 +566,7 @@ gen5_bind_bo(struct sna *sna,
 	ss[4] = 0;
 	ss[5] = 0;
 
-	kgem_bo_set_binding(bo, format | is_dst << 31, offset);
+	kgem_bo_set_binding(&sna->kgem, bo, format | is_dst << 31, offset);
 
 	DBG(("[%x] bind bo(handle=%d, addr=%d), format=%d, width=%d, height=%d, pitch=%d, tiling=%d -> %s\n",
 	     offset, bo->handle, ss[1],
@@ -2038,7 +2039,7 @@ gen5_render_composite(struct sna *sna,
 					     tmp->mask.bo != NULL,
 					     tmp->has_component_alpha,
 					     tmp->is_affine);
-	tmp->u.gen5.ve_id = gen4_choose_composite_emitter(sna, tmp);
+	tmp->u.gen5.ve_id = gen4_choose_composite_emitter(sna, tmp, false);
 
 	tmp->blt   = gen5_render_composite_blt;
 	tmp->box   = gen5_render_composite_box;
@@ -3318,8 +3319,10 @@ static bool gen5_render_setup(struct sna *sna)
 	null_create(&general);
 
 	/* Set up the two SF states (one for blending with a mask, one without) */
-	sf[0] = sna_static_stream_compile_sf(sna, &general, brw_sf_kernel__nomask);
-	sf[1] = sna_static_stream_compile_sf(sna, &general, brw_sf_kernel__mask);
+	sf[0] = sna_static_stream_compile_sf(sna, &general,
+					     "nomask", brw_sf_kernel__nomask);
+	sf[1] = sna_static_stream_compile_sf(sna, &general,
+					     "mask", brw_sf_kernel__mask);
 
 	for (m = 0; m < KERNEL_COUNT; m++) {
 		if (wm_kernels[m].size) {
@@ -3329,6 +3332,7 @@ static bool gen5_render_setup(struct sna *sna)
 						      64);
 		} else {
 			wm[m] = sna_static_stream_compile_wm(sna, &general,
+							     wm_kernels[m].name,
 							     wm_kernels[m].data,
 							     16);
 		}
@@ -1123,7 +1123,7 @@ gen6_bind_bo(struct sna *sna,
 	uint32_t is_scanout = is_dst && bo->scanout;
 
 	/* After the first bind, we manage the cache domains within the batch */
-	offset = kgem_bo_get_binding(bo, format | is_dst << 30 | is_scanout << 31);
+	offset = kgem_bo_get_binding(&sna->kgem, bo, format | is_dst << 30 | is_scanout << 31);
 	if (offset) {
 		DBG(("[%x]  bo(handle=%d), format=%d, reuse %s binding\n",
 		     offset, bo->handle, format,
@@ -1154,7 +1154,7 @@ gen6_bind_bo(struct sna *sna,
 	ss[4] = 0;
 	ss[5] = (is_scanout || bo->io) ? 0 : 3 << 16;
 
-	kgem_bo_set_binding(bo, format | is_dst << 30 | is_scanout << 31, offset);
+	kgem_bo_set_binding(&sna->kgem, bo, format | is_dst << 30 | is_scanout << 31, offset);
 
 	DBG(("[%x] bind bo(handle=%d, addr=%d), format=%d, width=%d, height=%d, pitch=%d, tiling=%d -> %s\n",
 	     offset, bo->handle, ss[1],
@@ -2421,7 +2421,7 @@ gen6_render_composite(struct sna *sna,
 							    tmp->mask.bo != NULL,
 							    tmp->has_component_alpha,
 							    tmp->is_affine),
-			       gen4_choose_composite_emitter(sna, tmp));
+			       gen4_choose_composite_emitter(sna, tmp, false));
 
 	tmp->blt   = gen6_render_composite_blt;
 	tmp->box   = gen6_render_composite_box;
@@ -3703,24 +3703,28 @@ static bool gen6_render_setup(struct sna *sna, int devid)
 			if (USE_8_PIXEL_DISPATCH) {
 				state->wm_kernel[m][0] =
 					sna_static_stream_compile_wm(sna, &general,
+								     wm_kernels[m].name,
 								     wm_kernels[m].data, 8);
 			}
 
 			if (USE_16_PIXEL_DISPATCH) {
 				state->wm_kernel[m][1] =
 					sna_static_stream_compile_wm(sna, &general,
+								     wm_kernels[m].name,
 								     wm_kernels[m].data, 16);
 			}
 
 			if (USE_32_PIXEL_DISPATCH) {
 				state->wm_kernel[m][2] =
 					sna_static_stream_compile_wm(sna, &general,
+								     wm_kernels[m].name,
 								     wm_kernels[m].data, 32);
 			}
 		}
 		if ((state->wm_kernel[m][0]|state->wm_kernel[m][1]|state->wm_kernel[m][2]) == 0) {
 			state->wm_kernel[m][1] =
 				sna_static_stream_compile_wm(sna, &general,
+							     wm_kernels[m].name,
 							     wm_kernels[m].data, 16);
 		}
 	}
@@ -1333,7 +1333,7 @@ gen7_bind_bo(struct sna *sna,
 	COMPILE_TIME_ASSERT(sizeof(struct gen7_surface_state) == 32);
 
 	/* After the first bind, we manage the cache domains within the batch */
-	offset = kgem_bo_get_binding(bo, format | is_dst << 30 | is_scanout << 31);
+	offset = kgem_bo_get_binding(&sna->kgem, bo, format | is_dst << 30 | is_scanout << 31);
 	if (offset) {
 		assert(offset >= sna->kgem.surface);
 		if (is_dst)
@@ -1365,7 +1365,7 @@ gen7_bind_bo(struct sna *sna,
 	if (is_hsw(sna))
 		ss[7] |= HSW_SURFACE_SWIZZLE(RED, GREEN, BLUE, ALPHA);
 
-	kgem_bo_set_binding(bo, format | is_dst << 30 | is_scanout << 31, offset);
+	kgem_bo_set_binding(&sna->kgem, bo, format | is_dst << 30 | is_scanout << 31, offset);
 
 	DBG(("[%x] bind bo(handle=%d, addr=%d), format=%d, width=%d, height=%d, pitch=%d, tiling=%d -> %s\n",
 	     offset, bo->handle, ss[1],
@@ -2533,6 +2533,8 @@ gen7_render_composite(struct sna *sna,
 		      unsigned flags,
 		      struct sna_composite_op *tmp)
 {
+	unsigned vb;
+
 	if (op >= ARRAY_SIZE(gen7_blend_op))
 		return false;
 
@@ -2641,8 +2643,19 @@ gen7_render_composite(struct sna *sna,
 		tmp->is_affine &= tmp->mask.is_affine;
 	}
 
+	/* Rectangles are emitted from source coordinates, but boxes from
+	 * destination coordinates, and either must fit the 2s2s vertex.
+	 */
+	vb = gen4_choose_composite_emitter(sna, tmp,
+					   gen4_source_is_short(&tmp->src,
+								src_x, src_y,
+								width, height) &&
+					   gen4_source_is_short(&tmp->src,
+								dst_x, dst_y,
+								width, height));
 	tmp->u.gen7.flags =
-		GEN7_SET_FLAGS(SAMPLER_OFFSET(tmp->src.filter,
+		GEN7_SET_FLAGS(vb == VERTEX_2s2s ? COPY_SAMPLER :
+			       SAMPLER_OFFSET(tmp->src.filter,
 					      tmp->src.repeat,
 					      tmp->mask.filter,
 					      tmp->mask.repeat),
@@ -2653,7 +2666,7 @@ gen7_render_composite(struct sna *sna,
 							    tmp->mask.bo != NULL,
 							    tmp->has_component_alpha,
 							    tmp->is_affine),
-			       gen4_choose_composite_emitter(sna, tmp));
+			       vb);
 
 	tmp->blt   = gen7_render_composite_blt;
 	tmp->box   = gen7_render_composite_box;
@@ -3949,18 +3962,21 @@ static bool gen7_render_setup(struct sna *sna, int devid)
 			if (USE_8_PIXEL_DISPATCH) {
 				state->wm_kernel[m][0] =
 					sna_static_stream_compile_wm(sna, &general,
+								     wm_kernels[m].name,
 								     wm_kernels[m].data, 8);
 			}
 
 			if (USE_16_PIXEL_DISPATCH) {
 				state->wm_kernel[m][1] =
 					sna_static_stream_compile_wm(sna, &general,
+								     wm_kernels[m].name,
 								     wm_kernels[m].data, 16);
 			}
 
 			if (USE_32_PIXEL_DISPATCH) {
 				state->wm_kernel[m][2] =
 					sna_static_stream_compile_wm(sna, &general,
+								     wm_kernels[m].name,
 								     wm_kernels[m].data, 32);
 			}
 		}
@@ -922,16 +922,40 @@ gen8_emit_invariant(struct sna *sna)
 	sna->render_state.gen8.needs_invariant = false;
 }
 
+/* Compare the packet just written from start against the copy of the
+ * same packet last sent in this batch, and discard it if nothing changed.
+ */
+static bool
+gen8_state_commit(struct sna *sna, int state, int start)
+{
+	struct gen8_render_state *render = &sna->render_state.gen8;
+	int len = sna->kgem.nbatch - start;
+
+	assert(state < GEN8_STATE_COUNT);
+	assert(len > 0 && len <= GEN8_STATE_DWORDS);
+
+	if (render->shadow.len[state] == len &&
+	    memcmp(render->shadow.dw[state], sna->kgem.batch + start,
+		   len * sizeof(uint32_t)) == 0) {
+		sna->kgem.nbatch = start;
+		render->shadow.saved += len;
+		return false;
+	}
+
+	memcpy(render->shadow.dw[state], sna->kgem.batch + start,
+	       len * sizeof(uint32_t));
+	render->shadow.len[state] = len;
+	return true;
+}
+
 static void
 gen8_emit_cc(struct sna *sna, uint32_t blend)
 {
 	struct gen8_render_state *render = &sna->render_state.gen8;
+	int start;
 
-	if (render->blend == blend)
-		return;
-
-	DBG(("%s: blend=%x (current=%x), src=%d, dst=%d\n",
-	     __FUNCTION__, blend, render->blend,
+	DBG(("%s: blend=%x, src=%d, dst=%d\n",
+	     __FUNCTION__, blend,
 	     blend / GEN8_BLENDFACTOR_COUNT,
 	     blend % GEN8_BLENDFACTOR_COUNT));
 
@@ -943,6 +967,7 @@ gen8_emit_cc(struct sna *sna, uint32_t blend)
 	 * Render Target Index. What other side-effects of Render Target Index?
 	 */
 
+	start = sna->kgem.nbatch;
 	OUT_BATCH(GEN8_3DSTATE_PS_BLEND | (2 - 2));
 	if (blend != GEN8_BLEND(NO_BLEND)) {
 		uint32_t src = blend / GEN8_BLENDFACTOR_COUNT;
@@ -956,7 +981,10 @@ gen8_emit_cc(struct sna *sna, uint32_t blend)
 	} else
 		OUT_BATCH(PS_BLEND_HAS_WRITEABLE_RT);
 
+	gen8_state_commit(sna, GEN8_STATE_PS_BLEND, start);
+
 	assert(is_aligned(render->cc_blend + blend * GEN8_BLEND_STATE_PADDED_SIZE, 64));
+	start = sna->kgem.nbatch;
 	OUT_BATCH(GEN8_3DSTATE_BLEND_STATE_POINTERS | (2 - 2));
 	OUT_BATCH((render->cc_blend + blend * GEN8_BLEND_STATE_PADDED_SIZE) | 1);
 
@@ -964,36 +992,31 @@ gen8_emit_cc(struct sna *sna, uint32_t blend)
 	OUT_BATCH(GEN8_3DSTATE_CC_STATE_POINTERS | (2 - 2));
 	OUT_BATCH(0);
 
-	render->blend = blend;
+	gen8_state_commit(sna, GEN8_STATE_BLEND_POINTERS, start);
 }
 
 static void
 gen8_emit_sampler(struct sna *sna, uint32_t state)
 {
-	if (sna->render_state.gen8.samplers == state)
-		return;
-
-	sna->render_state.gen8.samplers = state;
+	int start = sna->kgem.nbatch;
 
 	DBG(("%s: sampler = %x\n", __FUNCTION__, state));
 
 	assert(2 * sizeof(struct gen8_sampler_state) == 32);
 	OUT_BATCH(GEN8_3DSTATE_SAMPLER_STATE_POINTERS_PS | (2 - 2));
 	OUT_BATCH(sna->render_state.gen8.wm_state + state * 2 * sizeof(struct gen8_sampler_state));
+
+	gen8_state_commit(sna, GEN8_STATE_SAMPLER_POINTERS, start);
 }
 
 static void
 gen8_emit_sf(struct sna *sna, bool has_mask)
 {
 	int num_sf_outputs = has_mask ? 2 : 1;
-
-	if (sna->render_state.gen8.num_sf_outputs == num_sf_outputs)
-		return;
+	int start = sna->kgem.nbatch;
 
 	DBG(("%s: num_sf_outputs=%d\n", __FUNCTION__, num_sf_outputs));
 
-	sna->render_state.gen8.num_sf_outputs = num_sf_outputs;
-
 	OUT_BATCH(GEN8_3DSTATE_SBE | (4 - 2));
 	OUT_BATCH(num_sf_outputs << SBE_NUM_OUTPUTS_SHIFT |
 		  SBE_FORCE_VERTEX_URB_READ_LENGTH | /* forced is faster */
@@ -1002,19 +1025,19 @@ gen8_emit_sf(struct sna *sna, bool has_mask)
 		  1 << SBE_URB_ENTRY_READ_OFFSET_SHIFT);
 	OUT_BATCH(0);
 	OUT_BATCH(0);
+
+	gen8_state_commit(sna, GEN8_STATE_SBE, start);
 }
 
 static void
 gen8_emit_wm(struct sna *sna, int kernel)
 {
 	const uint32_t *kernels;
+	int start = sna->kgem.nbatch;
 
 	assert(kernel < ARRAY_SIZE(wm_kernels));
-	if (sna->render_state.gen8.kernel == kernel)
-		return;
-
-	sna->render_state.gen8.kernel = kernel;
 	kernels = sna->render_state.gen8.wm_kernel[kernel];
+	assert(kernels[0] | kernels[1] | kernels[2]);
 
 	DBG(("%s: switching to %s, num_surfaces=%d (8-wide? %d, 16-wide? %d, 32-wide? %d)\n",
 	     __FUNCTION__,
@@ -1040,13 +1063,99 @@ gen8_emit_wm(struct sna *sna, int kernel)
 		  6 << PS_DISPATCH_START_GRF_SHIFT_2);
 	OUT_BATCH64(kernels[2]);
 	OUT_BATCH64(kernels[1]);
+
+	gen8_state_commit(sna, GEN8_STATE_PS, start);
+}
+
+/* Only the plain affine kernels are used by nearly every session, the
+ * rest are compiled the first time an operation asks for them.
+ */
+static bool wm_kernel_is_common(int kernel)
+{
+	return (kernel == GEN8_WM_KERNEL_NOMASK ||
+		kernel == GEN8_WM_KERNEL_MASK);
+}
+
+static void
+gen8_compile_wm_kernel(struct sna *sna,
+		       struct sna_static_stream *stream,
+		       int m)
+{
+	struct gen8_render_state *state = &sna->render_state.gen8;
+
+	if (wm_kernels[m].size) {
+		state->wm_kernel[m][1] =
+			sna_static_stream_add(stream,
+					      wm_kernels[m].data,
+					      wm_kernels[m].size,
+					      64);
+	} else {
+		if (USE_8_PIXEL_DISPATCH) {
+			state->wm_kernel[m][0] =
+				sna_static_stream_compile_wm(sna, stream,
+							     wm_kernels[m].name,
+							     wm_kernels[m].data, 8);
+		}
+
+		if (USE_16_PIXEL_DISPATCH) {
+			state->wm_kernel[m][1] =
+				sna_static_stream_compile_wm(sna, stream,
+							     wm_kernels[m].name,
+							     wm_kernels[m].data, 16);
+		}
+
+		if (USE_32_PIXEL_DISPATCH) {
+			state->wm_kernel[m][2] =
+				sna_static_stream_compile_wm(sna, stream,
+							     wm_kernels[m].name,
+							     wm_kernels[m].data, 32);
+		}
+	}
+}
+
+static bool
+gen8_wm_kernel_prepare(struct sna *sna, int kernel)
+{
+	struct gen8_render_state *state = &sna->render_state.gen8;
+	uint32_t *kernels = state->wm_kernel[kernel];
+	struct kgem_bo *bo;
+
+	assert(kernel < ARRAY_SIZE(wm_kernels));
+	if (kernels[0] | kernels[1] | kernels[2])
+		return true;
+
+	DBG(("%s: compiling %s on first use\n",
+	     __FUNCTION__, wm_kernels[kernel].name));
+
+	gen8_compile_wm_kernel(sna, &state->general, kernel);
+	if ((kernels[0] | kernels[1] | kernels[2]) == 0)
+		return false;
+
+	/* The kernels are addressed relative to the instruction base,
+	 * so replace the whole bo with one that includes the new kernel.
+	 */
+	bo = sna_static_stream_upload(sna, &state->general);
+	if (bo == NULL) {
+		kernels[0] = kernels[1] = kernels[2] = 0;
+		return false;
+	}
+
+	/* The current batch has its base address set to the old bo */
+	if (!state->needs_invariant)
+		kgem_submit(&sna->kgem);
+
+	kgem_bo_destroy(&sna->kgem, state->general_bo);
+	state->general_bo = bo;
+	return true;
 }
 
 static bool
 gen8_emit_binding_table(struct sna *sna, uint16_t offset)
 {
-	if (sna->render_state.gen8.surface_table == offset)
+	if (sna->render_state.gen8.surface_table == offset) {
+		sna->render_state.gen8.shadow.saved += 2;
 		return false;
+	}
 
 	/* Binding table pointers */
 	assert(is_aligned(4*offset, 32));
@@ -1068,8 +1177,10 @@ gen8_emit_drawing_rectangle(struct sna *sna,
 	assert(!too_large(op->dst.width, op->dst.height));
 
 	if (sna->render_state.gen8.drawrect_limit == limit &&
-	    sna->render_state.gen8.drawrect_offset == offset)
+	    sna->render_state.gen8.drawrect_offset == offset) {
+		sna->render_state.gen8.shadow.saved += 4;
 		return true;
+	}
 
 	sna->render_state.gen8.drawrect_offset = offset;
 	sna->render_state.gen8.drawrect_limit = limit;
@@ -1096,11 +1207,9 @@ gen8_emit_vertex_elements(struct sna *sna,
 	int id = GEN8_VERTEX(op->u.gen8.flags);
 	bool has_mask;
 
-	DBG(("%s: setup id=%d\n", __FUNCTION__, id));
+	int start = sna->kgem.nbatch;
 
-	if (render->ve_id == id)
-		return;
-	render->ve_id = id;
+	DBG(("%s: setup id=%d\n", __FUNCTION__, id));
 
 	/* The VUE layout
 	 *    dword 0-3: pad (0.0, 0.0, 0.0. 0.0)
@@ -1199,6 +1308,8 @@ gen8_emit_vertex_elements(struct sna *sna,
 			  offset << VE_OFFSET_SHIFT);
 		OUT_BATCH(dw);
 	}
+
+	gen8_state_commit(sna, GEN8_STATE_VERTEX_ELEMENTS, start);
 }
 
 inline static void
@@ -1435,7 +1546,7 @@ gen8_bind_bo(struct sna *sna,
 	uint32_t is_scanout = is_dst && bo->scanout;
 
 	/* After the first bind, we manage the cache domains within the batch */
-	offset = kgem_bo_get_binding(bo, format | is_dst << 30 | is_scanout << 31);
+	offset = kgem_bo_get_binding(&sna->kgem, bo, format | is_dst << 30 | is_scanout << 31);
 	if (offset) {
 		if (is_dst)
 			kgem_bo_mark_dirty(bo);
@@ -1470,7 +1581,7 @@ gen8_bind_bo(struct sna *sna,
 	ss[14] = 0;
 	ss[15] = 0;
 
-	kgem_bo_set_binding(bo, format | is_dst << 30 | is_scanout << 31, offset);
+	kgem_bo_set_binding(&sna->kgem, bo, format | is_dst << 30 | is_scanout << 31, offset);
 
 	DBG(("[%x] bind bo(handle=%d, addr=%lx), format=%d, width=%d, height=%d, pitch=%d, tiling=%d -> %s\n",
 	     offset, bo->handle, *(uint64_t *)(ss+8),
@@ -2360,6 +2471,8 @@ gen8_render_composite(struct sna *sna,
 		      unsigned flags,
 		      struct sna_composite_op *tmp)
 {
+	unsigned vb;
+
 	if (op >= ARRAY_SIZE(gen8_blend_op))
 		return false;
 
@@ -2472,8 +2585,19 @@ gen8_render_composite(struct sna *sna,
 		tmp->is_affine &= tmp->mask.is_affine;
 	}
 
+	/* Rectangles are emitted from source coordinates, but boxes from
+	 * destination coordinates, and either must fit the 2s2s vertex.
+	 */
+	vb = gen4_choose_composite_emitter(sna, tmp,
+					   gen4_source_is_short(&tmp->src,
+								src_x, src_y,
+								width, height) &&
+					   gen4_source_is_short(&tmp->src,
+								dst_x, dst_y,
+								width, height));
 	tmp->u.gen8.flags =
-		GEN8_SET_FLAGS(SAMPLER_OFFSET(tmp->src.filter,
+		GEN8_SET_FLAGS(vb == VERTEX_2s2s ? COPY_SAMPLER :
+			       SAMPLER_OFFSET(tmp->src.filter,
 					      tmp->src.repeat,
 					      tmp->mask.filter,
 					      tmp->mask.repeat),
@@ -2484,7 +2608,7 @@ gen8_render_composite(struct sna *sna,
 							    tmp->mask.bo != NULL,
 							    tmp->has_component_alpha,
 							    tmp->is_affine),
-			       gen4_choose_composite_emitter(sna, tmp));
+			       vb);
 
 	tmp->blt   = gen8_render_composite_blt;
 	tmp->box   = gen8_render_composite_box;
@@ -2495,6 +2619,15 @@ gen8_render_composite(struct sna *sna,
 	}
 	tmp->done  = gen8_render_composite_done;
 
+	if (!gen8_wm_kernel_prepare(sna, GEN8_KERNEL(tmp->u.gen8.flags)))
+		goto cleanup_mask;
+	if (tmp->need_magic_ca_pass &&
+	    !gen8_wm_kernel_prepare(sna,
+				     gen8_choose_composite_kernel(PictOpAdd,
+								  true, true,
+								  tmp->is_affine)))
+		goto cleanup_mask;
+
 	kgem_set_mode(&sna->kgem, KGEM_RENDER, tmp->dst.bo);
 	if (!kgem_check_bo(&sna->kgem,
 			   tmp->dst.bo, tmp->src.bo, tmp->mask.bo,
@@ -2722,6 +2855,9 @@ gen8_render_composite_spans(struct sna *sna,
 		tmp->thread_boxes = gen8_render_composite_spans_boxes__thread;
 	tmp->done  = gen8_render_composite_spans_done;
 
+	if (!gen8_wm_kernel_prepare(sna, GEN8_KERNEL(tmp->base.u.gen8.flags)))
+		goto cleanup_src;
+
 	kgem_set_mode(&sna->kgem, KGEM_RENDER, tmp->base.dst.bo);
 	if (!kgem_check_bo(&sna->kgem,
 			   tmp->base.dst.bo, tmp->base.src.bo,
@@ -3914,6 +4050,9 @@ gen8_render_video(struct sna *sna,
 			       2);
 	tmp.priv = frame;
 
+	if (!gen8_wm_kernel_prepare(sna, GEN8_KERNEL(tmp.u.gen8.flags)))
+		return false;
+
 	kgem_set_mode(&sna->kgem, KGEM_RENDER, tmp.dst.bo);
 	if (!kgem_check_bo(&sna->kgem, tmp.dst.bo, frame->bo, NULL)) {
 		kgem_submit(&sna->kgem);
@@ -3991,15 +4130,22 @@ static void gen8_render_flush(struct sna *sna)
 
 static void gen8_render_reset(struct sna *sna)
 {
+	struct gen8_render_state *state = &sna->render_state.gen8;
+
+	/* Only count batches that carried render state */
+	if (!state->needs_invariant) {
+		DBG(("%s: skipped %d dwords of redundant state\n",
+		     __FUNCTION__, state->shadow.saved));
+		sna->kgem.stats.state_batches++;
+		sna->kgem.stats.state_saved += state->shadow.saved;
+	}
+	state->shadow.saved = 0;
+	memset(state->shadow.len, 0, sizeof(state->shadow.len));
+
 	sna->render_state.gen8.emit_flush = false;
 	sna->render_state.gen8.needs_invariant = true;
-	sna->render_state.gen8.ve_id = 3 << 2;
 	sna->render_state.gen8.last_primitive = -1;
 
-	sna->render_state.gen8.num_sf_outputs = 0;
-	sna->render_state.gen8.samplers = -1;
-	sna->render_state.gen8.blend = -1;
-	sna->render_state.gen8.kernel = -1;
 	sna->render_state.gen8.drawrect_offset = -1;
 	sna->render_state.gen8.drawrect_limit = -1;
 	sna->render_state.gen8.surface_table = 0;
@@ -4016,13 +4162,15 @@ static void gen8_render_reset(struct sna *sna)
 
 static void gen8_render_fini(struct sna *sna)
 {
+	gen8_vertex_fini(sna);
 	kgem_bo_destroy(&sna->kgem, sna->render_state.gen8.general_bo);
+	free(sna->render_state.gen8.general.data);
 }
 
 static bool gen8_render_setup(struct sna *sna)
 {
 	struct gen8_render_state *state = &sna->render_state.gen8;
-	struct sna_static_stream general;
+	struct sna_static_stream *general = &state->general;
 	struct gen8_sampler_state *ss;
 	int i, j, k, l, m;
 	uint32_t devid;
@@ -4039,50 +4187,29 @@ static bool gen8_render_setup(struct sna *sna)
 	else
 		return false;
 
-	sna_static_stream_init(&general);
+	sna_static_stream_init(general);
 
 	/* Zero pad the start. If you see an offset of 0x0 in the batchbuffer
 	 * dumps, you know it points to zero.
 	 */
-	null_create(&general);
+	null_create(general);
 
 	for (m = 0; m < ARRAY_SIZE(wm_kernels); m++) {
-		if (wm_kernels[m].size) {
-			state->wm_kernel[m][1] =
-				sna_static_stream_add(&general,
-						      wm_kernels[m].data,
-						      wm_kernels[m].size,
-						      64);
-		} else {
-			if (USE_8_PIXEL_DISPATCH) {
-				state->wm_kernel[m][0] =
-					sna_static_stream_compile_wm(sna, &general,
-								     wm_kernels[m].data, 8);
-			}
+		if (!wm_kernel_is_common(m))
+			continue;
 
-			if (USE_16_PIXEL_DISPATCH) {
-				state->wm_kernel[m][1] =
-					sna_static_stream_compile_wm(sna, &general,
-								     wm_kernels[m].data, 16);
-			}
-
-			if (USE_32_PIXEL_DISPATCH) {
-				state->wm_kernel[m][2] =
-					sna_static_stream_compile_wm(sna, &general,
-								     wm_kernels[m].data, 32);
-			}
-		}
+		gen8_compile_wm_kernel(sna, general, m);
 		assert(state->wm_kernel[m][0]|state->wm_kernel[m][1]|state->wm_kernel[m][2]);
 	}
 
 	COMPILE_TIME_ASSERT(SAMPLER_OFFSET(FILTER_COUNT, EXTEND_COUNT, FILTER_COUNT, EXTEND_COUNT) <= 0x7ff);
-	ss = sna_static_stream_map(&general,
+	ss = sna_static_stream_map(general,
 				   2 * sizeof(*ss) *
 				   (2 +
 				    FILTER_COUNT * EXTEND_COUNT *
 				    FILTER_COUNT * EXTEND_COUNT),
 				   32);
-	state->wm_state = sna_static_stream_offsetof(&general, ss);
+	state->wm_state = sna_static_stream_offsetof(general, ss);
 	sampler_copy_init(ss); ss += 2;
 	sampler_fill_init(ss); ss += 2;
 	for (i = 0; i < FILTER_COUNT; i++) {
@@ -4096,10 +4223,16 @@ static bool gen8_render_setup(struct sna *sna)
 		}
 	}
 
-	state->cc_blend = gen8_create_blend_state(&general);
+	state->cc_blend = gen8_create_blend_state(general);
 
-	state->general_bo = sna_static_stream_fini(sna, &general);
-	return state->general_bo != NULL;
+	/* Keep the stream to append the remaining kernels as required */
+	state->general_bo = sna_static_stream_upload(sna, general);
+	if (state->general_bo == NULL) {
+		free(general->data);
+		return false;
+	}
+
+	return true;
 }
 
 const char *gen8_render_init(struct sna *sna, const char *backend)
@@ -73,10 +73,106 @@ void gen8_vertex_flush(struct sna *sna)
 	sna->render.vertex_offset = 0;
 }
 
+/* Rather than throwing away each vbo as it fills and hoping the cache
+ * has an idle one to replace it with, the vertices are written into a
+ * single persistently mapped bo, carved into slots. Each slot remembers
+ * the last request that read from it, and we only move on to a slot once
+ * that request is complete; if the GPU is that far behind, we fall back
+ * to allocating a fresh vbo rather than wait.
+ */
+static bool vertex_ring_init(struct sna *sna)
+{
+	struct sna_vertex_ring *ring = &sna->render.vertex_ring;
+	struct kgem *kgem = &sna->kgem;
+	struct kgem_bo *bo;
+	void *map;
+
+	if (ring->bo)
+		return true;
+
+	if (ring->disabled)
+		return false;
+
+	/* We write to one slot whilst the GPU is reading from the others,
+	 * so we need a mapping that does not require a domain transfer.
+	 */
+	if (!kgem->has_llc && !kgem->has_wc_mmap) {
+		ring->disabled = true;
+		return false;
+	}
+
+	bo = kgem_create_linear(kgem,
+				VERTEX_RING_SLOTS * VERTEX_RING_SLOT_SIZE,
+				CREATE_NO_THROTTLE);
+	if (bo == NULL)
+		return false;
+
+	if (kgem->has_llc)
+		map = kgem_bo_map__cpu(kgem, bo);
+	else
+		map = kgem_bo_map__wc(kgem, bo);
+	if (map == NULL) {
+		kgem_bo_destroy(kgem, bo);
+		ring->disabled = true;
+		return false;
+	}
+
+	kgem_bo_mark_unreusable(bo);
+
+	DBG(("%s: handle=%d, %d slots of %d bytes\n", __FUNCTION__,
+	     bo->handle, VERTEX_RING_SLOTS, VERTEX_RING_SLOT_SIZE));
+
+	ring->bo = bo;
+	ring->map = map;
+	ring->slot = VERTEX_RING_SLOTS - 1;
+	memset(ring->seqno, 0, sizeof(ring->seqno));
+	return true;
+}
+
+static bool vertex_ring_next(struct sna *sna)
+{
+	struct sna_vertex_ring *ring = &sna->render.vertex_ring;
+	int slot;
+
+	assert(sna->render.vbo == NULL);
+
+	if (!vertex_ring_init(sna))
+		return false;
+
+	slot = (ring->slot + 1) % VERTEX_RING_SLOTS;
+	if (!kgem_seqno_complete(&sna->kgem, ring->seqno[slot])) {
+		DBG(("%s: slot %d still busy (seqno=%u)\n",
+		     __FUNCTION__, slot, ring->seqno[slot]));
+		return false;
+	}
+
+	DBG(("%s: slot %d\n", __FUNCTION__, slot));
+	ring->slot = slot;
+
+	sna->render.vbo = kgem_bo_reference(ring->bo);
+	sna->render.vertices =
+		(float *)(ring->map + slot * VERTEX_RING_SLOT_SIZE);
+	return true;
+}
+
+/* The vertex buffer address is the start of the current slot, and the
+ * slot is now busy until the current request completes.
+ */
+static unsigned vertex_ring_delta(struct sna *sna, struct kgem_bo *bo)
+{
+	struct sna_vertex_ring *ring = &sna->render.vertex_ring;
+
+	if (bo == NULL || bo != ring->bo)
+		return 0;
+
+	ring->seqno[ring->slot] = kgem_next_seqno(&sna->kgem);
+	return ring->slot * VERTEX_RING_SLOT_SIZE;
+}
+
 int gen8_vertex_finish(struct sna *sna)
 {
 	struct kgem_bo *bo;
-	unsigned int i;
+	unsigned int i, delta;
 	unsigned hint, size;
 
 	DBG(("%s: used=%d / %d\n", __FUNCTION__,
@@ -93,6 +189,7 @@ int gen8_vertex_finish(struct sna *sna)
 
 	bo = sna->render.vbo;
 	if (bo) {
+		delta = vertex_ring_delta(sna, bo);
 		for (i = 0; i < sna->render.nvertex_reloc; i++) {
 			DBG(("%s: reloc[%d] = %d\n", __FUNCTION__,
 			     i, sna->render.vertex_reloc[i]));
@@ -101,7 +198,7 @@ int gen8_vertex_finish(struct sna *sna)
 				kgem_add_reloc64(&sna->kgem,
 						 sna->render.vertex_reloc[i], bo,
 						 I915_GEM_DOMAIN_VERTEX << 16,
-						 0);
+						 delta);
 		}
 
 		assert(!sna->render.active);
@@ -121,27 +218,33 @@ int gen8_vertex_finish(struct sna *sna)
 		}
 	}
 
-	size = 256*1024;
 	assert(!sna->render.active);
-	sna->render.vertices = NULL;
-	sna->render.vbo = kgem_create_linear(&sna->kgem, size, hint);
-	while (sna->render.vbo == NULL && size > 16*1024) {
-		size /= 2;
+	if (vertex_ring_next(sna)) {
+		size = VERTEX_RING_SLOT_SIZE;
+	} else {
+		size = 256*1024;
+		sna->render.vertices = NULL;
 		sna->render.vbo = kgem_create_linear(&sna->kgem, size, hint);
-	}
-	if (sna->render.vbo == NULL)
-		sna->render.vbo = kgem_create_linear(&sna->kgem,
-						     256*1024, CREATE_GTT_MAP);
-	if (sna->render.vbo)
-		sna->render.vertices = kgem_bo_map(&sna->kgem, sna->render.vbo);
-	if (sna->render.vertices == NULL) {
-		if (sna->render.vbo) {
-			kgem_bo_destroy(&sna->kgem, sna->render.vbo);
-			sna->render.vbo = NULL;
+		while (sna->render.vbo == NULL && size > 16*1024) {
+			size /= 2;
+			sna->render.vbo = kgem_create_linear(&sna->kgem, size, hint);
 		}
-		sna->render.vertices = sna->render.vertex_data;
-		sna->render.vertex_size = ARRAY_SIZE(sna->render.vertex_data);
-		return 0;
+		if (sna->render.vbo == NULL)
+			sna->render.vbo = kgem_create_linear(&sna->kgem,
+							     256*1024, CREATE_GTT_MAP);
+		if (sna->render.vbo)
+			sna->render.vertices = kgem_bo_map(&sna->kgem, sna->render.vbo);
+		if (sna->render.vertices == NULL) {
+			if (sna->render.vbo) {
+				kgem_bo_destroy(&sna->kgem, sna->render.vbo);
+				sna->render.vbo = NULL;
+			}
+			sna->render.vertices = sna->render.vertex_data;
+			sna->render.vertex_size = ARRAY_SIZE(sna->render.vertex_data);
+			return 0;
+		}
+
+		size = __kgem_bo_size(sna->render.vbo);
 	}
 
 	if (sna->render.vertex_used) {
@@ -149,14 +252,13 @@ int gen8_vertex_finish(struct sna *sna)
 		     __FUNCTION__,
 		     sna->render.vertex_used,
 		     sna->render.vbo->handle));
-		assert(sizeof(float)*sna->render.vertex_used <=
-		       __kgem_bo_size(sna->render.vbo));
+		assert(sizeof(float)*sna->render.vertex_used <= size);
 		memcpy(sna->render.vertices,
 		       sna->render.vertex_data,
 		       sizeof(float)*sna->render.vertex_used);
 	}
 
-	size = __kgem_bo_size(sna->render.vbo)/4;
+	size /= 4;
 	if (size >= UINT16_MAX)
 		size = UINT16_MAX - 1;
 
@@ -184,6 +286,7 @@ void gen8_vertex_close(struct sna *sna)
 
 	bo = sna->render.vbo;
 	if (bo) {
+		delta = vertex_ring_delta(sna, bo);
 		if (sna->render.vertex_size - sna->render.vertex_used < 64) {
 			DBG(("%s: discarding vbo (full), handle=%d\n", __FUNCTION__, sna->render.vbo->handle));
 			sna->render.vbo = NULL;
@@ -219,6 +322,21 @@ void gen8_vertex_close(struct sna *sna)
 			delta = sna->kgem.nbatch * 4;
 			bo = NULL;
 			sna->kgem.nbatch += sna->render.vertex_used;
+		} else if (vertex_ring_next(sna)) {
+			DBG(("%s: ring vbo: %d\n", __FUNCTION__,
+			     sna->render.vertex_used));
+
+			memcpy(sna->render.vertices,
+			       sna->render.vertex_data,
+			       sizeof(float)*sna->render.vertex_used);
+
+			size = VERTEX_RING_SLOT_SIZE/4;
+			if (size >= UINT16_MAX)
+				size = UINT16_MAX - 1;
+
+			bo = sna->render.vbo;
+			sna->render.vertex_size = size;
+			delta = vertex_ring_delta(sna, bo);
 		} else {
 			size = 256 * 1024;
 			do {
@@ -294,3 +412,14 @@ void gen8_vertex_close(struct sna *sna)
 	if (free_bo)
 		kgem_bo_destroy(&sna->kgem, free_bo);
 }
+
+void gen8_vertex_fini(struct sna *sna)
+{
+	struct sna_vertex_ring *ring = &sna->render.vertex_ring;
+
+	if (ring->bo) {
+		kgem_bo_destroy(&sna->kgem, ring->bo);
+		ring->bo = NULL;
+		ring->map = NULL;
+	}
+}
@@ -984,16 +984,40 @@ gen9_emit_invariant(struct sna *sna)
 	sna->render_state.gen9.needs_invariant = false;
 }
 
+/* Compare the packet just written from start against the copy of the
+ * same packet last sent in this batch, and discard it if nothing changed.
+ */
+static bool
+gen9_state_commit(struct sna *sna, int state, int start)
+{
+	struct gen9_render_state *render = &sna->render_state.gen9;
+	int len = sna->kgem.nbatch - start;
+
+	assert(state < GEN9_STATE_COUNT);
+	assert(len > 0 && len <= GEN9_STATE_DWORDS);
+
+	if (render->shadow.len[state] == len &&
+	    memcmp(render->shadow.dw[state], sna->kgem.batch + start,
+		   len * sizeof(uint32_t)) == 0) {
+		sna->kgem.nbatch = start;
+		render->shadow.saved += len;
+		return false;
+	}
+
+	memcpy(render->shadow.dw[state], sna->kgem.batch + start,
+	       len * sizeof(uint32_t));
+	render->shadow.len[state] = len;
+	return true;
+}
+
 static void
 gen9_emit_cc(struct sna *sna, uint32_t blend)
 {
 	struct gen9_render_state *render = &sna->render_state.gen9;
+	int start;
 
-	if (render->blend == blend)
-		return;
-
-	DBG(("%s: blend=%x (current=%x), src=%d, dst=%d\n",
-	     __FUNCTION__, blend, render->blend,
+	DBG(("%s: blend=%x, src=%d, dst=%d\n",
+	     __FUNCTION__, blend,
 	     blend / GEN9_BLENDFACTOR_COUNT,
 	     blend % GEN9_BLENDFACTOR_COUNT));
 
@@ -1005,6 +1029,7 @@ gen9_emit_cc(struct sna *sna, uint32_t blend)
 	 * Render Target Index. What other side-effects of Render Target Index?
 	 */
 
+	start = sna->kgem.nbatch;
 	OUT_BATCH(GEN9_3DSTATE_PS_BLEND | (2 - 2));
 	if (blend != GEN9_BLEND(NO_BLEND)) {
 		uint32_t src = blend / GEN9_BLENDFACTOR_COUNT;
@@ -1018,7 +1043,10 @@ gen9_emit_cc(struct sna *sna, uint32_t blend)
 	} else
 		OUT_BATCH(PS_BLEND_HAS_WRITEABLE_RT);
 
+	gen9_state_commit(sna, GEN9_STATE_PS_BLEND, start);
+
 	assert(is_aligned(render->cc_blend + blend * GEN9_BLEND_STATE_PADDED_SIZE, 64));
+	start = sna->kgem.nbatch;
 	OUT_BATCH(GEN9_3DSTATE_BLEND_STATE_POINTERS | (2 - 2));
 	OUT_BATCH((render->cc_blend + blend * GEN9_BLEND_STATE_PADDED_SIZE) | 1);
 
@@ -1026,36 +1054,31 @@ gen9_emit_cc(struct sna *sna, uint32_t blend)
 	OUT_BATCH(GEN9_3DSTATE_CC_STATE_POINTERS | (2 - 2));
 	OUT_BATCH(0);
 
-	render->blend = blend;
+	gen9_state_commit(sna, GEN9_STATE_BLEND_POINTERS, start);
 }
 
 static void
 gen9_emit_sampler(struct sna *sna, uint32_t state)
 {
-	if (sna->render_state.gen9.samplers == state)
-		return;
-
-	sna->render_state.gen9.samplers = state;
+	int start = sna->kgem.nbatch;
 
 	DBG(("%s: sampler = %x\n", __FUNCTION__, state));
 
 	assert(2 * sizeof(struct gen9_sampler_state) == 32);
 	OUT_BATCH(GEN9_3DSTATE_SAMPLER_STATE_POINTERS_PS | (2 - 2));
 	OUT_BATCH(sna->render_state.gen9.wm_state + state * 2 * sizeof(struct gen9_sampler_state));
+
+	gen9_state_commit(sna, GEN9_STATE_SAMPLER_POINTERS, start);
 }
 
 static void
 gen9_emit_sf(struct sna *sna, bool has_mask)
 {
 	int num_sf_outputs = has_mask ? 2 : 1;
-
-	if (sna->render_state.gen9.num_sf_outputs == num_sf_outputs)
-		return;
+	int start = sna->kgem.nbatch;
 
 	DBG(("%s: num_sf_outputs=%d\n", __FUNCTION__, num_sf_outputs));
 
-	sna->render_state.gen9.num_sf_outputs = num_sf_outputs;
-
 	OUT_BATCH(GEN9_3DSTATE_SBE | (6 - 2));
 	OUT_BATCH(num_sf_outputs << SBE_NUM_OUTPUTS_SHIFT |
 		  SBE_FORCE_VERTEX_URB_READ_LENGTH | /* forced is faster */
@@ -1067,19 +1090,19 @@ gen9_emit_sf(struct sna *sna, bool has_mask)
         OUT_BATCH(SBE_ACTIVE_COMPONENT_XYZW << 0 |
 		  SBE_ACTIVE_COMPONENT_XYZW << 1);
         OUT_BATCH(0);
+
+	gen9_state_commit(sna, GEN9_STATE_SBE, start);
 }
 
 static void
 gen9_emit_wm(struct sna *sna, int kernel)
 {
 	const uint32_t *kernels;
+	int start = sna->kgem.nbatch;
 
 	assert(kernel < ARRAY_SIZE(wm_kernels));
-	if (sna->render_state.gen9.kernel == kernel)
-		return;
-
-	sna->render_state.gen9.kernel = kernel;
 	kernels = sna->render_state.gen9.wm_kernel[kernel];
+	assert(kernels[0] | kernels[1] | kernels[2]);
 
 	DBG(("%s: switching to %s, num_surfaces=%d (8-wide? %d, 16-wide? %d, 32-wide? %d)\n",
 	     __FUNCTION__,
@@ -1105,13 +1128,99 @@ gen9_emit_wm(struct sna *sna, int kernel)
 		  6 << PS_DISPATCH_START_GRF_SHIFT_2);
 	OUT_BATCH64(kernels[2]);
 	OUT_BATCH64(kernels[1]);
+
+	gen9_state_commit(sna, GEN9_STATE_PS, start);
+}
+
+/* Only the plain affine kernels are used by nearly every session, the
+ * rest are compiled the first time an operation asks for them.
+ */
+static bool wm_kernel_is_common(int kernel)
+{
+	return (kernel == GEN9_WM_KERNEL_NOMASK ||
+		kernel == GEN9_WM_KERNEL_MASK);
+}
+
+static void
+gen9_compile_wm_kernel(struct sna *sna,
+		       struct sna_static_stream *stream,
+		       int m)
+{
+	struct gen9_render_state *state = &sna->render_state.gen9;
+
+	if (wm_kernels[m].size) {
+		state->wm_kernel[m][1] =
+			sna_static_stream_add(stream,
+					      wm_kernels[m].data,
+					      wm_kernels[m].size,
+					      64);
+	} else {
+		if (USE_8_PIXEL_DISPATCH) {
+			state->wm_kernel[m][0] =
+				sna_static_stream_compile_wm(sna, stream,
+							     wm_kernels[m].name,
+							     wm_kernels[m].data, 8);
+		}
+
+		if (USE_16_PIXEL_DISPATCH) {
+			state->wm_kernel[m][1] =
+				sna_static_stream_compile_wm(sna, stream,
+							     wm_kernels[m].name,
+							     wm_kernels[m].data, 16);
+		}
+
+		if (USE_32_PIXEL_DISPATCH) {
+			state->wm_kernel[m][2] =
+				sna_static_stream_compile_wm(sna, stream,
+							     wm_kernels[m].name,
+							     wm_kernels[m].data, 32);
+		}
+	}
+}
+
+static bool
+gen9_wm_kernel_prepare(struct sna *sna, int kernel)
+{
+	struct gen9_render_state *state = &sna->render_state.gen9;
+	uint32_t *kernels = state->wm_kernel[kernel];
+	struct kgem_bo *bo;
+
+	assert(kernel < ARRAY_SIZE(wm_kernels));
+	if (kernels[0] | kernels[1] | kernels[2])
+		return true;
+
+	DBG(("%s: compiling %s on first use\n",
+	     __FUNCTION__, wm_kernels[kernel].name));
+
+	gen9_compile_wm_kernel(sna, &state->general, kernel);
+	if ((kernels[0] | kernels[1] | kernels[2]) == 0)
+		return false;
+
+	/* The kernels are addressed relative to the instruction base,
+	 * so replace the whole bo with one that includes the new kernel.
+	 */
+	bo = sna_static_stream_upload(sna, &state->general);
+	if (bo == NULL) {
+		kernels[0] = kernels[1] = kernels[2] = 0;
+		return false;
+	}
+
+	/* The current batch has its base address set to the old bo */
+	if (!state->needs_invariant)
+		kgem_submit(&sna->kgem);
+
+	kgem_bo_destroy(&sna->kgem, state->general_bo);
+	state->general_bo = bo;
+	return true;
 }
 
 static bool
 gen9_emit_binding_table(struct sna *sna, uint16_t offset)
 {
-	if (sna->render_state.gen9.surface_table == offset)
+	if (sna->render_state.gen9.surface_table == offset) {
+		sna->render_state.gen9.shadow.saved += 2;
 		return false;
+	}
 
 	/* Binding table pointers */
 	assert(is_aligned(4*offset, 32));
@@ -1133,8 +1242,10 @@ gen9_emit_drawing_rectangle(struct sna *sna,
 	assert(!too_large(op->dst.width, op->dst.height));
 
 	if (sna->render_state.gen9.drawrect_limit == limit &&
-	    sna->render_state.gen9.drawrect_offset == offset)
+	    sna->render_state.gen9.drawrect_offset == offset) {
+		sna->render_state.gen9.shadow.saved += 4;
 		return true;
+	}
 
 	sna->render_state.gen9.drawrect_offset = offset;
 	sna->render_state.gen9.drawrect_limit = limit;
@@ -1160,13 +1271,10 @@ gen9_emit_vertex_elements(struct sna *sna,
 	uint32_t src_format, dw;
 	int id = GEN9_VERTEX(op->u.gen9.flags);
 	bool has_mask;
+	int start = sna->kgem.nbatch, ve;
 
 	DBG(("%s: setup id=%d\n", __FUNCTION__, id));
 
-	if (render->ve_id == id)
-		return;
-	render->ve_id = id;
-
 	if (render->ve_dirty) {
 		/* dummy primitive to flush vertex before change? */
 		OUT_BATCH(GEN9_3DPRIMITIVE | (7 - 2));
@@ -1178,6 +1286,7 @@ gen9_emit_vertex_elements(struct sna *sna,
 		OUT_BATCH(0);	/* index buffer offset, ignored */
 	}
 
+	ve = sna->kgem.nbatch;
 	/* The VUE layout
 	 *    dword 0-3: pad (0.0, 0.0, 0.0. 0.0)
 	 *    dword 4-7: position (x, y, 1.0, 1.0),
@@ -1276,6 +1385,12 @@ gen9_emit_vertex_elements(struct sna *sna,
 		OUT_BATCH(dw);
 	}
 
+	/* Drop the flush along with the packet if nothing changed */
+	if (!gen9_state_commit(sna, GEN9_STATE_VERTEX_ELEMENTS, ve)) {
+		sna->kgem.nbatch = start;
+		return;
+	}
+
 	render->ve_dirty = true;
 }
 
@@ -1510,7 +1625,7 @@ gen9_bind_bo(struct sna *sna,
 	uint32_t is_scanout = is_dst && bo->scanout;
 
 	/* After the first bind, we manage the cache domains within the batch */
-	offset = kgem_bo_get_binding(bo, format | is_dst << 30 | is_scanout << 31);
+	offset = kgem_bo_get_binding(&sna->kgem, bo, format | is_dst << 30 | is_scanout << 31);
 	if (offset) {
 		if (is_dst)
 			kgem_bo_mark_dirty(bo);
@@ -1545,7 +1660,7 @@ gen9_bind_bo(struct sna *sna,
 	ss[14] = 0;
 	ss[15] = 0;
 
-	kgem_bo_set_binding(bo, format | is_dst << 30 | is_scanout << 31, offset);
+	kgem_bo_set_binding(&sna->kgem, bo, format | is_dst << 30 | is_scanout << 31, offset);
 
 	DBG(("[%x] bind bo(handle=%d, addr=%lx), format=%d, width=%d, height=%d, pitch=%d, tiling=%d -> %s\n",
 	     offset, bo->handle, *(uint64_t *)(ss+8),
@@ -2438,6 +2553,8 @@ gen9_render_composite(struct sna *sna,
 		      unsigned flags,
 		      struct sna_composite_op *tmp)
 {
+	unsigned vb;
+
 	if (op >= ARRAY_SIZE(gen9_blend_op))
 		return false;
 
@@ -2550,15 +2667,26 @@ gen9_render_composite(struct sna *sna,
 		tmp->is_affine &= tmp->mask.is_affine;
 	}
 
+	/* Rectangles are emitted from source coordinates, but boxes from
+	 * destination coordinates, and either must fit the 2s2s vertex.
+	 */
+	vb = gen4_choose_composite_emitter(sna, tmp,
+					   gen4_source_is_short(&tmp->src,
+								src_x, src_y,
+								width, height) &&
+					   gen4_source_is_short(&tmp->src,
+								dst_x, dst_y,
+								width, height));
 	tmp->u.gen9.flags =
-		GEN9_SET_FLAGS(SAMPLER_OFFSET(tmp->src.filter,
+		GEN9_SET_FLAGS(vb == VERTEX_2s2s ? COPY_SAMPLER :
+			       SAMPLER_OFFSET(tmp->src.filter,
 					      tmp->src.repeat,
 					      tmp->mask.filter,
 					      tmp->mask.repeat),
 			       gen9_get_blend(tmp->op,
 					      tmp->has_component_alpha,
 					      tmp->dst.format),
-			       gen4_choose_composite_emitter(sna, tmp));
+			       vb);
 	tmp->u.gen9.wm_kernel = gen9_choose_composite_kernel(tmp->op,
 							     tmp->mask.bo != NULL,
 							     tmp->has_component_alpha,
@@ -2573,6 +2701,15 @@ gen9_render_composite(struct sna *sna,
 	}
 	tmp->done  = gen9_render_composite_done;
 
+	if (!gen9_wm_kernel_prepare(sna, tmp->u.gen9.wm_kernel))
+		goto cleanup_mask;
+	if (tmp->need_magic_ca_pass &&
+	    !gen9_wm_kernel_prepare(sna,
+				     gen9_choose_composite_kernel(PictOpAdd,
+								  true, true,
+								  tmp->is_affine)))
+		goto cleanup_mask;
+
 	kgem_set_mode(&sna->kgem, KGEM_RENDER, tmp->dst.bo);
 	if (!kgem_check_bo(&sna->kgem,
 			   tmp->dst.bo, tmp->src.bo, tmp->mask.bo,
@@ -2801,6 +2938,9 @@ gen9_render_composite_spans(struct sna *sna,
 		tmp->thread_boxes = gen9_render_composite_spans_boxes__thread;
 	tmp->done  = gen9_render_composite_spans_done;
 
+	if (!gen9_wm_kernel_prepare(sna, tmp->base.u.gen9.wm_kernel))
+		goto cleanup_src;
+
 	kgem_set_mode(&sna->kgem, KGEM_RENDER, tmp->base.dst.bo);
 	if (!kgem_check_bo(&sna->kgem,
 			   tmp->base.dst.bo, tmp->base.src.bo,
@@ -3989,6 +4129,9 @@ gen9_render_video(struct sna *sna,
 	tmp.u.gen9.wm_kernel = select_video_kernel(video, frame);
 	tmp.priv = frame;
 
+	if (!gen9_wm_kernel_prepare(sna, tmp.u.gen9.wm_kernel))
+		return false;
+
 	kgem_set_mode(&sna->kgem, KGEM_RENDER, tmp.dst.bo);
 	if (!kgem_check_bo(&sna->kgem, tmp.dst.bo, frame->bo, NULL)) {
 		kgem_submit(&sna->kgem);
@@ -4066,16 +4209,23 @@ static void gen9_render_flush(struct sna *sna)
 
 static void gen9_render_reset(struct sna *sna)
 {
+	struct gen9_render_state *state = &sna->render_state.gen9;
+
+	/* Only count batches that carried render state */
+	if (!state->needs_invariant) {
+		DBG(("%s: skipped %d dwords of redundant state\n",
+		     __FUNCTION__, state->shadow.saved));
+		sna->kgem.stats.state_batches++;
+		sna->kgem.stats.state_saved += state->shadow.saved;
+	}
+	state->shadow.saved = 0;
+	memset(state->shadow.len, 0, sizeof(state->shadow.len));
+
 	sna->render_state.gen9.emit_flush = false;
 	sna->render_state.gen9.needs_invariant = true;
-	sna->render_state.gen9.ve_id = 3 << 2;
 	sna->render_state.gen9.ve_dirty = false;
 	sna->render_state.gen9.last_primitive = -1;
 
-	sna->render_state.gen9.num_sf_outputs = 0;
-	sna->render_state.gen9.samplers = -1;
-	sna->render_state.gen9.blend = -1;
-	sna->render_state.gen9.kernel = -1;
 	sna->render_state.gen9.drawrect_offset = -1;
 	sna->render_state.gen9.drawrect_limit = -1;
 	sna->render_state.gen9.surface_table = 0;
@@ -4092,13 +4242,15 @@ static void gen9_render_reset(struct sna *sna)
 
 static void gen9_render_fini(struct sna *sna)
 {
+	gen8_vertex_fini(sna);
 	kgem_bo_destroy(&sna->kgem, sna->render_state.gen9.general_bo);
+	free(sna->render_state.gen9.general.data);
 }
 
 static bool gen9_render_setup(struct sna *sna)
 {
 	struct gen9_render_state *state = &sna->render_state.gen9;
-	struct sna_static_stream general;
+	struct sna_static_stream *general = &state->general;
 	struct gen9_sampler_state *ss;
 	int i, j, k, l, m;
 	uint32_t devid;
@@ -4120,39 +4272,18 @@ static bool gen9_render_setup(struct sna *sna)
 	if (is_cfl(sna))
 		state->info = &cfl_gt_info;
 
-	sna_static_stream_init(&general);
+	sna_static_stream_init(general);
 
 	/* Zero pad the start. If you see an offset of 0x0 in the batchbuffer
 	 * dumps, you know it points to zero.
 	 */
-	null_create(&general);
+	null_create(general);
 
 	for (m = 0; m < ARRAY_SIZE(wm_kernels); m++) {
-		if (wm_kernels[m].size) {
-			state->wm_kernel[m][1] =
-				sna_static_stream_add(&general,
-						      wm_kernels[m].data,
-						      wm_kernels[m].size,
-						      64);
-		} else {
-			if (USE_8_PIXEL_DISPATCH) {
-				state->wm_kernel[m][0] =
-					sna_static_stream_compile_wm(sna, &general,
-								     wm_kernels[m].data, 8);
-			}
+		if (!wm_kernel_is_common(m))
+			continue;
 
-			if (USE_16_PIXEL_DISPATCH) {
-				state->wm_kernel[m][1] =
-					sna_static_stream_compile_wm(sna, &general,
-								     wm_kernels[m].data, 16);
-			}
-
-			if (USE_32_PIXEL_DISPATCH) {
-				state->wm_kernel[m][2] =
-					sna_static_stream_compile_wm(sna, &general,
-								     wm_kernels[m].data, 32);
-			}
-		}
+		gen9_compile_wm_kernel(sna, general, m);
 		assert(state->wm_kernel[m][0]|state->wm_kernel[m][1]|state->wm_kernel[m][2]);
 	}
 
@@ -4160,13 +4291,13 @@ static bool gen9_render_setup(struct sna *sna)
 			    1 << (sizeof(((struct sna_composite_op *)NULL)->u.gen9.wm_kernel) * 8));
 
 	COMPILE_TIME_ASSERT(SAMPLER_OFFSET(FILTER_COUNT, EXTEND_COUNT, FILTER_COUNT, EXTEND_COUNT) <= 0x7ff);
-	ss = sna_static_stream_map(&general,
+	ss = sna_static_stream_map(general,
 				   2 * sizeof(*ss) *
 				   (2 +
 				    FILTER_COUNT * EXTEND_COUNT *
 				    FILTER_COUNT * EXTEND_COUNT),
 				   32);
-	state->wm_state = sna_static_stream_offsetof(&general, ss);
+	state->wm_state = sna_static_stream_offsetof(general, ss);
 	sampler_copy_init(ss); ss += 2;
 	sampler_fill_init(ss); ss += 2;
 	for (i = 0; i < FILTER_COUNT; i++) {
@@ -4180,10 +4311,16 @@ static bool gen9_render_setup(struct sna *sna)
 		}
 	}
 
-	state->cc_blend = gen9_create_blend_state(&general);
+	state->cc_blend = gen9_create_blend_state(general);
 
-	state->general_bo = sna_static_stream_fini(sna, &general);
-	return state->general_bo != NULL;
+	/* Keep the stream to append the remaining kernels as required */
+	state->general_bo = sna_static_stream_upload(sna, general);
+	if (state->general_bo == NULL) {
+		free(general->data);
+		return false;
+	}
+
+	return true;
 }
 
 const char *gen9_render_init(struct sna *sna, const char *backend)
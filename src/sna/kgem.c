@@ -40,6 +40,9 @@
 #include <sched.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 
 #include <xf86drm.h>
 
@@ -83,6 +86,9 @@ search_snoop_cache(struct kgem *kgem, unsigned int num_pages, unsigned flags);
 #define DBG_NO_SHRINK_BATCHES 0
 #define DBG_NO_FAST_RELOC 0
 #define DBG_NO_HANDLE_LUT 0
+#define DBG_NO_SOFTPIN 0
+#define DBG_NO_EXEC_FENCE 0
+#define DBG_NO_ASYNC_SUBMIT 0
 #define DBG_NO_WT 0
 #define DBG_NO_WC_MMAP 0
 #define DBG_NO_BLT_Y 0
@@ -124,6 +130,7 @@ search_snoop_cache(struct kgem *kgem, unsigned int num_pages, unsigned flags);
 #define NUM_PAGES(x) (((x) + PAGE_SIZE-1) / PAGE_SIZE)
 
 #define MAX_GTT_VMA_CACHE 512
+#define KGEM_VA_START (1024*1024) /* keep stray NULL pointers out of our objects */
 #define MAX_CPU_VMA_CACHE INT16_MAX
 #define MAP_PRESERVE_TIME 10
 
@@ -141,11 +148,18 @@ search_snoop_cache(struct kgem *kgem, unsigned int num_pages, unsigned flags);
 #define LOCAL_I915_PARAM_HAS_HANDLE_LUT		26
 #define LOCAL_I915_PARAM_HAS_WT			27
 #define LOCAL_I915_PARAM_MMAP_VERSION		30
+#define LOCAL_I915_PARAM_HAS_EXEC_SOFTPIN	37
+#define LOCAL_I915_PARAM_HAS_EXEC_FENCE		44
 #define LOCAL_I915_PARAM_MMAP_GTT_COHERENT	52
 
 #define LOCAL_I915_EXEC_IS_PINNED		(1<<10)
 #define LOCAL_I915_EXEC_NO_RELOC		(1<<11)
 #define LOCAL_I915_EXEC_HANDLE_LUT		(1<<12)
+#define LOCAL_I915_EXEC_FENCE_OUT		(1<<17)
+
+#define LOCAL_IOCTL_I915_GEM_EXECBUFFER2_WR DRM_IOWR(DRM_COMMAND_BASE + DRM_I915_GEM_EXECBUFFER2, struct drm_i915_gem_execbuffer2)
+
+#define LOCAL_EXEC_OBJECT_PINNED		(1<<4)
 
 #define LOCAL_I915_GEM_CREATE2       0x34
 #define LOCAL_IOCTL_I915_GEM_CREATE2 DRM_IOWR (DRM_COMMAND_BASE + LOCAL_I915_GEM_CREATE2, struct local_i915_gem_create2)
@@ -224,6 +238,36 @@ enum {
 
 static struct kgem_bo *__kgem_freed_bo;
 static struct kgem_request *__kgem_freed_request;
+static int __kgem_out_fences;
+
+/* Each out-fence pins a file descriptor in the server, so keep only a
+ * bounded window of them alive and let the older requests fall back to
+ * the busy ioctl.
+ */
+#define MAX_OUT_FENCES 64
+
+/* A batch handed over to the submission thread. Only the exec list
+ * needs to outlive the batch in struct kgem, as asynchronous submission
+ * is restricted to batches whose objects are all softpinned and so
+ * carry no relocations.
+ */
+struct kgem_submit {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	enum { SUBMIT_IDLE, SUBMIT_QUEUED, SUBMIT_DONE, SUBMIT_EXIT } state;
+	int fd, ret;
+	uint64_t us;
+	struct kgem_request *rq;
+	struct drm_i915_gem_execbuffer2 execbuf;
+	struct drm_i915_gem_exec_object2 exec[ARRAY_SIZE(((struct kgem *)0)->exec)];
+};
+
+/* Until the kernel has seen the queued batch, nothing else may be asked
+ * of it: a busy query would report its objects as idle and a close
+ * would pull them out from underneath the execbuf.
+ */
+static struct kgem *__kgem_submit_pending;
 static struct drm_i915_gem_exec_object2 _kgem_dummy_exec;
 
 static inline struct sna *__to_sna(struct kgem *kgem)
@@ -240,6 +284,21 @@ static inline int bytes(struct kgem_bo *bo)
 #define bucket(B) (B)->size.pages.bucket
 #define num_pages(B) (B)->size.pages.count
 
+static int sys_ioctl(int fd, unsigned long req, void *arg)
+{
+	return ioctl(fd, req, arg);
+}
+
+/* Every request we make of the kernel is funneled through here, so that
+ * a userspace stand-in for i915 can be substituted when running headless.
+ */
+static kgem_ioctl_func kgem_ioctl = sys_ioctl;
+
+void kgem_set_ioctl(kgem_ioctl_func func)
+{
+	kgem_ioctl = func ? func : sys_ioctl;
+}
+
 static int __do_ioctl(int fd, unsigned long req, void *arg)
 {
 	do {
@@ -254,14 +313,17 @@ static int __do_ioctl(int fd, unsigned long req, void *arg)
 			return -err;
 		}
 
-		if (likely(ioctl(fd, req, arg) == 0))
+		if (likely(kgem_ioctl(fd, req, arg) == 0))
 			return 0;
 	} while (1);
 }
 
 inline static int do_ioctl(int fd, unsigned long req, void *arg)
 {
-	if (likely(ioctl(fd, req, arg) == 0))
+	if (unlikely(__kgem_submit_pending))
+		__kgem_submit_wait(__kgem_submit_pending);
+
+	if (likely(kgem_ioctl(fd, req, arg) == 0))
 		return 0;
 
 	return __do_ioctl(fd, req, arg);
@@ -281,6 +343,29 @@ static void debug_alloc__bo(struct kgem *kgem, struct kgem_bo *bo)
 #define debug_alloc__bo(k, b)
 #endif
 
+static inline void account_alloc__bo(struct kgem *kgem, struct kgem_bo *bo)
+{
+	kgem->stats.bo_create++;
+	kgem->stats.bo_bytes += bytes(bo);
+	debug_alloc__bo(kgem, bo);
+}
+
+static uint64_t stats_time_us(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void stats_stall(struct kgem_stats_stall *stall, uint64_t start)
+{
+	stall->count++;
+	stall->us += stats_time_us() - start;
+}
+
 #ifndef NDEBUG
 static void assert_tiling(struct kgem *kgem, struct kgem_bo *bo)
 {
@@ -476,13 +561,18 @@ static bool kgem_set_tiling(struct kgem *kgem, struct kgem_bo *bo,
 	if (DBG_NO_TILING)
 		return false;
 
+	/* The kernel must see the queued batch before we change the fence
+	 * underneath it.
+	 */
+	kgem_submit_wait(kgem);
+
 	VG_CLEAR(set_tiling);
 restart:
 	set_tiling.handle = bo->handle;
 	set_tiling.tiling_mode = tiling;
 	set_tiling.stride = tiling ? stride : 0;
 
-	if (ioctl(kgem->fd, DRM_IOCTL_I915_GEM_SET_TILING, &set_tiling) == 0) {
+	if (kgem_ioctl(kgem->fd, DRM_IOCTL_I915_GEM_SET_TILING, &set_tiling) == 0) {
 		bo->tiling = set_tiling.tiling_mode;
 		bo->pitch = set_tiling.tiling_mode ? set_tiling.stride : stride;
 		DBG(("%s: handle=%d, tiling=%d [%d], pitch=%d [%d]: %d\n",
@@ -546,21 +636,29 @@ static uint32_t gem_userptr(int fd, void *ptr, size_t size, int read_only)
 
 static bool __kgem_throttle(struct kgem *kgem, bool harder)
 {
+	uint64_t start = stats_time_us();
+	bool wedged = false;
+
 	/* Let this be woken up by sigtimer so that we don't block here
 	 * too much and completely starve X. We will sleep again shortly,
 	 * and so catch up or detect the hang.
 	 */
 	do {
-		if (ioctl(kgem->fd, DRM_IOCTL_I915_GEM_THROTTLE) == 0) {
+		int err = do_ioctl(kgem->fd, DRM_IOCTL_I915_GEM_THROTTLE, NULL);
+
+		if (err == 0) {
 			kgem->need_throttle = 0;
-			return false;
+			break;
 		}
 
-		if (errno == EIO)
-			return true;
+		if (err == -EIO) {
+			wedged = true;
+			break;
+		}
 	} while (harder);
 
-	return false;
+	stats_stall(&kgem->stats.throttle, start);
+	return wedged;
 }
 
 static bool __kgem_throttle_retire(struct kgem *kgem, unsigned flags)
@@ -639,6 +737,8 @@ retry_mmap:
 	 * issue with compositing managers which need to
 	 * frequently flush CPU damage to their GPU bo.
 	 */
+	if (ptr)
+		kgem->stats.mmap[KGEM_STATS_MMAP_GTT]++;
 	return bo->map__gtt = ptr;
 }
 
@@ -677,6 +777,7 @@ retry_wc:
 	VG(VALGRIND_MAKE_MEM_DEFINED(wc.addr_ptr, bytes(bo)));
 
 	DBG(("%s: caching CPU(wc) vma for %d\n", __FUNCTION__, bo->handle));
+	kgem->stats.mmap[KGEM_STATS_MMAP_WC]++;
 	return bo->map__wc = (void *)(uintptr_t)wc.addr_ptr;
 }
 
@@ -711,6 +812,7 @@ retry:
 	VG(VALGRIND_MAKE_MEM_DEFINED(arg.addr_ptr, bytes(bo)));
 
 	DBG(("%s: caching CPU vma for %d\n", __FUNCTION__, bo->handle));
+	kgem->stats.mmap[KGEM_STATS_MMAP_CPU]++;
 	return bo->map__cpu = (void *)(uintptr_t)arg.addr_ptr;
 }
 
@@ -793,6 +895,24 @@ bool __kgem_busy(struct kgem *kgem, int handle)
 	return busy.busy;
 }
 
+static bool __kgem_request_busy(struct kgem *kgem, struct kgem_request *rq)
+{
+	struct pollfd pfd;
+
+	if (rq->out_fence == -1)
+		return __kgem_busy(kgem, rq->bo->handle);
+
+	pfd.fd = rq->out_fence;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	if (poll(&pfd, 1, 0) < 0)
+		return __kgem_busy(kgem, rq->bo->handle);
+
+	DBG(("%s: handle=%d, fence=%d, busy=%d\n",
+	     __FUNCTION__, rq->bo->handle, rq->out_fence, pfd.revents == 0));
+	return pfd.revents == 0;
+}
+
 static void kgem_bo_retire(struct kgem *kgem, struct kgem_bo *bo)
 {
 	DBG(("%s: retiring bo handle=%d (needed flush? %d), rq? %d [busy?=%d]\n",
@@ -977,9 +1097,43 @@ constant inline static unsigned long __fls(unsigned long word)
 #endif
 }
 
+/* Each power-of-two range of sizes is split into 1 << CACHE_BUCKET_SHIFT
+ * buckets, so that walking a bucket rarely has to step over objects that
+ * are too small for the request. A search for a size then continues
+ * upwards through the remaining buckets of the same order, finding the
+ * smallest cached object first.
+ */
 constant inline static int cache_bucket(int num_pages)
 {
-	return __fls(num_pages);
+	int order = __fls(num_pages);
+	return order << CACHE_BUCKET_SHIFT |
+		((num_pages << CACHE_BUCKET_SHIFT >> order) & ((1 << CACHE_BUCKET_SHIFT) - 1));
+}
+
+constant inline static int cache_bucket_end(int bucket)
+{
+	return (bucket | ((1 << CACHE_BUCKET_SHIFT) - 1)) + 1;
+}
+
+/* number of buckets from here to the end of the given number of orders */
+constant inline static int cache_bucket_span(int bucket, int orders)
+{
+	return cache_bucket_end(bucket) - bucket + ((orders - 1) << CACHE_BUCKET_SHIFT);
+}
+
+constant inline static int stats_order(int num_pages)
+{
+	int order = __fls(num_pages);
+	return order < KGEM_STATS_ORDERS ? order : KGEM_STATS_ORDERS - 1;
+}
+
+static void stats_execbuf(struct kgem *kgem, uint64_t us)
+{
+	kgem->stats.execbuf++;
+	if (us >= 1 << (KGEM_STATS_LATENCY - 1))
+		kgem->stats.execbuf_us[KGEM_STATS_LATENCY - 1]++;
+	else
+		kgem->stats.execbuf_us[__fls(us | 1)]++;
 }
 
 static struct kgem_bo *__kgem_bo_init(struct kgem_bo *bo,
@@ -1040,6 +1194,8 @@ static struct kgem_request *__kgem_request_alloc(struct kgem *kgem)
 	list_init(&rq->buffers);
 	rq->bo = NULL;
 	rq->ring = 0;
+	rq->seqno = ++kgem->seqno;
+	rq->out_fence = -1;
 
 	return rq;
 }
@@ -1047,6 +1203,10 @@ static struct kgem_request *__kgem_request_alloc(struct kgem *kgem)
 static void __kgem_request_free(struct kgem_request *rq)
 {
 	_list_del(&rq->list);
+	if (rq->out_fence != -1) {
+		close(rq->out_fence);
+		__kgem_out_fences--;
+	}
 	if (DBG_NO_MALLOC_CACHE) {
 		free(rq);
 	} else {
@@ -1069,6 +1229,57 @@ static struct list *active(struct kgem *kgem, int num_pages, int tiling)
 	return &kgem->active[cache_bucket(num_pages)][tiling];
 }
 
+static bool inactive_is_empty(struct kgem *kgem, int num_pages)
+{
+	int b, end;
+
+	assert(num_pages < MAX_CACHE_SIZE / PAGE_SIZE);
+	for (b = cache_bucket(num_pages), end = cache_bucket_end(b); b < end; b++)
+		if (!list_is_empty(&kgem->inactive[b]))
+			return false;
+
+	return true;
+}
+
+static bool active_is_empty(struct kgem *kgem, int num_pages, int tiling)
+{
+	int b, end;
+
+	assert(num_pages < MAX_CACHE_SIZE / PAGE_SIZE);
+	for (b = cache_bucket(num_pages), end = cache_bucket_end(b); b < end; b++)
+		if (!list_is_empty(&kgem->active[b][tiling]))
+			return false;
+
+	return true;
+}
+
+static bool vma_is_empty(struct kgem *kgem, int type, int num_pages)
+{
+	int b, end;
+
+	assert(num_pages < MAX_CACHE_SIZE / PAGE_SIZE);
+	for (b = cache_bucket(num_pages), end = cache_bucket_end(b); b < end; b++)
+		if (!list_is_empty(&kgem->vma[type].inactive[b]))
+			return false;
+
+	return true;
+}
+
+static void cache_search_begin(struct kgem_cache_search *s)
+{
+	/* the previous search is complete, so fold in its length */
+	if (s->current > s->max)
+		s->max = s->current;
+	s->current = 0;
+	s->count++;
+}
+
+static inline void cache_search_step(struct kgem_cache_search *s)
+{
+	s->current++;
+	s->steps++;
+}
+
 static size_t
 agp_aperture_size(struct pci_device *dev, unsigned gen)
 {
@@ -1214,6 +1425,31 @@ static bool test_has_handle_lut(struct kgem *kgem)
 	return gem_param(kgem, LOCAL_I915_PARAM_HAS_HANDLE_LUT) > 0;
 }
 
+static bool test_has_softpin(struct kgem *kgem)
+{
+	if (DBG_NO_SOFTPIN)
+		return false;
+
+	/* Only the 64-bit relocations of gen8+ are written for softpin */
+	if (kgem->gen < 0100)
+		return false;
+
+	if (!kgem->has_full_ppgtt ||
+	    !kgem->has_handle_lut ||
+	    !kgem->has_no_reloc)
+		return false;
+
+	return gem_param(kgem, LOCAL_I915_PARAM_HAS_EXEC_SOFTPIN) > 0;
+}
+
+static bool test_has_exec_fence(struct kgem *kgem)
+{
+	if (DBG_NO_EXEC_FENCE)
+		return false;
+
+	return gem_param(kgem, LOCAL_I915_PARAM_HAS_EXEC_FENCE) > 0;
+}
+
 static bool test_has_wt(struct kgem *kgem)
 {
 	if (DBG_NO_WT)
@@ -1470,7 +1706,7 @@ static bool gem_set_tiling(int fd, uint32_t handle, int tiling, int stride)
 	set_tiling.tiling_mode = tiling;
 	set_tiling.stride = stride;
 
-	if (ioctl(fd, DRM_IOCTL_I915_GEM_SET_TILING, &set_tiling) == 0)
+	if (do_ioctl(fd, DRM_IOCTL_I915_GEM_SET_TILING, &set_tiling) == 0)
 		return set_tiling.tiling_mode == tiling;
 
 	return false;
@@ -1515,7 +1751,7 @@ static bool test_can_scanout_y(struct kgem *kgem)
 		f.modifiers[0] = (uint64_t)1 << 56 | 2; /* MOD_Y_TILED */
 		f.pixel_format = 'X' | 'R' << 8 | '2' << 16 | '4' << 24; /* XRGB8888 */
 		f.flags = 1 << 1; /* + modifier */
-		if (drmIoctl(kgem->fd, LOCAL_IOCTL_MODE_ADDFB2, &f) == 0) {
+		if (do_ioctl(kgem->fd, LOCAL_IOCTL_MODE_ADDFB2, &f) == 0) {
 			ret = true;
 			arg.fb_id = f.fb_id;
 		}
@@ -1544,12 +1780,12 @@ static bool test_has_dirtyfb(struct kgem *kgem)
 	if (create.handle == 0)
 		return false;
 
-	if (drmIoctl(kgem->fd, DRM_IOCTL_MODE_ADDFB, &create) == 0) {
+	if (do_ioctl(kgem->fd, DRM_IOCTL_MODE_ADDFB, &create) == 0) {
 		struct drm_mode_fb_dirty_cmd dirty;
 
 		memset(&dirty, 0, sizeof(dirty));
 		dirty.fb_id = create.fb_id;
-		ret = drmIoctl(kgem->fd,
+		ret = do_ioctl(kgem->fd,
 			       DRM_IOCTL_MODE_DIRTYFB,
 			       &dirty) == 0;
 
@@ -1558,7 +1794,7 @@ static bool test_has_dirtyfb(struct kgem *kgem)
 		 * beneficial vs flagging the whole fb as dirty.
 		 */
 
-		drmIoctl(kgem->fd,
+		do_ioctl(kgem->fd,
 			 DRM_IOCTL_MODE_RMFB,
 			 &create.fb_id);
 	}
@@ -1621,7 +1857,7 @@ static bool kgem_init_pinned_batches(struct kgem *kgem)
 				goto err;
 			}
 			bo->presumed_offset = pin.offset;
-			debug_alloc__bo(kgem, bo);
+			account_alloc__bo(kgem, bo);
 			list_add(&bo->list, &kgem->pinned_batches[n]);
 		}
 	}
@@ -1662,7 +1898,7 @@ err:
 			return false;
 		}
 
-		debug_alloc__bo(kgem, bo);
+		account_alloc__bo(kgem, bo);
 		list_add(&bo->list, &kgem->pinned_batches[n]);
 	}
 	return true;
@@ -1708,11 +1944,132 @@ out:
 	DBG(("%s: can fence?=%d\n", __FUNCTION__, kgem->can_fence));
 }
 
+static inline int va_order(int num_pages)
+{
+	return num_pages > 1 ? __fls(num_pages - 1) + 1 : 0;
+}
+
+static inline uint64_t va_size(int order)
+{
+	return (uint64_t)PAGE_SIZE << order;
+}
+
+static bool va_push(struct kgem_va_list *list, uint64_t addr)
+{
+	if (list->count == list->size) {
+		unsigned size = list->size ? 2 * list->size : 64;
+		uint64_t *new_addr;
+
+		new_addr = realloc(list->addr, size * sizeof(uint64_t));
+		if (new_addr == NULL)
+			return false;
+
+		list->addr = new_addr;
+		list->size = size;
+	}
+
+	list->addr[list->count++] = addr;
+	return true;
+}
+
+static bool kgem_bo_softpin(struct kgem *kgem, struct kgem_bo *bo)
+{
+	struct kgem_va *va = &kgem->va;
+	uint64_t addr;
+	int order, n;
+
+	assert(kgem->has_softpin);
+	assert(bo->proxy == NULL);
+
+	if (bo->softpin)
+		return true;
+
+	order = va_order(num_pages(bo));
+	if (order >= KGEM_VA_ORDERS)
+		return false;
+
+	if (va->free[order].count) {
+		addr = va->free[order].addr[--va->free[order].count];
+		goto out;
+	}
+
+	if (va->next + va_size(order) <= va->end) {
+		addr = va->next;
+		va->next += va_size(order);
+		goto out;
+	}
+
+	/* Split the smallest larger block, returning the remainder */
+	for (n = order + 1; n < KGEM_VA_ORDERS; n++) {
+		if (va->free[n].count == 0)
+			continue;
+
+		addr = va->free[n].addr[--va->free[n].count];
+		while (--n >= order)
+			(void)va_push(&va->free[n], addr + va_size(n));
+		goto out;
+	}
+
+	DBG(("%s: address space exhausted for handle=%d, num_pages=%d\n",
+	     __FUNCTION__, bo->handle, num_pages(bo)));
+	return false;
+
+out:
+	DBG(("%s: handle=%d, num_pages=%d -> %llx\n",
+	     __FUNCTION__, bo->handle, num_pages(bo), (long long)addr));
+	assert(addr >= KGEM_VA_START && addr + bytes(bo) <= va->end);
+	bo->presumed_offset = addr;
+	bo->softpin = true;
+	return true;
+}
+
+static void kgem_bo_release_va(struct kgem *kgem, struct kgem_bo *bo)
+{
+	struct kgem_va_list *list;
+
+	if (!bo->softpin)
+		return;
+
+	DBG(("%s: handle=%d, releasing %llx, busy? %d\n",
+	     __FUNCTION__, bo->handle, (long long)bo->presumed_offset,
+	     bo->rq != NULL));
+
+	/* A closed object stays bound until it is idle, so do not
+	 * reuse its address until then or we will stall in execbuf
+	 * waiting for the kernel to evict it.
+	 */
+	list = bo->rq ? kgem->va.busy : kgem->va.free;
+	if (va_push(&list[va_order(num_pages(bo))], bo->presumed_offset))
+		kgem->va.has_busy |= bo->rq != NULL;
+
+	bo->softpin = false;
+	bo->presumed_offset = 0;
+}
+
+static void kgem_va_release_busy(struct kgem *kgem)
+{
+	int n;
+
+	DBG(("%s\n", __FUNCTION__));
+
+	for (n = 0; n < KGEM_VA_ORDERS; n++) {
+		struct kgem_va_list *busy = &kgem->va.busy[n];
+
+		while (busy->count &&
+		       va_push(&kgem->va.free[n], busy->addr[busy->count-1]))
+			busy->count--;
+	}
+
+	kgem->va.has_busy = false;
+}
+
 static void kgem_fixup_relocs(struct kgem *kgem, struct kgem_bo *bo, int shrink)
 {
 	int n;
 
 	bo->target_handle = kgem->has_handle_lut ? kgem->nexec : bo->handle;
+	if (kgem->has_softpin)
+		(void)kgem_bo_softpin(kgem, bo);
 
 	assert(kgem->nreloc__self <= 256);
 	if (kgem->nreloc__self == 0)
@@ -1777,7 +2134,7 @@ static void kgem_fixup_relocs(struct kgem *kgem, struct kgem_bo *bo, int shrink)
 	}
 }
 
-static int kgem_bo_wait(struct kgem *kgem, struct kgem_bo *bo)
+static int __kgem_bo_wait(struct kgem *kgem, struct kgem_bo *bo)
 {
 	struct local_i915_gem_wait {
 		uint32_t handle;
@@ -1792,6 +2149,23 @@ static int kgem_bo_wait(struct kgem *kgem, struct kgem_bo *bo)
 	if (bo->rq == NULL)
 		return 0;
 
+	/* A batch is only ever used by its own request, so its fence
+	 * tells us exactly when it is idle.
+	 */
+	if (RQ(bo->rq)->bo == bo && RQ(bo->rq)->out_fence != -1) {
+		struct pollfd pfd;
+
+		pfd.fd = RQ(bo->rq)->out_fence;
+		pfd.events = POLLIN;
+		do {
+			ret = poll(&pfd, 1, -1);
+		} while (ret < 0 && errno == EINTR);
+		if (ret > 0) {
+			__kgem_retire_requests_upto(kgem, bo);
+			return 0;
+		}
+	}
+
 	VG_CLEAR(wait);
 	wait.handle = bo->handle;
 	wait.flags = 0;
@@ -1815,6 +2189,21 @@ static int kgem_bo_wait(struct kgem *kgem, struct kgem_bo *bo)
 	return ret;
 }
 
+static int kgem_bo_wait(struct kgem *kgem, struct kgem_bo *bo)
+{
+	uint64_t start;
+	int ret;
+
+	if (bo->rq == NULL)
+		return 0;
+
+	start = stats_time_us();
+	ret = __kgem_bo_wait(kgem, bo);
+	stats_stall(&kgem->stats.wait, start);
+
+	return ret;
+}
+
 static struct kgem_bo *kgem_new_batch(struct kgem *kgem)
 {
 	struct kgem_bo *last;
@@ -1906,9 +2295,8 @@ no_context_switch(struct kgem *kgem, int new_mode)
 	(void)new_mode;
 }
 
-static uint64_t get_gtt_size(int fd)
+static uint64_t get_context_gtt_size(int fd)
 {
-	struct drm_i915_gem_get_aperture aperture;
 	struct local_i915_gem_context_param {
 		uint32_t context;
 		uint32_t size;
@@ -1921,14 +2309,23 @@ static uint64_t get_gtt_size(int fd)
 #define LOCAL_I915_GEM_CONTEXT_GETPARAM       0x34
 #define LOCAL_IOCTL_I915_GEM_CONTEXT_GETPARAM DRM_IOWR (DRM_COMMAND_BASE + LOCAL_I915_GEM_CONTEXT_GETPARAM, struct local_i915_gem_context_param)
 
-	memset(&aperture, 0, sizeof(aperture));
-
 	memset(&p, 0, sizeof(p));
 	p.param = LOCAL_CONTEXT_PARAM_GTT_SIZE;
-	if (drmIoctl(fd, LOCAL_IOCTL_I915_GEM_CONTEXT_GETPARAM, &p) == 0)
-		aperture.aper_size = p.value;
+	if (do_ioctl(fd, LOCAL_IOCTL_I915_GEM_CONTEXT_GETPARAM, &p))
+		return 0;
+
+	return p.value;
+}
+
+static uint64_t get_gtt_size(int fd)
+{
+	struct drm_i915_gem_get_aperture aperture;
+
+	memset(&aperture, 0, sizeof(aperture));
+
+	aperture.aper_size = get_context_gtt_size(fd);
 	if (aperture.aper_size == 0)
-		(void)drmIoctl(fd, DRM_IOCTL_I915_GEM_GET_APERTURE, &aperture);
+		(void)do_ioctl(fd, DRM_IOCTL_I915_GEM_GET_APERTURE, &aperture);
 	if (aperture.aper_size == 0)
 		aperture.aper_size = 64*1024*1024;
 
@@ -1953,7 +2350,7 @@ static int get_gtt_type(int fd)
         p.param = I915_PARAM_HAS_ALIASING_PPGTT;
         p.value = &val;
 
-	drmIoctl(fd, DRM_IOCTL_I915_GETPARAM, &p);
+	do_ioctl(fd, DRM_IOCTL_I915_GETPARAM, &p);
 	return val;
 }
 
@@ -2046,6 +2443,10 @@ void kgem_init(struct kgem *kgem, int fd, struct pci_device *dev, unsigned gen)
 	DBG(("%s: has handle-lut? %d\n", __FUNCTION__,
 	     kgem->has_handle_lut));
 
+	kgem->has_exec_fence = test_has_exec_fence(kgem);
+	DBG(("%s: has exec-fence? %d\n", __FUNCTION__,
+	     kgem->has_exec_fence));
+
 	kgem->has_semaphores = false;
 	if (kgem->has_blt && test_has_semaphores_enabled(kgem))
 		kgem->has_semaphores = true;
@@ -2123,6 +2524,22 @@ void kgem_init(struct kgem *kgem, int fd, struct pci_device *dev, unsigned gen)
 
 	kgem->has_full_ppgtt = get_gtt_type(fd) > 1;
 
+	kgem->has_softpin = test_has_softpin(kgem);
+	if (kgem->has_softpin) {
+		/* Without EXEC_OBJECT_SUPPORTS_48B_ADDRESS the kernel
+		 * keeps every object below 4GiB, less the last page.
+		 */
+		kgem->va.next = KGEM_VA_START;
+		kgem->va.end = get_context_gtt_size(fd);
+		if (kgem->va.end == 0 || kgem->va.end > (1ull << 32) - PAGE_SIZE)
+			kgem->va.end = (1ull << 32) - PAGE_SIZE;
+		if (kgem->va.end <= kgem->va.next)
+			kgem->has_softpin = false;
+	}
+	DBG(("%s: has softpin? %d, va range [%llx, %llx]\n", __FUNCTION__,
+	     kgem->has_softpin,
+	     (long long)kgem->va.next, (long long)kgem->va.end));
+
 	gtt_size = get_gtt_size(fd);
 	kgem->aperture_total = gtt_size;
 	kgem->aperture_high = gtt_size * 3/4;
@@ -2492,6 +2909,8 @@ kgem_add_handle(struct kgem *kgem, struct kgem_bo *bo)
 	bo->target_handle = kgem->has_handle_lut ? kgem->nexec : bo->handle;
 	exec = memset(&kgem->exec[kgem->nexec++], 0, sizeof(*exec));
 	exec->handle = bo->handle;
+	if (kgem->has_softpin && kgem_bo_softpin(kgem, bo))
+		exec->flags = LOCAL_EXEC_OBJECT_PINNED;
 	exec->offset = bo->presumed_offset;
 
 	kgem->aperture += num_pages(bo);
@@ -2550,18 +2969,6 @@ static uint32_t kgem_end_batch(struct kgem *kgem)
 	return kgem->nbatch;
 }
 
-static void kgem_bo_binding_free(struct kgem *kgem, struct kgem_bo *bo)
-{
-	struct kgem_bo_binding *b;
-
-	b = bo->binding.next;
-	while (b) {
-		struct kgem_bo_binding *next = b->next;
-		free(b);
-		b = next;
-	}
-}
-
 static void kgem_bo_free(struct kgem *kgem, struct kgem_bo *bo)
 {
 	DBG(("%s: handle=%d, size=%d\n", __FUNCTION__, bo->handle, bytes(bo)));
@@ -2570,12 +2977,13 @@ static void kgem_bo_free(struct kgem *kgem, struct kgem_bo *bo)
 	assert(bo->exec == NULL);
 	assert(!bo->snoop || bo->rq == NULL);
 
+	kgem->stats.bo_close++;
+	kgem->stats.bo_bytes -= bytes(bo);
 #ifdef DEBUG_MEMORY
 	kgem->debug_memory.bo_allocs--;
 	kgem->debug_memory.bo_bytes -= bytes(bo);
 #endif
 
-	kgem_bo_binding_free(kgem, bo);
 	kgem_bo_rmfb(kgem, bo);
 
 	if (IS_USER_MAP(bo->map__cpu)) {
@@ -2610,6 +3018,8 @@ static void kgem_bo_free(struct kgem *kgem, struct kgem_bo *bo)
 		munmap(MAP(bo->map__cpu), bytes(bo));
 	}
 
+	kgem_bo_release_va(kgem, bo);
+
 	_list_del(&bo->list);
 	_list_del(&bo->request);
 	gem_close(kgem->fd, bo->handle);
@@ -2997,7 +3407,7 @@ static void __kgem_bo_destroy(struct kgem *kgem, struct kgem_bo *bo)
 	assert(bo->active_scanout == 0);
 	assert_tiling(kgem, bo);
 
-	bo->binding.offset = 0;
+	bo->binding = 0;
 
 	if (DBG_NO_CACHE)
 		goto destroy;
@@ -3241,6 +3651,36 @@ static bool __kgem_retire_rq(struct kgem *kgem, struct kgem_request *rq)
 	return retired;
 }
 
+/* Poll the fences of the oldest requests on the ring all at once,
+ * returning how many of them have completed. Requests on a ring
+ * complete in order, so we stop counting at the first busy one.
+ */
+static int kgem_poll__requests_ring(struct kgem *kgem, int ring)
+{
+	struct pollfd pfd[32];
+	struct kgem_request *rq;
+	int n = 0, i;
+
+	list_for_each_entry(rq, &kgem->requests[ring], list) {
+		if (rq->out_fence == -1 || n == ARRAY_SIZE(pfd))
+			break;
+
+		pfd[n].fd = rq->out_fence;
+		pfd[n].events = POLLIN;
+		pfd[n].revents = 0;
+		n++;
+	}
+	if (n == 0 || poll(pfd, n, 0) < 0)
+		return -1;
+
+	for (i = 0; i < n && pfd[i].revents; i++)
+		;
+
+	DBG(("%s: ring=%d, %d of %d polled requests complete\n",
+	     __FUNCTION__, ring, i, n));
+	return i;
+}
+
 static bool kgem_retire__requests_ring(struct kgem *kgem, int ring)
 {
 	bool retired = false;
@@ -3248,19 +3688,37 @@ static bool kgem_retire__requests_ring(struct kgem *kgem, int ring)
 	assert(ring < ARRAY_SIZE(kgem->requests));
 	while (!list_is_empty(&kgem->requests[ring])) {
 		struct kgem_request *rq;
+		int complete;
 
 		DBG(("%s: retiring ring %d\n", __FUNCTION__, ring));
 
-		rq = list_first_entry(&kgem->requests[ring],
-				      struct kgem_request,
-				      list);
-		assert(rq->ring == ring);
-		assert(rq->bo);
-		assert(RQ(rq->bo->rq) == rq);
-		if (__kgem_busy(kgem, rq->bo->handle))
+		complete = kgem_poll__requests_ring(kgem, ring);
+		if (complete < 0) {
+			/* No fence to poll, ask about the batch instead */
+			rq = list_first_entry(&kgem->requests[ring],
+					      struct kgem_request,
+					      list);
+			assert(rq->ring == ring);
+			assert(rq->bo);
+			assert(RQ(rq->bo->rq) == rq);
+			if (__kgem_busy(kgem, rq->bo->handle))
+				break;
+
+			retired |= __kgem_retire_rq(kgem, rq);
+			continue;
+		}
+
+		if (complete == 0)
 			break;
 
-		retired |= __kgem_retire_rq(kgem, rq);
+		do {
+			rq = list_first_entry(&kgem->requests[ring],
+					      struct kgem_request,
+					      list);
+			assert(rq->ring == ring);
+			assert(RQ(rq->bo->rq) == rq);
+			retired |= __kgem_retire_rq(kgem, rq);
+		} while (--complete);
 	}
 
 #if HAS_DEBUG_FULL
@@ -3309,6 +3767,9 @@ bool kgem_retire(struct kgem *kgem)
 	retired |= kgem_retire__flushing(kgem);
 	retired |= kgem_retire__requests(kgem);
 
+	if (kgem->va.has_busy && !kgem->need_retire)
+		kgem_va_release_busy(kgem);
+
 	DBG(("%s -- retired=%d, need_retire=%d\n",
 	     __FUNCTION__, retired, kgem->need_retire));
 
@@ -3317,6 +3778,46 @@ bool kgem_retire(struct kgem *kgem)
 	return retired;
 }
 
+/* Requests are numbered in the order they are built. Report whether the
+ * request numbered seqno has completed, retiring any of the oldest
+ * requests that have, but without calling back into the render backend.
+ */
+bool kgem_seqno_complete(struct kgem *kgem, uint32_t seqno)
+{
+	int n;
+
+	if ((int32_t)(seqno - kgem_next_seqno(kgem)) >= 0)
+		return false;
+
+	for (n = 0; n < ARRAY_SIZE(kgem->requests); n++) {
+		struct kgem_request *rq;
+
+		if (list_is_empty(&kgem->requests[n]))
+			continue;
+
+		rq = list_first_entry(&kgem->requests[n],
+				      struct kgem_request,
+				      list);
+		if ((int32_t)(seqno - rq->seqno) < 0)
+			continue;
+
+		kgem_retire__requests_ring(kgem, n);
+		if (list_is_empty(&kgem->requests[n]))
+			continue;
+
+		rq = list_first_entry(&kgem->requests[n],
+				      struct kgem_request,
+				      list);
+		if ((int32_t)(seqno - rq->seqno) >= 0) {
+			DBG(("%s: seqno=%u still busy, oldest=%u on ring %d\n",
+			     __FUNCTION__, seqno, rq->seqno, n));
+			return false;
+		}
+	}
+
+	return true;
+}
+
 bool __kgem_ring_is_idle(struct kgem *kgem, int ring)
 {
 	struct kgem_request *rq;
@@ -3328,7 +3829,7 @@ bool __kgem_ring_is_idle(struct kgem *kgem, int ring)
 	if (rq) {
 		struct kgem_request *tmp;
 
-		if (__kgem_busy(kgem, rq->bo->handle)) {
+		if (__kgem_request_busy(kgem, rq)) {
 			DBG(("%s: last fence handle=%d still busy\n",
 			     __FUNCTION__, rq->bo->handle));
 			return false;
@@ -3352,7 +3853,7 @@ bool __kgem_ring_is_idle(struct kgem *kgem, int ring)
 	assert(rq->ring == ring);
 	assert(rq->bo);
 	assert(RQ(rq->bo->rq) == rq);
-	if (__kgem_busy(kgem, rq->bo->handle)) {
+	if (__kgem_request_busy(kgem, rq)) {
 		DBG(("%s: last requests handle=%d still busy\n",
 		     __FUNCTION__, rq->bo->handle));
 		kgem->fence[ring] = rq;
@@ -3464,7 +3965,7 @@ static void kgem_commit(struct kgem *kgem)
 			continue;
 		}
 
-		bo->binding.offset = 0;
+		bo->binding = 0;
 		bo->domain = DOMAIN_GPU;
 		bo->gpu_dirty = false;
 		bo->gtt_dirty = false;
@@ -3514,6 +4015,7 @@ static void kgem_commit(struct kgem *kgem)
 		assert(rq->bo->map__gtt == NULL);
 		assert(rq->bo->map__wc == NULL);
 		assert(rq->bo->map__cpu == NULL);
+		kgem_bo_release_va(kgem, rq->bo);
 		gem_close(kgem->fd, rq->bo->handle);
 		kgem_cleanup_cache(kgem);
 	} else {
@@ -3523,8 +4025,9 @@ static void kgem_commit(struct kgem *kgem)
 		list_add_tail(&rq->list, &kgem->requests[rq->ring]);
 		kgem->need_throttle = kgem->need_retire = 1;
 
+		/* a batch still queued for submission is busy by definition */
 		if (kgem->fence[rq->ring] == NULL &&
-		    __kgem_busy(kgem, rq->bo->handle))
+		    (kgem->submit_pending || __kgem_request_busy(kgem, rq)))
 			kgem->fence[rq->ring] = rq;
 	}
 
@@ -3633,6 +4136,8 @@ static void kgem_finish_buffers(struct kgem *kgem)
 
 					shrink->target_handle =
 						kgem->has_handle_lut ? bo->base.target_handle : shrink->handle;
+					if (kgem->has_softpin && !kgem_bo_softpin(kgem, shrink))
+						bo->base.exec->flags &= ~LOCAL_EXEC_OBJECT_PINNED;
 					for (n = 0; n < kgem->nreloc; n++) {
 						if (kgem->reloc[n].target_handle == bo->base.target_handle) {
 							uint64_t addr = (int)kgem->reloc[n].delta + shrink->presumed_offset;
@@ -3681,6 +4186,8 @@ static void kgem_finish_buffers(struct kgem *kgem)
 							    0, bo->used, bo->mem) == 0) {
 					shrink->target_handle =
 						kgem->has_handle_lut ? bo->base.target_handle : shrink->handle;
+					if (kgem->has_softpin && !kgem_bo_softpin(kgem, shrink))
+						bo->base.exec->flags &= ~LOCAL_EXEC_OBJECT_PINNED;
 					for (n = 0; n < kgem->nreloc; n++) {
 						if (kgem->reloc[n].target_handle == bo->base.target_handle) {
 							uint64_t addr = (int)kgem->reloc[n].delta + shrink->presumed_offset;
@@ -3735,6 +4242,8 @@ static void kgem_cleanup(struct kgem *kgem)
 {
 	int n;
 
+	kgem_submit_wait(kgem);
+
 	for (n = 0; n < ARRAY_SIZE(kgem->requests); n++) {
 		while (!list_is_empty(&kgem->requests[n])) {
 			struct kgem_request *rq;
@@ -3876,7 +4385,7 @@ void kgem_reset(struct kgem *kgem)
 
 			assert(RQ(bo->rq) == rq);
 
-			bo->binding.offset = 0;
+			bo->binding = 0;
 			bo->exec = NULL;
 			bo->target_handle = -1;
 			bo->gpu_dirty = false;
@@ -3910,6 +4419,10 @@ void kgem_reset(struct kgem *kgem)
 	kgem->aperture_max_fence = 0;
 	kgem->nbatch = 0;
 	kgem->surface = kgem->batch_size;
+	if (kgem->nbinding) {
+		memset(kgem->binding, 0, sizeof(kgem->binding));
+		kgem->nbinding = 0;
+	}
 	kgem->mode = KGEM_NONE;
 	kgem->needs_semaphore = false;
 	kgem->needs_reservation = false;
@@ -3938,6 +4451,31 @@ static int compact_batch_surface(struct kgem *kgem, int *shrink)
 	return size * sizeof(uint32_t);
 }
 
+static int kgem_softpin_relocs(struct kgem *kgem)
+{
+	int n, count = 0;
+
+	/* The kernel only needs to see the relocations for the objects
+	 * we failed to assign an address to; everything else in the
+	 * batch already points at its pinned address.
+	 */
+	for (n = 0; n < kgem->nreloc; n++) {
+		assert(kgem->reloc[n].target_handle < kgem->nexec);
+		if (kgem->exec[kgem->reloc[n].target_handle].flags & LOCAL_EXEC_OBJECT_PINNED) {
+			assert(kgem->reloc[n].presumed_offset == kgem->exec[kgem->reloc[n].target_handle].offset);
+			continue;
+		}
+
+		if (count != n)
+			kgem->reloc[count] = kgem->reloc[n];
+		count++;
+	}
+
+	DBG(("%s: %d of %d relocations remaining\n",
+	     __FUNCTION__, count, kgem->nreloc));
+	return count;
+}
+
 static struct kgem_bo *first_available(struct kgem *kgem, struct list *list)
 {
 	struct kgem_bo *bo;
@@ -4041,59 +4579,256 @@ write:
 	return kgem_new_batch(kgem);
 }
 
-#if !NDEBUG
-static bool dump_file(const char *path)
-{
-	FILE *file;
-	size_t len = 0;
-	char *line = NULL;
+#if !NDEBUG
+static bool dump_file(const char *path)
+{
+	FILE *file;
+	size_t len = 0;
+	char *line = NULL;
+
+	file = fopen(path, "r");
+	if (file == NULL)
+		return false;
+
+	while (getline(&line, &len, file) != -1)
+		ErrorF("%s", line);
+
+	free(line);
+	fclose(file);
+	return true;
+}
+
+static void dump_debugfs(struct kgem *kgem, const char *name)
+{
+	char path[80];
+	int minor = kgem_get_minor(kgem);
+
+	if (minor < 0)
+		return;
+
+	sprintf(path, "/sys/kernel/debug/dri/%d/%s", minor, name);
+	if (dump_file(path))
+		return;
+
+	sprintf(path, "/debug/dri/%d/%s", minor, name);
+	if (dump_file(path))
+		return;
+}
+
+static void dump_gtt_info(struct kgem *kgem)
+{
+	dump_debugfs(kgem, "i915_gem_gtt");
+}
+
+static void dump_fence_regs(struct kgem *kgem)
+{
+	dump_debugfs(kgem, "i915_gem_fence_regs");
+}
+#endif
+
+static void *__kgem_submit_thread(void *arg)
+{
+	struct kgem_submit *s = arg;
+	sigset_t signals;
+
+	/* Leave the signals X uses for IO to the main thread */
+	sigfillset(&signals);
+	sigdelset(&signals, SIGBUS);
+	sigdelset(&signals, SIGSEGV);
+	pthread_sigmask(SIG_SETMASK, &signals, NULL);
+
+	pthread_mutex_lock(&s->mutex);
+	while (1) {
+		unsigned long cmd;
+		uint64_t start;
+		int ret;
+
+		while (s->state != SUBMIT_QUEUED && s->state != SUBMIT_EXIT)
+			pthread_cond_wait(&s->cond, &s->mutex);
+		if (s->state == SUBMIT_EXIT)
+			break;
+		pthread_mutex_unlock(&s->mutex);
+
+		cmd = DRM_IOCTL_I915_GEM_EXECBUFFER2;
+		if (s->execbuf.flags & LOCAL_I915_EXEC_FENCE_OUT)
+			cmd = LOCAL_IOCTL_I915_GEM_EXECBUFFER2_WR;
+
+		start = stats_time_us();
+		ret = 0;
+		if (kgem_ioctl(s->fd, cmd, &s->execbuf))
+			ret = __do_ioctl(s->fd, cmd, &s->execbuf);
+		start = stats_time_us() - start;
+
+		pthread_mutex_lock(&s->mutex);
+		s->ret = ret;
+		s->us = start;
+		s->state = SUBMIT_DONE;
+		pthread_cond_broadcast(&s->cond);
+	}
+	pthread_mutex_unlock(&s->mutex);
+
+	return NULL;
+}
+
+/* Returns 0 on success, -ENODEV if the device lacks softpinning and
+ * otherwise a negative errno describing why the thread did not start.
+ */
+int kgem_init_submit_thread(struct kgem *kgem)
+{
+	struct kgem_submit *s;
+	int err;
+
+	if (DBG_NO_ASYNC_SUBMIT)
+		return -ENOTSUP;
+
+	/* Without softpinning, the offsets written back by the kernel are
+	 * required before the next batch can be relocated.
+	 */
+	if (!kgem->has_softpin)
+		return -ENODEV;
+
+	s = malloc(sizeof(*s));
+	if (s == NULL)
+		return -ENOMEM;
+
+	pthread_mutex_init(&s->mutex, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	s->state = SUBMIT_IDLE;
+
+	err = pthread_create(&s->thread, NULL, __kgem_submit_thread, s);
+	if (err) {
+		pthread_cond_destroy(&s->cond);
+		pthread_mutex_destroy(&s->mutex);
+		free(s);
+		return -err;
+	}
+
+	DBG(("%s: submission thread started\n", __FUNCTION__));
+	kgem->submit = s;
+	return 0;
+}
+
+void kgem_fini_submit_thread(struct kgem *kgem)
+{
+	struct kgem_submit *s = kgem->submit;
+
+	if (s == NULL)
+		return;
+
+	kgem_submit_wait(kgem);
+
+	pthread_mutex_lock(&s->mutex);
+	assert(s->state == SUBMIT_IDLE);
+	s->state = SUBMIT_EXIT;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
+
+	pthread_join(s->thread, NULL);
+
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->mutex);
+	free(s);
+
+	DBG(("%s: submission thread stopped\n", __FUNCTION__));
+	kgem->submit = NULL;
+}
+
+void __kgem_submit_wait(struct kgem *kgem)
+{
+	struct kgem_submit *s = kgem->submit;
+	int ret;
+
+	assert(kgem->submit_pending);
+	assert(__kgem_submit_pending == kgem);
+
+	pthread_mutex_lock(&s->mutex);
+	while (s->state != SUBMIT_DONE)
+		pthread_cond_wait(&s->cond, &s->mutex);
+	s->state = SUBMIT_IDLE;
+	ret = s->ret;
+	pthread_mutex_unlock(&s->mutex);
+
+	stats_execbuf(kgem, s->us);
+
+	kgem->submit_pending = false;
+	__kgem_submit_pending = NULL;
+
+	DBG(("%s: handle=%d, ret=%d\n", __FUNCTION__, s->rq->bo->handle, ret));
+	if (ret == 0) {
+		if (s->execbuf.flags & LOCAL_I915_EXEC_FENCE_OUT) {
+			s->rq->out_fence = s->execbuf.rsvd2 >> 32;
+			__kgem_out_fences++;
+		}
+	} else if (!kgem->wedged) {
+		/* The request has already been committed, so unlike
+		 * do_execbuf() we cannot evict the caches and try again.
+		 */
+		xf86DrvMsg(kgem_get_screen_index(kgem), X_ERROR,
+			   "Failed to submit rendering commands (%s), disabling acceleration.\n",
+			   strerror(-ret));
+		__kgem_set_wedged(kgem);
+	}
+}
+
+static bool kgem_can_submit_async(struct kgem *kgem, struct kgem_request *rq)
+{
+	int n;
+
+	if (kgem->submit == NULL)
+		return false;
+
+	if (DBG_DUMP || DEBUG_SYNC || SHOW_BATCH_AFTER)
+		return false;
 
-	file = fopen(path, "r");
-	if (file == NULL)
+	if (rq == &kgem->static_request || kgem->nreloc)
 		return false;
 
-	while (getline(&line, &len, file) != -1)
-		ErrorF("%s", line);
+	for (n = 0; n < kgem->nexec; n++)
+		if ((kgem->exec[n].flags & LOCAL_EXEC_OBJECT_PINNED) == 0)
+			return false;
 
-	free(line);
-	fclose(file);
 	return true;
 }
 
-static void dump_debugfs(struct kgem *kgem, const char *name)
+static void kgem_submit_async(struct kgem *kgem,
+			      struct kgem_request *rq,
+			      const struct drm_i915_gem_execbuffer2 *execbuf)
 {
-	char path[80];
-	int minor = kgem_get_minor(kgem);
+	struct kgem_submit *s = kgem->submit;
 
-	if (minor < 0)
-		return;
+	assert(__kgem_submit_pending == NULL);
+	assert(s->state == SUBMIT_IDLE);
 
-	sprintf(path, "/sys/kernel/debug/dri/%d/%s", minor, name);
-	if (dump_file(path))
-		return;
+	memcpy(s->exec, kgem->exec, kgem->nexec * sizeof(kgem->exec[0]));
+	s->execbuf = *execbuf;
+	s->execbuf.buffers_ptr = (uintptr_t)s->exec;
+	s->fd = kgem->fd;
+	s->rq = rq;
 
-	sprintf(path, "/debug/dri/%d/%s", minor, name);
-	if (dump_file(path))
-		return;
-}
+	DBG(("%s: queueing handle=%d, nexec=%d\n",
+	     __FUNCTION__, rq->bo->handle, kgem->nexec));
 
-static void dump_gtt_info(struct kgem *kgem)
-{
-	dump_debugfs(kgem, "i915_gem_gtt");
-}
+	pthread_mutex_lock(&s->mutex);
+	s->state = SUBMIT_QUEUED;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->mutex);
 
-static void dump_fence_regs(struct kgem *kgem)
-{
-	dump_debugfs(kgem, "i915_gem_fence_regs");
+	kgem->submit_pending = true;
+	__kgem_submit_pending = kgem;
 }
-#endif
 
 static int do_execbuf(struct kgem *kgem, struct drm_i915_gem_execbuffer2 *execbuf)
 {
+	unsigned long cmd;
 	int ret;
 
+	/* Only the _WR variant copies the out-fence back to us */
+	cmd = DRM_IOCTL_I915_GEM_EXECBUFFER2;
+	if (execbuf->flags & LOCAL_I915_EXEC_FENCE_OUT)
+		cmd = LOCAL_IOCTL_I915_GEM_EXECBUFFER2_WR;
+
 retry:
-	ret = do_ioctl(kgem->fd, DRM_IOCTL_I915_GEM_EXECBUFFER2, execbuf);
+	ret = do_ioctl(kgem->fd, cmd, execbuf);
 	if (ret == 0)
 		return 0;
 
@@ -4106,7 +4841,7 @@ retry:
 		goto retry;
 
 	/* last gasp */
-	ret = do_ioctl(kgem->fd, DRM_IOCTL_I915_GEM_EXECBUFFER2, execbuf);
+	ret = do_ioctl(kgem->fd, cmd, execbuf);
 	if (ret != -ENOSPC)
 		return ret;
 
@@ -4120,9 +4855,7 @@ retry:
 
 	if (sna_mode_disable(__to_sna(kgem))) {
 		kgem_cleanup_cache(kgem);
-		ret = do_ioctl(kgem->fd,
-			       DRM_IOCTL_I915_GEM_EXECBUFFER2,
-			       execbuf);
+		ret = do_ioctl(kgem->fd, cmd, execbuf);
 		DBG(("%s: last_gasp ret=%d\n", __FUNCTION__, ret));
 		sna_mode_enable(__to_sna(kgem));
 	}
@@ -4159,6 +4892,9 @@ void _kgem_submit(struct kgem *kgem)
 
 	kgem_finish_buffers(kgem);
 
+	if (kgem->capture)
+		__kgem_capture_batch(kgem, batch_end);
+
 #if SHOW_BATCH_BEFORE
 	__kgem_batch_debug(kgem, batch_end);
 #endif
@@ -4174,14 +4910,21 @@ void _kgem_submit(struct kgem *kgem)
 
 		i = kgem->nexec++;
 		kgem->exec[i].handle = rq->bo->handle;
-		kgem->exec[i].relocation_count = kgem->nreloc;
 		kgem->exec[i].relocs_ptr = (uintptr_t)kgem->reloc;
 		kgem->exec[i].alignment = 0;
 		kgem->exec[i].offset = rq->bo->presumed_offset;
 		/* Make sure the kernel releases any fence, ignored if gen4+ */
 		kgem->exec[i].flags = EXEC_OBJECT_NEEDS_FENCE;
+		if (rq->bo->softpin)
+			kgem->exec[i].flags |= LOCAL_EXEC_OBJECT_PINNED;
 		kgem->exec[i].rsvd1 = 0;
 		kgem->exec[i].rsvd2 = 0;
+		if (kgem->has_softpin)
+			kgem->nreloc = kgem_softpin_relocs(kgem);
+		kgem->exec[i].relocation_count = kgem->nreloc;
+		kgem->stats.relocs += kgem->nreloc;
+		if (kgem->nreloc > kgem->stats.max_relocs)
+			kgem->stats.max_relocs = kgem->nreloc;
 
 		rq->bo->exec = &kgem->exec[i];
 		rq->bo->rq = MAKE_REQUEST(rq, kgem->ring); /* useful sanity check */
@@ -4194,6 +4937,10 @@ void _kgem_submit(struct kgem *kgem)
 		if (kgem->gen < 030)
 			execbuf.batch_len = batch_end*sizeof(uint32_t);
 		execbuf.flags = kgem->ring | kgem->batch_flags;
+		if (kgem->has_exec_fence &&
+		    rq != &kgem->static_request &&
+		    __kgem_out_fences < MAX_OUT_FENCES)
+			execbuf.flags |= LOCAL_I915_EXEC_FENCE_OUT;
 
 		if (DBG_DUMP) {
 			int fd = open("/tmp/i915-batchbuffers.dump",
@@ -4205,7 +4952,18 @@ void _kgem_submit(struct kgem *kgem)
 			}
 		}
 
-		ret = do_execbuf(kgem, &execbuf);
+		if (kgem_can_submit_async(kgem, rq)) {
+			kgem_submit_async(kgem, rq, &execbuf);
+			ret = 0;
+		} else {
+			uint64_t start = stats_time_us();
+			ret = do_execbuf(kgem, &execbuf);
+			stats_execbuf(kgem, stats_time_us() - start);
+			if (ret == 0 && execbuf.flags & LOCAL_I915_EXEC_FENCE_OUT) {
+				rq->out_fence = execbuf.rsvd2 >> 32;
+				__kgem_out_fences++;
+			}
+		}
 	} else
 		ret = -ENOMEM;
 
@@ -4385,6 +5143,120 @@ void kgem_clean_large_cache(struct kgem *kgem)
 	}
 }
 
+struct stats_cache {
+	unsigned count;
+	uint64_t bytes;
+};
+
+static void stats_cache_add(struct stats_cache *c, struct list *head)
+{
+	struct kgem_bo *bo;
+
+	list_for_each_entry(bo, head, list) {
+		c->count++;
+		c->bytes += bytes(bo);
+	}
+}
+
+/* Summarise the counters as "name value..." lines of text, returning
+ * the length written (truncated to fit).
+ */
+int kgem_stats_print(struct kgem *kgem, char *buf, int size)
+{
+	static const char *const mmap_names[] = { "gtt", "wc", "cpu" };
+	const struct kgem_stats *st = &kgem->stats;
+	struct stats_cache active = { 0 }, inactive = { 0 }, large = { 0 };
+	struct stats_cache snoop = { 0 }, scanout = { 0 };
+	struct kgem_request *rq;
+	int len = 0, count, n, i, j;
+
+#define OUT(...) do { \
+	n = snprintf(buf + len, size - len, __VA_ARGS__); \
+	if (n < 0 || n >= size - len) \
+		return len; \
+	len += n; \
+} while (0)
+
+	for (i = 0; i < ARRAY_SIZE(kgem->inactive); i++) {
+		for (j = 0; j < ARRAY_SIZE(kgem->active[i]); j++)
+			stats_cache_add(&active, &kgem->active[i][j]);
+		stats_cache_add(&inactive, &kgem->inactive[i]);
+	}
+	stats_cache_add(&large, &kgem->large);
+	stats_cache_add(&large, &kgem->large_inactive);
+	stats_cache_add(&snoop, &kgem->snoop);
+	stats_cache_add(&scanout, &kgem->scanout);
+
+	OUT("bo created %llu closed %llu bytes %llu\n",
+	    (unsigned long long)st->bo_create,
+	    (unsigned long long)st->bo_close,
+	    (unsigned long long)st->bo_bytes);
+	OUT("cache active %u %llu\n", active.count, (unsigned long long)active.bytes);
+	OUT("cache inactive %u %llu\n", inactive.count, (unsigned long long)inactive.bytes);
+	OUT("cache large %u %llu\n", large.count, (unsigned long long)large.bytes);
+	OUT("cache snoop %u %llu\n", snoop.count, (unsigned long long)snoop.bytes);
+	OUT("cache scanout %u %llu\n", scanout.count, (unsigned long long)scanout.bytes);
+	OUT("vma gtt %d cpu %d\n", kgem->vma[MAP_GTT].count, kgem->vma[MAP_CPU].count);
+
+	for (i = 0; i < KGEM_STATS_ORDERS; i++) {
+		if (st->lookup[i] == 0)
+			continue;
+
+		OUT("lookup %s%d %u miss %u\n",
+		    i == KGEM_STATS_ORDERS - 1 ? ">=" : "",
+		    PAGE_SIZE << i, st->lookup[i], st->miss[i]);
+	}
+	OUT("search linear %llu steps %llu max %u\n",
+	    (unsigned long long)kgem->search_linear.count,
+	    (unsigned long long)kgem->search_linear.steps,
+	    kgem->search_linear.max);
+	OUT("search 2d %llu steps %llu max %u\n",
+	    (unsigned long long)kgem->search_2d.count,
+	    (unsigned long long)kgem->search_2d.steps,
+	    kgem->search_2d.max);
+
+	OUT("execbuf %llu relocs %llu max %u\n",
+	    (unsigned long long)st->execbuf,
+	    (unsigned long long)st->relocs,
+	    st->max_relocs);
+	OUT("binding lookup %llu hit %llu\n",
+	    (unsigned long long)st->binding_lookup,
+	    (unsigned long long)st->binding_hit);
+	OUT("execbuf-us");
+	for (i = 0; i < KGEM_STATS_LATENCY; i++)
+		OUT(" %u", st->execbuf_us[i]);
+	OUT("\n");
+
+	for (i = 0; i < ARRAY_SIZE(kgem->requests); i++) {
+		count = 0;
+		list_for_each_entry(rq, &kgem->requests[i], list)
+			count++;
+		OUT("requests %s %d\n", i ? "blt" : "render", count);
+	}
+	OUT("wait %llu us %llu\n",
+	    (unsigned long long)st->wait.count,
+	    (unsigned long long)st->wait.us);
+	OUT("throttle %llu us %llu\n",
+	    (unsigned long long)st->throttle.count,
+	    (unsigned long long)st->throttle.us);
+
+	for (i = 0; i < KGEM_STATS_MMAP_TYPES; i++)
+		OUT("mmap %s %llu\n", mmap_names[i],
+		    (unsigned long long)st->mmap[i]);
+
+	OUT("trim %llu bytes %llu\n",
+	    (unsigned long long)st->trim,
+	    (unsigned long long)st->trim_bytes);
+	OUT("state batches %llu saved %llu\n",
+	    (unsigned long long)st->state_batches,
+	    (unsigned long long)st->state_saved);
+	OUT("aperture batch %u high %u total %u\n",
+	    kgem->aperture, kgem->aperture_high, kgem->aperture_total);
+#undef OUT
+
+	return len;
+}
+
 bool kgem_expire_cache(struct kgem *kgem)
 {
 	time_t now, expire;
@@ -4585,12 +5457,78 @@ bool kgem_cleanup_cache(struct kgem *kgem)
 	return true;
 }
 
+/* Objects are stamped with the time they went idle by the first expiry
+ * after they enter the inactive cache; unstamped objects are the newest.
+ */
+static inline bool inactive_before(struct kgem_bo *a, struct kgem_bo *b)
+{
+	return a->delta - 1 < b->delta - 1;
+}
+
+uint64_t kgem_trim_cache(struct kgem *kgem, uint64_t target)
+{
+	struct kgem_bo *bo;
+	uint64_t size = 0, freed = 0;
+	unsigned int i;
+
+	list_for_each_entry(bo, &kgem->large_inactive, list)
+		size += bytes(bo);
+	for (i = 0; i < ARRAY_SIZE(kgem->inactive); i++)
+		list_for_each_entry(bo, &kgem->inactive[i], list)
+			size += bytes(bo);
+
+	DBG(("%s: inactive %llu bytes, target %llu\n", __FUNCTION__,
+	     (unsigned long long)size, (unsigned long long)target));
+
+	/* Large objects are released at the next expiry regardless */
+	while (size > target && !list_is_empty(&kgem->large_inactive)) {
+		bo = list_last_entry(&kgem->large_inactive,
+				     struct kgem_bo, list);
+		size -= bytes(bo);
+		freed += bytes(bo);
+		kgem_bo_free(kgem, bo);
+	}
+
+	/* Then the least recently used across all buckets, along with
+	 * any mappings they hold in the vma caches.
+	 */
+	while (size > target) {
+		struct kgem_bo *oldest = NULL;
+
+		for (i = 0; i < ARRAY_SIZE(kgem->inactive); i++) {
+			if (list_is_empty(&kgem->inactive[i]))
+				continue;
+
+			bo = list_last_entry(&kgem->inactive[i],
+					     struct kgem_bo, list);
+			if (oldest == NULL || inactive_before(bo, oldest))
+				oldest = bo;
+		}
+		if (oldest == NULL)
+			break;
+
+		DBG(("%s: releasing handle=%d, size=%d, idle since %d\n",
+		     __FUNCTION__, oldest->handle, bytes(oldest), oldest->delta));
+		size -= bytes(oldest);
+		freed += bytes(oldest);
+		kgem_bo_free(kgem, oldest);
+	}
+
+	if (freed) {
+		kgem->stats.trim++;
+		kgem->stats.trim_bytes += freed;
+	}
+
+	return freed;
+}
+
 static struct kgem_bo *
-search_linear_cache(struct kgem *kgem, unsigned int num_pages, unsigned flags)
+__search_linear_cache(struct kgem *kgem, unsigned int num_pages, unsigned flags)
 {
 	struct kgem_bo *bo, *first = NULL;
 	bool use_active = (flags & CREATE_INACTIVE) == 0;
 	struct list *cache;
+	int b, end;
 
 	DBG(("%s: num_pages=%d, flags=%x, use_active? %d, use_large=%d [max=%d]\n",
 	     __FUNCTION__, num_pages, flags, use_active,
@@ -4598,6 +5536,7 @@ search_linear_cache(struct kgem *kgem, unsigned int num_pages, unsigned flags)
 	     MAX_CACHE_SIZE / PAGE_SIZE));
 
 	assert(num_pages);
+	cache_search_begin(&kgem->search_linear);
 
 	if (num_pages >= MAX_CACHE_SIZE / PAGE_SIZE) {
 		DBG(("%s: searching large buffers\n", __FUNCTION__));
@@ -4607,6 +5546,7 @@ retry_large:
 			assert(bo->refcnt == 0);
 			assert(bo->reusable);
 			assert(!bo->scanout);
+			cache_search_step(&kgem->search_linear);
 
 			if (num_pages > num_pages(bo))
 				goto discard;
@@ -4651,7 +5591,7 @@ discard:
 		return NULL;
 	}
 
-	if (!use_active && list_is_empty(inactive(kgem, num_pages))) {
+	if (!use_active && inactive_is_empty(kgem, num_pages)) {
 		DBG(("%s: inactive and cache bucket empty\n",
 		     __FUNCTION__));
 
@@ -4660,7 +5600,7 @@ discard:
 			return NULL;
 		}
 
-		if (list_is_empty(active(kgem, num_pages, I915_TILING_NONE))) {
+		if (active_is_empty(kgem, num_pages, I915_TILING_NONE)) {
 			DBG(("%s: active cache bucket empty\n", __FUNCTION__));
 			return NULL;
 		}
@@ -4670,7 +5610,7 @@ discard:
 			return NULL;
 		}
 
-		if (list_is_empty(inactive(kgem, num_pages))) {
+		if (inactive_is_empty(kgem, num_pages)) {
 			DBG(("%s: active cache bucket still empty after retire\n",
 			     __FUNCTION__));
 			return NULL;
@@ -4681,47 +5621,51 @@ discard:
 		int for_cpu = !!(flags & CREATE_CPU_MAP);
 		DBG(("%s: searching for inactive %s map\n",
 		     __FUNCTION__, for_cpu ? "cpu" : "gtt"));
-		cache = &kgem->vma[for_cpu].inactive[cache_bucket(num_pages)];
-		list_for_each_entry(bo, cache, vma) {
-			assert(for_cpu ? !!bo->map__cpu : (bo->map__gtt || bo->map__wc));
-			assert(bucket(bo) == cache_bucket(num_pages));
-			assert(bo->proxy == NULL);
-			assert(bo->rq == NULL);
-			assert(bo->exec == NULL);
-			assert(!bo->scanout);
+		for (b = cache_bucket(num_pages), end = cache_bucket_end(b); b < end; b++) {
+			cache = &kgem->vma[for_cpu].inactive[b];
+			list_for_each_entry(bo, cache, vma) {
+				assert(for_cpu ? !!bo->map__cpu : (bo->map__gtt || bo->map__wc));
+				assert(bucket(bo) == b);
+				assert(bo->proxy == NULL);
+				assert(bo->rq == NULL);
+				assert(bo->exec == NULL);
+				assert(!bo->scanout);
+				cache_search_step(&kgem->search_linear);
 
-			if (num_pages > num_pages(bo)) {
-				DBG(("inactive too small: %d < %d\n",
-				     num_pages(bo), num_pages));
-				continue;
-			}
+				if (num_pages > num_pages(bo)) {
+					DBG(("inactive too small: %d < %d\n",
+					     num_pages(bo), num_pages));
+					continue;
+				}
 
-			if (bo->purged && !kgem_bo_clear_purgeable(kgem, bo)) {
-				kgem_bo_free(kgem, bo);
-				break;
-			}
+				if (bo->purged && !kgem_bo_clear_purgeable(kgem, bo)) {
+					kgem_bo_free(kgem, bo);
+					goto vma_miss;
+				}
 
-			if (!kgem_set_tiling(kgem, bo, I915_TILING_NONE, 0)) {
-				kgem_bo_free(kgem, bo);
-				break;
-			}
+				if (!kgem_set_tiling(kgem, bo, I915_TILING_NONE, 0)) {
+					kgem_bo_free(kgem, bo);
+					goto vma_miss;
+				}
 
-			kgem_bo_remove_from_inactive(kgem, bo);
-			assert(list_is_empty(&bo->vma));
-			assert(list_is_empty(&bo->list));
+				kgem_bo_remove_from_inactive(kgem, bo);
+				assert(list_is_empty(&bo->vma));
+				assert(list_is_empty(&bo->list));
 
-			assert(bo->tiling == I915_TILING_NONE);
-			assert(bo->pitch == 0);
-			bo->delta = 0;
-			DBG(("  %s: found handle=%d (num_pages=%d) in linear vma cache\n",
-			     __FUNCTION__, bo->handle, num_pages(bo)));
-			assert(use_active || bo->domain != DOMAIN_GPU);
-			assert(!bo->needs_flush);
-			assert_tiling(kgem, bo);
-			ASSERT_MAYBE_IDLE(kgem, bo->handle, !use_active);
-			return bo;
+				assert(bo->tiling == I915_TILING_NONE);
+				assert(bo->pitch == 0);
+				bo->delta = 0;
+				DBG(("  %s: found handle=%d (num_pages=%d) in linear vma cache\n",
+				     __FUNCTION__, bo->handle, num_pages(bo)));
+				assert(use_active || bo->domain != DOMAIN_GPU);
+				assert(!bo->needs_flush);
+				assert_tiling(kgem, bo);
+				ASSERT_MAYBE_IDLE(kgem, bo->handle, !use_active);
+				return bo;
+			}
 		}
 
+vma_miss:
 		if (flags & CREATE_EXACT)
 			return NULL;
 
@@ -4729,90 +5673,94 @@ discard:
 			return NULL;
 	}
 
-	cache = use_active ? active(kgem, num_pages, I915_TILING_NONE) : inactive(kgem, num_pages);
-	list_for_each_entry(bo, cache, list) {
-		assert(bo->refcnt == 0);
-		assert(bo->reusable);
-		assert(!!bo->rq == !!use_active);
-		assert(bo->proxy == NULL);
-		assert(!bo->scanout);
+	for (b = cache_bucket(num_pages), end = cache_bucket_end(b); b < end; b++) {
+		cache = use_active ? &kgem->active[b][I915_TILING_NONE] : &kgem->inactive[b];
+		list_for_each_entry(bo, cache, list) {
+			assert(bo->refcnt == 0);
+			assert(bo->reusable);
+			assert(!!bo->rq == !!use_active);
+			assert(bo->proxy == NULL);
+			assert(!bo->scanout);
+			cache_search_step(&kgem->search_linear);
 
-		if (num_pages > num_pages(bo))
-			continue;
+			if (num_pages > num_pages(bo))
+				continue;
 
-		if (use_active &&
-		    kgem->gen <= 040 &&
-		    bo->tiling != I915_TILING_NONE)
-			continue;
+			if (use_active &&
+			    kgem->gen <= 040 &&
+			    bo->tiling != I915_TILING_NONE)
+				continue;
 
-		if (bo->purged && !kgem_bo_clear_purgeable(kgem, bo)) {
-			kgem_bo_free(kgem, bo);
-			break;
-		}
+			if (bo->purged && !kgem_bo_clear_purgeable(kgem, bo)) {
+				kgem_bo_free(kgem, bo);
+				goto found_near_miss;
+			}
 
-		if (I915_TILING_NONE != bo->tiling) {
-			if (flags & (CREATE_CPU_MAP | CREATE_GTT_MAP))
-				continue;
+			if (I915_TILING_NONE != bo->tiling) {
+				if (flags & (CREATE_CPU_MAP | CREATE_GTT_MAP))
+					continue;
 
-			if (first)
-				continue;
+				if (first)
+					continue;
 
-			if (!kgem_set_tiling(kgem, bo, I915_TILING_NONE, 0))
-				continue;
-		}
-		assert(bo->tiling == I915_TILING_NONE);
-		bo->pitch = 0;
+				if (!kgem_set_tiling(kgem, bo, I915_TILING_NONE, 0))
+					continue;
+			}
+			assert(bo->tiling == I915_TILING_NONE);
+			bo->pitch = 0;
 
-		if (bo->map__gtt || bo->map__wc || bo->map__cpu) {
-			if (flags & (CREATE_CPU_MAP | CREATE_GTT_MAP)) {
-				int for_cpu = !!(flags & CREATE_CPU_MAP);
-				if (for_cpu ? !!bo->map__cpu : (bo->map__gtt || bo->map__wc)){
+			if (bo->map__gtt || bo->map__wc || bo->map__cpu) {
+				if (flags & (CREATE_CPU_MAP | CREATE_GTT_MAP)) {
+					int for_cpu = !!(flags & CREATE_CPU_MAP);
+					if (for_cpu ? !!bo->map__cpu : (bo->map__gtt || bo->map__wc)){
+						if (first != NULL)
+							goto found_near_miss;
+
+						first = bo;
+						continue;
+					}
+				} else {
 					if (first != NULL)
-						break;
+						goto found_near_miss;
 
 					first = bo;
 					continue;
 				}
 			} else {
-				if (first != NULL)
-					break;
-
-				first = bo;
-				continue;
-			}
-		} else {
-			if (flags & CREATE_GTT_MAP && !kgem_bo_can_map(kgem, bo))
-				continue;
+				if (flags & CREATE_GTT_MAP && !kgem_bo_can_map(kgem, bo))
+					continue;
 
-			if (flags & (CREATE_CPU_MAP | CREATE_GTT_MAP)) {
-				if (first != NULL)
-					break;
+				if (flags & (CREATE_CPU_MAP | CREATE_GTT_MAP)) {
+					if (first != NULL)
+						goto found_near_miss;
 
-				first = bo;
-				continue;
+					first = bo;
+					continue;
+				}
 			}
-		}
 
-		if (use_active)
-			kgem_bo_remove_from_active(kgem, bo);
-		else
-			kgem_bo_remove_from_inactive(kgem, bo);
+			if (use_active)
+				kgem_bo_remove_from_active(kgem, bo);
+			else
+				kgem_bo_remove_from_inactive(kgem, bo);
 
-		assert(bo->tiling == I915_TILING_NONE);
-		assert(bo->pitch == 0);
-		bo->delta = 0;
-		DBG(("  %s: found handle=%d (num_pages=%d) in linear %s cache\n",
-		     __FUNCTION__, bo->handle, num_pages(bo),
-		     use_active ? "active" : "inactive"));
-		assert(list_is_empty(&bo->list));
-		assert(list_is_empty(&bo->vma));
-		assert(use_active || bo->domain != DOMAIN_GPU);
-		assert(!bo->needs_flush || use_active);
-		assert_tiling(kgem, bo);
-		ASSERT_MAYBE_IDLE(kgem, bo->handle, !use_active);
-		return bo;
+			assert(bo->tiling == I915_TILING_NONE);
+			assert(bo->pitch == 0);
+			bo->delta = 0;
+			DBG(("  %s: found handle=%d (num_pages=%d) in linear %s cache\n",
+			     __FUNCTION__, bo->handle, num_pages(bo),
+			     use_active ? "active" : "inactive"));
+			assert(list_is_empty(&bo->list));
+			assert(list_is_empty(&bo->vma));
+			assert(use_active || bo->domain != DOMAIN_GPU);
+			assert(!bo->needs_flush || use_active);
+			assert_tiling(kgem, bo);
+			ASSERT_MAYBE_IDLE(kgem, bo->handle, !use_active);
+			return bo;
+		}
 	}
 
+found_near_miss:
 	if (first) {
 		assert(first->tiling == I915_TILING_NONE);
 
@@ -4837,6 +5785,18 @@ discard:
 	return NULL;
 }
 
+static struct kgem_bo *
+search_linear_cache(struct kgem *kgem, unsigned int num_pages, unsigned flags)
+{
+	struct kgem_bo *bo;
+
+	bo = __search_linear_cache(kgem, num_pages, flags);
+
+	kgem->stats.lookup[stats_order(num_pages)]++;
+	kgem->stats.miss[stats_order(num_pages)] += bo == NULL;
+	return bo;
+}
+
 struct kgem_bo *kgem_create_for_name(struct kgem *kgem, uint32_t name)
 {
 	struct drm_gem_open open_arg;
@@ -4874,7 +5834,7 @@ struct kgem_bo *kgem_create_for_name(struct kgem *kgem, uint32_t name)
 	bo->reusable = false;
 	kgem_bo_unclean(kgem, bo);
 
-	debug_alloc__bo(kgem, bo);
+	account_alloc__bo(kgem, bo);
 	return bo;
 }
 
@@ -4937,7 +5897,7 @@ struct kgem_bo *kgem_create_for_prime(struct kgem *kgem, int name, uint32_t size
 	VG_CLEAR(caching);
 	caching.handle = args.handle;
 	caching.caching = kgem->has_llc;
-	(void)drmIoctl(kgem->fd, LOCAL_IOCTL_I915_GEM_GET_CACHING, &caching);
+	(void)do_ioctl(kgem->fd, LOCAL_IOCTL_I915_GEM_GET_CACHING, &caching);
 	DBG(("%s: imported handle=%d has caching %d\n", __FUNCTION__, args.handle, caching.caching));
 	switch (caching.caching) {
 	case 0:
@@ -4966,7 +5926,7 @@ struct kgem_bo *kgem_create_for_prime(struct kgem *kgem, int name, uint32_t size
 		break;
 	}
 
-	debug_alloc__bo(kgem, bo);
+	account_alloc__bo(kgem, bo);
 	return bo;
 #else
 	return NULL;
@@ -5034,7 +5994,7 @@ struct kgem_bo *kgem_create_linear(struct kgem *kgem, int size, unsigned flags)
 		return NULL;
 	}
 
-	debug_alloc__bo(kgem, bo);
+	account_alloc__bo(kgem, bo);
 	return bo;
 }
 
@@ -5285,7 +6245,7 @@ __kgem_bo_create_as_display(struct kgem *kgem, int size, int tiling, int pitch)
 	}
 
 	assert_tiling(kgem, bo);
-	debug_alloc__bo(kgem, bo);
+	account_alloc__bo(kgem, bo);
 
 	return bo;
 }
@@ -5395,7 +6355,7 @@ struct kgem_bo *kgem_create_2d(struct kgem *kgem,
 	struct kgem_bo *bo;
 	uint32_t pitch, tiled_height, size;
 	uint32_t handle;
-	int i, bucket, retry;
+	int i, b, end, bucket, retry;
 	bool exact = flags & (CREATE_EXACT | CREATE_SCANOUT);
 
 	if (tiling < 0)
@@ -5419,6 +6379,8 @@ struct kgem_bo *kgem_create_2d(struct kgem *kgem,
 
 	size /= PAGE_SIZE;
 	bucket = cache_bucket(size);
+	cache_search_begin(&kgem->search_2d);
+	kgem->stats.lookup[stats_order(size)]++;
 
 	if (flags & CREATE_SCANOUT) {
 		struct kgem_bo *last = NULL;
@@ -5549,6 +6511,7 @@ struct kgem_bo *kgem_create_2d(struct kgem *kgem,
 			assert(bo->refcnt == 0);
 			assert(bo->reusable);
 			assert_tiling(kgem, bo);
+			cache_search_step(&kgem->search_2d);
 
 			if (kgem->gen < 040) {
 				if (bo->pitch < pitch) {
@@ -5595,6 +6558,7 @@ large_inactive:
 			assert(bo->reusable);
 			assert(!bo->scanout);
 			assert_tiling(kgem, bo);
+			cache_search_step(&kgem->search_2d);
 
 			if (size > num_pages(bo))
 				continue;
@@ -5638,10 +6602,11 @@ large_inactive:
 		/* We presume that we will need to upload to this bo,
 		 * and so would prefer to have an active VMA.
 		 */
-		cache = &kgem->vma[for_cpu].inactive[bucket];
-		do {
+vma_search:
+		for (b = bucket, end = cache_bucket_end(b); b < end; b++) {
+			cache = &kgem->vma[for_cpu].inactive[b];
 			list_for_each_entry(bo, cache, vma) {
-				assert(bucket(bo) == bucket);
+				assert(bucket(bo) == b);
 				assert(bo->refcnt == 0);
 				assert(!bo->scanout);
 				assert(for_cpu ? !!bo->map__cpu : (bo->map__gtt || bo->map__wc));
@@ -5650,6 +6615,7 @@ large_inactive:
 				assert(list_is_empty(&bo->request));
 				assert(bo->flush == false);
 				assert_tiling(kgem, bo);
+				cache_search_step(&kgem->search_2d);
 
 				if (size > num_pages(bo)) {
 					DBG(("inactive too small: %d < %d\n",
@@ -5668,13 +6634,13 @@ large_inactive:
 						DBG(("inactive GTT vma with wrong tiling: %d < %d\n",
 						     bo->tiling, tiling));
 						kgem_bo_free(kgem, bo);
-						break;
+						goto vma_retire;
 					}
 				}
 
 				if (bo->purged && !kgem_bo_clear_purgeable(kgem, bo)) {
 					kgem_bo_free(kgem, bo);
-					break;
+					goto vma_retire;
 				}
 
 				if (tiling == I915_TILING_NONE)
@@ -5699,12 +6665,15 @@ large_inactive:
 				bo->refcnt = 1;
 				return bo;
 			}
-		} while (!list_is_empty(cache) &&
-			 __kgem_throttle_retire(kgem, flags));
+		}
+vma_retire:
+		if (!vma_is_empty(kgem, for_cpu, size) &&
+		    __kgem_throttle_retire(kgem, flags))
+			goto vma_search;
 
 		if (flags & CREATE_CPU_MAP && !kgem->has_llc) {
-			if (list_is_empty(&kgem->active[bucket][tiling]) &&
-			    list_is_empty(&kgem->inactive[bucket]))
+			if (active_is_empty(kgem, size, tiling) &&
+			    inactive_is_empty(kgem, size))
 				flags &= ~CREATE_CACHED;
 
 			goto create;
@@ -5714,10 +6683,11 @@ large_inactive:
 	if (flags & CREATE_INACTIVE)
 		goto skip_active_search;
 
-	/* Best active match */
+	/* Best active match, from within the next three orders of size */
 	retry = NUM_CACHE_BUCKETS - bucket;
-	if (retry > 3 && (flags & CREATE_TEMPORARY) == 0)
-		retry = 3;
+	if (retry > cache_bucket_span(bucket, 3) &&
+	    (flags & CREATE_TEMPORARY) == 0)
+		retry = cache_bucket_span(bucket, 3);
 search_active:
 	assert(bucket < NUM_CACHE_BUCKETS);
 	cache = &kgem->active[bucket][tiling];
@@ -5732,6 +6702,7 @@ search_active:
 			assert(bo->flush == false);
 			assert(!bo->scanout);
 			assert_tiling(kgem, bo);
+			cache_search_step(&kgem->search_2d);
 
 			if (kgem->gen < 040) {
 				if (bo->pitch < pitch) {
@@ -5782,6 +6753,7 @@ search_active:
 			assert(bo->tiling == tiling);
 			assert(bo->flush == false);
 			assert_tiling(kgem, bo);
+			cache_search_step(&kgem->search_2d);
 
 			if (num_pages(bo) < size)
 				continue;
@@ -5810,6 +6782,7 @@ search_active:
 				assert(!bo->scanout);
 				assert(bo->flush == false);
 				assert_tiling(kgem, bo);
+				cache_search_step(&kgem->search_2d);
 
 				if (num_pages(bo) < size)
 					continue;
@@ -5835,7 +6808,10 @@ search_active:
 				return bo;
 			}
 		}
-	} else if (!exact) { /* allow an active near-miss? */
+	} else if (!exact && retry == 1) { /* allow an active near-miss? */
+		/* The near-miss lists do not depend upon the bucket, so
+		 * only scan them once, on the final pass.
+		 */
 		for (i = tiling; i >= I915_TILING_NONE; i--) {
 			tiled_height = kgem_surface_size(kgem, kgem->has_relaxed_fencing, flags,
 							 width, height, bpp, tiling, &pitch);
@@ -5848,6 +6824,7 @@ search_active:
 				assert(!bo->scanout);
 				assert(bo->flush == false);
 				assert_tiling(kgem, bo);
+				cache_search_step(&kgem->search_2d);
 
 				if (bo->tiling) {
 					if (bo->pitch < pitch) {
@@ -5884,8 +6861,8 @@ search_active:
 skip_active_search:
 	bucket = cache_bucket(size);
 	retry = NUM_CACHE_BUCKETS - bucket;
-	if (retry > 3)
-		retry = 3;
+	if (retry > cache_bucket_span(bucket, 3))
+		retry = cache_bucket_span(bucket, 3);
 search_inactive:
 	/* Now just look for a close match and prefer any currently active */
 	assert(bucket < NUM_CACHE_BUCKETS);
@@ -5896,6 +6873,7 @@ search_inactive:
 		assert(!bo->scanout);
 		assert(bo->flush == false);
 		assert_tiling(kgem, bo);
+		cache_search_step(&kgem->search_2d);
 
 		if (size > num_pages(bo)) {
 			DBG(("inactive too small: %d < %d\n",
@@ -5946,6 +6924,7 @@ search_inactive:
 		list_for_each_entry_reverse(bo, &kgem->active[bucket][tiling], list) {
 			if (bo->exec)
 				break;
+			cache_search_step(&kgem->search_2d);
 
 			if (size > num_pages(bo))
 				continue;
@@ -6001,6 +6980,7 @@ no_retire:
 	}
 
 create:
+	kgem->stats.miss[stats_order(size)]++;
 	if (flags & CREATE_CACHED) {
 		DBG(("%s: no cached bo found, requested not to create a new bo\n", __FUNCTION__));
 		return NULL;
@@ -6043,7 +7023,7 @@ create:
 	assert(bytes(bo) >= bo->pitch * kgem_aligned_height(kgem, height, bo->tiling));
 	assert_tiling(kgem, bo);
 
-	debug_alloc__bo(kgem, bo);
+	account_alloc__bo(kgem, bo);
 
 	DBG(("  new pitch=%d, tiling=%d, handle=%d, id=%d, num_pages=%d [%d], bucket=%d\n",
 	     bo->pitch, bo->tiling, bo->handle, bo->unique_id,
@@ -6156,7 +7136,6 @@ void _kgem_bo_destroy(struct kgem *kgem, struct kgem_bo *bo)
 
 	if (bo->proxy) {
 		assert(!bo->reusable);
-		kgem_bo_binding_free(kgem, bo);
 
 		assert(list_is_empty(&bo->list));
 		_list_del(&bo->vma);
@@ -6210,7 +7189,7 @@ void kgem_scanout_flush(struct kgem *kgem, struct kgem_bo *bo)
 		struct drm_mode_fb_dirty_cmd cmd;
 		memset(&cmd, 0, sizeof(cmd));
 		cmd.fb_id = bo->delta;
-		(void)drmIoctl(kgem->fd, DRM_IOCTL_MODE_DIRTYFB, &cmd);
+		(void)do_ioctl(kgem->fd, DRM_IOCTL_MODE_DIRTYFB, &cmd);
 	}
 
 	/* Whatever actually happens, we can regard the GTT write domain
@@ -6247,6 +7226,10 @@ inline static bool needs_reservation(struct kgem *kgem, struct kgem_bo *bo)
 	if (kgem->needs_reservation)
 		return false;
 
+	/* With softpin we choose the address, the kernel never searches */
+	if (kgem->has_softpin)
+		return false;
+
 	if (bo->presumed_offset)
 		return false;
 
@@ -6759,6 +7742,12 @@ uint64_t kgem_add_reloc64(struct kgem *kgem,
 		kgem->reloc[index].target_handle = bo->target_handle;
 		kgem->reloc[index].presumed_offset = bo->presumed_offset;
 
+		/* Without the relocation, the kernel needs to be told
+		 * about the write for implicit fencing.
+		 */
+		if (read_write_domain & 0x7fff && bo->softpin)
+			bo->exec->flags |= LOCAL_EXEC_OBJECT_WRITE;
+
 		if (read_write_domain & 0x7fff && !bo->gpu_dirty) {
 			assert(!bo->snoop || kgem->can_blt_cpu);
 			__kgem_bo_mark_dirty(bo);
@@ -7097,7 +8086,7 @@ struct kgem_bo *kgem_create_map(struct kgem *kgem,
 
 	bo->unique_id = kgem_get_unique_id(kgem);
 	bo->snoop = !kgem->has_llc;
-	debug_alloc__bo(kgem, bo);
+	account_alloc__bo(kgem, bo);
 
 	if (first_page != (uintptr_t)ptr) {
 		struct kgem_bo *proxy;
@@ -7423,7 +8412,7 @@ create_snoopable_buffer(struct kgem *kgem, unsigned alloc)
 			}
 
 			__kgem_bo_init(&bo->base, handle, alloc);
-			debug_alloc__bo(kgem, &bo->base);
+			account_alloc__bo(kgem, &bo->base);
 			DBG(("%s: created CPU (LLC) handle=%d for buffer, size %d\n",
 			     __FUNCTION__, bo->base.handle, alloc));
 		}
@@ -7459,7 +8448,7 @@ create_snoopable_buffer(struct kgem *kgem, unsigned alloc)
 			}
 
 			__kgem_bo_init(&bo->base, handle, alloc);
-			debug_alloc__bo(kgem, &bo->base);
+			account_alloc__bo(kgem, &bo->base);
 			DBG(("%s: created CPU handle=%d for buffer, size %d\n",
 			     __FUNCTION__, bo->base.handle, alloc));
 		}
@@ -7504,7 +8493,7 @@ free_caching:
 		}
 
 		__kgem_bo_init(&bo->base, handle, alloc);
-		debug_alloc__bo(kgem, &bo->base);
+		account_alloc__bo(kgem, &bo->base);
 		DBG(("%s: created snoop handle=%d for buffer\n",
 		     __FUNCTION__, bo->base.handle));
 
@@ -7675,7 +8664,7 @@ struct kgem_bo *kgem_create_buffer(struct kgem *kgem,
 				goto skip_llc;
 			}
 			__kgem_bo_init(&bo->base, handle, alloc);
-			debug_alloc__bo(kgem, &bo->base);
+			account_alloc__bo(kgem, &bo->base);
 			DBG(("%s: created LLC handle=%d for buffer\n",
 			     __FUNCTION__, bo->base.handle));
 		}
@@ -7840,7 +8829,7 @@ skip_llc:
 			     __FUNCTION__, handle));
 
 			__kgem_bo_init(&bo->base, handle, alloc);
-			debug_alloc__bo(kgem, &bo->base);
+			account_alloc__bo(kgem, &bo->base);
 		}
 
 		assert(bo->mmapped);
@@ -8062,45 +9051,78 @@ void kgem_buffer_read_sync(struct kgem *kgem, struct kgem_bo *_bo)
 	bo->base.domain = DOMAIN_NONE;
 }
 
-uint32_t kgem_bo_get_binding(struct kgem_bo *bo, uint32_t format)
+static inline unsigned binding_hash(uint32_t handle, uint32_t format)
+{
+	return ((handle ^ format) * 0x9e3779b1) >> (32 - KGEM_BINDING_BITS);
+}
+
+static inline struct kgem_binding *
+binding_next(struct kgem *kgem, struct kgem_binding *b)
+{
+	if (++b == kgem->binding + ARRAY_SIZE(kgem->binding))
+		b = kgem->binding;
+	return b;
+}
+
+uint32_t kgem_bo_get_binding(struct kgem *kgem, struct kgem_bo *bo,
+			     uint32_t format)
 {
-	struct kgem_bo_binding *b;
+	struct kgem_binding *b;
 
 	assert(bo->refcnt);
 
-	for (b = &bo->binding; b && b->offset; b = b->next)
-		if (format == b->format)
+	kgem->stats.binding_lookup++;
+	if (bo->binding == 0)
+		return 0;
+
+	for (b = &kgem->binding[binding_hash(bo->handle, format)];
+	     b->offset;
+	     b = binding_next(kgem, b)) {
+		if (b->id == bo->binding &&
+		    b->handle == bo->handle &&
+		    b->format == format) {
+			kgem->stats.binding_hit++;
 			return b->offset;
+		}
+	}
 
 	return 0;
 }
 
-void kgem_bo_set_binding(struct kgem_bo *bo, uint32_t format, uint16_t offset)
+void kgem_bo_set_binding(struct kgem *kgem, struct kgem_bo *bo,
+			 uint32_t format, uint16_t offset)
 {
-	struct kgem_bo_binding *b;
+	struct kgem_binding *b;
 
 	assert(bo->refcnt);
+	assert(offset);
 
-	for (b = &bo->binding; b; b = b->next) {
-		if (b->offset)
-			continue;
-
-		b->offset = offset;
-		b->format = format;
-
-		if (b->next)
-			b->next->offset = 0;
-
+	/* Keep the table sparse; anything more is simply emitted again */
+	if (kgem->nbinding >= 3 * ARRAY_SIZE(kgem->binding) / 4)
 		return;
+
+	if (bo->binding == 0) {
+		if (++kgem->binding_id == 0)
+			++kgem->binding_id;
+		bo->binding = kgem->binding_id;
 	}
 
-	b = malloc(sizeof(*b));
-	if (b) {
-		b->next = bo->binding.next;
-		b->format = format;
-		b->offset = offset;
-		bo->binding.next = b;
+	for (b = &kgem->binding[binding_hash(bo->handle, format)];
+	     b->offset;
+	     b = binding_next(kgem, b)) {
+		if (b->id == bo->binding &&
+		    b->handle == bo->handle &&
+		    b->format == format) {
+			b->offset = offset;
+			return;
+		}
 	}
+
+	b->handle = bo->handle;
+	b->format = format;
+	b->id = bo->binding;
+	b->offset = offset;
+	kgem->nbinding++;
 }
 
 struct kgem_bo *
@@ -8143,7 +9165,7 @@ kgem_replace_bo(struct kgem *kgem,
 			return NULL;
 		}
 
-		debug_alloc__bo(kgem, dst);
+		account_alloc__bo(kgem, dst);
 	}
 	dst->pitch = pitch;
 	dst->unique_id = kgem_get_unique_id(kgem);
@@ -58,11 +58,7 @@ struct kgem_bo {
 	void *map__wc;
 #define MAP(ptr) ((void*)((uintptr_t)(ptr) & ~3))
 
-	struct kgem_bo_binding {
-		struct kgem_bo_binding *next;
-		uint32_t format;
-		uint16_t offset;
-	} binding;
+	uint32_t binding; /* id of its surface state in this batch, or 0 */
 
 	uint64_t presumed_offset;
 	uint32_t unique_id;
@@ -73,11 +69,13 @@ struct kgem_bo {
 	uint32_t active_scanout;
 	union {
 		struct {
-			uint32_t count:27;
+			uint32_t count:25;
 #define PAGE_SIZE 4096
-			uint32_t bucket:5;
-#define NUM_CACHE_BUCKETS 16
-#define MAX_CACHE_SIZE (1 << (NUM_CACHE_BUCKETS+12))
+			uint32_t bucket:7;
+#define CACHE_BUCKET_SHIFT 2 /* buckets per power-of-two, log2 */
+#define NUM_CACHE_BUCKETS (16 << CACHE_BUCKET_SHIFT)
+#define MAX_CACHE_SIZE (1 << (16+12))
+#define KGEM_VA_ORDERS 21 /* 4KiB .. 4GiB */
 		} pages;
 		uint32_t bytes;
 	} size;
@@ -94,6 +92,7 @@ struct kgem_bo {
 	uint32_t scanout : 1;
 	uint32_t prime : 1;
 	uint32_t purged : 1;
+	uint32_t softpin : 1;
 };
 #define DOMAIN_NONE 0
 #define DOMAIN_CPU 1
@@ -105,6 +104,8 @@ struct kgem_request {
 	struct kgem_bo *bo;
 	struct list buffers;
 	unsigned ring;
+	uint32_t seqno;
+	int out_fence; /* sync_file signaled upon completion, or -1 */
 };
 
 enum {
@@ -113,12 +114,21 @@ enum {
 	NUM_MAP_TYPES,
 };
 
+enum {
+	KGEM_STATS_MMAP_GTT = 0,
+	KGEM_STATS_MMAP_WC,
+	KGEM_STATS_MMAP_CPU,
+	KGEM_STATS_MMAP_TYPES,
+};
+
 typedef void (*memcpy_box_func)(const void *src, void *dst, int bpp,
 				int32_t src_stride, int32_t dst_stride,
 				int16_t src_x, int16_t src_y,
 				int16_t dst_x, int16_t dst_y,
 				uint16_t width, uint16_t height);
 
+typedef int (*kgem_ioctl_func)(int fd, unsigned long request, void *arg);
+
 struct kgem {
 	unsigned wedged;
 	int fd;
@@ -158,12 +168,61 @@ struct kgem {
 	struct kgem_request *fence[2];
 	struct kgem_request *next_request;
 	struct kgem_request static_request;
+	uint32_t seqno;
+
+	/* Optional thread issuing execbuf on our behalf, so that the next
+	 * batch can be built whilst the kernel processes this one.
+	 */
+	struct kgem_submit *submit;
+	bool submit_pending;
+
+	struct kgem_capture *capture;
 
 	struct {
 		struct list inactive[NUM_CACHE_BUCKETS];
 		int16_t count;
 	} vma[NUM_MAP_TYPES];
 
+	/* How many cached bo were inspected to satisfy each allocation */
+	struct kgem_cache_search {
+		uint64_t count, steps;
+		uint32_t current, max;
+	} search_linear, search_2d;
+
+	/* Always-on counters, reported by kgem_stats_print() */
+	struct kgem_stats {
+#define KGEM_STATS_ORDERS 17 /* lookups by power-of-two pages, last is large */
+#define KGEM_STATS_LATENCY 16 /* execbuf by power-of-two microseconds */
+		uint32_t lookup[KGEM_STATS_ORDERS], miss[KGEM_STATS_ORDERS];
+		uint64_t bo_create, bo_close, bo_bytes;
+		uint64_t execbuf, relocs;
+		uint32_t max_relocs;
+		uint32_t execbuf_us[KGEM_STATS_LATENCY];
+		struct kgem_stats_stall {
+			uint64_t count, us;
+		} wait, throttle;
+		uint64_t mmap[KGEM_STATS_MMAP_TYPES];
+		uint64_t binding_lookup, binding_hit;
+		uint64_t trim, trim_bytes;
+		uint64_t state_batches, state_saved;
+	} stats;
+
+	/* Most bytes to keep in the inactive caches, 0 for no limit */
+	uint64_t cache_budget;
+
+	/* GPU virtual addresses handed out for softpinning, in blocks of
+	 * power-of-two pages. Blocks released whilst their bo may still be
+	 * active are held back until the GPU is next idle.
+	 */
+	struct kgem_va {
+		uint64_t next, end;
+		struct kgem_va_list {
+			uint64_t *addr;
+			unsigned count, size;
+		} free[KGEM_VA_ORDERS], busy[KGEM_VA_ORDERS];
+		bool has_busy;
+	} va;
+
 	uint32_t bcs_state;
 
 	uint32_t batch_flags;
@@ -198,6 +257,8 @@ struct kgem {
 	uint32_t has_handle_lut :1;
 	uint32_t has_wc_mmap :1;
 	uint32_t has_dirtyfb :1;
+	uint32_t has_softpin :1;
+	uint32_t has_exec_fence :1;
 
 	uint32_t can_fence :1;
 	uint32_t can_blt_cpu :1;
@@ -227,6 +288,20 @@ struct kgem {
 	struct kgem_bo *batch_bo;
 
 	uint16_t reloc__self[256];
+
+	/* Offsets of the surface states emitted into this batch, hashed by
+	 * (handle, format) and checked against the bo's binding id.
+	 */
+	struct kgem_binding {
+		uint32_t handle;
+		uint32_t format;
+		uint32_t id;
+		uint32_t offset;
+#define KGEM_BINDING_BITS 9
+	} binding[1 << KGEM_BINDING_BITS];
+	uint32_t binding_id;
+	uint16_t nbinding;
+
 	struct drm_i915_gem_exec_object2 exec[384] page_aligned;
 	struct drm_i915_gem_relocation_entry reloc[8192] page_aligned;
 
@@ -252,6 +327,7 @@ struct kgem {
 #define KGEM_EXEC_SIZE(K) (int)(ARRAY_SIZE((K)->exec)-KGEM_EXEC_RESERVED)
 #define KGEM_RELOC_SIZE(K) (int)(ARRAY_SIZE((K)->reloc)-KGEM_RELOC_RESERVED)
 
+void kgem_set_ioctl(kgem_ioctl_func func);
 void kgem_init(struct kgem *kgem, int fd, struct pci_device *dev, unsigned gen);
 void kgem_reset(struct kgem *kgem);
 
@@ -328,10 +404,18 @@ bool kgem_bo_convert_to_gpu(struct kgem *kgem,
 			    unsigned flags);
 
 bool kgem_bo_is_fenced(struct kgem *kgem, struct kgem_bo *bo);
-uint32_t kgem_bo_get_binding(struct kgem_bo *bo, uint32_t format);
-void kgem_bo_set_binding(struct kgem_bo *bo, uint32_t format, uint16_t offset);
+uint32_t kgem_bo_get_binding(struct kgem *kgem, struct kgem_bo *bo,
+			     uint32_t format);
+void kgem_bo_set_binding(struct kgem *kgem, struct kgem_bo *bo,
+			 uint32_t format, uint16_t offset);
 
 bool kgem_retire(struct kgem *kgem);
+bool kgem_seqno_complete(struct kgem *kgem, uint32_t seqno);
+static inline uint32_t kgem_next_seqno(struct kgem *kgem)
+{
+	assert(kgem->next_request);
+	return kgem->next_request->seqno;
+}
 void kgem_retire__buffers(struct kgem *kgem);
 
 static inline bool kgem_bo_discard_cache(struct kgem_bo *bo, bool force)
@@ -378,6 +462,18 @@ static inline bool __kgem_ring_empty(struct kgem *kgem)
 }
 
 void _kgem_submit(struct kgem *kgem);
+int kgem_init_submit_thread(struct kgem *kgem);
+void kgem_fini_submit_thread(struct kgem *kgem);
+void __kgem_submit_wait(struct kgem *kgem);
+bool kgem_capture_open(struct kgem *kgem, const char *path, bool buffers);
+void kgem_capture_close(struct kgem *kgem);
+void __kgem_capture_batch(struct kgem *kgem, uint32_t nbatch);
+static inline void kgem_submit_wait(struct kgem *kgem)
+{
+	if (kgem->submit_pending)
+		__kgem_submit_wait(kgem);
+}
+
 static inline void kgem_submit(struct kgem *kgem)
 {
 	if (kgem->nbatch)
@@ -386,11 +482,14 @@ static inline void kgem_submit(struct kgem *kgem)
 
 static inline void kgem_bo_submit(struct kgem *kgem, struct kgem_bo *bo)
 {
-	if (bo->exec == NULL)
-		return;
-
-	assert(bo->refcnt);
-	_kgem_submit(kgem);
+	/* Callers hand the bo to the kernel themselves next, so the batch
+	 * must have been received by the kernel upon return.
+	 */
+	if (bo->exec) {
+		assert(bo->refcnt);
+		_kgem_submit(kgem);
+	}
+	kgem_submit_wait(kgem);
 }
 
 void kgem_scanout_flush(struct kgem *kgem, struct kgem_bo *bo);
@@ -857,10 +956,13 @@ void kgem_throttle(struct kgem *kgem);
 #define MAX_INACTIVE_TIME 10
 bool kgem_expire_cache(struct kgem *kgem);
 bool kgem_cleanup_cache(struct kgem *kgem);
+uint64_t kgem_trim_cache(struct kgem *kgem, uint64_t target);
 
 void kgem_clean_scanout_cache(struct kgem *kgem);
 void kgem_clean_large_cache(struct kgem *kgem);
 
+int kgem_stats_print(struct kgem *kgem, char *buf, int size);
+
 #if HAS_DEBUG_FULL
 void __kgem_batch_debug(struct kgem *kgem, uint32_t nbatch);
 #else
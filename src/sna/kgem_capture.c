@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "sna.h"
+#include "kgem_capture.h"
+
+struct kgem_capture {
+	int fd;
+	bool buffers;
+	struct kgem_capture_exec exec[ARRAY_SIZE(((struct kgem *)0)->exec)];
+	struct kgem_capture_reloc reloc[ARRAY_SIZE(((struct kgem *)0)->reloc)];
+};
+
+static bool write_all(int fd, struct iovec *iov, int count)
+{
+	while (count) {
+		ssize_t ret;
+
+		ret = writev(fd, iov, count);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return false;
+		}
+
+		while (count && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++, count--;
+		}
+		if (count) {
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return true;
+}
+
+bool kgem_capture_open(struct kgem *kgem, const char *path, bool buffers)
+{
+	struct kgem_capture_header header;
+	struct kgem_capture *c;
+	struct iovec iov;
+
+	assert(kgem->capture == NULL);
+
+	c = malloc(sizeof(*c));
+	if (c == NULL)
+		return false;
+
+	c->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (c->fd == -1) {
+		free(c);
+		return false;
+	}
+	c->buffers = buffers;
+
+	header.magic = KGEM_CAPTURE_MAGIC;
+	header.version = KGEM_CAPTURE_VERSION;
+	header.gen = kgem->gen;
+	header.flags = 0;
+	if (kgem->has_llc)
+		header.flags |= KGEM_CAPTURE_LLC;
+	if (kgem->has_softpin)
+		header.flags |= KGEM_CAPTURE_SOFTPIN;
+	if (buffers)
+		header.flags |= KGEM_CAPTURE_BUFFERS;
+
+	iov.iov_base = &header;
+	iov.iov_len = sizeof(header);
+	if (!write_all(c->fd, &iov, 1)) {
+		close(c->fd);
+		free(c);
+		return false;
+	}
+
+	kgem->capture = c;
+	return true;
+}
+
+void kgem_capture_close(struct kgem *kgem)
+{
+	struct kgem_capture *c = kgem->capture;
+
+	if (c == NULL)
+		return;
+
+	close(c->fd);
+	free(c);
+	kgem->capture = NULL;
+}
+
+static void capture_failed(struct kgem *kgem)
+{
+	ErrorF("SNA: failed to write batch capture (errno=%d), stopping\n",
+	       errno);
+	kgem_capture_close(kgem);
+}
+
+static bool capture_buffer(struct kgem *kgem, struct kgem_bo *bo)
+{
+	struct kgem_capture_record record;
+	struct kgem_capture_buffer buffer;
+	struct iovec iov[3];
+	void *ptr;
+
+	ptr = kgem_bo_map__debug(kgem, bo);
+	if (ptr == NULL)
+		return true;
+
+	buffer.handle = bo->handle;
+	buffer.size = kgem_bo_size(bo);
+
+	record.type = KGEM_CAPTURE_BUFFER;
+	record.length = sizeof(buffer) + buffer.size;
+
+	iov[0].iov_base = &record;
+	iov[0].iov_len = sizeof(record);
+	iov[1].iov_base = &buffer;
+	iov[1].iov_len = sizeof(buffer);
+	iov[2].iov_base = ptr;
+	iov[2].iov_len = buffer.size;
+
+	return write_all(kgem->capture->fd, iov, 3);
+}
+
+static uint32_t capture_target(struct kgem *kgem, uint32_t target)
+{
+	int n;
+
+	if (target == ~0U) /* self-relocation, fixed up with the batch */
+		return kgem->nexec;
+
+	if (kgem->has_handle_lut)
+		return target;
+
+	for (n = 0; n < kgem->nexec; n++)
+		if (kgem->exec[n].handle == target)
+			break;
+	return n;
+}
+
+void __kgem_capture_batch(struct kgem *kgem, uint32_t nbatch)
+{
+	struct kgem_capture *c = kgem->capture;
+	struct kgem_capture_record record;
+	struct kgem_capture_batch batch;
+	struct kgem_bo *bo;
+	struct timespec ts;
+	struct iovec iov[6];
+	int n;
+
+	assert(kgem->nexec <= ARRAY_SIZE(c->exec));
+	assert(kgem->nreloc <= ARRAY_SIZE(c->reloc));
+
+	for (n = 0; n < kgem->nexec; n++) {
+		c->exec[n].handle = kgem->exec[n].handle;
+		c->exec[n].size = 0;
+		c->exec[n].tiling = 0;
+		c->exec[n].pitch = 0;
+		c->exec[n].offset = kgem->exec[n].offset;
+		c->exec[n].flags = kgem->exec[n].flags;
+	}
+
+	list_for_each_entry(bo, &kgem->next_request->buffers, request) {
+		if (bo->exec == NULL || bo->proxy)
+			continue;
+
+		n = bo->exec - kgem->exec;
+		assert(n >= 0 && n < kgem->nexec);
+		c->exec[n].size = kgem_bo_size(bo);
+		c->exec[n].tiling = bo->tiling;
+		c->exec[n].pitch = bo->pitch;
+
+		if (c->buffers && !capture_buffer(kgem, bo))
+			goto err;
+	}
+
+	for (n = 0; n < kgem->nreloc; n++) {
+		c->reloc[n].offset = kgem->reloc[n].offset;
+		c->reloc[n].target = capture_target(kgem, kgem->reloc[n].target_handle);
+		c->reloc[n].delta = kgem->reloc[n].delta;
+		c->reloc[n].read_domains = kgem->reloc[n].read_domains;
+		c->reloc[n].write_domain = kgem->reloc[n].write_domain;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	batch.timestamp = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	batch.ring = kgem->ring;
+	batch.mode = kgem->mode;
+	batch.nbatch = nbatch;
+	batch.surface = kgem->surface;
+	batch.batch_size = kgem->batch_size;
+	batch.nexec = kgem->nexec;
+	batch.nreloc = kgem->nreloc;
+	batch.pad = 0;
+
+	iov[0].iov_base = &record;
+	iov[0].iov_len = sizeof(record);
+	iov[1].iov_base = &batch;
+	iov[1].iov_len = sizeof(batch);
+	iov[2].iov_base = c->exec;
+	iov[2].iov_len = kgem->nexec * sizeof(c->exec[0]);
+	iov[3].iov_base = c->reloc;
+	iov[3].iov_len = kgem->nreloc * sizeof(c->reloc[0]);
+	iov[4].iov_base = kgem->batch;
+	iov[4].iov_len = nbatch * sizeof(uint32_t);
+	iov[5].iov_base = kgem->batch + kgem->surface;
+	iov[5].iov_len = (kgem->batch_size - kgem->surface) * sizeof(uint32_t);
+
+	record.type = KGEM_CAPTURE_BATCH;
+	record.length = 0;
+	for (n = 1; n < ARRAY_SIZE(iov); n++)
+		record.length += iov[n].iov_len;
+
+	if (write_all(c->fd, iov, ARRAY_SIZE(iov)))
+		return;
+
+err:
+	capture_failed(kgem);
+}
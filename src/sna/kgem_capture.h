@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef KGEM_CAPTURE_H
+#define KGEM_CAPTURE_H
+
+#include <stdint.h>
+
+/* The batch trace written by the "BatchCapture" option.
+ *
+ * The file starts with a kgem_capture_header, followed by a sequence of
+ * records, each a kgem_capture_record giving the type and the length of
+ * its payload (always a multiple of 4 bytes). All values are in host
+ * byte order.
+ *
+ * A BATCH record is captured as kgem hands the batch over for submission,
+ * before it is packed into its bo. Its payload is a kgem_capture_batch,
+ * then nexec kgem_capture_exec, then nreloc kgem_capture_reloc, then the
+ * nbatch command dwords, then the (batch_size - surface) dwords of
+ * indirect state that the render backends build down from the end of the
+ * batch. Relocation offsets are in bytes from the start of the batch, in
+ * the same coordinates as the two blocks of dwords.
+ *
+ * If buffer contents are also captured, each BATCH record is preceded by
+ * a BUFFER record for every object in its exec list, holding a
+ * kgem_capture_buffer followed by the contents as seen before execution.
+ */
+
+#define KGEM_CAPTURE_MAGIC 0x54414e53 /* "SNAT" */
+#define KGEM_CAPTURE_VERSION 1
+
+struct kgem_capture_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t gen;		/* as kgem->gen, octal */
+	uint32_t flags;
+#define KGEM_CAPTURE_LLC	0x1
+#define KGEM_CAPTURE_SOFTPIN	0x2
+#define KGEM_CAPTURE_BUFFERS	0x4
+};
+
+enum {
+	KGEM_CAPTURE_BATCH = 1,
+	KGEM_CAPTURE_BUFFER,
+};
+
+struct kgem_capture_record {
+	uint32_t type;
+	uint32_t length;
+};
+
+struct kgem_capture_batch {
+	uint64_t timestamp;	/* CLOCK_MONOTONIC, in microseconds */
+	uint32_t ring;		/* KGEM_RENDER or KGEM_BLT */
+	uint32_t mode;
+	uint32_t nbatch;	/* including MI_BATCH_BUFFER_END */
+	uint32_t surface;
+	uint32_t batch_size;
+	uint32_t nexec;		/* excluding the batch itself */
+	uint32_t nreloc;
+	uint32_t pad;
+};
+
+struct kgem_capture_exec {
+	uint32_t handle;
+	uint32_t size;
+	uint32_t tiling;
+	uint32_t pitch;
+	uint64_t offset;	/* presumed */
+	uint64_t flags;
+};
+
+struct kgem_capture_reloc {
+	uint32_t offset;
+	uint32_t target;	/* index into the exec list, nexec for the batch */
+	int32_t delta;
+	uint32_t read_domains;
+	uint32_t write_domain;
+};
+
+struct kgem_capture_buffer {
+	uint32_t handle;
+	uint32_t size;
+};
+
+#endif /* KGEM_CAPTURE_H */
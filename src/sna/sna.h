@@ -173,7 +173,8 @@ struct sna_pixmap {
 struct sna_glyph {
 	PicturePtr atlas;
 	struct sna_coordinate coordinate;
-	uint16_t size, pos;
+	uint8_t size, used;
+	uint16_t pos;
 	pixman_image_t *image;
 };
 
@@ -274,6 +275,7 @@ struct sna {
 #define SNA_HAS_ASYNC_FLIP	0x20000
 #define SNA_LINEAR_FB		0x40000
 #define SNA_NO_THROTTLE		0x80000
+#define SNA_STATISTICS		0x100000
 #define SNA_REPROBE		0x80000000
 
 	unsigned cpu_features;
@@ -301,6 +303,7 @@ struct sna {
 	struct timeval timer_tv;
 	uint32_t timer_expire[NUM_TIMERS];
 	uint16_t timer_active;
+	uint32_t stats_time;
 
 	struct list flush_pixmaps;
 	struct list active_pixmaps;
@@ -453,6 +456,20 @@ struct sna {
 		char event[256];
 	} acpi;
 
+	struct {
+		int psi;
+		int events;
+		uint64_t high;
+		uint32_t time;
+	} pressure;
+
+	struct list shm_segments;
+
+	struct {
+		const char *path;
+		char build_id[65];
+	} kernel_cache;
+
 	struct sna_render render;
 
 #if DEBUG_MEMORY
@@ -1364,12 +1381,60 @@ static inline void sna_acpi_wakeup(struct sna *sna, void *read_mask)
 }
 void sna_acpi_fini(struct sna *sna);
 
+/* sna_pressure.c */
+void sna_pressure_init(struct sna *sna, bool monitor);
+void sna_pressure_check(struct sna *sna);
+static inline bool sna_pressure_enabled(struct sna *sna)
+{
+	return sna->kgem.cache_budget ||
+		sna->pressure.psi >= 0 || sna->pressure.events >= 0;
+}
+void sna_pressure_fini(struct sna *sna);
+
+/* sna_shm.c */
+void sna_shm_init(struct sna *sna);
+void sna_shm_create(struct sna *sna);
+struct kgem_bo *sna_shm_map(struct sna *sna, void *ptr, int size, bool write);
+void sna_shm_fini(struct sna *sna);
+
+/* Every caller of sna_use_threads() carries its own cost model, learnt
+ * from timing the threaded operations it launches.
+ */
+struct sna_threads_site {
+	const char *func;
+	int line;
+	int threshold;
+
+	struct sna_threads_site *next;
+	unsigned calls, threaded, samples;
+
+	/* decayed normal equations for
+	 *   t = serial * P + cost * P/n + overhead * (n-1)
+	 */
+	double sxx[3][3], sxt[3];
+	double serial; /* ns per pixel that does not scale with threads */
+	double cost; /* ns per pixel that does */
+	double overhead; /* ns per additional thread */
+};
+
 void sna_threads_init(void);
-int sna_use_threads (int width, int height, int threshold);
+int __sna_use_threads(struct sna_threads_site *site,
+		      int width, int height);
+#define sna_use_threads(width, height, threshold) ({ \
+	static struct sna_threads_site __site__ = { \
+		__FUNCTION__, __LINE__, threshold \
+	}; \
+	__sna_use_threads(&__site__, width, height); \
+})
+void sna_threads_dump(int verb);
 void sna_threads_run(int id, void (*func)(void *arg), void *arg);
 void sna_threads_trap(int sig);
 void sna_threads_wait(void);
 void sna_threads_kill(void);
+void sna_threads_parallel_for(int num_threads, int count, int tile,
+			      void (*func)(void *arg, int start, int end),
+			      void *arg);
+int sna_threads_band(int num_threads, int height);
 
 void sna_image_composite(pixman_op_t        op,
 			 pixman_image_t    *src,
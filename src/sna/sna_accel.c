@@ -51,6 +51,8 @@
 #include <shmint.h>
 
 #include <X11/extensions/damageproto.h>
+#include <X11/Xatom.h>
+#include <property.h>
 
 #include <sys/time.h>
 #include <sys/mman.h>
@@ -5094,7 +5096,9 @@ try_upload__blt(PixmapPtr pixmap, RegionRec *region,
 		return false;
 	}
 
-	src_bo = kgem_create_map(&sna->kgem, bits, stride * h, true);
+	src_bo = sna_shm_map(sna, bits, stride * h, false);
+	if (src_bo == NULL)
+		src_bo = kgem_create_map(&sna->kgem, bits, stride * h, true);
 	if (src_bo == NULL)
 		return false;
 
@@ -17162,9 +17166,13 @@ sna_get_image__blt(PixmapPtr pixmap,
 
 	pitch = PixmapBytePad(region->extents.x2 - region->extents.x1,
 			      pixmap->drawable.depth);
-	dst_bo = kgem_create_map(&sna->kgem, dst,
-				 pitch * (region->extents.y2 - region->extents.y1),
-				 false);
+	dst_bo = sna_shm_map(sna, dst,
+			     pitch * (region->extents.y2 - region->extents.y1),
+			     true);
+	if (dst_bo == NULL)
+		dst_bo = kgem_create_map(&sna->kgem, dst,
+					 pitch * (region->extents.y2 - region->extents.y1),
+					 false);
 	if (dst_bo) {
 		dst_bo->pitch = pitch;
 		kgem_bo_mark_unreusable(dst_bo);
@@ -17465,6 +17473,9 @@ void sna_accel_flush(struct sna *sna)
 
 	if (sna->kgem.flush)
 		kgem_submit(&sna->kgem);
+
+	/* and make sure the kernel has it before the clients are told */
+	kgem_submit_wait(&sna->kgem);
 }
 
 static void
@@ -17912,6 +17923,14 @@ static void sna_accel_debug_memory(struct sna *sna)
 	       (unsigned long)sna->kgem.debug_memory.bo_bytes,
 	       sna->debug_memory.cpu_bo_allocs,
 	       (unsigned long)sna->debug_memory.cpu_bo_bytes);
+	ErrorF("BO cache searches: linear %llu (%llu steps, longest %u), 2D %llu (%llu steps, longest %u)\n",
+	       (unsigned long long)sna->kgem.search_linear.count,
+	       (unsigned long long)sna->kgem.search_linear.steps,
+	       sna->kgem.search_linear.max,
+	       (unsigned long long)sna->kgem.search_2d.count,
+	       (unsigned long long)sna->kgem.search_2d.steps,
+	       sna->kgem.search_2d.max);
+	sna_threads_dump(0);
 
 #ifdef VALGRIND_DO_ADDED_LEAK_CHECK
 	VG(VALGRIND_DO_ADDED_LEAK_CHECK);
@@ -18250,9 +18269,10 @@ bool sna_accel_init(ScreenPtr screen, struct sna *sna)
 
 	screen->SetScreenPixmap = sna_set_screen_pixmap;
 
-	if (sna->kgem.has_userptr)
+	if (sna->kgem.has_userptr) {
 		ShmRegisterFuncs(screen, &shm_funcs);
-	else
+		sna_shm_init(sna);
+	} else
 		ShmRegisterFbFuncs(screen);
 
 	if (!sna_picture_init(screen))
@@ -18313,6 +18333,9 @@ void sna_accel_create(struct sna *sna)
 	if (damage)
 		sna->damage_event = damage->eventBase + XDamageNotify;
 
+	if (sna->kgem.has_userptr)
+		sna_shm_create(sna);
+
 	if (!sna_glyphs_create(sna))
 		goto fail;
 
@@ -18413,6 +18436,7 @@ void sna_accel_close(struct sna *sna)
 	sna_composite_close(sna);
 	sna_gradients_close(sna);
 	sna_glyphs_close(sna);
+	sna_threads_dump(4);
 
 	sna_pixmap_expire(sna);
 
@@ -18421,9 +18445,35 @@ void sna_accel_close(struct sna *sna)
 	DeleteCallback(&EventCallback, sna_event_callback, sna);
 	RemoveNotifyFd(sna->kgem.fd);
 
+	if (sna->kgem.has_userptr)
+		sna_shm_fini(sna);
+
 	kgem_cleanup_cache(&sna->kgem);
 }
 
+static void sna_accel_publish_stats(struct sna *sna)
+{
+	static const char name[] = "SNA_STATISTICS";
+	ScreenPtr screen = xf86ScrnToScreen(sna->scrn);
+	char buf[4096];
+	Atom atom;
+	int len;
+
+	if (screen->root == NULL)
+		return;
+
+	atom = MakeAtom(name, sizeof(name) - 1, TRUE);
+	if (atom == None)
+		return;
+
+	len = kgem_stats_print(&sna->kgem, buf, sizeof(buf));
+	DBG(("%s: %d bytes\n", __FUNCTION__, len));
+
+	dixChangeWindowProperty(serverClient, screen->root,
+				atom, XA_STRING, 8, PropModeReplace,
+				len, buf, TRUE);
+}
+
 void sna_accel_block(struct sna *sna, struct timeval **tv)
 {
 	sigtrap_assert_inactive();
@@ -18467,6 +18517,18 @@ restart:
 	if (sna_accel_do_debug_memory(sna))
 		sna_accel_debug_memory(sna);
 
+	if (sna->flags & SNA_STATISTICS &&
+	    (int32_t)(TIME - sna->stats_time) >= 1000) {
+		sna->stats_time = TIME;
+		sna_accel_publish_stats(sna);
+	}
+
+	if (sna_pressure_enabled(sna) &&
+	    (int32_t)(TIME - sna->pressure.time) >= 1000) {
+		sna->pressure.time = TIME;
+		sna_pressure_check(sna);
+	}
+
 	if (sna->watch_shm_flush == 1) {
 		DBG(("%s: removing shm watchers\n", __FUNCTION__));
 		DeleteCallback(&FlushCallback, sna_shm_flush_callback, sna);
@@ -56,6 +56,32 @@ struct sna_damage_box
 
 static struct sna_damage *__freed_damage;
 
+/*
+ * The tiled backend is an alternative to batching boxes for a later
+ * reduction. Instead the damage is split over a coarse grid of tiles, each
+ * with its own small region that is updated immediately. Adding,
+ * subtracting and querying a box then only touches the regions of the
+ * tiles that it overlaps, and we only need to assemble the complete
+ * region when the caller asks for the boxes themselves.
+ */
+#define TILE_SHIFT 7
+#define TILE_SIZE (1 << TILE_SHIFT)
+
+struct sna_damage_tiles {
+	int x, y, width, height; /* in tiles */
+	int count; /* number of non-empty tiles */
+	pixman_region16_t *tile;
+};
+
+static bool damage_tiled;
+
+void sna_damage_set_tiled(bool enable)
+{
+	damage_tiled = enable;
+}
+
+static void tiles_reduce(struct sna_damage *damage);
+
 static inline bool region_is_singular(const RegionRec *r)
 {
 	return r->data == NULL;
@@ -161,6 +187,16 @@ last_box(struct sna_damage *damage)
 			  list);
 }
 
+/* The embedded array is not laid out as a struct sna_damage_box */
+static BoxPtr
+last_box_start(struct sna_damage *damage)
+{
+	if (list_is_empty(&damage->embedded_box.list))
+		return damage->embedded_box.box;
+
+	return (BoxPtr)(last_box(damage) + 1);
+}
+
 static void
 reset_embedded_box(struct sna_damage *damage)
 {
@@ -194,6 +230,10 @@ static struct sna_damage *_sna_damage_create(void)
 	pixman_region_init(&damage->region);
 	reset_extents(damage);
 
+	damage->tiles = NULL;
+	if (damage_tiled)
+		damage->tiles = calloc(1, sizeof(struct sna_damage_tiles));
+
 	return damage;
 }
 
@@ -221,6 +261,11 @@ static void __sna_damage_reduce(struct sna_damage *damage)
 	assert(damage->mode != DAMAGE_ALL);
 	assert(damage->dirty);
 
+	if (damage->tiles) {
+		tiles_reduce(damage);
+		return;
+	}
+
 	DBG(("    reduce: before region.n=%d\n", region_num_rects(region)));
 
 	nboxes = damage->embedded_box.size;
@@ -250,7 +295,7 @@ static void __sna_damage_reduce(struct sna_damage *damage)
 
 	iter = last_box(damage);
 	n = iter->size - damage->remain;
-	boxes = (BoxRec *)(iter+1);
+	boxes = last_box_start(damage);
 	DBG(("   last box count=%d/%d, need=%d\n", n, iter->size, nboxes));
 	if (nboxes > iter->size) {
 		boxes = malloc(sizeof(BoxRec)*nboxes);
@@ -391,7 +436,7 @@ restart:
 
 	DBG(("    %s(): new elt\n", __FUNCTION__));
 	assert(damage->remain == 0);
-	assert(damage->box - (BoxRec *)(last_box(damage)+1) == last_box(damage)->size);
+	assert(damage->box - last_box_start(damage) == last_box(damage)->size);
 
 	if (!_sna_damage_create_boxes(damage, count)) {
 		unsigned mode;
@@ -448,7 +493,7 @@ restart:
 
 	DBG(("    %s(): new elt\n", __FUNCTION__));
 	assert(damage->remain == 0);
-	assert(damage->box - (BoxRec *)(last_box(damage)+1) == last_box(damage)->size);
+	assert(damage->box - last_box_start(damage) == last_box(damage)->size);
 
 	if (!_sna_damage_create_boxes(damage, count)) {
 		unsigned mode;
@@ -511,7 +556,7 @@ restart:
 
 	DBG(("    %s(): new elt\n", __FUNCTION__));
 	assert(damage->remain == 0);
-	assert(damage->box - (BoxRec *)(last_box(damage)+1) == last_box(damage)->size);
+	assert(damage->box - last_box_start(damage) == last_box(damage)->size);
 
 	if (!_sna_damage_create_boxes(damage, count)) {
 		unsigned mode;
@@ -574,7 +619,7 @@ restart:
 
 	DBG(("    %s(): new elt\n", __FUNCTION__));
 	assert(damage->remain == 0);
-	assert(damage->box - (BoxRec *)(last_box(damage)+1) == last_box(damage)->size);
+	assert(damage->box - last_box_start(damage) == last_box(damage)->size);
 
 	if (!_sna_damage_create_boxes(damage, count)) {
 		unsigned mode;
@@ -634,12 +679,366 @@ static void _pixman_region_union_box(RegionRec *region, const BoxRec *box)
 	pixman_region_union(region, region, &u);
 }
 
+static bool damage_is_empty(const struct sna_damage *damage)
+{
+	/* Any boxes still pending addition are not yet in the region */
+	if (damage->dirty && damage->mode == DAMAGE_ADD)
+		return false;
+
+	return RegionNil(&damage->region);
+}
+
 static bool box_contains_region(const BoxRec *b, const RegionRec *r)
 {
 	return (b->x1 <= r->extents.x1 && b->x2 >= r->extents.x2 &&
 		b->y1 <= r->extents.y1 && b->y2 >= r->extents.y2);
 }
 
+static bool box_contains(const BoxRec *a, const BoxRec *b)
+{
+	if (b->x1 < a->x1 || b->x2 > a->x2)
+		return false;
+
+	if (b->y1 < a->y1 || b->y2 > a->y2)
+		return false;
+
+	return true;
+}
+
+static bool box_overlaps(const BoxRec *a, const BoxRec *b)
+{
+	return (a->x1 < b->x2 && a->x2 > b->x1 &&
+		a->y1 < b->y2 && a->y2 > b->y1);
+}
+
+static inline pixman_region16_t *
+tiles_get(struct sna_damage_tiles *t, int tx, int ty)
+{
+	assert(tx >= t->x && tx < t->x + t->width);
+	assert(ty >= t->y && ty < t->y + t->height);
+	return &t->tile[(ty - t->y) * t->width + (tx - t->x)];
+}
+
+static inline void
+tiles_clip(const BoxRec *box, int tx, int ty, BoxRec *clip)
+{
+	int x1 = tx * TILE_SIZE, y1 = ty * TILE_SIZE;
+
+	clip->x1 = box->x1 > x1 ? box->x1 : x1;
+	clip->y1 = box->y1 > y1 ? box->y1 : y1;
+	clip->x2 = box->x2 < x1 + TILE_SIZE ? box->x2 : x1 + TILE_SIZE;
+	clip->y2 = box->y2 < y1 + TILE_SIZE ? box->y2 : y1 + TILE_SIZE;
+	assert(clip->x2 > clip->x1 && clip->y2 > clip->y1);
+}
+
+static void tiles_clear(struct sna_damage_tiles *t)
+{
+	int n;
+
+	for (n = 0; n < t->width * t->height; n++)
+		pixman_region_fini(&t->tile[n]);
+	free(t->tile);
+	t->tile = NULL;
+	t->width = t->height = 0;
+	t->count = 0;
+}
+
+static bool tiles_grow(struct sna_damage_tiles *t,
+		       int x1, int y1, int x2, int y2)
+{
+	pixman_region16_t *tile;
+	int x, y;
+
+	if (t->width) {
+		if (x1 >= t->x && x2 <= t->x + t->width &&
+		    y1 >= t->y && y2 <= t->y + t->height)
+			return true;
+
+		if (x1 > t->x)
+			x1 = t->x;
+		if (y1 > t->y)
+			y1 = t->y;
+		if (x2 < t->x + t->width)
+			x2 = t->x + t->width;
+		if (y2 < t->y + t->height)
+			y2 = t->y + t->height;
+	}
+
+	DBG(("%s: (%d, %d), (%d, %d) -> (%d, %d), (%d, %d)\n", __FUNCTION__,
+	     t->x, t->y, t->x + t->width, t->y + t->height,
+	     x1, y1, x2, y2));
+
+	tile = malloc(sizeof(*tile) * (x2 - x1) * (y2 - y1));
+	if (tile == NULL)
+		return false;
+
+	for (y = y1; y < y2; y++) {
+		for (x = x1; x < x2; x++) {
+			pixman_region16_t *r = &tile[(y - y1) * (x2 - x1) + x - x1];
+			if (x >= t->x && x < t->x + t->width &&
+			    y >= t->y && y < t->y + t->height)
+				*r = *tiles_get(t, x, y);
+			else
+				pixman_region_init(r);
+		}
+	}
+
+	free(t->tile);
+	t->tile = tile;
+	t->x = x1;
+	t->y = y1;
+	t->width = x2 - x1;
+	t->height = y2 - y1;
+	return true;
+}
+
+static bool tiles_add_box(struct sna_damage_tiles *t, const BoxRec *box)
+{
+	int x1 = box->x1 >> TILE_SHIFT, x2 = ((box->x2 - 1) >> TILE_SHIFT) + 1;
+	int y1 = box->y1 >> TILE_SHIFT, y2 = ((box->y2 - 1) >> TILE_SHIFT) + 1;
+	int tx, ty;
+
+	assert(box->x2 > box->x1 && box->y2 > box->y1);
+
+	if (!tiles_grow(t, x1, y1, x2, y2))
+		return false;
+
+	for (ty = y1; ty < y2; ty++) {
+		for (tx = x1; tx < x2; tx++) {
+			pixman_region16_t *r = tiles_get(t, tx, ty);
+			BoxRec clip;
+
+			tiles_clip(box, tx, ty, &clip);
+			if (r->data == NULL && box_contains(&r->extents, &clip))
+				continue;
+
+			if (!pixman_region_not_empty(r))
+				t->count++;
+			_pixman_region_union_box(r, &clip);
+		}
+	}
+
+	return true;
+}
+
+static void tiles_subtract_box(struct sna_damage_tiles *t, const BoxRec *box)
+{
+	int x1 = box->x1 >> TILE_SHIFT, x2 = ((box->x2 - 1) >> TILE_SHIFT) + 1;
+	int y1 = box->y1 >> TILE_SHIFT, y2 = ((box->y2 - 1) >> TILE_SHIFT) + 1;
+	int tx, ty;
+
+	assert(box->x2 > box->x1 && box->y2 > box->y1);
+
+	if (x1 < t->x)
+		x1 = t->x;
+	if (x2 > t->x + t->width)
+		x2 = t->x + t->width;
+	if (y1 < t->y)
+		y1 = t->y;
+	if (y2 > t->y + t->height)
+		y2 = t->y + t->height;
+
+	for (ty = y1; ty < y2; ty++) {
+		for (tx = x1; tx < x2; tx++) {
+			pixman_region16_t *r = tiles_get(t, tx, ty);
+			RegionRec tmp;
+
+			if (!pixman_region_not_empty(r))
+				continue;
+
+			tiles_clip(box, tx, ty, &tmp.extents);
+			if (!box_overlaps(&tmp.extents, &r->extents))
+				continue;
+
+			if (box_contains(&tmp.extents, &r->extents)) {
+				pixman_region_fini(r);
+				pixman_region_init(r);
+			} else {
+				tmp.data = NULL;
+				pixman_region_subtract(r, r, &tmp);
+			}
+			if (!pixman_region_not_empty(r))
+				t->count--;
+		}
+	}
+	assert(t->count >= 0);
+}
+
+static int tiles_contains_box(struct sna_damage_tiles *t, const BoxRec *box)
+{
+	int x1 = box->x1 >> TILE_SHIFT, x2 = ((box->x2 - 1) >> TILE_SHIFT) + 1;
+	int y1 = box->y1 >> TILE_SHIFT, y2 = ((box->y2 - 1) >> TILE_SHIFT) + 1;
+	bool in = false, out = false;
+	int tx, ty;
+
+	if (t->count == 0)
+		return PIXMAN_REGION_OUT;
+
+	if (x1 < t->x) {
+		x1 = t->x;
+		out = true;
+	}
+	if (x2 > t->x + t->width) {
+		x2 = t->x + t->width;
+		out = true;
+	}
+	if (y1 < t->y) {
+		y1 = t->y;
+		out = true;
+	}
+	if (y2 > t->y + t->height) {
+		y2 = t->y + t->height;
+		out = true;
+	}
+
+	for (ty = y1; ty < y2; ty++) {
+		for (tx = x1; tx < x2; tx++) {
+			BoxRec clip;
+
+			tiles_clip(box, tx, ty, &clip);
+			switch (pixman_region_contains_rectangle(tiles_get(t, tx, ty), &clip)) {
+			case PIXMAN_REGION_IN:
+				in = true;
+				break;
+			case PIXMAN_REGION_OUT:
+				out = true;
+				break;
+			default:
+				return PIXMAN_REGION_PART;
+			}
+			if (in && out)
+				return PIXMAN_REGION_PART;
+		}
+	}
+
+	return in ? PIXMAN_REGION_IN : PIXMAN_REGION_OUT;
+}
+
+static void tiles_reduce(struct sna_damage *damage)
+{
+	struct sna_damage_tiles *t = damage->tiles;
+	pixman_region16_t *region = &damage->region;
+	BoxPtr boxes;
+	int n, count;
+
+	DBG(("%s: %d tiles\n", __FUNCTION__, t->count));
+
+	count = 0;
+	for (n = 0; n < t->width * t->height; n++)
+		count += region_num_rects(&t->tile[n]);
+
+	pixman_region_fini(region);
+	pixman_region_init(region);
+	if (count) {
+		boxes = malloc(sizeof(BoxRec) * count);
+		if (boxes) {
+			BoxPtr b = boxes;
+
+			for (n = 0; n < t->width * t->height; n++) {
+				int len = region_num_rects(&t->tile[n]);
+				memcpy(b, region_rects(&t->tile[n]), len * sizeof(BoxRec));
+				b += len;
+			}
+
+			pixman_region_fini(region);
+			pixman_region_init_rects(region, boxes, count);
+			free(boxes);
+		} else {
+			for (n = 0; n < t->width * t->height; n++)
+				pixman_region_union(region, region, &t->tile[n]);
+		}
+	}
+
+	if (pixman_region_not_empty(region))
+		damage->extents = region->extents;
+	else
+		reset_extents(damage);
+
+	damage->mode = DAMAGE_ADD;
+	damage->dirty = false;
+}
+
+static void tiles_fini(struct sna_damage *damage)
+{
+	tiles_clear(damage->tiles);
+	free(damage->tiles);
+	damage->tiles = NULL;
+}
+
+/* If we cannot extend the grid, continue by batching boxes instead */
+static void damage_untile(struct sna_damage *damage)
+{
+	DBG(("%s\n", __FUNCTION__));
+
+	if (damage->dirty)
+		tiles_reduce(damage);
+	tiles_fini(damage);
+}
+
+static bool damage_tiles_add_box(struct sna_damage *damage, const BoxRec *box)
+{
+	assert(damage->mode == DAMAGE_ADD);
+
+	damage->dirty = true;
+	if (!tiles_add_box(damage->tiles, box)) {
+		damage_untile(damage);
+		return false;
+	}
+
+	damage_union(damage, box);
+	return true;
+}
+
+static bool damage_tiles_add_boxes(struct sna_damage *damage,
+				   const BoxRec *box, int n,
+				   int dx, int dy)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		BoxRec b;
+
+		b.x1 = box[i].x1 + dx;
+		b.x2 = box[i].x2 + dx;
+		b.y1 = box[i].y1 + dy;
+		b.y2 = box[i].y2 + dy;
+		if (!damage_tiles_add_box(damage, &b))
+			return false;
+	}
+
+	return true;
+}
+
+static bool damage_tiles_subtract(struct sna_damage *damage,
+				  const BoxRec *box, int n,
+				  int dx, int dy)
+{
+	int i;
+
+	if (damage->mode == DAMAGE_ALL) {
+		assert(damage->tiles->count == 0);
+		if (!tiles_add_box(damage->tiles, &damage->extents)) {
+			damage_untile(damage);
+			return false;
+		}
+		damage->mode = DAMAGE_ADD;
+	}
+
+	for (i = 0; i < n; i++) {
+		BoxRec b;
+
+		b.x1 = box[i].x1 + dx;
+		b.x2 = box[i].x2 + dx;
+		b.y1 = box[i].y1 + dy;
+		b.y2 = box[i].y2 + dy;
+		if (sna_damage_overlaps_box(damage, &b))
+			tiles_subtract_box(damage->tiles, &b);
+	}
+
+	damage->dirty = true;
+	return true;
+}
+
 static struct sna_damage *__sna_damage_add_box(struct sna_damage *damage,
 					       const BoxRec *box)
 {
@@ -659,6 +1058,9 @@ static struct sna_damage *__sna_damage_add_box(struct sna_damage *damage,
 		break;
 	}
 
+	if (damage->tiles && damage_tiles_add_box(damage, box))
+		return damage;
+
 	if (region_is_singular_or_empty(&damage->region) ||
 	    box_contains_region(box, &damage->region)) {
 		_pixman_region_union_box(&damage->region, box);
@@ -694,6 +1096,13 @@ inline static struct sna_damage *__sna_damage_add(struct sna_damage *damage,
 		break;
 	}
 
+	if (damage->tiles &&
+	    damage_tiles_add_boxes(damage,
+				   region_rects(region),
+				   region_num_rects(region),
+				   0, 0))
+		return damage;
+
 	if (region_is_singular(region))
 		return __sna_damage_add_box(damage, &region->extents);
 
@@ -730,9 +1139,11 @@ fastcall struct sna_damage *_sna_damage_add(struct sna_damage *damage,
 
 	DBG(("  = %s\n",
 	     _debug_describe_damage(damage_buf, sizeof(damage_buf), damage)));
-	assert(region_num_rects(&damage->region));
-	assert(damage->region.extents.x2 > damage->region.extents.x1);
-	assert(damage->region.extents.y2 > damage->region.extents.y1);
+	if (damage->tiles == NULL) {
+		assert(region_num_rects(&damage->region));
+		assert(damage->region.extents.x2 > damage->region.extents.x1);
+		assert(damage->region.extents.y2 > damage->region.extents.y1);
+	}
 
 	return damage;
 }
@@ -791,6 +1202,9 @@ __sna_damage_add_boxes(struct sna_damage *damage,
 	if (n == 1)
 		return __sna_damage_add_box(damage, &extents);
 
+	if (damage->tiles && damage_tiles_add_boxes(damage, box, n, dx, dy))
+		return damage;
+
 	if (pixman_region_contains_rectangle(&damage->region,
 					     &extents) == PIXMAN_REGION_IN)
 		return damage;
@@ -880,6 +1294,21 @@ __sna_damage_add_rectangles(struct sna_damage *damage,
 		break;
 	}
 
+	if (damage->tiles) {
+		for (i = 0; i < n; i++) {
+			BoxRec b;
+
+			b.x1 = r[i].x + dx;
+			b.x2 = b.x1 + r[i].width;
+			b.y1 = r[i].y + dy;
+			b.y2 = b.y1 + r[i].height;
+			if (!damage_tiles_add_box(damage, &b))
+				break;
+		}
+		if (i == n)
+			return damage;
+	}
+
 	if (pixman_region_contains_rectangle(&damage->region,
 					     &extents) == PIXMAN_REGION_IN)
 		return damage;
@@ -964,6 +1393,21 @@ __sna_damage_add_points(struct sna_damage *damage,
 		break;
 	}
 
+	if (damage->tiles) {
+		for (i = 0; i < n; i++) {
+			BoxRec b;
+
+			b.x1 = p[i].x + dx;
+			b.x2 = b.x1 + 1;
+			b.y1 = p[i].y + dy;
+			b.y2 = b.y1 + 1;
+			if (!damage_tiles_add_box(damage, &b))
+				break;
+		}
+		if (i == n)
+			return damage;
+	}
+
 	if (pixman_region_contains_rectangle(&damage->region,
 					     &extents) == PIXMAN_REGION_IN)
 		return damage;
@@ -1017,9 +1461,11 @@ fastcall struct sna_damage *_sna_damage_add_box(struct sna_damage *damage,
 
 	DBG(("  = %s\n",
 	     _debug_describe_damage(damage_buf, sizeof(damage_buf), damage)));
-	assert(region_num_rects(&damage->region));
-	assert(damage->region.extents.x2 > damage->region.extents.x1);
-	assert(damage->region.extents.y2 > damage->region.extents.y1);
+	if (damage->tiles == NULL) {
+		assert(region_num_rects(&damage->region));
+		assert(damage->region.extents.x2 > damage->region.extents.x1);
+		assert(damage->region.extents.y2 > damage->region.extents.y1);
+	}
 
 	return damage;
 }
@@ -1040,6 +1486,8 @@ struct sna_damage *__sna_damage_all(struct sna_damage *damage,
 		pixman_region_fini(&damage->region);
 		free_list(&damage->embedded_box.list);
 		reset_embedded_box(damage);
+		if (damage->tiles)
+			tiles_clear(damage->tiles);
 	} else {
 		damage = _sna_damage_create();
 		if (damage == NULL)
@@ -1078,6 +1526,13 @@ struct sna_damage *_sna_damage_is_all(struct sna_damage *damage,
 		return damage;
 	}
 
+	/* The tiled backend only shrinks its extents upon reduction */
+	if (damage->extents.x1 > 0 || damage->extents.y1 > 0 ||
+	    damage->extents.x2 < width || damage->extents.y2 < height) {
+		DBG(("%s: no, reduced extents\n", __FUNCTION__));
+		return damage;
+	}
+
 	assert(damage->extents.x1 == 0 &&
 	       damage->extents.y1 == 0 &&
 	       damage->extents.x2 == width &&
@@ -1086,24 +1541,23 @@ struct sna_damage *_sna_damage_is_all(struct sna_damage *damage,
 	return __sna_damage_all(damage, width, height);
 }
 
-static bool box_contains(const BoxRec *a, const BoxRec *b)
-{
-	if (b->x1 < a->x1 || b->x2 > a->x2)
-		return false;
-
-	if (b->y1 < a->y1 || b->y2 > a->y2)
-		return false;
-
-	return true;
-}
-
 static struct sna_damage *__sna_damage_subtract(struct sna_damage *damage,
 						RegionPtr region)
 {
 	if (damage == NULL)
 		return NULL;
 
-	if (RegionNil(&damage->region)) {
+	if (damage->tiles &&
+	    damage_tiles_subtract(damage,
+				  region_rects(region),
+				  region_num_rects(region),
+				  0, 0)) {
+		if (damage->tiles->count == 0)
+			goto no_damage;
+		return damage;
+	}
+
+	if (damage_is_empty(damage)) {
 no_damage:
 		__sna_damage_destroy(damage);
 		return NULL;
@@ -1196,7 +1650,15 @@ inline static struct sna_damage *__sna_damage_subtract_box(struct sna_damage *da
 	if (damage == NULL)
 		return NULL;
 
-	if (RegionNil(&damage->region)) {
+	if (damage->tiles && damage_tiles_subtract(damage, box, 1, 0, 0)) {
+		if (damage->tiles->count == 0) {
+			__sna_damage_destroy(damage);
+			return NULL;
+		}
+		return damage;
+	}
+
+	if (damage_is_empty(damage)) {
 		__sna_damage_destroy(damage);
 		return NULL;
 	}
@@ -1268,7 +1730,15 @@ static struct sna_damage *__sna_damage_subtract_boxes(struct sna_damage *damage,
 	if (damage == NULL)
 		return NULL;
 
-	if (RegionNil(&damage->region)) {
+	if (damage->tiles && damage_tiles_subtract(damage, box, n, dx, dy)) {
+		if (damage->tiles->count == 0) {
+			__sna_damage_destroy(damage);
+			return NULL;
+		}
+		return damage;
+	}
+
+	if (damage_is_empty(damage)) {
 		__sna_damage_destroy(damage);
 		return NULL;
 	}
@@ -1356,6 +1826,9 @@ static int __sna_damage_contains_box(struct sna_damage **_damage,
 	if (!sna_damage_overlaps_box(damage, box))
 		return PIXMAN_REGION_OUT;
 
+	if (damage->tiles)
+		return tiles_contains_box(damage->tiles, box);
+
 	ret = pixman_region_contains_rectangle(&damage->region, (BoxPtr)box);
 	if (!damage->dirty)
 		return ret;
@@ -1426,12 +1899,6 @@ int _sna_damage_contains_box(struct sna_damage **damage,
 }
 #endif
 
-static bool box_overlaps(const BoxRec *a, const BoxRec *b)
-{
-	return (a->x1 < b->x2 && a->x2 > b->x1 &&
-		a->y1 < b->y2 && a->y2 > b->y1);
-}
-
 bool _sna_damage_contains_box__no_reduce(const struct sna_damage *damage,
 					 const BoxRec *box)
 {
@@ -1442,6 +1909,9 @@ bool _sna_damage_contains_box__no_reduce(const struct sna_damage *damage,
 	if (!box_contains(&damage->extents, box))
 		return false;
 
+	if (damage->tiles)
+		return tiles_contains_box(damage->tiles, box) == PIXMAN_REGION_IN;
+
 	n = pixman_region_contains_rectangle((pixman_region16_t *)&damage->region, (BoxPtr)box);
 	if (!damage->dirty)
 		return n == PIXMAN_REGION_IN;
@@ -1604,6 +2074,8 @@ struct sna_damage *_sna_damage_combine(struct sna_damage *l,
 void __sna_damage_destroy(struct sna_damage *damage)
 {
 	free_list(&damage->embedded_box.list);
+	if (damage->tiles)
+		tiles_fini(damage);
 
 	pixman_region_fini(&damage->region);
 	*(void **)damage = __freed_damage;
@@ -1772,6 +2244,7 @@ void sna_damage_selftest(void)
 	};
 	char region_buf[120];
 	char damage_buf[1000];
+	bool tiled = damage_tiled;
 	int pass;
 
 	for (pass = 0; pass < 16384; pass++) {
@@ -1780,6 +2253,8 @@ void sna_damage_selftest(void)
 		pixman_region16_t ref;
 		int iter, i;
 
+		damage_tiled = pass & 1;
+
 		iter = 1 + rand() % (1 + (pass / 64));
 		DBG(("%s: pass %d, iters=%d\n", __FUNCTION__, pass, iter));
 
@@ -1802,6 +2277,8 @@ void sna_damage_selftest(void)
 		pixman_region_fini(&ref);
 		sna_damage_destroy(&damage);
 	}
+
+	damage_tiled = tiled;
 }
 #endif
 
@@ -1811,6 +2288,9 @@ void _sna_damage_debug_get_region(struct sna_damage *damage, RegionRec *r)
 	BoxPtr boxes;
 	struct sna_damage_box *iter;
 
+	if (damage->tiles && damage->dirty)
+		tiles_reduce(damage);
+
 	RegionCopy(r, &damage->region);
 	if (!damage->dirty)
 		return;
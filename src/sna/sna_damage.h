@@ -15,6 +15,7 @@ struct sna_damage {
 	} mode;
 	int remain, dirty;
 	BoxPtr box;
+	struct sna_damage_tiles *tiles;
 	struct {
 		struct list list;
 		int size;
@@ -28,6 +29,7 @@ struct sna_damage {
 #define DAMAGE_REGION(ptr) (&DAMAGE_PTR(ptr)->region)
 
 struct sna_damage *sna_damage_create(void);
+void sna_damage_set_tiled(bool enable);
 
 struct sna_damage *__sna_damage_all(struct sna_damage *damage,
 				    int width, int height);
@@ -308,7 +310,11 @@ static inline void sna_damage_reduce_all(struct sna_damage **_damage,
 					return;
 			}
 
-			if (damage->region.data == NULL)
+			if (damage->region.data == NULL &&
+			    damage->extents.x1 <= 0 &&
+			    damage->extents.y1 <= 0 &&
+			    damage->extents.x2 >= pixmap->drawable.width &&
+			    damage->extents.y2 >= pixmap->drawable.height)
 				*_damage = _sna_damage_all(damage,
 							   pixmap->drawable.width,
 							   pixmap->drawable.height);
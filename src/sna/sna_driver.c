@@ -524,6 +524,8 @@ static Bool sna_pre_init(ScrnInfoPtr scrn, int probe)
 	rgb defaultWeight = { 0, 0, 0 };
 	EntityInfoPtr pEnt;
 	Gamma zeros = { 0.0, 0.0, 0.0 };
+	const char *s;
+	int budget;
 	int fd;
 
 	DBG(("%s flags=%x, numEntities=%d\n",
@@ -565,6 +567,8 @@ static Bool sna_pre_init(ScrnInfoPtr scrn, int probe)
 
 		sna->cpu_features = sna_cpu_detect();
 		sna->acpi.fd = sna_acpi_open();
+		sna->pressure.psi = -1;
+		sna->pressure.events = -1;
 	}
 	sna = to_sna(scrn);
 	sna->pEnt = pEnt;
@@ -634,6 +638,10 @@ static Bool sna_pre_init(ScrnInfoPtr scrn, int probe)
 		  xf86GetPciInfoForEntity(pEnt->index),
 		  sna->info->gen);
 
+	sna_damage_set_tiled(xf86ReturnOptValBool(sna->Options,
+						  OPTION_TILED_DAMAGE,
+						  FALSE));
+
 	if (xf86ReturnOptValBool(sna->Options, OPTION_TILING_FB, FALSE))
 		sna->flags |= SNA_LINEAR_FB;
 	if (!sna->kgem.can_fence)
@@ -669,6 +677,57 @@ static Bool sna_pre_init(ScrnInfoPtr scrn, int probe)
 
 	xf86DrvMsg(scrn->scrnIndex, X_CONFIG, "Throttling %sabled\n", (sna->flags & SNA_NO_THROTTLE) ? "dis" : "en");
 
+	if (xf86ReturnOptValBool(sna->Options, OPTION_STATISTICS, FALSE)) {
+		xf86DrvMsg(scrn->scrnIndex, X_CONFIG,
+			   "Publishing driver statistics on the root window\n");
+		sna->flags |= SNA_STATISTICS;
+	}
+
+	s = xf86GetOptValString(sna->Options, OPTION_BATCH_CAPTURE);
+	if (s) {
+		bool buffers = xf86ReturnOptValBool(sna->Options,
+						    OPTION_BATCH_CAPTURE_BUFFERS,
+						    FALSE);
+		if (kgem_capture_open(&sna->kgem, s, buffers))
+			xf86DrvMsg(scrn->scrnIndex, X_CONFIG,
+				   "Capturing batches%s to %s\n",
+				   buffers ? " and buffer contents" : "", s);
+		else
+			xf86DrvMsg(scrn->scrnIndex, X_WARNING,
+				   "Unable to open batch capture file %s: %s\n",
+				   s, strerror(errno));
+	}
+
+	if (xf86GetOptValInteger(sna->Options, OPTION_CACHE_BUDGET, &budget) &&
+	    budget > 0) {
+		sna->kgem.cache_budget = (uint64_t)budget << 20;
+		xf86DrvMsg(scrn->scrnIndex, X_CONFIG,
+			   "Keeping at most %dMiB of idle buffers cached\n",
+			   budget);
+	}
+
+	sna_pressure_init(sna, xf86ReturnOptValBool(sna->Options,
+						    OPTION_MEMORY_PRESSURE,
+						    TRUE));
+	if (sna->pressure.psi >= 0 || sna->pressure.events >= 0)
+		xf86DrvMsg(scrn->scrnIndex, X_INFO,
+			   "Releasing cached buffers under memory pressure (%s%s%s)\n",
+			   sna->pressure.psi >= 0 ? "psi" : "",
+			   sna->pressure.psi >= 0 && sna->pressure.events >= 0 ? ", " : "",
+			   sna->pressure.events >= 0 ? "memory.high" : "");
+
+	sna->kernel_cache.path = xf86GetOptValString(sna->Options,
+						     OPTION_KERNEL_CACHE);
+	if (sna->kernel_cache.path && !sna_kernel_cache_init(sna)) {
+		xf86DrvMsg(scrn->scrnIndex, X_WARNING,
+			   "Unable to find the driver's build-id, not caching compiled kernels\n");
+		sna->kernel_cache.path = NULL;
+	}
+	if (sna->kernel_cache.path)
+		xf86DrvMsg(scrn->scrnIndex, X_CONFIG,
+			   "Caching compiled kernels in %s\n",
+			   sna->kernel_cache.path);
+
 	if (!sna_mode_pre_init(scrn, sna)) {
 		xf86DrvMsg(scrn->scrnIndex, X_ERROR,
 			   "No outputs and no modes.\n");
@@ -697,6 +756,8 @@ static Bool sna_pre_init(ScrnInfoPtr scrn, int probe)
 
 cleanup:
 	scrn->driverPrivate = (void *)((uintptr_t)sna->info | (sna->flags & SNA_IS_SLAVED) | 2);
+	kgem_capture_close(&sna->kgem);
+	sna_pressure_fini(sna);
 	if (sna->dev)
 		intel_put_device(sna->dev);
 	free(sna);
@@ -1039,6 +1100,7 @@ static Bool sna_late_close_screen(CLOSE_SCREEN_ARGS_DECL)
 
 	sna_accel_close(sna);
 	sna_video_close(sna);
+	kgem_fini_submit_thread(&sna->kgem);
 
 	depths = screen->allowedDepths;
 	for (d = 0; d < screen->numDepths; d++)
@@ -1050,6 +1112,30 @@ static Bool sna_late_close_screen(CLOSE_SCREEN_ARGS_DECL)
 	return TRUE;
 }
 
+/* The thread is stopped again when the screen is closed, so it is
+ * started afresh for each server generation.
+ */
+static void sna_submit_init(struct sna *sna)
+{
+	ScrnInfoPtr scrn = sna->scrn;
+	int err;
+
+	if (!xf86ReturnOptValBool(sna->Options, OPTION_ASYNC_SUBMIT, FALSE))
+		return;
+
+	err = kgem_init_submit_thread(&sna->kgem);
+	if (err == 0)
+		xf86DrvMsg(scrn->scrnIndex, X_CONFIG,
+			   "Submitting batches from a separate thread\n");
+	else if (err == -ENODEV)
+		xf86DrvMsg(scrn->scrnIndex, X_WARNING,
+			   "Asynchronous submission requires softpinning, which is unavailable\n");
+	else
+		xf86DrvMsg(scrn->scrnIndex, X_WARNING,
+			   "Unable to start the submission thread: %s\n",
+			   strerror(-err));
+}
+
 static Bool
 sna_register_all_privates(void)
 {
@@ -1201,6 +1287,7 @@ sna_screen_init(SCREEN_INIT_ARGS_DECL)
 
 	assert(screen->CloseScreen == NULL);
 	screen->CloseScreen = sna_late_close_screen;
+	sna_submit_init(sna);
 	if (!sna_accel_init(screen, sna)) {
 		xf86DrvMsg(scrn->scrnIndex, X_ERROR,
 			   "Hardware acceleration initialization failed\n");
@@ -1296,7 +1383,9 @@ static void sna_free_screen(FREE_SCREEN_ARGS_DECL)
 
 	sna_mode_fini(sna);
 	sna_acpi_fini(sna);
+	sna_pressure_fini(sna);
 
+	kgem_capture_close(&sna->kgem);
 	intel_put_device(sna->dev);
 	free(sna);
 }
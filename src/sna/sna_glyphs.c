@@ -77,6 +77,7 @@
 #define DISCARD_MASK 0 /* -1 = never, 1 = always */
 
 #define CACHE_PICTURE_SIZE 1024
+#define CACHE_BUDGET (16 << 20) /* bytes of atlas pages per format */
 #define GLYPH_MIN_SIZE 8
 #define GLYPH_MAX_SIZE 64
 #define GLYPH_CACHE_SIZE (CACHE_PICTURE_SIZE * CACHE_PICTURE_SIZE / (GLYPH_MIN_SIZE * GLYPH_MIN_SIZE))
@@ -135,6 +136,17 @@ static inline bool can_use_glyph0(void)
 #endif
 }
 
+/* Mark the glyph as recently used for glyph_cache_evict(). Glyphs too
+ * large for the cache never have a size assigned.
+ */
+static inline void glyph_touch(struct sna_render *render, struct sna_glyph *p)
+{
+	if (p->size) {
+		p->used = 1;
+		render->glyph[p->pos & 1].lookups++;
+	}
+}
+
 #define NeedsComponent(f) (PICT_FORMAT_A(f) != 0 && PICT_FORMAT_RGB(f) != 0)
 
 static bool op_is_bounded(uint8_t op)
@@ -153,17 +165,28 @@ static bool op_is_bounded(uint8_t op)
 void sna_glyphs_close(struct sna *sna)
 {
 	struct sna_render *render = &sna->render;
-	unsigned int i;
+	unsigned int i, j;
 
 	DBG(("%s\n", __FUNCTION__));
 
 	for (i = 0; i < ARRAY_SIZE(render->glyph); i++) {
 		struct sna_glyph_cache *cache = &render->glyph[i];
 
-		if (cache->picture)
-			FreePicture(cache->picture, 0);
+		if (cache->num_pages)
+			xf86DrvMsgVerb(sna->scrn->scrnIndex, X_INFO, 4,
+				       "Glyph cache[%s]: %d pages, %lu hits, %lu misses, %lu evictions\n",
+				       i ? "argb" : "a8", cache->num_pages,
+				       cache->lookups - cache->misses,
+				       cache->misses, cache->evictions);
+
+		for (j = 0; j < cache->num_pages; j++) {
+			struct sna_glyph_page *page = &cache->page[j];
 
-		free(cache->glyphs);
+			if (page->picture)
+				FreePicture(page->picture, 0);
+
+			free(page->glyphs);
+		}
 	}
 	memset(render->glyph, 0, sizeof(render->glyph));
 
@@ -177,14 +200,77 @@ void sna_glyphs_close(struct sna *sna)
 	}
 }
 
-/* All caches for a single format share a single pixmap for glyph storage,
+static bool
+glyph_cache_add_page(ScreenPtr screen, struct sna_glyph_cache *cache)
+{
+	struct sna_glyph_page *page;
+	struct sna_pixmap *priv;
+	PixmapPtr pixmap;
+	PicturePtr picture = NULL;
+	CARD32 component_alpha;
+	int error;
+
+	if (cache->num_pages == cache->max_pages)
+		return false;
+
+	DBG(("%s: adding page %d of %d for format %08x\n", __FUNCTION__,
+	     cache->num_pages, cache->max_pages,
+	     (unsigned)cache->format->format));
+
+	/* Now allocate the pixmap and picture */
+	pixmap = screen->CreatePixmap(screen,
+				      CACHE_PICTURE_SIZE,
+				      CACHE_PICTURE_SIZE,
+				      cache->format->depth,
+				      SNA_CREATE_SCRATCH);
+	if (!pixmap) {
+		DBG(("%s: failed to allocate pixmap for Glyph cache\n",
+		     __FUNCTION__));
+		return false;
+	}
+
+	priv = sna_pixmap(pixmap);
+	if (priv != NULL) {
+		/* Prevent the cache from ever being paged out */
+		assert(priv->gpu_bo);
+		priv->pinned = PIN_SCANOUT;
+
+		component_alpha = NeedsComponent(cache->format->format);
+		picture = CreatePicture(0, &pixmap->drawable, cache->format,
+					CPComponentAlpha, &component_alpha,
+					serverClient, &error);
+	}
+
+	screen->DestroyPixmap(pixmap);
+	if (!picture)
+		return false;
+
+	ValidatePicture(picture);
+	assert(picture->pDrawable == &pixmap->drawable);
+
+	page = &cache->page[cache->num_pages];
+	page->glyphs = calloc(GLYPH_CACHE_SIZE, sizeof(struct sna_glyph *));
+	if (!page->glyphs) {
+		FreePicture(picture, 0);
+		return false;
+	}
+
+	page->picture = picture;
+	page->count = page->evict = 0;
+	cache->current = cache->num_pages++;
+	return true;
+}
+
+/* All caches for a single format share a set of pixmaps for glyph storage,
  * allowing mixing glyphs of different sizes without paying a penalty
  * for switching between source pixmaps. (Note that for a size of font
  * right at the border between two sizes, we might be switching for almost
  * every glyph.)
  *
- * This function allocates the storage pixmap, and then fills in the
- * rest of the allocated structures for all caches with the given format.
+ * This function allocates the first storage pixmap for each format, and
+ * then fills in the rest of the allocated structures. Further pages are
+ * added by glyph_cache() on demand, until the format's CACHE_BUDGET is
+ * exhausted.
  */
 bool sna_glyphs_create(struct sna *sna)
 {
@@ -225,56 +311,23 @@ bool sna_glyphs_create(struct sna *sna)
 
 	for (i = 0; i < ARRAY_SIZE(formats); i++) {
 		struct sna_glyph_cache *cache = &sna->render.glyph[i];
-		struct sna_pixmap *priv;
-		PixmapPtr pixmap;
-		PicturePtr picture = NULL;
-		PictFormatPtr pPictFormat;
-		CARD32 component_alpha;
 		int depth = PIXMAN_FORMAT_DEPTH(formats[i]);
+		int bytes;
 
-		pPictFormat = PictureMatchFormat(screen, depth, formats[i]);
-		if (!pPictFormat)
-			goto bail;
-
-		/* Now allocate the pixmap and picture */
-		pixmap = screen->CreatePixmap(screen,
-					      CACHE_PICTURE_SIZE,
-					      CACHE_PICTURE_SIZE,
-					      depth,
-					      SNA_CREATE_SCRATCH);
-		if (!pixmap) {
-			DBG(("%s: failed to allocate pixmap for Glyph cache\n",
-			     __FUNCTION__));
+		cache->format = PictureMatchFormat(screen, depth, formats[i]);
+		if (!cache->format)
 			goto bail;
-		}
 
-		priv = sna_pixmap(pixmap);
-		if (priv != NULL) {
-			/* Prevent the cache from ever being paged out */
-			assert(priv->gpu_bo);
-			priv->pinned = PIN_SCANOUT;
+		bytes = CACHE_PICTURE_SIZE * CACHE_PICTURE_SIZE *
+			PIXMAN_FORMAT_BPP(formats[i]) / 8;
+		cache->max_pages = CACHE_BUDGET / bytes;
+		if (cache->max_pages > ARRAY_SIZE(cache->page))
+			cache->max_pages = ARRAY_SIZE(cache->page);
+		if (cache->max_pages < 1)
+			cache->max_pages = 1;
 
-			component_alpha = NeedsComponent(pPictFormat->format);
-			picture = CreatePicture(0, &pixmap->drawable, pPictFormat,
-						CPComponentAlpha, &component_alpha,
-						serverClient, &error);
-		}
-
-		screen->DestroyPixmap(pixmap);
-		if (!picture)
+		if (!glyph_cache_add_page(screen, cache))
 			goto bail;
-
-		ValidatePicture(picture);
-		assert(picture->pDrawable == &pixmap->drawable);
-
-		cache->count = cache->evict = 0;
-		cache->picture = picture;
-		cache->glyphs = calloc(GLYPH_CACHE_SIZE,
-				       sizeof(struct sna_glyph *));
-		if (!cache->glyphs)
-			goto bail;
-
-		cache->evict = rand() % GLYPH_CACHE_SIZE;
 	}
 
 	sna->render.white_picture =
@@ -289,8 +342,21 @@ bail:
 	return false;
 }
 
+static struct sna_glyph_page *
+glyph_page(struct sna_glyph_cache *cache, PicturePtr atlas)
+{
+	int i;
+
+	for (i = 0; i < cache->num_pages - 1; i++)
+		if (cache->page[i].picture == atlas)
+			break;
+
+	assert(cache->page[i].picture == atlas);
+	return &cache->page[i];
+}
+
 static void
-glyph_cache_upload(struct sna_glyph_cache *cache,
+glyph_cache_upload(struct sna_glyph_page *page,
 		   GlyphPtr glyph, PicturePtr glyph_picture,
 		   int16_t x, int16_t y)
 {
@@ -300,7 +366,7 @@ glyph_cache_upload(struct sna_glyph_cache *cache,
 	     glyph_picture->pDrawable->width,
 	     glyph_picture->pDrawable->height));
 	sna_composite(PictOpSrc,
-		      glyph_picture, 0, cache->picture,
+		      glyph_picture, 0, page->picture,
 		      0, 0,
 		      0, 0,
 		      x, y,
@@ -390,6 +456,86 @@ glyph_size_to_mask(int size)
 	return glyph_count_to_mask(glyph_size_to_count(size));
 }
 
+static void
+glyph_cache_discard(struct sna_glyph_cache *cache,
+		    struct sna_glyph_page *page,
+		    int pos)
+{
+	struct sna_glyph *p = page->glyphs[pos];
+
+	p->atlas = NULL;
+	page->glyphs[pos] = NULL;
+	cache->evictions++;
+}
+
+/* Once every page is full, we sweep a clock hand across the current page
+ * looking for space for the new glyph. Any glyph occupying the space that
+ * has been used since the hand last passed over it is given a second
+ * chance and the hand moves on, so the glyphs of the text currently on
+ * screen stay resident and only the stale ones are replaced.
+ */
+static int
+glyph_cache_evict(struct sna_glyph_cache *cache,
+		  struct sna_glyph_page *page,
+		  int size)
+{
+	int count = glyph_size_to_count(size);
+	int pos, s, i, n;
+
+	for (n = 2 * GLYPH_CACHE_SIZE / count; n--; ) {
+		struct sna_glyph *p = NULL;
+		bool used = false;
+
+		pos = page->evict & glyph_count_to_mask(count);
+		page->evict = (pos + count) & (GLYPH_CACHE_SIZE - 1);
+
+		/* Is the space wholly occupied by a single larger glyph? */
+		for (s = size; s <= GLYPH_MAX_SIZE; s *= 2) {
+			i = pos & glyph_size_to_mask(s);
+			p = page->glyphs[i];
+			if (p == NULL)
+				continue;
+
+			if (p->size < s)
+				p = NULL;
+			break;
+		}
+		if (p) {
+			page->evict = (i + glyph_size_to_count(p->size)) & (GLYPH_CACHE_SIZE - 1);
+			if (p->used && n) {
+				p->used = 0;
+				continue;
+			}
+
+			DBG(("%s: reusing slot %d of size %d\n",
+			     __FUNCTION__, i, p->size));
+			glyph_cache_discard(cache, page, i);
+			return i;
+		}
+
+		for (i = 0; i < count; i++) {
+			p = page->glyphs[pos + i];
+			if (p && p->used) {
+				p->used = 0;
+				used = true;
+			}
+		}
+		if (used && n)
+			continue;
+
+		DBG(("%s: evicting slots [%d, %d)\n",
+		     __FUNCTION__, pos, pos + count));
+		for (i = 0; i < count; i++) {
+			if (page->glyphs[pos + i])
+				glyph_cache_discard(cache, page, pos + i);
+		}
+		return pos;
+	}
+
+	assert(0);
+	return 0;
+}
+
 static int
 glyph_cache(ScreenPtr screen,
 	    struct sna_render *render,
@@ -397,6 +543,7 @@ glyph_cache(ScreenPtr screen,
 {
 	PicturePtr glyph_picture;
 	struct sna_glyph_cache *cache;
+	struct sna_glyph_page *page;
 	struct sna_glyph *p;
 	int size, mask, pos, s;
 
@@ -430,51 +577,40 @@ glyph_cache(ScreenPtr screen,
 			break;
 
 	cache = &render->glyph[PICT_FORMAT_RGB(glyph_picture->format) != 0];
+	cache->misses++;
+
 	s = glyph_size_to_count(size);
 	mask = glyph_count_to_mask(s);
-	pos = (cache->count + s - 1) & mask;
+	page = &cache->page[cache->current];
+	pos = (page->count + s - 1) & mask;
 	if (pos < GLYPH_CACHE_SIZE) {
-		cache->count = pos + s;
+		page->count = pos + s;
+	} else if (glyph_cache_add_page(screen, cache)) {
+		page = &cache->page[cache->current];
+		page->count = s;
+		pos = 0;
 	} else {
-		p = NULL;
-		for (s = size; s <= GLYPH_MAX_SIZE; s *= 2) {
-			int i = cache->evict & glyph_size_to_mask(s);
-			p = cache->glyphs[i];
-			if (p == NULL)
-				continue;
+		int hand = page->evict;
 
-			if (p->size >= s) {
-				cache->glyphs[i] = NULL;
-				p->atlas = NULL;
-				pos = i;
-			} else
-				p = NULL;
-			break;
-		}
-		if (p == NULL) {
-			int count = glyph_size_to_count(size);
-			pos = cache->evict & glyph_count_to_mask(count);
-			for (s = 0; s < count; s++) {
-				p = cache->glyphs[pos + s];
-				if (p != NULL) {
-					p->atlas =NULL;
-					cache->glyphs[pos + s] = NULL;
-				}
-			}
-		}
+		pos = glyph_cache_evict(cache, page, size);
 
-		/* And pick a new eviction position */
-		cache->evict = rand() % GLYPH_CACHE_SIZE;
+		/* Once the hand has swept the whole page, move on to the
+		 * next so that every page is aged in turn.
+		 */
+		if (page->evict < hand && ++cache->current == cache->num_pages)
+			cache->current = 0;
 	}
-	assert(cache->glyphs[pos] == NULL);
+	assert(page->glyphs[pos] == NULL);
 
 	p = sna_glyph(glyph);
-	DBG(("%s(%d): adding glyph to cache %d, pos %d\n",
+	DBG(("%s(%d): adding glyph to cache %d, page %d, pos %d\n",
 	     __FUNCTION__, screen->myNum,
-	     PICT_FORMAT_RGB(glyph_picture->format) != 0, pos));
-	cache->glyphs[pos] = p;
-	p->atlas = cache->picture;
+	     PICT_FORMAT_RGB(glyph_picture->format) != 0,
+	     (int)(page - cache->page), pos));
+	page->glyphs[pos] = p;
+	p->atlas = page->picture;
 	p->size = size;
+	p->used = 0;
 	p->pos = pos << 1 | (PICT_FORMAT_RGB(glyph_picture->format) != 0);
 	s = pos / ((GLYPH_MAX_SIZE / GLYPH_MIN_SIZE) * (GLYPH_MAX_SIZE / GLYPH_MIN_SIZE));
 	p->coordinate.x = s % (CACHE_PICTURE_SIZE / GLYPH_MAX_SIZE) * GLYPH_MAX_SIZE;
@@ -487,12 +623,90 @@ glyph_cache(ScreenPtr screen,
 		pos >>= 2;
 	}
 
-	glyph_cache_upload(cache, glyph, glyph_picture,
+	glyph_cache_upload(page, glyph, glyph_picture,
 			   p->coordinate.x, p->coordinate.y);
 
 	return true;
 }
 
+/* Make sure every glyph in the run is resident, and report which atlas
+ * pages the run draws from. If that is more than one, the caller can then
+ * emit the run in a pass per page rather than switching atlas (and so
+ * flushing the composite op) every time consecutive glyphs disagree.
+ *
+ * Caching a glyph may evict an earlier one of the same run, so only once
+ * every glyph has been cached is each occurrence assigned its pass, which
+ * is recorded in order[] and not revisited. Any occurrence then without a
+ * page (too large for the cache, or evicted) is left for a final pass, in
+ * which glyph_cache() is free to move or evict glyphs again without
+ * affecting what the earlier passes drew.
+ */
+static int
+glyphs_cache_pages(ScreenPtr screen, struct sna_render *render,
+		   int nlist, GlyphListPtr list, GlyphPtr *glyphs,
+		   PicturePtr *pages, uint8_t *order)
+{
+	GlyphListPtr l;
+	GlyphPtr *g;
+	int npages = 0, count = 0, i, n;
+
+	for (i = 0; i < nlist; i++)
+		count += list[i].len;
+	if (count > N_STACK_GLYPHS)
+		return 0;
+
+	for (l = list, g = glyphs; l < list + nlist; l++) {
+		n = l->len;
+		while (n--) {
+			GlyphPtr glyph = *g++;
+			struct sna_glyph *p;
+
+			if (!glyph_valid(glyph))
+				continue;
+
+			p = sna_glyph(glyph);
+			if (p->atlas == NULL &&
+			    !glyph_cache(screen, render, glyph))
+				continue;
+
+			if (p->size == 0)
+				continue;
+
+			/* Keep it resident for the rest of this run */
+			p->used = 1;
+
+			for (i = 0; i < npages; i++)
+				if (pages[i] == p->atlas)
+					break;
+			if (i == npages)
+				pages[npages++] = p->atlas;
+		}
+	}
+
+	if (npages <= 1)
+		return npages;
+
+	for (l = list, g = glyphs; l < list + nlist; l++) {
+		n = l->len;
+		while (n--) {
+			struct sna_glyph *p = sna_glyph(*g++);
+
+			for (i = 0; i < npages; i++)
+				if (p->size && p->atlas == pages[i])
+					break;
+			*order++ = i;
+		}
+	}
+
+	return npages;
+}
+
+static inline bool
+glyph_in_pass(const uint8_t *order, int k, int npages, int pass)
+{
+	return npages <= 1 || order[k] == pass;
+}
+
 static void apply_damage(struct sna_composite_op *op,
 			 const struct sna_composite_rectangles *r)
 {
@@ -594,6 +808,12 @@ glyphs_to_dst(struct sna *sna,
 	struct sna_composite_op tmp;
 	ScreenPtr screen = dst->pDrawable->pScreen;
 	PicturePtr glyph_atlas;
+	PicturePtr pages[2*GLYPH_CACHE_PAGES];
+	uint8_t order[N_STACK_GLYPHS];
+	GlyphListPtr first_list = list;
+	GlyphPtr *first_glyph = glyphs;
+	int first_nlist = nlist;
+	int npages, pass = 0, k;
 	const BoxRec *rects;
 	int nrect;
 	int16_t x, y;
@@ -613,12 +833,20 @@ glyphs_to_dst(struct sna *sna,
 	} else
 		nrect = 0;
 
-	x = dst->pDrawable->x;
-	y = dst->pDrawable->y;
-	src_x -= list->xOff + x;
-	src_y -= list->yOff + y;
+	/* Overlapping glyphs may only be reordered if the op commutes */
+	npages = 0;
+	if (op == PictOpOver || op == PictOpAdd)
+		npages = glyphs_cache_pages(screen, &sna->render,
+					    nlist, list, glyphs, pages, order);
+
+	src_x -= list->xOff + dst->pDrawable->x;
+	src_y -= list->yOff + dst->pDrawable->y;
 
 	glyph_atlas = NO_ATLAS;
+next_pass:
+	k = 0;
+	x = dst->pDrawable->x;
+	y = dst->pDrawable->y;
 	while (nlist--) {
 		int n = list->len;
 		x += list->xOff;
@@ -629,6 +857,9 @@ glyphs_to_dst(struct sna *sna,
 			int i;
 
 			p = sna_glyph(glyph);
+			if (!glyph_in_pass(order, k++, npages, pass))
+				goto next_glyph;
+
 			if (unlikely(p->atlas != glyph_atlas)) {
 				if (unlikely(!glyph_valid(glyph)))
 					goto next_glyph;
@@ -651,6 +882,7 @@ glyphs_to_dst(struct sna *sna,
 
 				glyph_atlas = p->atlas;
 			}
+			glyph_touch(&sna->render, p);
 
 			if (nrect) {
 				int xi = x - glyph->info.x;
@@ -730,6 +962,12 @@ next_glyph:
 		}
 		list++;
 	}
+	if (npages > 1 && pass++ < npages) {
+		list = first_list;
+		glyphs = first_glyph;
+		nlist = first_nlist;
+		goto next_pass;
+	}
 	if (glyph_atlas != NO_ATLAS)
 		tmp.done(sna, &tmp);
 
@@ -747,6 +985,12 @@ glyphs0_to_dst(struct sna *sna,
 	struct sna_composite_op tmp;
 	ScreenPtr screen = dst->pDrawable->pScreen;
 	PicturePtr glyph_atlas = NO_ATLAS;
+	PicturePtr pages[2*GLYPH_CACHE_PAGES];
+	uint8_t order[N_STACK_GLYPHS];
+	GlyphListPtr first_list = list;
+	GlyphPtr *first_glyph = glyphs;
+	int first_nlist = nlist;
+	int npages, pass = 0, k;
 	int x, y;
 
 	if (NO_GLYPHS_TO_DST)
@@ -758,10 +1002,8 @@ glyphs0_to_dst(struct sna *sna,
 	     __FUNCTION__, op, src_x, src_y, nlist,
 	     list->xOff, list->yOff, dst->pDrawable->x, dst->pDrawable->y));
 
-	x = dst->pDrawable->x;
-	y = dst->pDrawable->y;
-	src_x -= list->xOff + x;
-	src_y -= list->yOff + y;
+	src_x -= list->xOff + dst->pDrawable->x;
+	src_y -= list->yOff + dst->pDrawable->y;
 
 	if (clipped_glyphs(dst, nlist, list, glyphs)) {
 		const BoxRec *rects = region_rects(dst->pCompositeClip);
@@ -769,6 +1011,16 @@ glyphs0_to_dst(struct sna *sna,
 		if (nrect == 0)
 			return true;
 
+		/* Overlapping glyphs may only be reordered if the op commutes */
+		npages = 0;
+		if (op == PictOpOver || op == PictOpAdd)
+			npages = glyphs_cache_pages(screen, &sna->render,
+						    nlist, list, glyphs, pages, order);
+
+next_pass_N:
+		k = 0;
+		x = dst->pDrawable->x;
+		y = dst->pDrawable->y;
 		while (nlist--) {
 			int n = list->len;
 			x += list->xOff;
@@ -778,6 +1030,9 @@ glyphs0_to_dst(struct sna *sna,
 				struct sna_glyph *p = sna_glyph0(glyph);
 				int i, xi, yi;
 
+				if (!glyph_in_pass(order, k++, npages, pass))
+					goto next_glyph_N;
+
 				if (unlikely(p->atlas != glyph_atlas)) {
 					if (unlikely(!glyph_valid(glyph)))
 						goto next_glyph_N;
@@ -801,6 +1056,7 @@ glyphs0_to_dst(struct sna *sna,
 
 					glyph_atlas = p->atlas;
 				}
+				glyph_touch(&sna->render, p);
 
 				xi = x - glyph->info.x;
 				yi = y - glyph->info.y;
@@ -861,59 +1117,86 @@ next_glyph_N:
 			}
 			list++;
 		}
-	} else while (nlist--) {
-		int n = list->len;
-		x += list->xOff;
-		y += list->yOff;
-		while (n--) {
-			GlyphPtr glyph = *glyphs++;
-			struct sna_glyph *p = sna_glyph0(glyph);
-			struct sna_composite_rectangles r;
+		if (npages > 1 && pass++ < npages) {
+			list = first_list;
+			glyphs = first_glyph;
+			nlist = first_nlist;
+			goto next_pass_N;
+		}
+	} else {
+		npages = 0;
+		if (op == PictOpOver || op == PictOpAdd)
+			npages = glyphs_cache_pages(screen, &sna->render,
+						    nlist, list, glyphs, pages, order);
+
+next_pass_0:
+		k = 0;
+		x = dst->pDrawable->x;
+		y = dst->pDrawable->y;
+		while (nlist--) {
+			int n = list->len;
+			x += list->xOff;
+			y += list->yOff;
+			while (n--) {
+				GlyphPtr glyph = *glyphs++;
+				struct sna_glyph *p = sna_glyph0(glyph);
+				struct sna_composite_rectangles r;
 
-			if (unlikely(p->atlas != glyph_atlas)) {
-				if (unlikely(!glyph_valid(glyph)))
+				if (!glyph_in_pass(order, k++, npages, pass))
 					goto next_glyph_0;
 
-				if (glyph_atlas != NO_ATLAS) {
-					tmp.done(sna, &tmp);
-					glyph_atlas = NO_ATLAS;
-				}
-
-				if (unlikely(p->atlas == NULL)) {
-					if (!glyph_cache(screen, &sna->render, glyph))
+				if (unlikely(p->atlas != glyph_atlas)) {
+					if (unlikely(!glyph_valid(glyph)))
 						goto next_glyph_0;
-				}
 
-				if (!sna->render.composite(sna,
-							   op, src, p->atlas, dst,
-							   0, 0, 0, 0, 0, 0,
-							   0, 0,
-							   COMPOSITE_PARTIAL, &tmp))
-					return false;
+					if (glyph_atlas != NO_ATLAS) {
+						tmp.done(sna, &tmp);
+						glyph_atlas = NO_ATLAS;
+					}
 
-				glyph_atlas = p->atlas;
-			}
+					if (unlikely(p->atlas == NULL)) {
+						if (!glyph_cache(screen, &sna->render, glyph))
+							goto next_glyph_0;
+					}
 
-			r.dst.x = x - glyph->info.x;
-			r.dst.y = y - glyph->info.y;
-			r.src.x = r.dst.x + src_x;
-			r.src.y = r.dst.y + src_y;
-			r.mask = p->coordinate;
-			glyph_copy_size(&r, glyph);
+					if (!sna->render.composite(sna,
+								   op, src, p->atlas, dst,
+								   0, 0, 0, 0, 0, 0,
+								   0, 0,
+								   COMPOSITE_PARTIAL, &tmp))
+						return false;
 
-			DBG(("%s: glyph=(%d, %d)x(%d, %d), unclipped\n",
-			     __FUNCTION__,
-			     r.dst.x, r.dst.y,
-			     r.width, r.height));
+					glyph_atlas = p->atlas;
+				}
+				glyph_touch(&sna->render, p);
 
-			tmp.blt(sna, &tmp, &r);
-			apply_damage_clipped_to_dst(&tmp, &r, dst->pDrawable);
+				r.dst.x = x - glyph->info.x;
+				r.dst.y = y - glyph->info.y;
+				r.src.x = r.dst.x + src_x;
+				r.src.y = r.dst.y + src_y;
+				r.mask = p->coordinate;
+				glyph_copy_size(&r, glyph);
+
+				DBG(("%s: glyph=(%d, %d)x(%d, %d), unclipped\n",
+				     __FUNCTION__,
+				     r.dst.x, r.dst.y,
+				     r.width, r.height));
+
+				tmp.blt(sna, &tmp, &r);
+				apply_damage_clipped_to_dst(&tmp, &r, dst->pDrawable);
 
 next_glyph_0:
-			x += glyph->info.xOff;
-			y += glyph->info.yOff;
+				x += glyph->info.xOff;
+				y += glyph->info.yOff;
+			}
+			list++;
+		}
+		if (npages > 1 && pass++ < npages) {
+			list = first_list;
+			glyphs = first_glyph;
+			nlist = first_nlist;
+			goto next_pass_0;
 		}
-		list++;
 	}
 	if (glyph_atlas != NO_ATLAS)
 		tmp.done(sna, &tmp);
@@ -973,6 +1256,7 @@ glyphs_slow(struct sna *sna,
 				if (!glyph_cache(screen, &sna->render, glyph))
 					goto next_glyph;
 			}
+			glyph_touch(&sna->render, p);
 
 			DBG(("%s: glyph=(%d, %d)x(%d, %d), src=(%d, %d), mask=(%d, %d)\n",
 			     __FUNCTION__,
@@ -1339,6 +1623,12 @@ next_image:
 	} else {
 		struct sna_composite_op tmp;
 		PicturePtr glyph_atlas = NO_ATLAS;
+		PicturePtr pages[2*GLYPH_CACHE_PAGES];
+		uint8_t order[N_STACK_GLYPHS];
+		GlyphListPtr first_list = list;
+		GlyphPtr *first_glyph = glyphs;
+		int first_nlist = nlist;
+		int npages, pass = 0, k;
 
 		pixmap = screen->CreatePixmap(screen,
 					      width, height, format->depth,
@@ -1358,6 +1648,16 @@ next_image:
 		if (!clear_pixmap(sna, pixmap))
 			goto err_mask;
 
+		/* Accumulating into the mask with PictOpAdd, the glyphs can be
+		 * added in any order, so draw those from each page together.
+		 */
+		npages = glyphs_cache_pages(screen, &sna->render,
+					    nlist, list, glyphs, pages, order);
+
+next_pass:
+		k = 0;
+		x = -box.x1;
+		y = -box.y1;
 		do {
 			int n = list->len;
 			x += list->xOff;
@@ -1367,6 +1667,9 @@ next_image:
 				struct sna_glyph *p = sna_glyph(glyph);
 				struct sna_composite_rectangles r;
 
+				if (!glyph_in_pass(order, k++, npages, pass))
+					goto next_glyph;
+
 				if (unlikely(p->atlas != glyph_atlas)) {
 					bool ok;
 
@@ -1411,6 +1714,7 @@ next_image:
 
 					glyph_atlas = p->atlas;
 				}
+				glyph_touch(&sna->render, p);
 
 				DBG(("%s: blt glyph origin (%d, %d), offset (%d, %d), src (%d, %d), size (%d, %d)\n",
 				     __FUNCTION__,
@@ -1431,6 +1735,12 @@ next_glyph:
 			}
 			list++;
 		} while (--nlist);
+		if (npages > 1 && pass++ < npages) {
+			list = first_list;
+			glyphs = first_glyph;
+			nlist = first_nlist;
+			goto next_pass;
+		}
 		if (glyph_atlas != NO_ATLAS)
 			tmp.done(sna, &tmp);
 	}
@@ -2390,10 +2700,12 @@ sna_glyph_unrealize(ScreenPtr screen, GlyphPtr glyph)
 	if (p->atlas && p->atlas != GetGlyphPicture(glyph, screen)) {
 		struct sna *sna = to_sna_from_screen(screen);
 		struct sna_glyph_cache *cache = &sna->render.glyph[p->pos&1];
-		DBG(("%s: releasing glyph pos %d from cache %d\n",
-		     __FUNCTION__, p->pos >> 1, p->pos & 1));
-		assert(cache->glyphs[p->pos >> 1] == p);
-		cache->glyphs[p->pos >> 1] = NULL;
+		struct sna_glyph_page *page = glyph_page(cache, p->atlas);
+		DBG(("%s: releasing glyph pos %d from cache %d, page %d\n",
+		     __FUNCTION__, p->pos >> 1, p->pos & 1,
+		     (int)(page - cache->page)));
+		assert(page->glyphs[p->pos >> 1] == p);
+		page->glyphs[p->pos >> 1] = NULL;
 		p->atlas = NULL;
 	}
 
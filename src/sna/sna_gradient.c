@@ -32,6 +32,8 @@
 #include "sna.h"
 #include "sna_render.h"
 
+#include "intel_options.h"
+
 #define xFixedToDouble(f) pixman_fixed_to_double(f)
 
 bool
@@ -98,60 +100,80 @@ sna_gradient_sample_width(PictGradient *gradient)
 	return min(width, 1024);
 }
 
+/* The rasterised ramps are shared by every screen. Each screen keeps its
+ * own cache of bo referencing them, uploading its own copy from the
+ * pixels we keep alongside the stops, as the screens need not share a
+ * device.
+ */
+struct sna_gradient_ramp {
+	struct sna_gradient_ramp *next;
+	uint32_t hash;
+	int refcnt;
+	int width;
+	uint32_t *pixels;
+	int nstops;
+	PictGradientStop stops[];
+};
+
+static struct sna_gradient_ramp *ramps[GRADIENT_CACHE_HASH];
+
+static uint32_t
+gradient_hash(const PictGradient *pattern)
+{
+	const uint8_t *ptr = (const uint8_t *)pattern->stops;
+	int len = sizeof(PictGradientStop) * pattern->nstops;
+	uint32_t hash = 2166136261u; /* FNV-1a */
+
+	while (len--) {
+		hash ^= *ptr++;
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
 static bool
-_gradient_color_stops_equal(PictGradient *pattern,
-			    struct sna_gradient_cache *cache)
+ramp_equal(const struct sna_gradient_ramp *ramp,
+	   uint32_t hash, const PictGradient *pattern)
 {
-    if (cache->nstops != pattern->nstops)
-	    return false;
+	if (ramp->hash != hash)
+		return false;
+
+	if (ramp->nstops != pattern->nstops)
+		return false;
 
-    return memcmp(cache->stops,
-		  pattern->stops,
-		  sizeof(PictGradientStop)*cache->nstops) == 0;
+	return memcmp(ramp->stops,
+		      pattern->stops,
+		      sizeof(PictGradientStop)*ramp->nstops) == 0;
 }
 
-struct kgem_bo *
-sna_render_get_gradient(struct sna *sna,
-			PictGradient *pattern)
+static struct sna_gradient_ramp *
+ramp_create(uint32_t hash, PictGradient *pattern)
 {
-	struct sna_render *render = &sna->render;
-	struct sna_gradient_cache *cache;
+	struct sna_gradient_ramp *ramp;
 	pixman_image_t *gradient, *image;
 	pixman_point_fixed_t p1, p2;
-	int i, width;
-	struct kgem_bo *bo;
-
-	DBG(("%s: %dx[%f:%x ... %f:%x ... %f:%x]\n", __FUNCTION__,
-	     pattern->nstops,
-	     pattern->stops[0].x / 65536.,
-	     pattern->stops[0].color.alpha >> 8 << 24 |
-	     pattern->stops[0].color.red   >> 8 << 16 |
-	     pattern->stops[0].color.green >> 8 << 8 |
-	     pattern->stops[0].color.blue  >> 8 << 0,
-	     pattern->stops[pattern->nstops/2].x / 65536.,
-	     pattern->stops[pattern->nstops/2].color.alpha >> 8 << 24 |
-	     pattern->stops[pattern->nstops/2].color.red   >> 8 << 16 |
-	     pattern->stops[pattern->nstops/2].color.green >> 8 << 8 |
-	     pattern->stops[pattern->nstops/2].color.blue  >> 8 << 0,
-	     pattern->stops[pattern->nstops-1].x / 65536.,
-	     pattern->stops[pattern->nstops-1].color.alpha >> 8 << 24 |
-	     pattern->stops[pattern->nstops-1].color.red   >> 8 << 16 |
-	     pattern->stops[pattern->nstops-1].color.green >> 8 << 8 |
-	     pattern->stops[pattern->nstops-1].color.blue  >> 8 << 0));
-
-	for (i = 0; i < render->gradient_cache.size; i++) {
-		cache = &render->gradient_cache.cache[i];
-		if (_gradient_color_stops_equal(pattern, cache)) {
-			DBG(("%s: old --> %d\n", __FUNCTION__, i));
-			return kgem_bo_reference(cache->bo);
-		}
-	}
+	int width;
 
 	width = sna_gradient_sample_width(pattern);
 	DBG(("%s: sample width = %d\n", __FUNCTION__, width));
 	if (width == 0)
 		return NULL;
 
+	ramp = malloc(sizeof(*ramp) +
+		      sizeof(PictGradientStop) * pattern->nstops +
+		      sizeof(uint32_t) * width);
+	if (ramp == NULL)
+		return NULL;
+
+	ramp->hash = hash;
+	ramp->refcnt = 0;
+	ramp->width = width;
+	ramp->nstops = pattern->nstops;
+	memcpy(ramp->stops, pattern->stops,
+	       sizeof(PictGradientStop) * pattern->nstops);
+	ramp->pixels = (uint32_t *)(ramp->stops + pattern->nstops);
+
 	p1.x = 0;
 	p1.y = 0;
 	p2.x = width << 16;
@@ -161,15 +183,16 @@ sna_render_get_gradient(struct sna *sna,
 						       (pixman_gradient_stop_t *)pattern->stops,
 						       pattern->nstops);
 	if (gradient == NULL)
-		return NULL;
+		goto err;
 
 	pixman_image_set_filter(gradient, PIXMAN_FILTER_BILINEAR, NULL, 0);
 	pixman_image_set_repeat(gradient, PIXMAN_REPEAT_PAD);
 
-	image = pixman_image_create_bits(PIXMAN_a8r8g8b8, width, 1, NULL, 0);
+	image = pixman_image_create_bits(PIXMAN_a8r8g8b8, width, 1,
+					 ramp->pixels, 4*width);
 	if (image == NULL) {
 		pixman_image_unref(gradient);
-		return NULL;
+		goto err;
 	}
 
 	pixman_image_composite(PIXMAN_OP_SRC,
@@ -179,48 +202,174 @@ sna_render_get_gradient(struct sna *sna,
 			       0, 0,
 			       width, 1);
 	pixman_image_unref(gradient);
+	pixman_image_unref(image);
 
 	DBG(("%s: [0]=%x, [%d]=%x [%d]=%x\n", __FUNCTION__,
-	     pixman_image_get_data(image)[0],
-	     width/2, pixman_image_get_data(image)[width/2],
-	     width-1, pixman_image_get_data(image)[width-1]));
+	     ramp->pixels[0],
+	     width/2, ramp->pixels[width/2],
+	     width-1, ramp->pixels[width-1]));
 
-	bo = kgem_create_linear(&sna->kgem, width*4, 0);
-	if (!bo) {
-		pixman_image_unref(image);
-		return NULL;
+	ramp->next = ramps[hash % GRADIENT_CACHE_HASH];
+	ramps[hash % GRADIENT_CACHE_HASH] = ramp;
+	return ramp;
+
+err:
+	free(ramp);
+	return NULL;
+}
+
+static struct sna_gradient_ramp *
+ramp_get(uint32_t hash, PictGradient *pattern)
+{
+	struct sna_gradient_ramp *ramp;
+
+	for (ramp = ramps[hash % GRADIENT_CACHE_HASH]; ramp; ramp = ramp->next) {
+		if (ramp_equal(ramp, hash, pattern)) {
+			DBG(("%s: shared ramp, refcnt=%d\n",
+			     __FUNCTION__, ramp->refcnt));
+			break;
+		}
 	}
+	if (ramp == NULL)
+		ramp = ramp_create(hash, pattern);
+	if (ramp)
+		ramp->refcnt++;
 
-	bo->pitch = 4*width;
-	kgem_bo_write(&sna->kgem, bo, pixman_image_get_data(image), 4*width);
+	return ramp;
+}
 
-	pixman_image_unref(image);
+static void
+ramp_put(struct sna_gradient_ramp *ramp)
+{
+	struct sna_gradient_ramp **prev;
 
-	if (render->gradient_cache.size < GRADIENT_CACHE_SIZE)
-		i = render->gradient_cache.size++;
-	else
-		i = rand () % GRADIENT_CACHE_SIZE;
+	assert(ramp->refcnt > 0);
+	if (--ramp->refcnt)
+		return;
 
-	cache = &render->gradient_cache.cache[i];
-	if (cache->nstops < pattern->nstops) {
-		PictGradientStop *newstops;
+	for (prev = &ramps[ramp->hash % GRADIENT_CACHE_HASH];
+	     *prev != ramp;
+	     prev = &(*prev)->next)
+		;
+	*prev = ramp->next;
+	free(ramp);
+}
 
-		newstops = malloc(sizeof(PictGradientStop) * pattern->nstops);
-		if (newstops == NULL)
-			return bo;
+static struct kgem_bo *
+ramp_bo(struct sna *sna, struct sna_gradient_ramp *ramp)
+{
+	struct kgem_bo *bo;
+
+	bo = kgem_create_linear(&sna->kgem, 4*ramp->width, 0);
+	if (bo == NULL)
+		return NULL;
 
-		free(cache->stops);
-		cache->stops = newstops;
+	bo->pitch = 4*ramp->width;
+	if (!kgem_bo_write(&sna->kgem, bo, ramp->pixels, 4*ramp->width)) {
+		kgem_bo_destroy(&sna->kgem, bo);
+		return NULL;
 	}
 
-	memcpy(cache->stops, pattern->stops,
-	       sizeof(PictGradientStop) * pattern->nstops);
-	cache->nstops = pattern->nstops;
+	return bo;
+}
+
+static void
+gradient_cache_remove(struct sna *sna, struct sna_gradient_cache *cache)
+{
+	struct sna_render *render = &sna->render;
+	struct sna_gradient_cache **prev;
+
+	DBG(("%s: evicting ramp, width=%d, nstops=%d\n",
+	     __FUNCTION__, cache->ramp->width, cache->ramp->nstops));
+
+	for (prev = &render->gradient_cache.hash[cache->ramp->hash % GRADIENT_CACHE_HASH];
+	     *prev != cache;
+	     prev = &(*prev)->next)
+		;
+	*prev = cache->next;
+	list_del(&cache->link);
+	render->gradient_cache.size--;
+
+	kgem_bo_destroy(&sna->kgem, cache->bo);
+	ramp_put(cache->ramp);
+	free(cache);
+}
+
+struct kgem_bo *
+sna_render_get_gradient(struct sna *sna,
+			PictGradient *pattern)
+{
+	struct sna_render *render = &sna->render;
+	struct sna_gradient_cache *cache;
+	struct sna_gradient_ramp *ramp;
+	struct kgem_bo *bo;
+	uint32_t hash;
+
+	DBG(("%s: %dx[%f:%x ... %f:%x ... %f:%x]\n", __FUNCTION__,
+	     pattern->nstops,
+	     pattern->stops[0].x / 65536.,
+	     pattern->stops[0].color.alpha >> 8 << 24 |
+	     pattern->stops[0].color.red   >> 8 << 16 |
+	     pattern->stops[0].color.green >> 8 << 8 |
+	     pattern->stops[0].color.blue  >> 8 << 0,
+	     pattern->stops[pattern->nstops/2].x / 65536.,
+	     pattern->stops[pattern->nstops/2].color.alpha >> 8 << 24 |
+	     pattern->stops[pattern->nstops/2].color.red   >> 8 << 16 |
+	     pattern->stops[pattern->nstops/2].color.green >> 8 << 8 |
+	     pattern->stops[pattern->nstops/2].color.blue  >> 8 << 0,
+	     pattern->stops[pattern->nstops-1].x / 65536.,
+	     pattern->stops[pattern->nstops-1].color.alpha >> 8 << 24 |
+	     pattern->stops[pattern->nstops-1].color.red   >> 8 << 16 |
+	     pattern->stops[pattern->nstops-1].color.green >> 8 << 8 |
+	     pattern->stops[pattern->nstops-1].color.blue  >> 8 << 0));
+
+	hash = gradient_hash(pattern);
+	for (cache = render->gradient_cache.hash[hash % GRADIENT_CACHE_HASH];
+	     cache;
+	     cache = cache->next) {
+		if (ramp_equal(cache->ramp, hash, pattern)) {
+			DBG(("%s: old, hash=%08x\n", __FUNCTION__, hash));
+			list_move(&cache->link, &render->gradient_cache.lru);
+			render->gradient_cache.hits++;
+			return kgem_bo_reference(cache->bo);
+		}
+	}
+	render->gradient_cache.misses++;
+
+	ramp = ramp_get(hash, pattern);
+	if (ramp == NULL)
+		return NULL;
+
+	bo = ramp_bo(sna, ramp);
+	if (bo == NULL)
+		goto out;
+
+	if (render->gradient_cache.max == 0)
+		goto out;
+
+	cache = malloc(sizeof(*cache));
+	if (cache == NULL)
+		goto out;
+
+	if (render->gradient_cache.size == render->gradient_cache.max)
+		gradient_cache_remove(sna,
+				      list_last_entry(&render->gradient_cache.lru,
+						      struct sna_gradient_cache,
+						      link));
+
+	DBG(("%s: new, hash=%08x, cache size=%d\n",
+	     __FUNCTION__, hash, render->gradient_cache.size + 1));
 
-	if (cache->bo)
-		kgem_bo_destroy(&sna->kgem, cache->bo);
+	cache->ramp = ramp;
 	cache->bo = kgem_bo_reference(bo);
+	cache->next = render->gradient_cache.hash[hash % GRADIENT_CACHE_HASH];
+	render->gradient_cache.hash[hash % GRADIENT_CACHE_HASH] = cache;
+	list_add(&cache->link, &render->gradient_cache.lru);
+	render->gradient_cache.size++;
+	return bo;
 
+out:
+	ramp_put(ramp);
 	return bo;
 }
 
@@ -232,25 +381,135 @@ sna_render_flush_solid(struct sna *sna)
 	DBG(("sna_render_flush_solid(size=%d)\n", cache->size));
 	assert(cache->dirty);
 	assert(cache->size);
-	assert(cache->size <= 1024);
+	assert(cache->size <= SOLID_CACHE_SIZE);
+	assert(cache->map == NULL);
 
 	kgem_bo_write(&sna->kgem, cache->cache_bo,
 		      cache->color, cache->size*sizeof(uint32_t));
 	cache->dirty = 0;
 }
 
+static inline unsigned solid_hash(uint32_t color)
+{
+	return ((color * 0x9e3779b1) >> 16) & (SOLID_CACHE_HASH - 1);
+}
+
+static int solid_cache_find(struct sna_solid_cache *cache, uint32_t color)
+{
+	unsigned h = solid_hash(color);
+
+	while (cache->hash[h]) {
+		int i = cache->hash[h] - 1;
+		if (cache->color[i] == color)
+			return i;
+		h = (h + 1) & (SOLID_CACHE_HASH - 1);
+	}
+
+	return -1;
+}
+
+static void solid_cache_insert(struct sna_solid_cache *cache, int i)
+{
+	unsigned h = solid_hash(cache->color[i]);
+
+	while (cache->hash[h])
+		h = (h + 1) & (SOLID_CACHE_HASH - 1);
+	cache->hash[h] = i + 1;
+}
+
+static void solid_cache_remove(struct sna_solid_cache *cache, int i)
+{
+	unsigned h = solid_hash(cache->color[i]);
+	unsigned j, k;
+
+	while (cache->hash[h] != i + 1) {
+		assert(cache->hash[h]);
+		h = (h + 1) & (SOLID_CACHE_HASH - 1);
+	}
+
+	/* Shift the remainder of the probe chain back into the hole */
+	j = h;
+	for (;;) {
+		cache->hash[h] = 0;
+		do {
+			j = (j + 1) & (SOLID_CACHE_HASH - 1);
+			if (cache->hash[j] == 0)
+				return;
+			k = solid_hash(cache->color[cache->hash[j] - 1]);
+		} while (h <= j ? (h < k && k <= j) : (h < k || k <= j));
+		cache->hash[h] = cache->hash[j];
+		h = j;
+	}
+}
+
+static bool solid_cache_idle(struct sna *sna)
+{
+	struct kgem *kgem = &sna->kgem;
+	struct kgem_bo *bo = sna->render.solid_cache.cache_bo;
+
+	/* If the cache is referenced by the current batch, the per-slot
+	 * exec tracking tells us which entries are live in it, and we only
+	 * need to wait for the earlier batches to complete.
+	 */
+	if (bo->exec == NULL)
+		return !__kgem_bo_is_busy(kgem, bo);
+
+	if (!kgem->need_retire)
+		return true;
+
+	return (kgem_ring_is_idle(kgem, KGEM_RENDER) &&
+		kgem_ring_is_idle(kgem, KGEM_BLT));
+}
+
+static int solid_cache_evict(struct sna *sna)
+{
+	struct sna_solid_cache *cache = &sna->render.solid_cache;
+	int n, i;
+
+	if (!solid_cache_idle(sna)) {
+		DBG(("%s: cache busy\n", __FUNCTION__));
+		return -1;
+	}
+
+	/* Second-chance clock over the slots no longer held by anyone else */
+	for (n = 0; n < 2*SOLID_CACHE_SIZE; n++) {
+		struct kgem_bo *bo;
+
+		i = cache->evict;
+		cache->evict = (i + 1) & (SOLID_CACHE_SIZE - 1);
+
+		bo = cache->bo[i];
+		if (bo && (bo->refcnt > 1 || bo->exec))
+			continue;
+
+		if (cache->used[i]) {
+			cache->used[i] = 0;
+			continue;
+		}
+
+		DBG(("%s: evicting slot %d (%08x)\n",
+		     __FUNCTION__, i, cache->color[i]));
+		solid_cache_remove(cache, i);
+		if (bo) {
+			kgem_bo_destroy(&sna->kgem, bo);
+			cache->bo[i] = NULL;
+		}
+		cache->evictions++;
+		return i;
+	}
+
+	return -1;
+}
+
 static void
-sna_render_finish_solid(struct sna *sna, bool force)
+sna_render_finish_solid(struct sna *sna)
 {
 	struct sna_solid_cache *cache = &sna->render.solid_cache;
 	struct kgem_bo *old;
 	int i;
 
-	DBG(("sna_render_finish_solid(force=%d, domain=%d, busy=%d, dirty=%d, size=%d)\n",
-	     force, cache->cache_bo->domain, cache->cache_bo->rq != NULL, cache->dirty, cache->size));
-
-	if (!force && cache->cache_bo->domain != DOMAIN_GPU)
-		return;
+	DBG(("sna_render_finish_solid(domain=%d, busy=%d, dirty=%d, size=%d)\n",
+	     cache->cache_bo->domain, cache->cache_bo->rq != NULL, cache->dirty, cache->size));
 
 	if (cache->dirty)
 		sna_render_flush_solid(sna);
@@ -262,28 +521,24 @@ sna_render_finish_solid(struct sna *sna, bool force)
 		kgem_bo_destroy(&sna->kgem, cache->bo[i]);
 		cache->bo[i] = NULL;
 	}
+	memset(cache->hash, 0, sizeof(cache->hash));
+	memset(cache->used, 0, sizeof(cache->used));
+	cache->size = 0;
+	cache->last = 0;
+	cache->evict = 0;
 
 	DBG(("sna_render_finish_solid reset\n"));
 	old = cache->cache_bo;
 	cache->cache_bo = kgem_create_linear(&sna->kgem, sizeof(cache->color), 0);
 	if (cache->cache_bo == NULL) {
+		/* Reuse the busy bo, but only through synchronous writes */
 		cache->cache_bo = old;
-		old = NULL;
-	}
-
-	if (force)
-		cache->size = 0;
-	if (cache->last < cache->size) {
-		cache->bo[cache->last] = kgem_create_proxy(&sna->kgem, cache->cache_bo,
-							   cache->last*sizeof(uint32_t), sizeof(uint32_t));
-		if (cache->bo[cache->last])
-			cache->bo[cache->last]->pitch = 4;
-		else
-			cache->last = 1024;
+		cache->map = NULL;
+		return;
 	}
 
-	if (old)
-		kgem_bo_destroy(&sna->kgem, old);
+	cache->map = kgem_bo_map__async(&sna->kgem, cache->cache_bo);
+	kgem_bo_destroy(&sna->kgem, old);
 }
 
 struct kgem_bo *
@@ -333,32 +588,49 @@ sna_render_get_solid(struct sna *sna, uint32_t color)
 		}
 	}
 
-	if (cache->color[cache->last] == color) {
-		DBG(("sna_render_get_solid(%d) = %x (last)\n",
-		     cache->last, color));
-		return kgem_bo_reference(cache->bo[cache->last]);
+	i = cache->last;
+	if (i < cache->size && cache->color[i] == color && cache->bo[i]) {
+		DBG(("sna_render_get_solid(%d) = %x (last)\n", i, color));
+		cache->hits++;
+		return kgem_bo_reference(cache->bo[i]);
 	}
 
-	for (i = 0; i < cache->size; i++) {
-		if (cache->color[i] == color) {
-			if (cache->bo[i] == NULL) {
-				DBG(("sna_render_get_solid(%d) = %x (recreate)\n",
-				     i, color));
-				goto create;
-			} else {
-				DBG(("sna_render_get_solid(%d) = %x (old)\n",
-				     i, color));
-				goto done;
-			}
+	i = solid_cache_find(cache, color);
+	if (i >= 0) {
+		cache->hits++;
+		if (cache->bo[i] == NULL) {
+			DBG(("sna_render_get_solid(%d) = %x (recreate)\n",
+			     i, color));
+			goto create;
+		} else {
+			DBG(("sna_render_get_solid(%d) = %x (old)\n",
+			     i, color));
+			goto done;
 		}
 	}
 
-	sna_render_finish_solid(sna, i == ARRAY_SIZE(cache->color));
+	cache->misses++;
+
+	/* Without a mapping, we can only write into the bo whilst idle */
+	if (cache->map == NULL && cache->cache_bo->domain == DOMAIN_GPU)
+		sna_render_finish_solid(sna);
+
+	if (cache->size < SOLID_CACHE_SIZE) {
+		i = cache->size++;
+	} else {
+		i = solid_cache_evict(sna);
+		if (i < 0) {
+			sna_render_finish_solid(sna);
+			i = cache->size++;
+		}
+	}
 
-	i = cache->size++;
-	assert(i < ARRAY_SIZE(cache->color));
 	cache->color[i] = color;
-	cache->dirty = 1;
+	solid_cache_insert(cache, i);
+	if (cache->map)
+		cache->map[i] = color;
+	else
+		cache->dirty = 1;
 	DBG(("sna_render_get_solid(%d) = %x (new)\n", i, color));
 
 create:
@@ -367,6 +639,7 @@ create:
 	cache->bo[i]->pitch = 4;
 
 done:
+	cache->used[i] = 1;
 	cache->last = i;
 	return kgem_bo_reference(cache->bo[i]);
 }
@@ -426,12 +699,19 @@ static bool sna_solid_cache_init(struct sna *sna)
 	DBG(("%s\n", __FUNCTION__));
 
 	cache->cache_bo =
-		kgem_create_linear(&sna->kgem, 4096, 0);
+		kgem_create_linear(&sna->kgem, sizeof(cache->color), 0);
 	if (!cache->cache_bo)
 		return false;
 
+	/* The bo is persistent and written to in place, slot by slot, as
+	 * only slots that are no longer referenced by the GPU are replaced.
+	 */
+	cache->map = kgem_bo_map__async(&sna->kgem, cache->cache_bo);
+
+	memset(cache->hash, 0, sizeof(cache->hash));
+	memset(cache->used, 0, sizeof(cache->used));
 	cache->last = 0;
-	cache->color[cache->last] = 0;
+	cache->evict = 0;
 	cache->dirty = 0;
 	cache->size = 0;
 
@@ -440,8 +720,17 @@ static bool sna_solid_cache_init(struct sna *sna)
 
 bool sna_gradients_create(struct sna *sna)
 {
+	int max;
+
 	DBG(("%s\n", __FUNCTION__));
 
+	if (!xf86GetOptValInteger(sna->Options, OPTION_GRADIENT_CACHE, &max) ||
+	    max < 0)
+		max = GRADIENT_CACHE_SIZE;
+	sna->render.gradient_cache.max = max;
+	sna->render.gradient_cache.size = 0;
+	list_init(&sna->render.gradient_cache.lru);
+
 	if (unlikely(sna->kgem.wedged))
 		return true;
 
@@ -478,19 +767,29 @@ void sna_gradients_close(struct sna *sna)
 			kgem_bo_destroy(&sna->kgem, sna->render.solid_cache.bo[i]);
 	}
 	sna->render.solid_cache.cache_bo = 0;
+	sna->render.solid_cache.map = NULL;
 	sna->render.solid_cache.size = 0;
 	sna->render.solid_cache.dirty = 0;
 
-	for (i = 0; i < sna->render.gradient_cache.size; i++) {
-		struct sna_gradient_cache *cache =
-			&sna->render.gradient_cache.cache[i];
-
-		if (cache->bo)
-			kgem_bo_destroy(&sna->kgem, cache->bo);
-
-		free(cache->stops);
-		cache->stops = NULL;
-		cache->nstops = 0;
+	if (sna->render.solid_cache.hits + sna->render.solid_cache.misses)
+		xf86DrvMsgVerb(sna->scrn->scrnIndex, X_INFO, 4,
+			       "Solid cache: %lu hits, %lu misses, %lu evictions\n",
+			       sna->render.solid_cache.hits,
+			       sna->render.solid_cache.misses,
+			       sna->render.solid_cache.evictions);
+
+	if (sna->render.gradient_cache.hits + sna->render.gradient_cache.misses)
+		xf86DrvMsgVerb(sna->scrn->scrnIndex, X_INFO, 4,
+			       "Gradient cache: %lu hits, %lu misses\n",
+			       sna->render.gradient_cache.hits,
+			       sna->render.gradient_cache.misses);
+
+	for (i = 0; i < GRADIENT_CACHE_HASH; i++) {
+		while (sna->render.gradient_cache.hash[i])
+			gradient_cache_remove(sna,
+					      sna->render.gradient_cache.hash[i]);
 	}
-	sna->render.gradient_cache.size = 0;
+	assert(sna->render.gradient_cache.size == 0);
+	sna->render.gradient_cache.hits = 0;
+	sna->render.gradient_cache.misses = 0;
 }
@@ -0,0 +1,224 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "sna.h"
+
+/* Report when tasks in our cgroup (or the whole system) spend at least
+ * 200ms of any 2s window stalled on memory. Windows that are a multiple
+ * of 2s are accepted from unprivileged processes.
+ */
+#define PSI_TRIGGER "some 200000 2000000"
+
+static bool cgroup_path(char *buf, int size)
+{
+	char line[1024];
+	bool found = false;
+	FILE *file;
+
+	/* Only the unified (v2) hierarchy carries pressure and events */
+	file = fopen("/proc/self/cgroup", "r");
+	if (file == NULL)
+		return false;
+
+	while (fgets(line, sizeof(line), file)) {
+		char *eol;
+
+		if (strncmp(line, "0::", 3))
+			continue;
+
+		eol = strchr(line, '\n');
+		if (eol)
+			*eol = '\0';
+
+		found = snprintf(buf, size, "/sys/fs/cgroup%s", line + 3) < size;
+		break;
+	}
+	fclose(file);
+
+	return found;
+}
+
+static int open_psi(const char *cgroup)
+{
+	char path[1024];
+	int fd = -1;
+
+	if (cgroup) {
+		snprintf(path, sizeof(path), "%s/memory.pressure", cgroup);
+		fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	}
+	if (fd < 0)
+		fd = open("/proc/pressure/memory",
+			  O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (write(fd, PSI_TRIGGER, sizeof(PSI_TRIGGER)) < 0) {
+		DBG(("%s: failed to install trigger, errno=%d\n",
+		     __FUNCTION__, errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static bool read_memory_high(int fd, uint64_t *count)
+{
+	char buf[512], *s;
+	int len;
+
+	/* memory.events: low, high, max, oom, oom_kill, one per line */
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return false;
+	buf[len] = '\0';
+
+	for (s = buf; s; s = strchr(s, '\n')) {
+		if (*s == '\n')
+			s++;
+		if (strncmp(s, "high ", 5) == 0) {
+			*count = strtoull(s + 5, NULL, 10);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void sna_pressure_init(struct sna *sna, bool monitor)
+{
+	char cgroup[1024], path[1100];
+	bool has_cgroup;
+
+	sna->pressure.psi = -1;
+	sna->pressure.events = -1;
+	sna->pressure.high = 0;
+
+	if (!monitor)
+		return;
+
+	has_cgroup = cgroup_path(cgroup, sizeof(cgroup));
+	DBG(("%s: cgroup '%s'\n", __FUNCTION__, has_cgroup ? cgroup : ""));
+
+	sna->pressure.psi = open_psi(has_cgroup ? cgroup : NULL);
+
+	/* Reclaim from memory.high is what pushes the cgroup into swap */
+	if (has_cgroup) {
+		snprintf(path, sizeof(path), "%s/memory.events", cgroup);
+		sna->pressure.events = open(path, O_RDONLY | O_CLOEXEC);
+		if (sna->pressure.events >= 0 &&
+		    !read_memory_high(sna->pressure.events,
+				      &sna->pressure.high)) {
+			close(sna->pressure.events);
+			sna->pressure.events = -1;
+		}
+	}
+
+	DBG(("%s: psi=%d, events=%d\n", __FUNCTION__,
+	     sna->pressure.psi, sna->pressure.events));
+}
+
+static bool psi_triggered(struct sna *sna)
+{
+	struct pollfd pfd;
+
+	if (sna->pressure.psi < 0)
+		return false;
+
+	pfd.fd = sna->pressure.psi;
+	pfd.events = POLLPRI;
+	if (poll(&pfd, 1, 0) <= 0)
+		return false;
+
+	if (pfd.revents & (POLLERR | POLLNVAL)) {
+		DBG(("%s: trigger lost, detaching\n", __FUNCTION__));
+		close(sna->pressure.psi);
+		sna->pressure.psi = -1;
+		return false;
+	}
+
+	return pfd.revents & POLLPRI;
+}
+
+static bool memory_high_exceeded(struct sna *sna)
+{
+	uint64_t high;
+
+	if (sna->pressure.events < 0)
+		return false;
+
+	if (!read_memory_high(sna->pressure.events, &high) ||
+	    high == sna->pressure.high)
+		return false;
+
+	sna->pressure.high = high;
+	return true;
+}
+
+/* Called at most once a second from the block handler. The kernel
+ * notifications arrive as POLLPRI which the server does not wait upon,
+ * so we sample them instead; whilst anything is cached the expiry timer
+ * keeps waking us up.
+ */
+void sna_pressure_check(struct sna *sna)
+{
+	struct kgem *kgem = &sna->kgem;
+	bool psi = psi_triggered(sna);
+	bool high = memory_high_exceeded(sna);
+	uint64_t freed;
+
+	if (psi || high) {
+		freed = kgem_trim_cache(kgem, kgem->cache_budget / 2);
+		if (freed)
+			xf86DrvMsgVerb(sna->scrn->scrnIndex, X_INFO, 3,
+				       "Memory pressure (%s), released %llu KiB of cached buffers\n",
+				       high ? "memory.high" : "psi",
+				       (unsigned long long)freed >> 10);
+	} else if (kgem->cache_budget)
+		kgem_trim_cache(kgem, kgem->cache_budget);
+}
+
+void sna_pressure_fini(struct sna *sna)
+{
+	if (sna->pressure.psi >= 0) {
+		close(sna->pressure.psi);
+		sna->pressure.psi = -1;
+	}
+
+	if (sna->pressure.events >= 0) {
+		close(sna->pressure.events);
+		sna->pressure.events = -1;
+	}
+}
@@ -10,12 +10,17 @@
 #include <pthread.h>
 #include "atomic.h"
 
-#define GRADIENT_CACHE_SIZE 16
+#define GRADIENT_CACHE_SIZE 256 /* default, see Option "GradientCacheSize" */
+#define GRADIENT_CACHE_HASH 256
+#define SOLID_CACHE_SIZE 4096
+#define SOLID_CACHE_HASH (2*SOLID_CACHE_SIZE)
+#define GLYPH_CACHE_PAGES 8
 
 #define GXinvalid 0xff
 
 struct sna;
 struct sna_glyph;
+struct sna_gradient_ramp;
 struct sna_video;
 struct sna_video_frame;
 struct brw_compile;
@@ -313,27 +318,41 @@ struct sna_render {
 
 	struct sna_solid_cache {
 		struct kgem_bo *cache_bo;
-		struct kgem_bo *bo[1024];
-		uint32_t color[1024];
+		uint32_t *map;
+		struct kgem_bo *bo[SOLID_CACHE_SIZE];
+		uint32_t color[SOLID_CACHE_SIZE];
+		uint16_t hash[SOLID_CACHE_HASH]; /* slot + 1, 0 if empty */
+		uint8_t used[SOLID_CACHE_SIZE];
 		int last;
 		int size;
+		int evict;
 		int dirty;
+		unsigned long hits, misses, evictions;
 	} solid_cache;
 
 	struct {
 		struct sna_gradient_cache {
+			struct sna_gradient_cache *next;
+			struct list link;
+			struct sna_gradient_ramp *ramp;
 			struct kgem_bo *bo;
-			int nstops;
-			PictGradientStop *stops;
-		} cache[GRADIENT_CACHE_SIZE];
-		int size;
+		} *hash[GRADIENT_CACHE_HASH];
+		struct list lru;
+		int size, max;
+		unsigned long hits, misses;
 	} gradient_cache;
 
 	struct sna_glyph_cache{
-		PicturePtr picture;
-		struct sna_glyph **glyphs;
-		uint16_t count;
-		uint16_t evict;
+		PictFormatPtr format;
+		struct sna_glyph_page {
+			PicturePtr picture;
+			struct sna_glyph **glyphs;
+			uint16_t count;
+			uint16_t evict;
+		} page[GLYPH_CACHE_PAGES];
+		uint8_t num_pages, max_pages;
+		uint8_t current;
+		unsigned long lookups, misses, evictions;
 	} glyph[2];
 	pixman_image_t *white_image;
 	PicturePtr white_picture;
@@ -350,9 +369,27 @@ struct sna_render {
 	struct kgem_bo *vbo;
 	float *vertices;
 
+	/* gen8+ carve their vbo out of a persistently mapped ring */
+	struct sna_vertex_ring {
+#define VERTEX_RING_SLOTS 8
+#define VERTEX_RING_SLOT_SIZE (256*1024)
+		struct kgem_bo *bo;
+		uint8_t *map;
+		uint32_t seqno[VERTEX_RING_SLOTS];
+		int slot;
+		bool disabled;
+	} vertex_ring;
+
 	float vertex_data[1024];
 };
 
+struct sna_static_stream {
+	uint32_t size, used;
+	uint8_t *data;
+	struct sna_kernel_cache *cache;
+	bool uploaded;
+};
+
 struct gen2_render_state {
 	uint32_t target;
 	Bool need_invariant;
@@ -569,6 +606,18 @@ enum {
 	GEN8_WM_KERNEL_COUNT
 };
 
+/* Packets shadowed by gen8_state_commit() */
+enum {
+	GEN8_STATE_PS_BLEND,
+	GEN8_STATE_BLEND_POINTERS,
+	GEN8_STATE_SAMPLER_POINTERS,
+	GEN8_STATE_SBE,
+	GEN8_STATE_PS,
+	GEN8_STATE_VERTEX_ELEMENTS,
+	GEN8_STATE_COUNT
+};
+#define GEN8_STATE_DWORDS 12
+
 struct gen8_render_state {
 	unsigned gt;
 
@@ -577,6 +626,7 @@ struct gen8_render_state {
 
 	const struct gt_info *info;
 	struct kgem_bo *general_bo;
+	struct sna_static_stream general;
 
 	uint32_t vs_state;
 	uint32_t sf_state;
@@ -588,12 +638,13 @@ struct gen8_render_state {
 
 	uint32_t drawrect_offset;
 	uint32_t drawrect_limit;
-	uint32_t blend;
-	uint32_t samplers;
-	uint32_t kernel;
 
-	uint16_t num_sf_outputs;
-	uint16_t ve_id;
+	struct {
+		uint32_t dw[GEN8_STATE_COUNT][GEN8_STATE_DWORDS];
+		uint8_t len[GEN8_STATE_COUNT];
+		uint32_t saved;
+	} shadow;
+
 	uint16_t last_primitive;
 	uint16_t floats_per_vertex;
 	uint16_t surface_table;
@@ -630,6 +681,18 @@ enum {
 	GEN9_WM_KERNEL_COUNT
 };
 
+/* Packets shadowed by gen9_state_commit() */
+enum {
+	GEN9_STATE_PS_BLEND,
+	GEN9_STATE_BLEND_POINTERS,
+	GEN9_STATE_SAMPLER_POINTERS,
+	GEN9_STATE_SBE,
+	GEN9_STATE_PS,
+	GEN9_STATE_VERTEX_ELEMENTS,
+	GEN9_STATE_COUNT
+};
+#define GEN9_STATE_DWORDS 12
+
 struct gen9_render_state {
 	unsigned gt;
 
@@ -639,6 +702,7 @@ struct gen9_render_state {
 
 	const struct gt_info *info;
 	struct kgem_bo *general_bo;
+	struct sna_static_stream general;
 
 	uint32_t vs_state;
 	uint32_t sf_state;
@@ -650,22 +714,19 @@ struct gen9_render_state {
 
 	uint32_t drawrect_offset;
 	uint32_t drawrect_limit;
-	uint32_t blend;
-	uint32_t samplers;
-	uint32_t kernel;
 
-	uint16_t num_sf_outputs;
-	uint16_t ve_id;
+	struct {
+		uint32_t dw[GEN9_STATE_COUNT][GEN9_STATE_DWORDS];
+		uint8_t len[GEN9_STATE_COUNT];
+		uint32_t saved;
+	} shadow;
+
 	uint16_t last_primitive;
 	uint16_t floats_per_vertex;
 	uint16_t surface_table;
 };
 
-struct sna_static_stream {
-	uint32_t size, used;
-	uint8_t *data;
-};
-
+bool sna_kernel_cache_init(struct sna *sna);
 int sna_static_stream_init(struct sna_static_stream *stream);
 uint32_t sna_static_stream_add(struct sna_static_stream *stream,
 			       const void *data, uint32_t len, uint32_t align);
@@ -675,12 +736,16 @@ uint32_t sna_static_stream_offsetof(struct sna_static_stream *stream,
 				    void *ptr);
 unsigned sna_static_stream_compile_sf(struct sna *sna,
 				      struct sna_static_stream *stream,
+				      const char *name,
 				      bool (*compile)(struct brw_compile *));
 
 unsigned sna_static_stream_compile_wm(struct sna *sna,
 				      struct sna_static_stream *stream,
+				      const char *name,
 				      bool (*compile)(struct brw_compile *, int),
 				      int width);
+struct kgem_bo *sna_static_stream_upload(struct sna *sna,
+					 struct sna_static_stream *stream);
 struct kgem_bo *sna_static_stream_fini(struct sna *sna,
 				       struct sna_static_stream *stream);
 
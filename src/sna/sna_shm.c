@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sna.h"
+
+#include <resource.h>
+#include <shmint.h>
+
+/* ShmPutImage and ShmGetImage hand us a pointer into the client's segment
+ * but not the segment itself, and importing the pages with userptr is far
+ * more expensive than the blit. So we follow the segments as they are
+ * attached and detached, and keep a single userptr bo covering each one
+ * that any request within it can borrow a proxy of.
+ */
+
+struct sna_shm_segment {
+	struct list link;
+	ShmDescPtr desc;
+	struct kgem_bo *bo;
+	int refcnt;
+	bool failed;
+};
+
+/* Resolved once MIT-SHM has registered its type, see sna_shm_create() */
+static RESTYPE shm_seg_type;
+
+static bool is_shm_segment(RESTYPE type)
+{
+	return type == shm_seg_type;
+}
+
+static struct sna_shm_segment *
+find_segment(struct sna *sna, ShmDescPtr desc)
+{
+	struct sna_shm_segment *seg;
+
+	list_for_each_entry(seg, &sna->shm_segments, link)
+		if (seg->desc == desc)
+			return seg;
+
+	return NULL;
+}
+
+static void free_segment(struct sna *sna, struct sna_shm_segment *seg)
+{
+	DBG(("%s: addr=%p, size=%ld, handle=%d\n", __FUNCTION__,
+	     seg->desc->addr, (long)seg->desc->size,
+	     seg->bo ? seg->bo->handle : 0));
+
+	if (seg->bo) {
+		/* Every user waited for the GPU before returning */
+		assert(!kgem_bo_is_busy(seg->bo));
+		kgem_bo_destroy(&sna->kgem, seg->bo);
+	}
+
+	list_del(&seg->link);
+	free(seg);
+}
+
+static void
+sna_shm_resource_state(CallbackListPtr *list, void *closure, void *data)
+{
+	ResourceStateInfoRec *info = data;
+	struct sna *sna = closure;
+	struct sna_shm_segment *seg;
+	ShmDescPtr desc;
+
+	if (!is_shm_segment(info->type))
+		return;
+
+	desc = info->value;
+	seg = find_segment(sna, desc);
+
+	switch (info->state) {
+	case ResourceStateAdding:
+		if (seg == NULL) {
+			seg = calloc(1, sizeof(*seg));
+			if (seg == NULL)
+				return;
+
+			seg->desc = desc;
+			list_add(&seg->link, &sna->shm_segments);
+		}
+		seg->refcnt++;
+		break;
+
+	case ResourceStateFreeing:
+		if (seg && --seg->refcnt == 0)
+			free_segment(sna, seg);
+		break;
+	}
+}
+
+/* Borrow a proxy of the segment containing [ptr, ptr+size), if any */
+struct kgem_bo *sna_shm_map(struct sna *sna, void *ptr, int size, bool write)
+{
+	struct sna_shm_segment *seg;
+	char *addr = ptr;
+
+	list_for_each_entry(seg, &sna->shm_segments, link) {
+		struct kgem_bo *bo;
+
+		if (addr < seg->desc->addr ||
+		    addr + size > seg->desc->addr + seg->desc->size)
+			continue;
+
+		if (seg->failed || (write && !seg->desc->writable))
+			return NULL;
+
+		if (seg->bo == NULL) {
+			if ((uintptr_t)seg->desc->addr & (PAGE_SIZE - 1) ||
+			    seg->desc->size > sna->kgem.max_object_size) {
+				seg->failed = true;
+				return NULL;
+			}
+
+			seg->bo = kgem_create_map(&sna->kgem,
+						  seg->desc->addr,
+						  seg->desc->size,
+						  !seg->desc->writable);
+			if (seg->bo == NULL) {
+				DBG(("%s: failed to import segment %p\n",
+				     __FUNCTION__, seg->desc->addr));
+				seg->failed = true;
+				return NULL;
+			}
+			kgem_bo_mark_unreusable(seg->bo);
+		}
+
+		bo = kgem_create_proxy(&sna->kgem, seg->bo,
+				       addr - seg->desc->addr, size);
+		if (bo == NULL)
+			return NULL;
+
+		bo->map__cpu = MAKE_USER_MAP(ptr);
+
+		/* Keep the most recently used segment at the front */
+		list_move(&seg->link, &sna->shm_segments);
+
+		DBG(("%s: ptr=%p, size=%d => handle=%d, offset=%d\n",
+		     __FUNCTION__, ptr, size, bo->handle, bo->delta));
+		return bo;
+	}
+
+	return NULL;
+}
+
+void sna_shm_init(struct sna *sna)
+{
+	list_init(&sna->shm_segments);
+}
+
+/* The extensions are initialised after the screens, so the segment type
+ * only exists by the time we are asked to create the screen resources.
+ * Only then start following the resources, and not at all if MIT-SHM is
+ * disabled.
+ */
+void sna_shm_create(struct sna *sna)
+{
+	shm_seg_type = ShmSegType;
+	DBG(("%s: segment type=%lx\n", __FUNCTION__, (long)shm_seg_type));
+	if (shm_seg_type == 0)
+		return;
+
+	AddCallback(&ResourceStateCallback, sna_shm_resource_state, sna);
+}
+
+void sna_shm_fini(struct sna *sna)
+{
+	/* The type is allocated afresh for each server generation */
+	DeleteCallback(&ResourceStateCallback, sna_shm_resource_state, sna);
+	shm_seg_type = 0;
+
+	while (!list_is_empty(&sna->shm_segments))
+		free_segment(sna,
+			     list_first_entry(&sna->shm_segments,
+					      struct sna_shm_segment,
+					      link));
+}
@@ -33,8 +33,438 @@
 #include "sna_render.h"
 #include "brw/brw.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <link.h>
+#include <elf.h>
+
+/* The compiled kernels depend only upon the generation and the driver
+ * build, so rather than run the assembler on every startup we keep the
+ * output of the last run on disk. Each kernel is identified by the name
+ * the backend gives it, together with its type and dispatch width, and
+ * the file as a whole by the build-id of the driver that compiled it.
+ */
+#define KERNEL_CACHE_MAGIC 0x4b414e53 /* "SNAK" */
+#define KERNEL_CACHE_VERSION 2
+
+enum { KERNEL_SF, KERNEL_WM };
+
+struct kernel_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t gen;
+	uint32_t count;
+	uint32_t size;
+	uint32_t checksum;
+	char build_id[64];
+};
+
+struct kernel_cache_entry {
+	char name[32];
+	uint16_t type;
+	uint16_t width;
+	uint32_t offset;
+	uint32_t length;
+};
+
+struct sna_kernel_cache {
+	void *map;
+	size_t map_size;
+	const struct kernel_cache_entry *entry;
+	const uint8_t *payload;
+	uint32_t size;
+	int count;
+
+	struct kernel_cache_entry *record;
+	int num_records, max_records;
+	bool dirty;
+};
+
+static uint32_t kernel_cache_checksum(const void *data, size_t len,
+				      uint32_t hash)
+{
+	const uint8_t *p = data;
+
+	/* FNV-1a */
+	while (len--)
+		hash = (hash ^ *p++) * 16777619;
+	return hash;
+}
+
+struct build_id {
+	uintptr_t addr;
+	char *buf;
+	int len;
+};
+
+static bool contains(const struct dl_phdr_info *info, uintptr_t addr)
+{
+	int n;
+
+	for (n = 0; n < info->dlpi_phnum; n++) {
+		const ElfW(Phdr) *phdr = &info->dlpi_phdr[n];
+		uintptr_t start = info->dlpi_addr + phdr->p_vaddr;
+
+		if (phdr->p_type == PT_LOAD &&
+		    addr >= start && addr - start < phdr->p_memsz)
+			return true;
+	}
+
+	return false;
+}
+
+static int find_build_id(struct dl_phdr_info *info, size_t size, void *closure)
+{
+	struct build_id *id = closure;
+	int n;
+
+	(void)size;
+
+	/* Only interested in the object we were loaded from */
+	if (!contains(info, id->addr))
+		return 0;
+
+	for (n = 0; n < info->dlpi_phnum; n++) {
+		const ElfW(Phdr) *phdr = &info->dlpi_phdr[n];
+		const uint8_t *ptr, *end;
+
+		if (phdr->p_type != PT_NOTE)
+			continue;
+
+		ptr = (const uint8_t *)(info->dlpi_addr + phdr->p_vaddr);
+		end = ptr + phdr->p_memsz;
+		while (ptr + sizeof(ElfW(Nhdr)) <= end) {
+			const ElfW(Nhdr) *note = (const ElfW(Nhdr) *)ptr;
+			const uint8_t *name = (const uint8_t *)(note + 1);
+			const uint8_t *desc = name + ALIGN(note->n_namesz, 4);
+
+			ptr = desc + ALIGN(note->n_descsz, 4);
+			if (ptr > end)
+				break;
+
+			if (note->n_type == NT_GNU_BUILD_ID &&
+			    note->n_namesz == 4 && memcmp(name, "GNU", 4) == 0) {
+				int i, len = note->n_descsz;
+
+				if (len > (id->len - 1) / 2)
+					len = (id->len - 1) / 2;
+				for (i = 0; i < len; i++)
+					sprintf(id->buf + 2*i, "%02x", desc[i]);
+				return len > 0;
+			}
+		}
+	}
+
+	/* The right object, but linked without --build-id */
+	return -1;
+}
+
+/* Identify the driver by its build-id, as a version string says nothing
+ * about local changes to the kernels or to the assembler.
+ */
+bool sna_kernel_cache_init(struct sna *sna)
+{
+	struct build_id id;
+
+	id.addr = (uintptr_t)sna_kernel_cache_init;
+	id.buf = sna->kernel_cache.build_id;
+	id.len = sizeof(sna->kernel_cache.build_id);
+	id.buf[0] = '\0';
+
+	if (dl_iterate_phdr(find_build_id, &id) <= 0)
+		return false;
+
+	DBG(("%s: build-id %s\n", __FUNCTION__, id.buf));
+	return true;
+}
+
+static void kernel_cache_filename(struct sna *sna, char *buf, int len)
+{
+	snprintf(buf, len, "%s/sna-kernels-%03o",
+		 sna->kernel_cache.path, sna->kgem.gen);
+}
+
+static bool kernel_cache_load(struct sna *sna, struct sna_kernel_cache *cache)
+{
+	const struct kernel_cache_header *hdr;
+	const struct kernel_cache_entry *entry;
+	char filename[1024];
+	struct stat st;
+	uint32_t hash;
+	int fd, n;
+
+	kernel_cache_filename(sna, filename, sizeof(filename));
+	fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*hdr)) {
+		close(fd);
+		return false;
+	}
+
+	cache->map_size = st.st_size;
+	cache->map = mmap(NULL, cache->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (cache->map == MAP_FAILED) {
+		cache->map = NULL;
+		return false;
+	}
+
+	hdr = cache->map;
+	if (hdr->magic != KERNEL_CACHE_MAGIC ||
+	    hdr->version != KERNEL_CACHE_VERSION ||
+	    hdr->gen != (unsigned)sna->kgem.gen ||
+	    strncmp(hdr->build_id, sna->kernel_cache.build_id,
+		    sizeof(hdr->build_id))) {
+		DBG(("%s: %s is stale\n", __FUNCTION__, filename));
+		goto stale;
+	}
+
+	if ((uint64_t)hdr->count * sizeof(*entry) + hdr->size !=
+	    cache->map_size - sizeof(*hdr)) {
+		DBG(("%s: %s is truncated\n", __FUNCTION__, filename));
+		goto stale;
+	}
+
+	entry = (const struct kernel_cache_entry *)(hdr + 1);
+	hash = kernel_cache_checksum(entry,
+				     cache->map_size - sizeof(*hdr),
+				     2166136261u);
+	if (hash != hdr->checksum) {
+		DBG(("%s: %s is corrupt\n", __FUNCTION__, filename));
+		goto stale;
+	}
+
+	for (n = 0; n < (int)hdr->count; n++) {
+		if (entry[n].offset > hdr->size ||
+		    entry[n].length > hdr->size - entry[n].offset ||
+		    entry[n].length % sizeof(struct brw_instruction) ||
+		    memchr(entry[n].name, 0, sizeof(entry[n].name)) == NULL) {
+			DBG(("%s: %s has an invalid entry %d\n",
+			     __FUNCTION__, filename, n));
+			goto stale;
+		}
+	}
+
+	cache->entry = entry;
+	cache->payload = (const uint8_t *)(entry + hdr->count);
+	cache->size = hdr->size;
+	cache->count = hdr->count;
+
+	DBG(("%s: loaded %d kernels from %s\n",
+	     __FUNCTION__, cache->count, filename));
+	return true;
+
+stale:
+	munmap(cache->map, cache->map_size);
+	cache->map = NULL;
+	return false;
+}
+
+static void kernel_cache_save(struct sna *sna,
+			      struct sna_kernel_cache *cache,
+			      struct sna_static_stream *stream)
+{
+	struct kernel_cache_header hdr;
+	char filename[1024], tmp[1040];
+	uint32_t offset;
+	FILE *file;
+	bool ok;
+	int fd, n;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = KERNEL_CACHE_MAGIC;
+	hdr.version = KERNEL_CACHE_VERSION;
+	hdr.gen = sna->kgem.gen;
+	hdr.count = cache->num_records;
+	strncpy(hdr.build_id, sna->kernel_cache.build_id, sizeof(hdr.build_id));
+
+	/* Rewrite the offsets to be relative to the packed payload */
+	offset = 0;
+	hdr.checksum = 2166136261u;
+	for (n = 0; n < cache->num_records; n++) {
+		struct kernel_cache_entry e = cache->record[n];
+
+		e.offset = offset;
+		offset += e.length;
+		hdr.checksum = kernel_cache_checksum(&e, sizeof(e),
+						     hdr.checksum);
+	}
+	hdr.size = offset;
+	for (n = 0; n < cache->num_records; n++)
+		hdr.checksum = kernel_cache_checksum(stream->data + cache->record[n].offset,
+						     cache->record[n].length,
+						     hdr.checksum);
+
+	/* Write to a temporary and rename so that a concurrent server
+	 * never sees a partial file.
+	 */
+	kernel_cache_filename(sna, filename, sizeof(filename));
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", filename);
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		DBG(("%s: unable to create %s\n", __FUNCTION__, tmp));
+		return;
+	}
+
+	file = fdopen(fd, "w");
+	if (file == NULL) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+
+	fwrite(&hdr, sizeof(hdr), 1, file);
+	offset = 0;
+	for (n = 0; n < cache->num_records; n++) {
+		struct kernel_cache_entry e = cache->record[n];
+
+		e.offset = offset;
+		offset += e.length;
+		fwrite(&e, sizeof(e), 1, file);
+	}
+	for (n = 0; n < cache->num_records; n++)
+		fwrite(stream->data + cache->record[n].offset,
+		       cache->record[n].length, 1, file);
+
+	ok = !ferror(file);
+	if (fclose(file))
+		ok = false;
+	if (!ok || rename(tmp, filename)) {
+		DBG(("%s: failed to write %s\n", __FUNCTION__, filename));
+		unlink(tmp);
+		return;
+	}
+
+	DBG(("%s: saved %d kernels (%d bytes) to %s\n",
+	     __FUNCTION__, hdr.count, hdr.size, filename));
+}
+
+static struct sna_kernel_cache *kernel_cache_get(struct sna *sna,
+						 struct sna_static_stream *stream)
+{
+	struct sna_kernel_cache *cache = stream->cache;
+
+	if (cache == NULL && !stream->uploaded && sna->kernel_cache.path) {
+		cache = calloc(1, sizeof(*cache));
+		if (cache == NULL)
+			return NULL;
+
+		if (!kernel_cache_load(sna, cache))
+			cache->dirty = true;
+		stream->cache = cache;
+	}
+
+	return cache;
+}
+
+static void kernel_cache_record(struct sna_kernel_cache *cache,
+				const char *name, int type, int width,
+				uint32_t offset, uint32_t length)
+{
+	struct kernel_cache_entry *e;
+
+	if (cache->num_records < 0)
+		return;
+
+	if (cache->num_records == cache->max_records) {
+		int max = cache->max_records ? 2*cache->max_records : 64;
+
+		e = realloc(cache->record, max * sizeof(*e));
+		if (e == NULL) {
+			/* Too incomplete to be worth saving */
+			cache->num_records = -1;
+			cache->dirty = false;
+			return;
+		}
+
+		cache->record = e;
+		cache->max_records = max;
+	}
+
+	e = &cache->record[cache->num_records++];
+	memset(e->name, 0, sizeof(e->name));
+	strncpy(e->name, name, sizeof(e->name) - 1);
+	e->type = type;
+	e->width = width;
+	e->offset = offset;
+	e->length = length;
+}
+
+static bool kernel_cache_lookup(struct sna_kernel_cache *cache,
+				struct sna_static_stream *stream,
+				const char *name, int type, int width,
+				unsigned *offset)
+{
+	const struct kernel_cache_entry *e;
+	int n;
+
+	assert(strlen(name) < sizeof(e->name));
+
+	if (cache->map == NULL || cache->num_records < 0)
+		return false;
+
+	for (n = 0; n < cache->count; n++) {
+		e = &cache->entry[n];
+		if (e->type == type && e->width == width &&
+		    strcmp(e->name, name) == 0)
+			break;
+	}
+	if (n == cache->count) {
+		DBG(("%s: kernel %s/%d not found, compiling\n",
+		     __FUNCTION__, name, width));
+		cache->dirty = true;
+		return false;
+	}
+
+	if (e->offset > cache->size ||
+	    e->length > cache->size - e->offset) {
+		DBG(("%s: kernel %s/%d lies outside the cache, compiling\n",
+		     __FUNCTION__, name, width));
+		cache->dirty = true;
+		return false;
+	}
+
+	*offset = 0;
+	if (e->length) {
+		void *ptr = sna_static_stream_map(stream, e->length, 64);
+		memcpy(ptr, cache->payload + e->offset, e->length);
+		*offset = sna_static_stream_offsetof(stream, ptr);
+	}
+	kernel_cache_record(cache, name, type, width, *offset, e->length);
+	return true;
+}
+
+static void kernel_cache_fini(struct sna *sna, struct sna_static_stream *stream)
+{
+	struct sna_kernel_cache *cache = stream->cache;
+
+	if (cache == NULL)
+		return;
+
+	if (cache->map) {
+		/* Some of the stored kernels were not requested */
+		if (cache->num_records != cache->count)
+			cache->dirty = true;
+		munmap(cache->map, cache->map_size);
+	}
+
+	if (cache->dirty && cache->num_records > 0)
+		kernel_cache_save(sna, cache, stream);
+
+	free(cache->record);
+	free(cache);
+	stream->cache = NULL;
+}
+
 int sna_static_stream_init(struct sna_static_stream *stream)
 {
+	stream->cache = NULL;
+	stream->uploaded = false;
 	stream->used = 0;
 	stream->size = 64*1024;
 
@@ -80,19 +510,33 @@ uint32_t sna_static_stream_offsetof(struct sna_static_stream *stream, void *ptr)
 	return (uint8_t *)ptr - stream->data;
 }
 
-struct kgem_bo *sna_static_stream_fini(struct sna *sna,
-				       struct sna_static_stream *stream)
+/* Upload a copy of the stream, leaving it open for further additions */
+struct kgem_bo *sna_static_stream_upload(struct sna *sna,
+					 struct sna_static_stream *stream)
 {
 	struct kgem_bo *bo;
 
 	DBG(("uploaded %d bytes of static state\n", stream->used));
 
+	/* Only the kernels compiled during setup are cached */
+	kernel_cache_fini(sna, stream);
+	stream->uploaded = true;
+
 	bo = kgem_create_linear(&sna->kgem, stream->used, 0);
 	if (bo && !kgem_bo_write(&sna->kgem, bo, stream->data, stream->used)) {
 		kgem_bo_destroy(&sna->kgem, bo);
 		return NULL;
 	}
 
+	return bo;
+}
+
+struct kgem_bo *sna_static_stream_fini(struct sna *sna,
+				       struct sna_static_stream *stream)
+{
+	struct kgem_bo *bo;
+
+	bo = sna_static_stream_upload(sna, stream);
 	free(stream->data);
 
 	return bo;
@@ -101,9 +545,16 @@ struct kgem_bo *sna_static_stream_fini(struct sna *sna,
 unsigned
 sna_static_stream_compile_sf(struct sna *sna,
 			     struct sna_static_stream *stream,
+			     const char *name,
 			     bool (*compile)(struct brw_compile *))
 {
+	struct sna_kernel_cache *cache = kernel_cache_get(sna, stream);
 	struct brw_compile p;
+	unsigned offset;
+
+	if (cache &&
+	    kernel_cache_lookup(cache, stream, name, KERNEL_SF, 0, &offset))
+		return offset;
 
 	brw_compile_init(&p, sna->kgem.gen,
 			 sna_static_stream_map(stream,
@@ -111,22 +562,36 @@ sna_static_stream_compile_sf(struct sna *sna,
 
 	if (!compile(&p)) {
 		stream->used -= 64*sizeof(uint32_t);
+		if (cache)
+			kernel_cache_record(cache, name, KERNEL_SF, 0, 0, 0);
 		return 0;
 	}
 
 	assert(p.nr_insn*sizeof(struct brw_instruction) <= 64*sizeof(uint32_t));
 
 	stream->used -= 64*sizeof(uint32_t) - p.nr_insn*sizeof(struct brw_instruction);
-	return sna_static_stream_offsetof(stream, p.store);
+	offset = sna_static_stream_offsetof(stream, p.store);
+	if (cache)
+		kernel_cache_record(cache, name, KERNEL_SF, 0, offset,
+				    p.nr_insn*sizeof(struct brw_instruction));
+	return offset;
 }
 
 unsigned
 sna_static_stream_compile_wm(struct sna *sna,
 			     struct sna_static_stream *stream,
+			     const char *name,
 			     bool (*compile)(struct brw_compile *, int),
 			     int dispatch_width)
 {
+	struct sna_kernel_cache *cache = kernel_cache_get(sna, stream);
 	struct brw_compile p;
+	unsigned offset;
+
+	if (cache &&
+	    kernel_cache_lookup(cache, stream,
+				name, KERNEL_WM, dispatch_width, &offset))
+		return offset;
 
 	brw_compile_init(&p, sna->kgem.gen,
 			 sna_static_stream_map(stream,
@@ -134,11 +599,18 @@ sna_static_stream_compile_wm(struct sna *sna,
 
 	if (!compile(&p, dispatch_width)) {
 		stream->used -= 256*sizeof(uint32_t);
+		if (cache)
+			kernel_cache_record(cache, name,
+					    KERNEL_WM, dispatch_width, 0, 0);
 		return 0;
 	}
 
 	assert(p.nr_insn*sizeof(struct brw_instruction) <= 256*sizeof(uint32_t));
 
 	stream->used -= 256*sizeof(uint32_t) - p.nr_insn*sizeof(struct brw_instruction);
-	return sna_static_stream_offsetof(stream, p.store);
+	offset = sna_static_stream_offsetof(stream, p.store);
+	if (cache)
+		kernel_cache_record(cache, name, KERNEL_WM, dispatch_width, offset,
+				    p.nr_insn*sizeof(struct brw_instruction));
+	return offset;
 }
@@ -34,6 +34,8 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <signal.h>
+#include <time.h>
+#include <math.h>
 
 #ifdef HAVE_VALGRIND
 #include <valgrind.h>
@@ -44,41 +46,156 @@ static inline bool valgrind_active(void) { return false; }
 
 static int max_threads = -1;
 
+/* Work is handed to the pool through a single Chase-Lev work-stealing
+ * deque. Only the main thread pushes and pops at the bottom, while the
+ * workers steal from the top, so neither submitting nor picking up a
+ * task takes a lock. The main thread keeps executing tasks from the
+ * bottom whilst it waits for the pool, so an uneven split of the work
+ * is rebalanced by whoever finishes first.
+ *
+ * The indices increase monotonically and a push is refused whilst the
+ * deque is full, so a slot is never rewritten underneath a thief that
+ * has not yet claimed it.
+ */
+#define MAX_TASKS 256
+
+struct task {
+	void (*func)(void *arg);
+	void *arg;
+};
+
+static struct {
+	volatile unsigned top;
+	char pad[60];
+	volatile unsigned bottom;
+	struct task tasks[MAX_TASKS];
+} queue;
+
+static volatile int pending;
+static volatile int sleepers;
+static volatile int dead;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER;
+
+#define mb() __sync_synchronize()
+
 static struct thread {
     pthread_t thread;
-    pthread_mutex_t mutex;
-    pthread_cond_t cond;
-
-    void (*func)(void *arg);
-    void *arg;
+    int signal;
 } *threads;
 
+static bool queue_push(void (*func)(void *arg), void *arg)
+{
+	unsigned b = queue.bottom;
+	unsigned t = queue.top;
+	struct task *task;
+
+	if ((int)(b - t) >= MAX_TASKS)
+		return false;
+
+	task = &queue.tasks[b & (MAX_TASKS - 1)];
+	task->func = func;
+	task->arg = arg;
+
+	__sync_fetch_and_add(&pending, 1);
+	mb();
+	queue.bottom = b + 1;
+	return true;
+}
+
+static bool queue_pop(struct task *task)
+{
+	unsigned b, t;
+	bool ret = true;
+
+	b = queue.bottom - 1;
+	queue.bottom = b;
+	mb();
+	t = queue.top;
+
+	if ((int)(b - t) < 0) {
+		queue.bottom = b + 1;
+		return false;
+	}
+
+	*task = queue.tasks[b & (MAX_TASKS - 1)];
+	if (b == t) {
+		/* last task, race any thieves for it */
+		ret = __sync_bool_compare_and_swap(&queue.top, t, t + 1);
+		queue.bottom = t + 1;
+	}
+
+	return ret;
+}
+
+static bool queue_steal(struct task *task)
+{
+	unsigned b, t;
+
+	do {
+		t = queue.top;
+		mb();
+		b = queue.bottom;
+		if ((int)(b - t) <= 0)
+			return false;
+
+		*task = ((volatile struct task *)queue.tasks)[t & (MAX_TASKS - 1)];
+	} while (!__sync_bool_compare_and_swap(&queue.top, t, t + 1));
+
+	return true;
+}
+
+static bool queue_empty(void)
+{
+	return (int)(queue.bottom - queue.top) <= 0;
+}
+
+static void task_complete(void)
+{
+	if (__sync_sub_and_fetch(&pending, 1) == 0) {
+		pthread_mutex_lock(&lock);
+		pthread_cond_signal(&idle);
+		pthread_mutex_unlock(&lock);
+	}
+}
+
+static void unlock(void *arg)
+{
+	pthread_mutex_unlock(arg);
+}
+
 static void *__run__(void *arg)
 {
-	struct thread *t = arg;
 	sigset_t signals;
 
+	(void)arg;
+
 	/* Disable all signals in the slave threads as X uses them for IO */
 	sigfillset(&signals);
 	sigdelset(&signals, SIGBUS);
 	sigdelset(&signals, SIGSEGV);
 	pthread_sigmask(SIG_SETMASK, &signals, NULL);
 
-	pthread_mutex_lock(&t->mutex);
 	while (1) {
-		while (t->func == NULL)
-			pthread_cond_wait(&t->cond, &t->mutex);
-		pthread_mutex_unlock(&t->mutex);
+		struct task task;
 
-		assert(t->func);
-		t->func(t->arg);
+		if (queue_steal(&task)) {
+			task.func(task.arg);
+			task_complete();
+			continue;
+		}
 
-		pthread_mutex_lock(&t->mutex);
-		t->arg = NULL;
-		t->func = NULL;
-		pthread_cond_signal(&t->cond);
+		pthread_mutex_lock(&lock);
+		pthread_cleanup_push(unlock, &lock);
+		sleepers++;
+		mb();
+		while (queue_empty())
+			pthread_cond_wait(&wakeup, &lock);
+		sleepers--;
+		pthread_cleanup_pop(1);
 	}
-	pthread_mutex_unlock(&t->mutex);
 
 	return NULL;
 }
@@ -155,11 +272,7 @@ void sna_threads_init(void)
 		goto bail;
 
 	for (n = 1; n < max_threads; n++) {
-		pthread_mutex_init(&threads[n].mutex, NULL);
-		pthread_cond_init(&threads[n].cond, NULL);
-
-		threads[n].func = NULL;
-		threads[n].arg = NULL;
+		threads[n].signal = 0;
 		if (pthread_create(&threads[n].thread, NULL,
 				   __run__, &threads[n]))
 			goto bail;
@@ -172,19 +285,171 @@ bail:
 	max_threads = 0;
 }
 
+/* Each call site learns how long its threaded operations take, modelling
+ * the wall time to process P pixels across n threads as
+ *
+ *   t(n) = serial * P + cost * P / n + overhead * (n - 1)
+ *
+ * where serial is the per-pixel time that does not scale with more threads
+ * (e.g. once we saturate memory bandwidth), cost the per-pixel time that
+ * does, and overhead the price of waking and synchronising with each extra
+ * thread. The parameters are fitted by least squares over the recent
+ * threaded calls (older samples decay away), and from them we pick the n
+ * that minimises t(n). Until a site has seen enough samples we fall back
+ * to its static threshold.
+ */
+#define MODEL_WARMUP 8
+#define MODEL_DECAY 0.95
+#define MODEL_EXPLORE 16
+#define MODEL_MIN_OVERHEAD 1000. /* ns, roughly a futex wakeup */
+
+static struct sna_threads_site *sites;
+
+/* The threaded operation currently being timed, see __sna_use_threads() */
+static struct {
+	struct sna_threads_site *site;
+	uint64_t start;
+	double pixels;
+	int tasks;
+} measure;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double det3(const double m[3][3])
+{
+	return (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+		m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+		m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]));
+}
+
+static bool site_solve3(struct sna_threads_site *site)
+{
+	double m[3][3], x[3], det;
+	int i, j;
+
+	det = det3(site->sxx);
+	if (det <= 1e-9 * site->sxx[0][0] * site->sxx[1][1] * site->sxx[2][2])
+		return false;
+
+	/* Cramer's rule, solving for each parameter in turn */
+	for (i = 0; i < 3; i++) {
+		memcpy(m, site->sxx, sizeof(m));
+		for (j = 0; j < 3; j++)
+			m[j][i] = site->sxt[j];
+		x[i] = det3(m) / det;
+	}
+
+	site->serial = x[0];
+	site->cost = x[1];
+	site->overhead = x[2];
+	return true;
+}
+
+static bool site_solve2(struct sna_threads_site *site)
+{
+	double det;
+
+	det = site->sxx[1][1] * site->sxx[2][2] - site->sxx[1][2] * site->sxx[1][2];
+	if (det <= 1e-9 * site->sxx[1][1] * site->sxx[2][2])
+		return false;
+
+	site->serial = 0;
+	site->cost = (site->sxt[1] * site->sxx[2][2] - site->sxt[2] * site->sxx[1][2]) / det;
+	site->overhead = (site->sxt[2] * site->sxx[1][1] - site->sxt[1] * site->sxx[1][2]) / det;
+	return true;
+}
+
+static void site_update(struct sna_threads_site *site,
+			int n, double pixels, double t)
+{
+	double x[3] = { pixels, pixels / n, n - 1 };
+	int i, j;
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++)
+			site->sxx[i][j] = MODEL_DECAY * site->sxx[i][j] + x[i] * x[j];
+		site->sxt[i] = MODEL_DECAY * site->sxt[i] + x[i] * t;
+	}
+	site->samples++;
+
+	/* Until we have seen a spread of thread counts, we cannot tell the
+	 * scalable cost apart from the serial cost, or either from the
+	 * per-thread overhead: so fall back to the simpler models, keeping
+	 * the last overhead and refitting the cost alone.
+	 */
+	if (!site_solve3(site) && !site_solve2(site)) {
+		site->serial = 0;
+		site->cost = (site->sxt[1] - site->overhead * site->sxx[1][2]) / site->sxx[1][1];
+	}
+
+	if (site->serial < 0)
+		site->serial = 0;
+	if (site->cost < 0)
+		site->cost = 0;
+	if (site->overhead < MODEL_MIN_OVERHEAD)
+		site->overhead = MODEL_MIN_OVERHEAD;
+
+	DBG(("%s: %s:%d n=%d, pixels=%.0f, time=%.0fns -> serial=%.3fns/px, cost=%.3fns/px, overhead=%.0fns\n",
+	     __FUNCTION__, site->func, site->line, n, pixels, t,
+	     site->serial, site->cost, site->overhead));
+}
+
+static void measure_begin(struct sna_threads_site *site, double pixels)
+{
+	measure.site = site;
+	measure.pixels = pixels;
+	measure.tasks = 0;
+	measure.start = now_ns();
+}
+
+static void measure_end(void)
+{
+	struct sna_threads_site *site = measure.site;
+	uint64_t end;
+
+	measure.site = NULL;
+	if (site == NULL || measure.tasks == 0)
+		return;
+
+	end = now_ns();
+	if (end <= measure.start)
+		return;
+
+	site_update(site, measure.tasks + 1, measure.pixels,
+		    end - measure.start);
+}
+
 void sna_threads_run(int id, void (*func)(void *arg), void *arg)
 {
 	assert(max_threads > 0);
 	assert(pthread_self() == threads[0].thread);
-	assert(id > 0 && id < max_threads);
-
-	assert(threads[id].func == NULL);
+	assert(id > 0);
+	(void)id;
+
+	/* The id is only a hint, the task goes to whichever thread is
+	 * first to become idle. If the deque is full, we just run the task
+	 * ourselves.
+	 */
+	measure.tasks++;
+	if (!queue_push(func, arg)) {
+		func(arg);
+		return;
+	}
 
-	pthread_mutex_lock(&threads[id].mutex);
-	threads[id].func = func;
-	threads[id].arg = arg;
-	pthread_cond_signal(&threads[id].cond);
-	pthread_mutex_unlock(&threads[id].mutex);
+	mb();
+	if (sleepers) {
+		pthread_mutex_lock(&lock);
+		pthread_cond_signal(&wakeup);
+		pthread_mutex_unlock(&lock);
+	}
 }
 
 void sna_threads_trap(int sig)
@@ -203,36 +468,44 @@ void sna_threads_trap(int sig)
 
 	ERR(("%s: thread[%d] caught signal %d\n", __func__, n, sig));
 
-	pthread_mutex_lock(&threads[n].mutex);
-	threads[n].arg = (void *)(intptr_t)sig;
-	threads[n].func = NULL;
-	pthread_cond_signal(&threads[n].cond);
-	pthread_mutex_unlock(&threads[n].mutex);
+	threads[n].signal = sig;
+	dead = true;
+	task_complete();
 
 	pthread_exit(&sig);
 }
 
 void sna_threads_wait(void)
 {
+	struct task task;
 	int n;
 
 	assert(max_threads > 0);
 	assert(pthread_self() == threads[0].thread);
 
-	for (n = 1; n < max_threads; n++) {
-		if (threads[n].func != NULL) {
-			pthread_mutex_lock(&threads[n].mutex);
-			while (threads[n].func)
-				pthread_cond_wait(&threads[n].cond, &threads[n].mutex);
-			pthread_mutex_unlock(&threads[n].mutex);
-		}
+	/* Help drain the queue before sleeping on the stragglers */
+	while (queue_pop(&task)) {
+		task.func(task.arg);
+		task_complete();
+	}
 
-		if (threads[n].arg != NULL) {
-			DBG(("%s: thread[%d] died from signal %d\n", __func__, n, (int)(intptr_t)threads[n].arg));
-			sna_threads_kill();
-			return;
+	if (pending) {
+		pthread_mutex_lock(&lock);
+		while (pending)
+			pthread_cond_wait(&idle, &lock);
+		pthread_mutex_unlock(&lock);
+	}
+
+	if (dead) {
+		for (n = 1; n < max_threads; n++) {
+			if (threads[n].signal)
+				DBG(("%s: thread[%d] died from signal %d\n",
+				     __func__, n, threads[n].signal));
 		}
+		sna_threads_kill();
 	}
+
+	measure_end();
 }
 
 void sna_threads_kill(void)
@@ -243,24 +516,102 @@ void sna_threads_kill(void)
 	assert(max_threads > 0);
 	assert(pthread_self() == threads[0].thread);
 
-	for (n = 1; n < max_threads; n++)
-		pthread_cancel(threads[n].thread);
+	for (n = 1; n < max_threads; n++) {
+		if (threads[n].signal == 0)
+			pthread_cancel(threads[n].thread);
+	}
 
 	for (n = 1; n < max_threads; n++)
 		pthread_join(threads[n].thread, NULL);
 
+	measure.site = NULL;
 	max_threads = 0;
 }
 
-int sna_use_threads(int width, int height, int threshold)
+/* Only the main thread hands out loops, and it waits for them to finish,
+ * so a single descriptor suffices. Should we longjmp out of
+ * sna_threads_parallel_for() instead, both this and the arg it points to
+ * on the caller's stack are stale; the caller must sna_threads_kill() the
+ * workers before they claim another tile.
+ */
+static struct parallel_for {
+	void (*func)(void *arg, int start, int end);
+	void *arg;
+	volatile int next;
+	int count;
+	int tile;
+} parallel;
+
+static void parallel_for_task(void *arg)
 {
-	int num_threads;
+	struct parallel_for *pf = arg;
+	int start;
 
-	if (max_threads <= 0)
-		return 1;
+	while ((start = __sync_fetch_and_add(&pf->next, pf->tile)) < pf->count) {
+		int end = start + pf->tile;
+		if (end > pf->count)
+			end = pf->count;
 
-	if (height <= 1)
-		return 1;
+		pf->func(pf->arg, start, end);
+	}
+}
+
+void sna_threads_parallel_for(int num_threads, int count, int tile,
+			      void (*func)(void *arg, int start, int end),
+			      void *arg)
+{
+	int n;
+
+	assert(tile > 0);
+
+	if (num_threads > max_threads)
+		num_threads = max_threads;
+	if (num_threads > (count + tile - 1) / tile)
+		num_threads = (count + tile - 1) / tile;
+	if (num_threads <= 1) {
+		if (count > 0)
+			func(arg, 0, count);
+		return;
+	}
+
+	assert(pthread_self() == threads[0].thread);
+
+	DBG(("%s: %d tiles of %d across %d threads\n",
+	     __FUNCTION__, (count + tile - 1) / tile, tile, num_threads));
+
+	parallel.func = func;
+	parallel.arg = arg;
+	parallel.next = 0;
+	parallel.count = count;
+	parallel.tile = tile;
+
+	/* Every thread keeps claiming the next tile until none remain,
+	 * so a slow tile only delays the thread that is processing it.
+	 */
+	for (n = 1; n < num_threads; n++)
+		sna_threads_run(n, parallel_for_task, &parallel);
+	parallel_for_task(&parallel);
+
+	sna_threads_wait();
+}
+
+/* Split the rows into several bands per thread, so that those threads
+ * finishing early can take on the remainder of a busier band's work.
+ */
+int sna_threads_band(int num_threads, int height)
+{
+	int dy;
+
+	dy = (height + 4*num_threads - 1) / (4*num_threads);
+	if (dy < 8)
+		dy = 8;
+
+	return dy;
+}
+
+static int static_threads(int width, int height, int threshold)
+{
+	int num_threads;
 
 	if (width < 128)
 		height /= 128/width;
@@ -277,6 +628,109 @@ int sna_use_threads(int width, int height, int threshold)
 	return num_threads;
 }
 
+static int model_threads(struct sna_threads_site *site,
+			 double pixels, int limit)
+{
+	double work = site->cost * pixels;
+	double best_t = work;
+	int n, last, best = 1;
+
+	/* t(n) is convex with its minimum at sqrt(cost * P / overhead) */
+	n = sqrt(work / site->overhead);
+	if (n > limit)
+		n = limit;
+	if (n < 2)
+		n = 2;
+	last = n + 1;
+
+	for (; n <= limit && n <= last; n++) {
+		double t = work / n + site->overhead * (n - 1);
+		if (t < best_t) {
+			best_t = t;
+			best = n;
+		}
+	}
+
+	return best;
+}
+
+static void site_register(struct sna_threads_site *site)
+{
+	if (site->calls++)
+		return;
+
+	site->overhead = MODEL_MIN_OVERHEAD;
+	site->next = sites;
+	sites = site;
+}
+
+int __sna_use_threads(struct sna_threads_site *site, int width, int height)
+{
+	double pixels = (double)width * height;
+	int num_threads, limit;
+
+	/* Forget any launch that was abandoned before completion */
+	measure.site = NULL;
+
+	if (max_threads <= 0)
+		return 1;
+
+	site_register(site);
+
+	if (height <= 1)
+		return 1;
+
+	limit = max_threads;
+	if (limit > height)
+		limit = height;
+
+	num_threads = static_threads(width, height, site->threshold);
+	if (site->samples >= MODEL_WARMUP) {
+		int n = model_threads(site, pixels, limit);
+
+		/* Keep sampling at neighbouring thread counts, otherwise a
+		 * site that settles on a single n can never tell the per-pixel
+		 * cost apart from the overhead, and one that settles on no
+		 * threads at all would never learn again.
+		 */
+		if ((site->calls & (MODEL_EXPLORE - 1)) == 0) {
+			if (n == 1)
+				n = num_threads;
+			else if (site->calls & MODEL_EXPLORE && n < limit)
+				n++;
+			else if (n > 2)
+				n--;
+		}
+
+		num_threads = n;
+	}
+
+	if (num_threads > 1) {
+		site->threaded++;
+		measure_begin(site, pixels);
+	}
+
+	return num_threads;
+}
+
+void sna_threads_dump(int verb)
+{
+	struct sna_threads_site *site;
+
+	if (max_threads <= 0)
+		return;
+
+	LogMessageVerb(X_INFO, verb,
+		       "SNA thread pool: %d threads\n", max_threads);
+	for (site = sites; site; site = site->next) {
+		LogMessageVerb(X_INFO, verb,
+			       "  %s:%d: threshold %d, calls %u, threaded %u, samples %u, serial %.3fns/px, cost %.3fns/px, overhead %.0fns\n",
+			       site->func, site->line, site->threshold,
+			       site->calls, site->threaded, site->samples,
+			       site->serial, site->cost, site->overhead);
+	}
+}
+
 struct thread_composite {
 	pixman_image_t *src, *mask, *dst;
 	pixman_op_t op;
@@ -286,14 +740,14 @@ struct thread_composite {
 	uint16_t width, height;
 };
 
-static void thread_composite(void *arg)
+static void thread_composite(void *arg, int start, int end)
 {
 	struct thread_composite *t = arg;
 	pixman_image_composite(t->op, t->src, t->mask, t->dst,
-			       t->src_x, t->src_y,
-			       t->mask_x, t->mask_y,
-			       t->dst_x, t->dst_y,
-			       t->width, t->height);
+			       t->src_x, t->src_y + start,
+			       t->mask_x, t->mask_y + start,
+			       t->dst_x, t->dst_y + start,
+			       t->width, end - start);
 }
 
 void sna_image_composite(pixman_op_t        op,
@@ -322,52 +776,28 @@ void sna_image_composite(pixman_op_t        op,
 			sigtrap_put();
 		}
 	} else {
-		struct thread_composite data[num_threads];
-		int y, dy, n;
+		struct thread_composite data;
 
 		DBG(("%s: using %d threads for compositing %dx%d\n",
 		     __FUNCTION__, num_threads, width, height));
 
-		y = dst_y;
-		dy = (height + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * dy >= height;
-
-		data[0].op = op;
-		data[0].src = src;
-		data[0].mask = mask;
-		data[0].dst = dst;
-		data[0].src_x = src_x;
-		data[0].src_y = src_y;
-		data[0].mask_x = mask_x;
-		data[0].mask_y = mask_y;
-		data[0].dst_x = dst_x;
-		data[0].dst_y = y;
-		data[0].width = width;
-		data[0].height = dy;
+		data.op = op;
+		data.src = src;
+		data.mask = mask;
+		data.dst = dst;
+		data.src_x = src_x;
+		data.src_y = src_y;
+		data.mask_x = mask_x;
+		data.mask_y = mask_y;
+		data.dst_x = dst_x;
+		data.dst_y = dst_y;
+		data.width = width;
+		data.height = height;
 
 		if (sigtrap_get() == 0) {
-			for (n = 1; n < num_threads; n++) {
-				data[n] = data[0];
-				data[n].src_y += y - dst_y;
-				data[n].mask_y += y - dst_y;
-				data[n].dst_y = y;
-				y += dy;
-
-				sna_threads_run(n, thread_composite, &data[n]);
-			}
-
-			assert(y < dst_y + height);
-			if (y + dy > dst_y + height)
-				dy = dst_y + height - y;
-
-			data[0].src_y += y - dst_y;
-			data[0].mask_y += y - dst_y;
-			data[0].dst_y = y;
-			data[0].height = dy;
-
-			thread_composite(&data[0]);
-
-			sna_threads_wait();
+			sna_threads_parallel_for(num_threads, height,
+						 sna_threads_band(num_threads, height),
+						 thread_composite, &data);
 			sigtrap_put();
 		} else
 			sna_threads_kill();
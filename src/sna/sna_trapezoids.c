@@ -270,6 +270,17 @@ static void rasterize_traps_thread(void *arg)
 	pixman_image_unref(image);
 }
 
+static void rasterize_traps_band(void *arg, int start, int end)
+{
+	struct rasterize_traps_thread band = *(struct rasterize_traps_thread *)arg;
+
+	band.ptr += start * band.stride;
+	band.bounds.y2 = band.bounds.y1 + end;
+	band.bounds.y1 += start;
+
+	rasterize_traps_thread(&band);
+}
+
 static void
 trapezoids_fallback(struct sna *sna,
 		    CARD8 op, PicturePtr src, PicturePtr dst,
@@ -379,36 +390,19 @@ trapezoids_fallback(struct sna *sna,
 					return;
 				}
 			} else {
-				struct rasterize_traps_thread threads[num_threads];
-				int y, dy, n;
+				struct rasterize_traps_thread thread;
 
-				threads[0].ptr = scratch->devPrivate.ptr;
-				threads[0].stride = scratch->devKind;
-				threads[0].traps = traps;
-				threads[0].ntrap = ntrap;
-				threads[0].bounds = bounds;
-				threads[0].format = format;
-
-				y = bounds.y1;
-				dy = (height + num_threads - 1) / num_threads;
-				num_threads -= (num_threads-1) * dy >= bounds.y2 - bounds.y1;
+				thread.ptr = scratch->devPrivate.ptr;
+				thread.stride = scratch->devKind;
+				thread.traps = traps;
+				thread.ntrap = ntrap;
+				thread.bounds = bounds;
+				thread.format = format;
 
 				if (sigtrap_get() == 0) {
-					for (n = 1; n < num_threads; n++) {
-						threads[n] = threads[0];
-						threads[n].ptr += (y - bounds.y1) * threads[n].stride;
-						threads[n].bounds.y1 = y;
-						threads[n].bounds.y2 = y += dy;
-
-						sna_threads_run(n, rasterize_traps_thread, &threads[n]);
-					}
-
-					assert(y < threads[0].bounds.y2);
-					threads[0].ptr += (y - bounds.y1) * threads[0].stride;
-					threads[0].bounds.y1 = y;
-					rasterize_traps_thread(&threads[0]);
-
-					sna_threads_wait();
+					sna_threads_parallel_for(num_threads, height,
+								 sna_threads_band(num_threads, height),
+								 rasterize_traps_band, &thread);
 					sigtrap_put();
 				} else
 					sna_threads_kill();
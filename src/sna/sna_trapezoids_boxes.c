@@ -1070,6 +1070,15 @@ static void rectilinear_inplace_thread(void *arg)
 	pixman_image_unref(pi.mask);
 }
 
+static void rectilinear_inplace_thread_band(void *arg, int y1, int y2)
+{
+	struct rectilinear_inplace_thread thread = *(struct rectilinear_inplace_thread *)arg;
+
+	thread.y2 = thread.y1 + y2;
+	thread.y1 += y1;
+	rectilinear_inplace_thread(&thread);
+}
+
 static bool
 composite_unaligned_boxes_inplace(struct sna *sna,
 				  CARD8 op,
@@ -1186,43 +1195,32 @@ composite_unaligned_boxes_inplace(struct sna *sna,
 			pixman_image_unref(pi.source);
 			pixman_image_unref(pi.mask);
 		} else {
-			struct rectilinear_inplace_thread thread[num_threads];
-			int i, y, dy;
+			struct rectilinear_inplace_thread thread;
+			int h;
 
+			thread.trap = t;
+			thread.dst = image_from_pict(dst, false, &thread.dx, &thread.dy);
+			thread.src = image_from_pict(src, false, &thread.sx, &thread.sy);
+			thread.sx += src_x;
+			thread.sy += src_y;
 
-			thread[0].trap = t;
-			thread[0].dst = image_from_pict(dst, false, &thread[0].dx, &thread[0].dy);
-			thread[0].src = image_from_pict(src, false, &thread[0].sx, &thread[0].sy);
-			thread[0].sx += src_x;
-			thread[0].sy += src_y;
+			thread.clip = &clip;
+			thread.op = op;
 
-			thread[0].clip = &clip;
-			thread[0].op = op;
-
-			y = clip.extents.y1;
-			dy = (clip.extents.y2 - clip.extents.y1 + num_threads - 1) / num_threads;
-			num_threads = (clip.extents.y2 - clip.extents.y1 + dy - 1) / dy;
+			thread.y1 = clip.extents.y1;
+			thread.y2 = clip.extents.y2;
+			h = thread.y2 - thread.y1;
 
 			if (sigtrap_get() == 0) {
-				for (i = 1; i < num_threads; i++) {
-					thread[i] = thread[0];
-					thread[i].y1 = y;
-					thread[i].y2 = y += dy;
-					sna_threads_run(i, rectilinear_inplace_thread, &thread[i]);
-				}
-
-				assert(y < clip.extents.y2);
-				thread[0].y1 = y;
-				thread[0].y2 = clip.extents.y2;
-				rectilinear_inplace_thread(&thread[0]);
-
-				sna_threads_wait();
+				sna_threads_parallel_for(num_threads, h,
+							 sna_threads_band(num_threads, h),
+							 rectilinear_inplace_thread_band, &thread);
 				sigtrap_put();
 			} else
 				sna_threads_kill();
 
-			pixman_image_unref(thread[0].dst);
-			pixman_image_unref(thread[0].src);
+			pixman_image_unref(thread.dst);
+			pixman_image_unref(thread.src);
 		}
 
 		RegionUninit(&clip);
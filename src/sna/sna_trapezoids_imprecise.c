@@ -1854,6 +1854,15 @@ span_thread(void *arg)
 	}
 }
 
+static void span_thread_band(void *arg, int y1, int y2)
+{
+	struct span_thread thread = *(struct span_thread *)arg;
+
+	thread.extents.y2 = thread.extents.y1 + y2;
+	thread.extents.y1 += y1;
+	span_thread(&thread);
+}
+
 bool
 imprecise_trapezoid_span_converter(struct sna *sna,
 				   CARD8 op, PicturePtr src, PicturePtr dst,
@@ -1986,44 +1995,31 @@ imprecise_trapezoid_span_converter(struct sna *sna,
 
 		tor_fini(&tor);
 	} else {
-		struct span_thread threads[num_threads];
-		int y, h;
+		struct span_thread thread;
+		int h;
 
 		DBG(("%s: using %d threads for span compositing %dx%d\n",
 		     __FUNCTION__, num_threads,
 		     clip.extents.x2 - clip.extents.x1,
 		     clip.extents.y2 - clip.extents.y1));
 
-		threads[0].sna = sna;
-		threads[0].op = &tmp;
-		threads[0].traps = traps;
-		threads[0].ntrap = ntrap;
-		threads[0].extents = clip.extents;
-		threads[0].clip = &clip;
-		threads[0].dx = dx;
-		threads[0].dy = dy;
-		threads[0].draw_y = dst->pDrawable->y;
-		threads[0].unbounded = !was_clear && maskFormat && !operator_is_bounded(op);
-		threads[0].span = thread_choose_span(&tmp, dst, maskFormat, &clip);
-
-		y = clip.extents.y1;
-		h = clip.extents.y2 - clip.extents.y1;
-		h = (h + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * h >= clip.extents.y2 - clip.extents.y1;
-
-		for (n = 1; n < num_threads; n++) {
-			threads[n] = threads[0];
-			threads[n].extents.y1 = y;
-			threads[n].extents.y2 = y += h;
-
-			sna_threads_run(n, span_thread, &threads[n]);
-		}
+		thread.sna = sna;
+		thread.op = &tmp;
+		thread.traps = traps;
+		thread.ntrap = ntrap;
+		thread.extents = clip.extents;
+		thread.clip = &clip;
+		thread.dx = dx;
+		thread.dy = dy;
+		thread.draw_y = dst->pDrawable->y;
+		thread.unbounded = !was_clear && maskFormat && !operator_is_bounded(op);
+		thread.span = thread_choose_span(&tmp, dst, maskFormat, &clip);
 
-		assert(y < threads[0].extents.y2);
-		threads[0].extents.y1 = y;
-		span_thread(&threads[0]);
+		h = thread.extents.y2 - thread.extents.y1;
 
-		sna_threads_wait();
+		sna_threads_parallel_for(num_threads, h,
+					 sna_threads_band(num_threads, h),
+					 span_thread_band, &thread);
 	}
 skip:
 	tmp.done(sna, &tmp);
@@ -2565,6 +2561,15 @@ static void inplace_x8r8g8b8_thread(void *arg)
 	tor_fini(&tor);
 }
 
+static void inplace_x8r8g8b8_thread_band(void *arg, int y1, int y2)
+{
+	struct inplace_x8r8g8b8_thread thread = *(struct inplace_x8r8g8b8_thread *)arg;
+
+	thread.extents.y2 = thread.extents.y1 + y2;
+	thread.extents.y1 += y1;
+	inplace_x8r8g8b8_thread(&thread);
+}
+
 static bool
 trapezoid_span_inplace__x8r8g8b8(CARD8 op,
 				 PicturePtr dst,
@@ -2760,47 +2765,34 @@ trapezoid_span_inplace__x8r8g8b8(CARD8 op,
 
 		tor_fini(&tor);
 	} else {
-		struct inplace_x8r8g8b8_thread threads[num_threads];
-		int y, h;
+		struct inplace_x8r8g8b8_thread thread;
+		int h;
 
 		DBG(("%s: using %d threads for inplace compositing %dx%d\n",
 		     __FUNCTION__, num_threads,
 		     region.extents.x2 - region.extents.x1,
 		     region.extents.y2 - region.extents.y1));
 
-		threads[0].traps = traps;
-		threads[0].ntrap = ntrap;
-		threads[0].extents = region.extents;
-		threads[0].lerp = lerp;
-		threads[0].is_solid = is_solid;
-		threads[0].color = color;
-		threads[0].dx = dx;
-		threads[0].dy = dy;
-		threads[0].dst = dst;
-		threads[0].src = src;
-		threads[0].op = op;
-		threads[0].src_x = src_x;
-		threads[0].src_y = src_y;
-
-		y = region.extents.y1;
-		h = region.extents.y2 - region.extents.y1;
-		h = (h + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * h >= region.extents.y2 - region.extents.y1;
+		thread.traps = traps;
+		thread.ntrap = ntrap;
+		thread.extents = region.extents;
+		thread.lerp = lerp;
+		thread.is_solid = is_solid;
+		thread.color = color;
+		thread.dx = dx;
+		thread.dy = dy;
+		thread.dst = dst;
+		thread.src = src;
+		thread.op = op;
+		thread.src_x = src_x;
+		thread.src_y = src_y;
+
+		h = thread.extents.y2 - thread.extents.y1;
 
 		if (sigtrap_get() == 0) {
-			for (n = 1; n < num_threads; n++) {
-				threads[n] = threads[0];
-				threads[n].extents.y1 = y;
-				threads[n].extents.y2 = y += h;
-
-				sna_threads_run(n, inplace_x8r8g8b8_thread, &threads[n]);
-			}
-
-			assert(y < threads[0].extents.y2);
-			threads[0].extents.y1 = y;
-			inplace_x8r8g8b8_thread(&threads[0]);
-
-			sna_threads_wait();
+			sna_threads_parallel_for(num_threads, h,
+						 sna_threads_band(num_threads, h),
+						 inplace_x8r8g8b8_thread_band, &thread);
 			sigtrap_put();
 		} else
 			sna_threads_kill(); /* leaks thread allocations */
@@ -2845,6 +2837,15 @@ static void inplace_thread(void *arg)
 	tor_fini(&tor);
 }
 
+static void inplace_thread_band(void *arg, int y1, int y2)
+{
+	struct inplace_thread thread = *(struct inplace_thread *)arg;
+
+	thread.extents.y2 = thread.extents.y1 + y2;
+	thread.extents.y1 += y1;
+	inplace_thread(&thread);
+}
+
 bool
 imprecise_trapezoid_span_inplace(struct sna *sna,
 				 CARD8 op, PicturePtr src, PicturePtr dst,
@@ -3024,45 +3025,32 @@ imprecise_trapezoid_span_inplace(struct sna *sna,
 
 		tor_fini(&tor);
 	} else {
-		struct inplace_thread threads[num_threads];
-		int y, h;
+		struct inplace_thread thread;
+		int h;
 
 		DBG(("%s: using %d threads for inplace compositing %dx%d\n",
 		     __FUNCTION__, num_threads,
 		     region.extents.x2 - region.extents.x1,
 		     region.extents.y2 - region.extents.y1));
 
-		threads[0].traps = traps;
-		threads[0].ntrap = ntrap;
-		threads[0].inplace = inplace;
-		threads[0].clipped = clipped;
-		threads[0].extents = region.extents;
-		threads[0].span = span;
-		threads[0].unbounded = unbounded;
-		threads[0].dx = dx;
-		threads[0].dy = dy;
-		threads[0].draw_x = dst->pDrawable->x;
-		threads[0].draw_y = dst->pDrawable->y;
-
-		y = region.extents.y1;
-		h = region.extents.y2 - region.extents.y1;
-		h = (h + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * h >= region.extents.y2 - region.extents.y1;
+		thread.traps = traps;
+		thread.ntrap = ntrap;
+		thread.inplace = inplace;
+		thread.clipped = clipped;
+		thread.extents = region.extents;
+		thread.span = span;
+		thread.unbounded = unbounded;
+		thread.dx = dx;
+		thread.dy = dy;
+		thread.draw_x = dst->pDrawable->x;
+		thread.draw_y = dst->pDrawable->y;
 
-		if (sigtrap_get() == 0) {
-			for (n = 1; n < num_threads; n++) {
-				threads[n] = threads[0];
-				threads[n].extents.y1 = y;
-				threads[n].extents.y2 = y += h;
+		h = thread.extents.y2 - thread.extents.y1;
 
-				sna_threads_run(n, inplace_thread, &threads[n]);
-			}
-
-			assert(y < threads[0].extents.y2);
-			threads[0].extents.y1 = y;
-			inplace_thread(&threads[0]);
-
-			sna_threads_wait();
+		if (sigtrap_get() == 0) {
+			sna_threads_parallel_for(num_threads, h,
+						 sna_threads_band(num_threads, h),
+						 inplace_thread_band, &thread);
 			sigtrap_put();
 		} else
 			sna_threads_kill(); /* leaks thread allocations */
@@ -3709,6 +3697,15 @@ tristrip_thread(void *arg)
 	}
 }
 
+static void tristrip_thread_band(void *arg, int y1, int y2)
+{
+	struct tristrip_thread thread = *(struct tristrip_thread *)arg;
+
+	thread.extents.y2 = thread.extents.y1 + y2;
+	thread.extents.y1 += y1;
+	tristrip_thread(&thread);
+}
+
 bool
 imprecise_tristrip_span_converter(struct sna *sna,
 				  CARD8 op, PicturePtr src, PicturePtr dst,
@@ -3844,44 +3841,31 @@ imprecise_tristrip_span_converter(struct sna *sna,
 
 		tor_fini(&tor);
 	} else {
-		struct tristrip_thread threads[num_threads];
-		int y, h, n;
+		struct tristrip_thread thread;
+		int h;
 
 		DBG(("%s: using %d threads for tristrip compositing %dx%d\n",
 		     __FUNCTION__, num_threads,
 		     clip.extents.x2 - clip.extents.x1,
 		     clip.extents.y2 - clip.extents.y1));
 
-		threads[0].sna = sna;
-		threads[0].op = &tmp;
-		threads[0].points = points;
-		threads[0].count = count;
-		threads[0].extents = clip.extents;
-		threads[0].clip = &clip;
-		threads[0].dx = dx;
-		threads[0].dy = dy;
-		threads[0].draw_y = dst->pDrawable->y;
-		threads[0].unbounded = !was_clear && maskFormat && !operator_is_bounded(op);
-		threads[0].span = thread_choose_span(&tmp, dst, maskFormat, &clip);
-
-		y = clip.extents.y1;
-		h = clip.extents.y2 - clip.extents.y1;
-		h = (h + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * h >= clip.extents.y2 - clip.extents.y1;
-
-		for (n = 1; n < num_threads; n++) {
-			threads[n] = threads[0];
-			threads[n].extents.y1 = y;
-			threads[n].extents.y2 = y += h;
-
-			sna_threads_run(n, tristrip_thread, &threads[n]);
-		}
-
-		assert(y < threads[0].extents.y2);
-		threads[0].extents.y1 = y;
-		tristrip_thread(&threads[0]);
-
-		sna_threads_wait();
+		thread.sna = sna;
+		thread.op = &tmp;
+		thread.points = points;
+		thread.count = count;
+		thread.extents = clip.extents;
+		thread.clip = &clip;
+		thread.dx = dx;
+		thread.dy = dy;
+		thread.draw_y = dst->pDrawable->y;
+		thread.unbounded = !was_clear && maskFormat && !operator_is_bounded(op);
+		thread.span = thread_choose_span(&tmp, dst, maskFormat, &clip);
+
+		h = thread.extents.y2 - thread.extents.y1;
+
+		sna_threads_parallel_for(num_threads, h,
+					 sna_threads_band(num_threads, h),
+					 tristrip_thread_band, &thread);
 	}
 skip:
 	tmp.done(sna, &tmp);
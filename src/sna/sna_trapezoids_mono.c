@@ -816,6 +816,15 @@ mono_span_thread(void *arg)
 	RegionUninit(&mono.clip);
 }
 
+static void mono_span_thread_band(void *arg, int y1, int y2)
+{
+	struct mono_span_thread thread = *(struct mono_span_thread *)arg;
+
+	thread.extents.y2 = thread.extents.y1 + y2;
+	thread.extents.y1 += y1;
+	mono_span_thread(&thread);
+}
+
 bool
 mono_trapezoids_span_converter(struct sna *sna,
 			       CARD8 op, PicturePtr src, PicturePtr dst,
@@ -890,41 +899,28 @@ mono_trapezoids_span_converter(struct sna *sna,
 					      mono.clip.extents.y2 - mono.clip.extents.y1,
 					      32);
 	if (num_threads > 1) {
-		struct mono_span_thread threads[num_threads];
-		int y, h;
+		struct mono_span_thread thread;
+		int h;
 
 		DBG(("%s: using %d threads for mono span compositing %dx%d\n",
 		     __FUNCTION__, num_threads,
 		     mono.clip.extents.x2 - mono.clip.extents.x1,
 		     mono.clip.extents.y2 - mono.clip.extents.y1));
 
-		threads[0].sna = mono.sna;
-		threads[0].op = &mono.op;
-		threads[0].traps = traps;
-		threads[0].ntrap = ntrap;
-		threads[0].extents = mono.clip.extents;
-		threads[0].clip = &mono.clip;
-		threads[0].dx = dx;
-		threads[0].dy = dy;
-
-		y = extents.y1;
-		h = extents.y2 - extents.y1;
-		h = (h + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * h >= extents.y2 - extents.y1;
-
-		for (n = 1; n < num_threads; n++) {
-			threads[n] = threads[0];
-			threads[n].extents.y1 = y;
-			threads[n].extents.y2 = y += h;
-
-			sna_threads_run(n, mono_span_thread, &threads[n]);
-		}
+		thread.sna = mono.sna;
+		thread.op = &mono.op;
+		thread.traps = traps;
+		thread.ntrap = ntrap;
+		thread.extents = mono.clip.extents;
+		thread.clip = &mono.clip;
+		thread.dx = dx;
+		thread.dy = dy;
 
-		threads[0].extents.y1 = y;
-		threads[0].extents.y2 = extents.y2;
-		mono_span_thread(&threads[0]);
+		h = thread.extents.y2 - thread.extents.y1;
 
-		sna_threads_wait();
+		sna_threads_parallel_for(num_threads, h,
+					 sna_threads_band(num_threads, h),
+					 mono_span_thread_band, &thread);
 		mono.op.done(mono.sna, &mono.op);
 		return true;
 	}
@@ -1799,6 +1799,15 @@ span_thread(void *arg)
 	}
 }
 
+static void span_thread_band(void *arg, int y1, int y2)
+{
+	struct span_thread thread = *(struct span_thread *)arg;
+
+	thread.extents.y2 = thread.extents.y1 + y2;
+	thread.extents.y1 += y1;
+	span_thread(&thread);
+}
+
 bool
 precise_trapezoid_span_converter(struct sna *sna,
 				 CARD8 op, PicturePtr src, PicturePtr dst,
@@ -1931,44 +1940,31 @@ precise_trapezoid_span_converter(struct sna *sna,
 
 		tor_fini(&tor);
 	} else {
-		struct span_thread threads[num_threads];
-		int y, h;
+		struct span_thread thread;
+		int h;
 
 		DBG(("%s: using %d threads for span compositing %dx%d\n",
 		     __FUNCTION__, num_threads,
 		     clip.extents.x2 - clip.extents.x1,
 		     clip.extents.y2 - clip.extents.y1));
 
-		threads[0].sna = sna;
-		threads[0].op = &tmp;
-		threads[0].traps = traps;
-		threads[0].ntrap = ntrap;
-		threads[0].extents = clip.extents;
-		threads[0].clip = &clip;
-		threads[0].dx = dx;
-		threads[0].dy = dy;
-		threads[0].draw_y = dst->pDrawable->y;
-		threads[0].unbounded = !was_clear && maskFormat && !operator_is_bounded(op);
-		threads[0].span = thread_choose_span(&tmp, dst, maskFormat, &clip);
-
-		y = clip.extents.y1;
-		h = clip.extents.y2 - clip.extents.y1;
-		h = (h + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * h >= clip.extents.y2 - clip.extents.y1;
-
-		for (n = 1; n < num_threads; n++) {
-			threads[n] = threads[0];
-			threads[n].extents.y1 = y;
-			threads[n].extents.y2 = y += h;
-
-			sna_threads_run(n, span_thread, &threads[n]);
-		}
+		thread.sna = sna;
+		thread.op = &tmp;
+		thread.traps = traps;
+		thread.ntrap = ntrap;
+		thread.extents = clip.extents;
+		thread.clip = &clip;
+		thread.dx = dx;
+		thread.dy = dy;
+		thread.draw_y = dst->pDrawable->y;
+		thread.unbounded = !was_clear && maskFormat && !operator_is_bounded(op);
+		thread.span = thread_choose_span(&tmp, dst, maskFormat, &clip);
 
-		assert(y < threads[0].extents.y2);
-		threads[0].extents.y1 = y;
-		span_thread(&threads[0]);
+		h = thread.extents.y2 - thread.extents.y1;
 
-		sna_threads_wait();
+		sna_threads_parallel_for(num_threads, h,
+					 sna_threads_band(num_threads, h),
+					 span_thread_band, &thread);
 	}
 skip:
 	tmp.done(sna, &tmp);
@@ -2048,6 +2044,15 @@ mask_thread(void *arg)
 	tor_fini(&tor);
 }
 
+static void mask_thread_band(void *arg, int y1, int y2)
+{
+	struct mask_thread thread = *(struct mask_thread *)arg;
+
+	thread.extents.y2 = thread.extents.y1 + y2;
+	thread.extents.y1 += y1;
+	mask_thread(&thread);
+}
+
 bool
 precise_trapezoid_mask_converter(CARD8 op, PicturePtr src, PicturePtr dst,
 				 PictFormatPtr maskFormat, unsigned flags,
@@ -2150,40 +2155,27 @@ precise_trapezoid_mask_converter(CARD8 op, PicturePtr src, PicturePtr dst,
 		}
 		tor_fini(&tor);
 	} else {
-		struct mask_thread threads[num_threads];
-		int y, h;
+		struct mask_thread thread;
+		int h;
 
 		DBG(("%s: using %d threads for mask compositing %dx%d\n",
 		     __FUNCTION__, num_threads,
 		     extents.x2 - extents.x1,
 		     extents.y2 - extents.y1));
 
-		threads[0].scratch = scratch;
-		threads[0].traps = traps;
-		threads[0].ntrap = ntrap;
-		threads[0].extents = extents;
-		threads[0].dx = dx;
-		threads[0].dy = dy;
-		threads[0].dst_y = dst_y;
-
-		y = extents.y1;
-		h = extents.y2 - extents.y1;
-		h = (h + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * h >= extents.y2 - extents.y1;
-
-		for (n = 1; n < num_threads; n++) {
-			threads[n] = threads[0];
-			threads[n].extents.y1 = y;
-			threads[n].extents.y2 = y += h;
-
-			sna_threads_run(n, mask_thread, &threads[n]);
-		}
+		thread.scratch = scratch;
+		thread.traps = traps;
+		thread.ntrap = ntrap;
+		thread.extents = extents;
+		thread.dx = dx;
+		thread.dy = dy;
+		thread.dst_y = dst_y;
 
-		assert(y < threads[0].extents.y2);
-		threads[0].extents.y1 = y;
-		mask_thread(&threads[0]);
+		h = thread.extents.y2 - thread.extents.y1;
 
-		sna_threads_wait();
+		sna_threads_parallel_for(num_threads, h,
+					 sna_threads_band(num_threads, h),
+					 mask_thread_band, &thread);
 	}
 
 	mask = CreatePicture(0, &scratch->drawable,
@@ -2573,6 +2565,15 @@ static void inplace_x8r8g8b8_thread(void *arg)
 	tor_fini(&tor);
 }
 
+static void inplace_x8r8g8b8_thread_band(void *arg, int y1, int y2)
+{
+	struct inplace_x8r8g8b8_thread thread = *(struct inplace_x8r8g8b8_thread *)arg;
+
+	thread.extents.y2 = thread.extents.y1 + y2;
+	thread.extents.y1 += y1;
+	inplace_x8r8g8b8_thread(&thread);
+}
+
 static bool
 trapezoid_span_inplace__x8r8g8b8(CARD8 op,
 				 PicturePtr dst,
@@ -2770,47 +2771,34 @@ trapezoid_span_inplace__x8r8g8b8(CARD8 op,
 
 		tor_fini(&tor);
 	} else {
-		struct inplace_x8r8g8b8_thread threads[num_threads];
-		int y, h;
+		struct inplace_x8r8g8b8_thread thread;
+		int h;
 
 		DBG(("%s: using %d threads for inplace compositing %dx%d\n",
 		     __FUNCTION__, num_threads,
 		     region.extents.x2 - region.extents.x1,
 		     region.extents.y2 - region.extents.y1));
 
-		threads[0].traps = traps;
-		threads[0].ntrap = ntrap;
-		threads[0].extents = region.extents;
-		threads[0].lerp = lerp;
-		threads[0].is_solid = is_solid;
-		threads[0].color = color;
-		threads[0].dx = dx;
-		threads[0].dy = dy;
-		threads[0].dst = dst;
-		threads[0].src = src;
-		threads[0].op = op;
-		threads[0].src_x = src_x;
-		threads[0].src_y = src_y;
-
-		y = region.extents.y1;
-		h = region.extents.y2 - region.extents.y1;
-		h = (h + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * h >= region.extents.y2 - region.extents.y1;
+		thread.traps = traps;
+		thread.ntrap = ntrap;
+		thread.extents = region.extents;
+		thread.lerp = lerp;
+		thread.is_solid = is_solid;
+		thread.color = color;
+		thread.dx = dx;
+		thread.dy = dy;
+		thread.dst = dst;
+		thread.src = src;
+		thread.op = op;
+		thread.src_x = src_x;
+		thread.src_y = src_y;
+
+		h = thread.extents.y2 - thread.extents.y1;
 
 		if (sigtrap_get() == 0) {
-			for (n = 1; n < num_threads; n++) {
-				threads[n] = threads[0];
-				threads[n].extents.y1 = y;
-				threads[n].extents.y2 = y += h;
-
-				sna_threads_run(n, inplace_x8r8g8b8_thread, &threads[n]);
-			}
-
-			assert(y < threads[0].extents.y2);
-			threads[0].extents.y1 = y;
-			inplace_x8r8g8b8_thread(&threads[0]);
-
-			sna_threads_wait();
+			sna_threads_parallel_for(num_threads, h,
+						 sna_threads_band(num_threads, h),
+						 inplace_x8r8g8b8_thread_band, &thread);
 			sigtrap_put();
 		} else
 			sna_threads_kill(); /* leaks thread allocations */
@@ -2855,6 +2843,15 @@ static void inplace_thread(void *arg)
 	tor_fini(&tor);
 }
 
+static void inplace_thread_band(void *arg, int y1, int y2)
+{
+	struct inplace_thread thread = *(struct inplace_thread *)arg;
+
+	thread.extents.y2 = thread.extents.y1 + y2;
+	thread.extents.y1 += y1;
+	inplace_thread(&thread);
+}
+
 bool
 precise_trapezoid_span_inplace(struct sna *sna,
 			       CARD8 op, PicturePtr src, PicturePtr dst,
@@ -3037,45 +3034,32 @@ precise_trapezoid_span_inplace(struct sna *sna,
 
 		tor_fini(&tor);
 	} else {
-		struct inplace_thread threads[num_threads];
-		int y, h;
+		struct inplace_thread thread;
+		int h;
 
 		DBG(("%s: using %d threads for inplace compositing %dx%d\n",
 		     __FUNCTION__, num_threads,
 		     region.extents.x2 - region.extents.x1,
 		     region.extents.y2 - region.extents.y1));
 
-		threads[0].traps = traps;
-		threads[0].ntrap = ntrap;
-		threads[0].inplace = inplace;
-		threads[0].extents = region.extents;
-		threads[0].clipped = clipped;
-		threads[0].span = span;
-		threads[0].unbounded = unbounded;
-		threads[0].dx = dx;
-		threads[0].dy = dy;
-		threads[0].draw_x = dst->pDrawable->x;
-		threads[0].draw_y = dst->pDrawable->y;
-
-		y = region.extents.y1;
-		h = region.extents.y2 - region.extents.y1;
-		h = (h + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * h >= region.extents.y2 - region.extents.y1;
+		thread.traps = traps;
+		thread.ntrap = ntrap;
+		thread.inplace = inplace;
+		thread.extents = region.extents;
+		thread.clipped = clipped;
+		thread.span = span;
+		thread.unbounded = unbounded;
+		thread.dx = dx;
+		thread.dy = dy;
+		thread.draw_x = dst->pDrawable->x;
+		thread.draw_y = dst->pDrawable->y;
 
-		if (sigtrap_get() == 0) {
-			for (n = 1; n < num_threads; n++) {
-				threads[n] = threads[0];
-				threads[n].extents.y1 = y;
-				threads[n].extents.y2 = y += h;
+		h = thread.extents.y2 - thread.extents.y1;
 
-				sna_threads_run(n, inplace_thread, &threads[n]);
-			}
-
-			assert(y < threads[0].extents.y2);
-			threads[0].extents.y1 = y;
-			inplace_thread(&threads[0]);
-
-			sna_threads_wait();
+		if (sigtrap_get() == 0) {
+			sna_threads_parallel_for(num_threads, h,
+						 sna_threads_band(num_threads, h),
+						 inplace_thread_band, &thread);
 			sigtrap_put();
 		} else
 			sna_threads_kill(); /* leaks thread allocations */
@@ -3184,40 +3168,27 @@ precise_trapezoid_span_fallback(CARD8 op, PicturePtr src, PicturePtr dst,
 		}
 		tor_fini(&tor);
 	} else {
-		struct mask_thread threads[num_threads];
-		int y, h;
+		struct mask_thread thread;
+		int h;
 
 		DBG(("%s: using %d threads for mask compositing %dx%d\n",
 		     __FUNCTION__, num_threads,
 		     extents.x2 - extents.x1,
 		     extents.y2 - extents.y1));
 
-		threads[0].scratch = scratch;
-		threads[0].traps = traps;
-		threads[0].ntrap = ntrap;
-		threads[0].extents = extents;
-		threads[0].dx = dx;
-		threads[0].dy = dy;
-		threads[0].dst_y = dst_y;
-
-		y = extents.y1;
-		h = extents.y2 - extents.y1;
-		h = (h + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * h >= extents.y2 - extents.y1;
-
-		for (n = 1; n < num_threads; n++) {
-			threads[n] = threads[0];
-			threads[n].extents.y1 = y;
-			threads[n].extents.y2 = y += h;
-
-			sna_threads_run(n, mask_thread, &threads[n]);
-		}
+		thread.scratch = scratch;
+		thread.traps = traps;
+		thread.ntrap = ntrap;
+		thread.extents = extents;
+		thread.dx = dx;
+		thread.dy = dy;
+		thread.dst_y = dst_y;
 
-		assert(y < threads[0].extents.y2);
-		threads[0].extents.y1 = y;
-		mask_thread(&threads[0]);
+		h = thread.extents.y2 - thread.extents.y1;
 
-		sna_threads_wait();
+		sna_threads_parallel_for(num_threads, h,
+					 sna_threads_band(num_threads, h),
+					 mask_thread_band, &thread);
 	}
 
 	mask = CreatePicture(0, &scratch->drawable,
@@ -3314,6 +3285,15 @@ tristrip_thread(void *arg)
 	}
 }
 
+static void tristrip_thread_band(void *arg, int y1, int y2)
+{
+	struct tristrip_thread thread = *(struct tristrip_thread *)arg;
+
+	thread.extents.y2 = thread.extents.y1 + y2;
+	thread.extents.y1 += y1;
+	tristrip_thread(&thread);
+}
+
 bool
 precise_tristrip_span_converter(struct sna *sna,
 				CARD8 op, PicturePtr src, PicturePtr dst,
@@ -3449,44 +3429,31 @@ precise_tristrip_span_converter(struct sna *sna,
 
 		tor_fini(&tor);
 	} else {
-		struct tristrip_thread threads[num_threads];
-		int y, h, n;
+		struct tristrip_thread thread;
+		int h;
 
 		DBG(("%s: using %d threads for tristrip compositing %dx%d\n",
 		     __FUNCTION__, num_threads,
 		     clip.extents.x2 - clip.extents.x1,
 		     clip.extents.y2 - clip.extents.y1));
 
-		threads[0].sna = sna;
-		threads[0].op = &tmp;
-		threads[0].points = points;
-		threads[0].count = count;
-		threads[0].extents = clip.extents;
-		threads[0].clip = &clip;
-		threads[0].dx = dx;
-		threads[0].dy = dy;
-		threads[0].draw_y = dst->pDrawable->y;
-		threads[0].unbounded = !was_clear && maskFormat && !operator_is_bounded(op);
-		threads[0].span = thread_choose_span(&tmp, dst, maskFormat, &clip);
-
-		y = clip.extents.y1;
-		h = clip.extents.y2 - clip.extents.y1;
-		h = (h + num_threads - 1) / num_threads;
-		num_threads -= (num_threads-1) * h >= clip.extents.y2 - clip.extents.y1;
-
-		for (n = 1; n < num_threads; n++) {
-			threads[n] = threads[0];
-			threads[n].extents.y1 = y;
-			threads[n].extents.y2 = y += h;
-
-			sna_threads_run(n, tristrip_thread, &threads[n]);
-		}
-
-		assert(y < threads[0].extents.y2);
-		threads[0].extents.y1 = y;
-		tristrip_thread(&threads[0]);
-
-		sna_threads_wait();
+		thread.sna = sna;
+		thread.op = &tmp;
+		thread.points = points;
+		thread.count = count;
+		thread.extents = clip.extents;
+		thread.clip = &clip;
+		thread.dx = dx;
+		thread.dy = dy;
+		thread.draw_y = dst->pDrawable->y;
+		thread.unbounded = !was_clear && maskFormat && !operator_is_bounded(op);
+		thread.span = thread_choose_span(&tmp, dst, maskFormat, &clip);
+
+		h = thread.extents.y2 - thread.extents.y1;
+
+		sna_threads_parallel_for(num_threads, h,
+					 sna_threads_band(num_threads, h),
+					 tristrip_thread_band, &thread);
 	}
 skip:
 	tmp.done(sna, &tmp);
@@ -0,0 +1,840 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#define _GNU_SOURCE /* fallocate */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <xf86drm.h>
+#include <i915_drm.h>
+
+#include "fake_i915.h"
+
+/* The newer ioctls, as used by kgem, in case the libdrm headers predate them */
+#define LOCAL_I915_PARAM_HAS_BLT		11
+#define LOCAL_I915_PARAM_HAS_RELAXED_FENCING	12
+#define LOCAL_I915_PARAM_HAS_RELAXED_DELTA	15
+#define LOCAL_I915_PARAM_HAS_LLC		17
+#define LOCAL_I915_PARAM_HAS_ALIASING_PPGTT	18
+#define LOCAL_I915_PARAM_HAS_NO_RELOC		25
+#define LOCAL_I915_PARAM_HAS_HANDLE_LUT		26
+#define LOCAL_I915_PARAM_MMAP_VERSION		30
+#define LOCAL_I915_PARAM_HAS_EXEC_SOFTPIN	37
+#define LOCAL_I915_PARAM_MMAP_GTT_COHERENT	52
+
+#define LOCAL_I915_EXEC_HANDLE_LUT		(1<<12)
+#define LOCAL_I915_EXEC_FENCE_OUT		(1<<17)
+
+#define LOCAL_EXEC_OBJECT_WRITE			(1<<2)
+#define LOCAL_EXEC_OBJECT_PINNED		(1<<4)
+
+#define LOCAL_I915_GEM_WAIT			0x2c
+#define LOCAL_I915_GEM_SET_CACHING		0x2f
+#define LOCAL_I915_GEM_GET_CACHING		0x30
+#define LOCAL_I915_GEM_CONTEXT_GETPARAM		0x34
+
+struct local_i915_gem_wait {
+	uint32_t handle;
+	uint32_t flags;
+	int64_t timeout;
+};
+
+struct local_i915_gem_caching {
+	uint32_t handle;
+	uint32_t caching;
+};
+
+struct local_i915_gem_mmap2 {
+	uint32_t handle;
+	uint32_t pad;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t addr_ptr;
+	uint64_t flags;
+};
+
+struct local_i915_gem_get_tiling_v2 {
+	uint32_t handle;
+	uint32_t tiling_mode;
+	uint32_t swizzle_mode;
+	uint32_t phys_swizzle_mode;
+};
+
+struct local_i915_gem_context_param {
+	uint32_t context;
+	uint32_t size;
+	uint64_t param;
+	uint64_t value;
+};
+#define LOCAL_CONTEXT_PARAM_GTT_SIZE	0x3
+
+#define PAGE_SIZE 4096
+#define ALIGN(x, y) (((x) + (y) - 1) & -(y))
+
+#define THROTTLE_US 20000 /* as i915_gem_throttle, 20ms */
+#define MAX_REQUESTS 1024
+
+struct object {
+	uint64_t offset;	/* into the backing file */
+	uint64_t size;
+	uint64_t gtt;
+	uint64_t busy;		/* completion time of the last batch */
+	uint32_t tiling, stride;
+	uint32_t caching;
+	uint32_t madv;
+	unsigned engine : 8;
+	unsigned written : 1;
+	unsigned bound : 1;
+};
+
+static struct device {
+	pthread_mutex_t lock;
+	struct fake_i915_params params;
+	struct fake_i915_stats stats;
+	int fd;
+
+	struct object **object;
+	unsigned num_objects, max_objects;
+	uint32_t *free_handle;
+	unsigned num_free;
+
+	uint64_t next_offset;
+	uint64_t next_gtt;
+
+	uint64_t engine[4];	/* completion time of the last batch */
+
+	/* ring of outstanding batches for throttling */
+	struct request {
+		uint64_t emitted, completed;
+	} request[MAX_REQUESTS];
+	unsigned request_head;
+} dev = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.fd = -1,
+};
+
+static uint64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void sleep_until(uint64_t target)
+{
+	uint64_t now;
+
+	while ((now = now_us()) < target) {
+		struct timespec ts;
+
+		ts.tv_sec = (target - now) / 1000000;
+		ts.tv_nsec = (target - now) % 1000000 * 1000;
+		nanosleep(&ts, NULL);
+	}
+}
+
+static int create_backing(void)
+{
+	char name[] = "/tmp/fake-i915-XXXXXX";
+	int fd;
+
+#ifdef __NR_memfd_create
+	fd = syscall(__NR_memfd_create, "fake-i915", 1 /* MFD_CLOEXEC */);
+	if (fd != -1)
+		return fd;
+#endif
+
+	fd = mkstemp(name);
+	if (fd != -1)
+		unlink(name);
+	return fd;
+}
+
+int fake_i915_open(const struct fake_i915_params *params)
+{
+	int fd;
+
+	if (dev.fd != -1) {
+		errno = EBUSY;
+		return -1;
+	}
+
+	fd = create_backing();
+	if (fd == -1)
+		return -1;
+
+	/* Objects are carved out of a sparse file; offsets are never reused,
+	 * and the pages are punched out again as each object is closed.
+	 */
+	if (ftruncate(fd, (off_t)1 << 40)) {
+		close(fd);
+		return -1;
+	}
+
+	dev.params = *params;
+	if (dev.params.aperture == 0)
+		dev.params.aperture = 256 << 20;
+	memset(&dev.stats, 0, sizeof(dev.stats));
+	memset(dev.engine, 0, sizeof(dev.engine));
+	memset(dev.request, 0, sizeof(dev.request));
+	dev.request_head = 0;
+	dev.next_offset = 0;
+	dev.next_gtt = PAGE_SIZE;
+	dev.fd = fd;
+	return fd;
+}
+
+void fake_i915_close(int fd)
+{
+	unsigned n;
+
+	if (fd != dev.fd)
+		return;
+
+	for (n = 0; n < dev.num_objects; n++)
+		free(dev.object[n]);
+	free(dev.object);
+	free(dev.free_handle);
+	dev.object = NULL;
+	dev.free_handle = NULL;
+	dev.num_objects = dev.max_objects = dev.num_free = 0;
+
+	close(fd);
+	dev.fd = -1;
+}
+
+void fake_i915_get_stats(int fd, struct fake_i915_stats *stats)
+{
+	pthread_mutex_lock(&dev.lock);
+	if (fd == dev.fd)
+		*stats = dev.stats;
+	else
+		memset(stats, 0, sizeof(*stats));
+	pthread_mutex_unlock(&dev.lock);
+}
+
+static struct object *lookup(uint32_t handle)
+{
+	if (handle == 0 || handle > dev.num_objects)
+		return NULL;
+
+	return dev.object[handle - 1];
+}
+
+bool fake_i915_is_busy(int fd, uint32_t handle)
+{
+	struct object *obj;
+	bool busy = false;
+
+	pthread_mutex_lock(&dev.lock);
+	if (fd == dev.fd && (obj = lookup(handle)))
+		busy = obj->busy > now_us();
+	pthread_mutex_unlock(&dev.lock);
+
+	return busy;
+}
+
+static int engine_class(unsigned ring)
+{
+	switch (ring) {
+	default:
+	case I915_EXEC_DEFAULT:
+	case I915_EXEC_RENDER: return 0;
+	case I915_EXEC_BLT: return 1;
+	case I915_EXEC_BSD: return 2;
+	case 4 /* I915_EXEC_VEBOX */: return 3;
+	}
+}
+
+static int gem_getparam(drm_i915_getparam_t *gp)
+{
+	int v;
+
+	switch (gp->param) {
+	case LOCAL_I915_PARAM_HAS_BLT:
+	case LOCAL_I915_PARAM_HAS_RELAXED_FENCING:
+	case LOCAL_I915_PARAM_HAS_RELAXED_DELTA:
+	case LOCAL_I915_PARAM_HAS_NO_RELOC:
+	case LOCAL_I915_PARAM_HAS_HANDLE_LUT:
+	case LOCAL_I915_PARAM_MMAP_VERSION:
+	case LOCAL_I915_PARAM_MMAP_GTT_COHERENT:
+		v = 1;
+		break;
+	case LOCAL_I915_PARAM_HAS_LLC:
+		v = dev.params.llc;
+		break;
+	case LOCAL_I915_PARAM_HAS_ALIASING_PPGTT:
+		v = dev.params.full_ppgtt ? 3 : 1;
+		break;
+	case LOCAL_I915_PARAM_HAS_EXEC_SOFTPIN:
+		v = dev.params.full_ppgtt;
+		break;
+	case I915_PARAM_NUM_FENCES_AVAIL:
+		v = 32;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	*gp->value = v;
+	return 0;
+}
+
+static uint32_t new_handle(struct object *obj)
+{
+	uint32_t handle;
+
+	if (dev.num_free) {
+		handle = dev.free_handle[--dev.num_free];
+	} else {
+		if (dev.num_objects == dev.max_objects) {
+			unsigned max = dev.max_objects ? 2 * dev.max_objects : 1024;
+			struct object **o;
+			uint32_t *f;
+
+			o = realloc(dev.object, max * sizeof(*o));
+			if (o == NULL)
+				return 0;
+			dev.object = o;
+
+			f = realloc(dev.free_handle, max * sizeof(*f));
+			if (f == NULL)
+				return 0;
+			dev.free_handle = f;
+
+			dev.max_objects = max;
+		}
+		handle = ++dev.num_objects;
+	}
+
+	dev.object[handle - 1] = obj;
+	return handle;
+}
+
+static int gem_create(struct drm_i915_gem_create *arg)
+{
+	struct object *obj;
+
+	if (arg->size == 0)
+		return -EINVAL;
+
+	obj = calloc(1, sizeof(*obj));
+	if (obj == NULL)
+		return -ENOMEM;
+
+	obj->size = ALIGN(arg->size, PAGE_SIZE);
+	obj->offset = dev.next_offset;
+	obj->caching = dev.params.llc;
+
+	arg->handle = new_handle(obj);
+	if (arg->handle == 0) {
+		free(obj);
+		return -ENOMEM;
+	}
+	arg->size = obj->size;
+	dev.next_offset += obj->size;
+
+	dev.stats.created++;
+	dev.stats.bytes += obj->size;
+	if (dev.stats.bytes > dev.stats.max_bytes)
+		dev.stats.max_bytes = dev.stats.bytes;
+	if (++dev.stats.objects > dev.stats.max_objects)
+		dev.stats.max_objects = dev.stats.objects;
+	return 0;
+}
+
+static int gem_close(struct drm_gem_close *arg)
+{
+	struct object *obj = lookup(arg->handle);
+
+	if (obj == NULL)
+		return -ENOENT;
+
+	(void)fallocate(dev.fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			obj->offset, obj->size);
+
+	dev.object[arg->handle - 1] = NULL;
+	dev.free_handle[dev.num_free++] = arg->handle;
+
+	dev.stats.closed++;
+	dev.stats.bytes -= obj->size;
+	dev.stats.objects--;
+	free(obj);
+	return 0;
+}
+
+static int gem_busy(struct drm_i915_gem_busy *arg)
+{
+	struct object *obj = lookup(arg->handle);
+
+	if (obj == NULL)
+		return -ENOENT;
+
+	arg->busy = 0;
+	if (obj->busy > now_us()) {
+		int class = engine_class(obj->engine);
+
+		arg->busy = 1 << (16 + class);
+		if (obj->written)
+			arg->busy |= class + 1;
+	}
+	return 0;
+}
+
+static int gem_mmap(struct local_i915_gem_mmap2 *arg, unsigned size)
+{
+	struct object *obj = lookup(arg->handle);
+	void *ptr;
+
+	if (obj == NULL)
+		return -ENOENT;
+
+	if (size >= sizeof(*arg) && arg->flags & ~1ull)
+		return -EINVAL;
+
+	if (arg->offset + arg->size > obj->size || arg->offset & (PAGE_SIZE - 1))
+		return -EINVAL;
+
+	ptr = mmap(0, arg->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   dev.fd, obj->offset + arg->offset);
+	if (ptr == MAP_FAILED)
+		return -errno;
+
+	arg->addr_ptr = (uintptr_t)ptr;
+	return 0;
+}
+
+static int gem_set_tiling(struct drm_i915_gem_set_tiling *arg)
+{
+	struct object *obj = lookup(arg->handle);
+
+	if (obj == NULL)
+		return -ENOENT;
+
+	switch (arg->tiling_mode) {
+	case I915_TILING_NONE:
+		arg->stride = 0;
+		break;
+	case I915_TILING_X:
+		if (arg->stride == 0 || arg->stride & 511)
+			return -EINVAL;
+		break;
+	case I915_TILING_Y:
+		if (arg->stride == 0 || arg->stride & 127)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	obj->tiling = arg->tiling_mode;
+	obj->stride = arg->stride;
+	arg->swizzle_mode = I915_BIT_6_SWIZZLE_NONE;
+	return 0;
+}
+
+static int gem_get_tiling(struct local_i915_gem_get_tiling_v2 *arg, unsigned size)
+{
+	struct object *obj = lookup(arg->handle);
+
+	if (obj == NULL)
+		return -ENOENT;
+
+	arg->tiling_mode = obj->tiling;
+	arg->swizzle_mode = I915_BIT_6_SWIZZLE_NONE;
+	if (size >= sizeof(*arg))
+		arg->phys_swizzle_mode = I915_BIT_6_SWIZZLE_NONE;
+	return 0;
+}
+
+static int gem_pread(struct drm_i915_gem_pread *arg)
+{
+	struct object *obj = lookup(arg->handle);
+
+	if (obj == NULL)
+		return -ENOENT;
+
+	if (arg->offset + arg->size > obj->size)
+		return -EINVAL;
+
+	if (pread(dev.fd, (void *)(uintptr_t)arg->data_ptr,
+		  arg->size, obj->offset + arg->offset) != (ssize_t)arg->size)
+		return -EFAULT;
+
+	return 0;
+}
+
+static int gem_pwrite(struct drm_i915_gem_pwrite *arg)
+{
+	struct object *obj = lookup(arg->handle);
+
+	if (obj == NULL)
+		return -ENOENT;
+
+	if (arg->offset + arg->size > obj->size)
+		return -EINVAL;
+
+	if (pwrite(dev.fd, (void *)(uintptr_t)arg->data_ptr,
+		   arg->size, obj->offset + arg->offset) != (ssize_t)arg->size)
+		return -EFAULT;
+
+	return 0;
+}
+
+static struct object *
+exec_target(struct object **objects, unsigned count,
+	    uint64_t flags, uint32_t target)
+{
+	if (flags & LOCAL_I915_EXEC_HANDLE_LUT)
+		return target < count ? objects[target] : NULL;
+
+	return lookup(target);
+}
+
+static int exec_relocate(struct object *obj,
+			 struct drm_i915_gem_exec_object2 *exec,
+			 unsigned count, struct object **objects,
+			 uint64_t flags)
+{
+	struct drm_i915_gem_relocation_entry *reloc =
+		(void *)(uintptr_t)exec->relocs_ptr;
+	unsigned width = dev.params.gen >= 0100 ? 8 : 4;
+	unsigned n;
+
+	for (n = 0; n < exec->relocation_count; n++) {
+		struct object *target;
+		uint64_t value;
+
+		target = exec_target(objects, count, flags,
+				     reloc[n].target_handle);
+		if (target == NULL)
+			return -ENOENT;
+
+		if (reloc[n].offset + width > obj->size)
+			return -EINVAL;
+
+		if (reloc[n].write_domain)
+			target->written = true;
+
+		dev.stats.relocs++;
+		if (reloc[n].presumed_offset == target->gtt)
+			continue;
+
+		value = target->gtt + (int32_t)reloc[n].delta;
+		if (pwrite(dev.fd, &value, width,
+			   obj->offset + reloc[n].offset) != width)
+			return -EFAULT;
+
+		reloc[n].presumed_offset = target->gtt;
+		dev.stats.relocs_written++;
+	}
+
+	return 0;
+}
+
+static int gem_execbuffer2(struct drm_i915_gem_execbuffer2 *arg)
+{
+	struct drm_i915_gem_exec_object2 *exec =
+		(void *)(uintptr_t)arg->buffers_ptr;
+	struct object **objects;
+	struct request *rq;
+	uint64_t now, done;
+	unsigned ring, n;
+	int ret;
+
+	if (arg->buffer_count == 0)
+		return -EINVAL;
+	if (exec == NULL)
+		return -EFAULT;
+	if (arg->flags & LOCAL_I915_EXEC_FENCE_OUT)
+		return -EINVAL;
+
+	objects = malloc(arg->buffer_count * sizeof(*objects));
+	if (objects == NULL)
+		return -ENOMEM;
+
+	/* Bind everything first so that the relocations see the final
+	 * addresses, just as the kernel would.
+	 */
+	now = now_us();
+	for (n = 0; n < arg->buffer_count; n++) {
+		struct object *obj = lookup(exec[n].handle);
+
+		if (obj == NULL) {
+			ret = -ENOENT;
+			goto out;
+		}
+		objects[n] = obj;
+
+		if (obj->busy <= now)
+			obj->written = false;
+		if (exec[n].flags & LOCAL_EXEC_OBJECT_WRITE)
+			obj->written = true;
+
+		if (exec[n].flags & LOCAL_EXEC_OBJECT_PINNED) {
+			obj->gtt = exec[n].offset;
+			obj->bound = true;
+		} else if (!obj->bound) {
+			uint64_t align = exec[n].alignment > PAGE_SIZE ? exec[n].alignment : PAGE_SIZE;
+
+			dev.next_gtt = ALIGN(dev.next_gtt, align);
+			if (dev.next_gtt + obj->size > dev.params.aperture)
+				dev.next_gtt = PAGE_SIZE;
+			obj->gtt = dev.next_gtt;
+			obj->bound = true;
+			dev.next_gtt += obj->size;
+		}
+		exec[n].offset = obj->gtt;
+	}
+
+	for (n = 0; n < arg->buffer_count; n++) {
+		ret = exec_relocate(objects[n], &exec[n],
+				    arg->buffer_count, objects, arg->flags);
+		if (ret)
+			goto out;
+	}
+
+	/* Each batch occupies its engine for the configured latency */
+	ring = engine_class(arg->flags & I915_EXEC_RING_MASK);
+	done = dev.engine[ring] > now ? dev.engine[ring] : now;
+	done += dev.params.latency_us;
+	dev.engine[ring] = done;
+
+	for (n = 0; n < arg->buffer_count; n++) {
+		objects[n]->busy = done;
+		objects[n]->engine = arg->flags & I915_EXEC_RING_MASK;
+	}
+
+	rq = &dev.request[dev.request_head++ % MAX_REQUESTS];
+	rq->emitted = now;
+	rq->completed = done;
+
+	dev.stats.execbuf++;
+	ret = 0;
+out:
+	free(objects);
+	return ret;
+}
+
+/* i915_gem_throttle: wait for the batches emitted more than 20ms ago */
+static uint64_t throttle_target(void)
+{
+	uint64_t cutoff = now_us() - THROTTLE_US, target = 0;
+	unsigned n;
+
+	for (n = 0; n < MAX_REQUESTS; n++) {
+		const struct request *rq = &dev.request[n];
+
+		if (rq->emitted && rq->emitted <= cutoff && rq->completed > target)
+			target = rq->completed;
+	}
+
+	return target;
+}
+
+int fake_i915_ioctl(int fd, unsigned long request, void *arg)
+{
+	uint64_t wait = 0, start;
+	int64_t timeout = -1;
+	struct object *obj;
+	int ret;
+
+	if (fd != dev.fd)
+		return ioctl(fd, request, arg);
+
+	pthread_mutex_lock(&dev.lock);
+	dev.stats.ioctls++;
+
+	switch (DRM_IOCTL_NR(request)) {
+	case DRM_IOCTL_NR(DRM_IOCTL_GEM_CLOSE):
+		ret = gem_close(arg);
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GETPARAM:
+		ret = gem_getparam(arg);
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_CREATE:
+		ret = gem_create(arg);
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_PREAD:
+	case DRM_COMMAND_BASE + DRM_I915_GEM_PWRITE:
+		/* the copy is made below, once the object is idle */
+		if ((obj = lookup(((struct drm_i915_gem_pread *)arg)->handle))) {
+			wait = obj->busy;
+			ret = 0;
+		} else
+			ret = -ENOENT;
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_MMAP:
+		ret = gem_mmap(arg, _IOC_SIZE(request));
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_MMAP_GTT:
+		if ((obj = lookup(((struct drm_i915_gem_mmap_gtt *)arg)->handle))) {
+			((struct drm_i915_gem_mmap_gtt *)arg)->offset = obj->offset;
+			ret = 0;
+		} else
+			ret = -ENOENT;
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_SET_DOMAIN:
+		if ((obj = lookup(((struct drm_i915_gem_set_domain *)arg)->handle))) {
+			wait = obj->busy;
+			ret = 0;
+		} else
+			ret = -ENOENT;
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_SET_TILING:
+		ret = gem_set_tiling(arg);
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_GET_TILING:
+		ret = gem_get_tiling(arg, _IOC_SIZE(request));
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_MADVISE:
+		if ((obj = lookup(((struct drm_i915_gem_madvise *)arg)->handle))) {
+			obj->madv = ((struct drm_i915_gem_madvise *)arg)->madv;
+			((struct drm_i915_gem_madvise *)arg)->retained = 1;
+			ret = 0;
+		} else
+			ret = -ENOENT;
+		break;
+
+	case DRM_COMMAND_BASE + LOCAL_I915_GEM_SET_CACHING:
+		if ((obj = lookup(((struct local_i915_gem_caching *)arg)->handle))) {
+			obj->caching = ((struct local_i915_gem_caching *)arg)->caching;
+			ret = 0;
+		} else
+			ret = -ENOENT;
+		break;
+
+	case DRM_COMMAND_BASE + LOCAL_I915_GEM_GET_CACHING:
+		if ((obj = lookup(((struct local_i915_gem_caching *)arg)->handle))) {
+			((struct local_i915_gem_caching *)arg)->caching = obj->caching;
+			ret = 0;
+		} else
+			ret = -ENOENT;
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_BUSY:
+		ret = gem_busy(arg);
+		break;
+
+	case DRM_COMMAND_BASE + LOCAL_I915_GEM_WAIT:
+		if ((obj = lookup(((struct local_i915_gem_wait *)arg)->handle))) {
+			wait = obj->busy;
+			timeout = ((struct local_i915_gem_wait *)arg)->timeout;
+			ret = 0;
+		} else
+			ret = -ENOENT;
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_THROTTLE:
+		wait = throttle_target();
+		ret = 0;
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_EXECBUFFER2:
+		ret = gem_execbuffer2(arg);
+		break;
+
+	case DRM_COMMAND_BASE + DRM_I915_GEM_GET_APERTURE:
+		((struct drm_i915_gem_get_aperture *)arg)->aper_size = dev.params.aperture;
+		((struct drm_i915_gem_get_aperture *)arg)->aper_available_size = dev.params.aperture;
+		ret = 0;
+		break;
+
+	case DRM_COMMAND_BASE + LOCAL_I915_GEM_CONTEXT_GETPARAM:
+		if (_IOC_SIZE(request) == sizeof(struct local_i915_gem_context_param) &&
+		    ((struct local_i915_gem_context_param *)arg)->param == LOCAL_CONTEXT_PARAM_GTT_SIZE) {
+			((struct local_i915_gem_context_param *)arg)->value = dev.params.aperture;
+			ret = 0;
+		} else
+			ret = -EINVAL;
+		break;
+
+	default:
+		/* no userptr, flink, prime or modesetting */
+		ret = -ENODEV;
+		break;
+	}
+	pthread_mutex_unlock(&dev.lock);
+
+	/* Blocking requests sleep until the simulated GPU catches up */
+	start = now_us();
+	if (ret == 0 && wait > start) {
+		if (timeout >= 0 && wait > start + timeout / 1000) {
+			sleep_until(start + timeout / 1000);
+			((struct local_i915_gem_wait *)arg)->timeout = 0;
+			ret = -ETIME;
+		} else {
+			sleep_until(wait);
+			if (timeout > 0)
+				((struct local_i915_gem_wait *)arg)->timeout -= (wait - start) * 1000;
+		}
+
+		pthread_mutex_lock(&dev.lock);
+		dev.stats.waits++;
+		dev.stats.wait_us += now_us() - start;
+		pthread_mutex_unlock(&dev.lock);
+	}
+
+	if (ret == 0 && DRM_IOCTL_NR(request) == DRM_COMMAND_BASE + DRM_I915_GEM_PREAD) {
+		pthread_mutex_lock(&dev.lock);
+		ret = gem_pread(arg);
+		pthread_mutex_unlock(&dev.lock);
+	}
+	if (ret == 0 && DRM_IOCTL_NR(request) == DRM_COMMAND_BASE + DRM_I915_GEM_PWRITE) {
+		pthread_mutex_lock(&dev.lock);
+		ret = gem_pwrite(arg);
+		pthread_mutex_unlock(&dev.lock);
+	}
+
+	if (ret) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifndef FAKE_I915_H
+#define FAKE_I915_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* A userspace stand-in for the i915 GEM interface, enough to drive kgem.
+ *
+ * Objects live in a memfd which doubles as the device file, so that
+ * both the GTT mmap of the fd and the CPU/WC mmap ioctls return real
+ * (and coherent) mappings. Batches are not executed; instead each engine
+ * is modelled as a timeline on which every batch occupies the GPU for
+ * the configured latency, and the objects it references are reported
+ * busy until it completes.
+ */
+struct fake_i915_params {
+	unsigned gen;		/* as kgem->gen, selects 32/64-bit relocations */
+	bool llc;
+	bool full_ppgtt;	/* also advertises softpin on gen8+ */
+	unsigned latency_us;	/* GPU time per batch */
+	uint64_t aperture;	/* in bytes, 0 for the default 256MiB */
+};
+
+struct fake_i915_stats {
+	unsigned objects, max_objects;
+	uint64_t bytes, max_bytes;
+	uint64_t created, closed;
+	uint64_t execbuf, relocs, relocs_written;
+	uint64_t waits, wait_us;
+	uint64_t ioctls;
+};
+
+int fake_i915_open(const struct fake_i915_params *params);
+void fake_i915_close(int fd);
+int fake_i915_ioctl(int fd, unsigned long request, void *arg);
+
+void fake_i915_get_stats(int fd, struct fake_i915_stats *stats);
+bool fake_i915_is_busy(int fd, uint32_t handle);
+
+#endif /* FAKE_I915_H */
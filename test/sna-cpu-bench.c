@@ -0,0 +1,576 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* Headless benchmark for the CPU copy routines in src/sna/blt.c.
+ *
+ * The driver sources are linked in directly, so this runs without an X
+ * server or a GPU. Every SIMD variant picked by choose_memcpy_tiled_x()
+ * is first checked against the scalar routine before it is timed.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sna.h"
+#include <pixman.h>
+#include "sna-stubs.h"
+
+#define ARRAY_SIZE(a) (sizeof(a)/sizeof(a[0]))
+
+static const struct variant {
+	const char *name;
+	unsigned features;
+} variants[] = {
+	{ "scalar", 0 },
+	{ "sse2", SSE2 },
+	{ "avx2", SSE2 | AVX | AVX2 },
+};
+
+static const struct swizzle {
+	const char *name;
+	int mode;
+	int gen;
+} swizzles[] = {
+	{ "none", I915_BIT_6_SWIZZLE_NONE, 060 },
+	{ "9", I915_BIT_6_SWIZZLE_9, 060 },
+	{ "9_10", I915_BIT_6_SWIZZLE_9_10, 060 },
+	{ "9_11", I915_BIT_6_SWIZZLE_9_11, 060 },
+	{ "9_10_11", I915_BIT_6_SWIZZLE_9_10_11, 060 },
+	{ "gen2", I915_BIT_6_SWIZZLE_NONE, 020 },
+};
+
+static const int bpps[] = { 8, 16, 32 };
+static const int sizes[] = { 8, 64, 256, 1024 };
+static const int offsets[] = { 0, 1, 7 };
+
+#define MAX_SIZE 1024
+#define MAX_OFFSET 8
+#define SURFACE_PITCH 8192 /* a multiple of every X-tile width */
+#define SURFACE_HEIGHT (MAX_SIZE + 2*MAX_OFFSET + 16)
+#define SURFACE_SIZE (SURFACE_PITCH * SURFACE_HEIGHT)
+
+static unsigned cpu;
+static int failures;
+
+static uint8_t *src, *dst, *ref;
+
+static void *surface_create(void)
+{
+	void *ptr;
+
+	if (posix_memalign(&ptr, 4096, SURFACE_SIZE))
+		abort();
+
+	return ptr;
+}
+
+static void surface_fill(void *ptr, unsigned seed)
+{
+	uint32_t *p = ptr;
+	int n;
+
+	for (n = 0; n < SURFACE_SIZE / 4; n++) {
+		seed = seed * 1103515245 + 12345;
+		p[n] = seed;
+	}
+}
+
+/* Run EXPR until at least min_time has passed, growing the batch between
+ * clock reads so that small boxes are not dominated by the timer.
+ */
+#define BENCH(gbps, bytes, EXPR) do { \
+	struct timespec start, now; \
+	unsigned long loops = 0, batch = 1, i; \
+	double t; \
+	clock_gettime(CLOCK_MONOTONIC, &start); \
+	do { \
+		for (i = 0; i < batch; i++) { \
+			EXPR; \
+		} \
+		loops += batch; \
+		clock_gettime(CLOCK_MONOTONIC, &now); \
+		t = elapsed(&start, &now); \
+		if (t < min_time / 16) \
+			batch *= 2; \
+	} while (t < min_time); \
+	gbps = (double)(bytes) * loops / t / 1e9; \
+} while (0)
+
+static void report(const char *func, const char *swizzle, const char *variant,
+		   int bpp, int size, int offset, double gbps)
+{
+	fprintf(stdout, "%24s %-8s %-7s bpp=%-2d %4dx%-4d +%d: %7.2f GB/s\n",
+		func, swizzle, variant, bpp, size, size, offset, gbps);
+}
+
+static void fail(const char *func, const char *swizzle, const char *variant,
+		 int bpp, int x, int y, int w, int h)
+{
+	fprintf(stdout, "%24s %-8s %-7s bpp=%-2d (%d, %d)x(%d, %d): FAIL\n",
+		func, swizzle, variant, bpp, x, y, w, h);
+	failures++;
+}
+
+static void choose(struct kgem *kgem, const struct swizzle *s, unsigned features)
+{
+	memset(kgem, 0, sizeof(*kgem));
+	kgem->gen = s->gen;
+	choose_memcpy_tiled_x(kgem, s->mode, features);
+}
+
+enum { TO, FROM, BETWEEN };
+static const char *tiled_names[] = {
+	"memcpy_to_tiled_x",
+	"memcpy_from_tiled_x",
+	"memcpy_between_tiled_x",
+};
+
+static memcpy_box_func tiled_func(struct kgem *kgem, int op)
+{
+	switch (op) {
+	case TO: return kgem->memcpy_to_tiled_x;
+	case FROM: return kgem->memcpy_from_tiled_x;
+	default: return kgem->memcpy_between_tiled_x;
+	}
+}
+
+static void run_tiled(memcpy_box_func func, int op, int bpp,
+		      void *s, void *d,
+		      int sx, int sy, int dx, int dy, int w, int h)
+{
+	/* between_tiled requires both surfaces to share the same phase */
+	if (op == BETWEEN)
+		sx = dx;
+
+	func(s, d, bpp, SURFACE_PITCH, SURFACE_PITCH, sx, sy, dx, dy, w, h);
+}
+
+static void check_tiled(const struct swizzle *s, const struct variant *v,
+			int op, int bpp)
+{
+	struct kgem scalar, simd;
+	memcpy_box_func func;
+	unsigned seed = 0xdeadbeef;
+	int n;
+
+	choose(&scalar, s, 0);
+	choose(&simd, s, v->features);
+
+	func = tiled_func(&simd, op);
+	if (func == NULL || func == tiled_func(&scalar, op))
+		return;
+
+	surface_fill(src, seed);
+	surface_fill(dst, ~seed);
+	memcpy(ref, dst, SURFACE_SIZE);
+
+	for (n = 0; n < 64; n++) {
+		int max = SURFACE_PITCH / (bpp / 8) - 1;
+		int w, h, sx, sy, dx, dy;
+
+		seed = seed * 1103515245 + 12345;
+		w = 1 + (seed >> 8) % MAX_SIZE;
+		seed = seed * 1103515245 + 12345;
+		h = 1 + (seed >> 8) % 64;
+		seed = seed * 1103515245 + 12345;
+		sx = (seed >> 8) % (max - w);
+		seed = seed * 1103515245 + 12345;
+		dx = (seed >> 8) % (max - w);
+		seed = seed * 1103515245 + 12345;
+		sy = (seed >> 8) % (SURFACE_HEIGHT - 16 - h);
+		dy = (seed >> 16) % (SURFACE_HEIGHT - 16 - h);
+
+		run_tiled(tiled_func(&scalar, op), op, bpp, src, ref,
+			  sx, sy, dx, dy, w, h);
+		run_tiled(func, op, bpp, src, dst,
+			  sx, sy, dx, dy, w, h);
+
+		if (memcmp(ref, dst, SURFACE_SIZE)) {
+			fail(tiled_names[op], s->name, v->name, bpp,
+			     dx, dy, w, h);
+			return;
+		}
+	}
+}
+
+static void bench_tiled(void)
+{
+	unsigned s, v, op, b, size, offset;
+
+	for (op = TO; op <= BETWEEN; op++) {
+		for (s = 0; s < ARRAY_SIZE(swizzles); s++) {
+			for (v = 0; v < ARRAY_SIZE(variants); v++) {
+				struct kgem kgem;
+				memcpy_box_func func;
+
+				if ((variants[v].features & cpu) != variants[v].features)
+					continue;
+
+				choose(&kgem, &swizzles[s], variants[v].features);
+				func = tiled_func(&kgem, op);
+				if (func == NULL)
+					continue;
+
+				if (v) {
+					struct kgem prev;
+
+					/* skip variants that were not compiled in */
+					choose(&prev, &swizzles[s], variants[v-1].features);
+					if (func == tiled_func(&prev, op))
+						continue;
+				}
+
+				for (b = 0; b < ARRAY_SIZE(bpps); b++)
+					check_tiled(&swizzles[s], &variants[v], op, bpps[b]);
+				if (check_only)
+					continue;
+
+				for (b = 0; b < ARRAY_SIZE(bpps); b++) {
+					for (size = 0; size < ARRAY_SIZE(sizes); size++) {
+						for (offset = 0; offset < ARRAY_SIZE(offsets); offset++) {
+							int bpp = bpps[b];
+							int sz = sizes[size];
+							int x = offsets[offset];
+							double gbps;
+
+							BENCH(gbps, sz * sz * bpp / 8,
+							      run_tiled(func, op, bpp, src, dst,
+									x, 0, x, 0, sz, sz));
+							report(tiled_names[op],
+							       swizzles[s].name,
+							       variants[v].name,
+							       bpp, sz, x, gbps);
+						}
+					}
+				}
+			}
+		}
+		if (!check_only)
+			fprintf(stdout, "\n");
+	}
+}
+
+static void check_blt(int bpp)
+{
+	unsigned seed = 0x12345678;
+	int cpp = bpp / 8;
+	int n, y;
+
+	surface_fill(src, seed);
+	surface_fill(dst, ~seed);
+	memcpy(ref, dst, SURFACE_SIZE);
+
+	for (n = 0; n < 64; n++) {
+		int w, h, sx, sy, dx, dy;
+
+		seed = seed * 1103515245 + 12345;
+		w = 1 + (seed >> 8) % MAX_SIZE;
+		h = 1 + (seed >> 20) % 64;
+		seed = seed * 1103515245 + 12345;
+		sx = (seed >> 8) % MAX_OFFSET;
+		dx = (seed >> 12) % MAX_OFFSET;
+		sy = (seed >> 16) % MAX_OFFSET;
+		dy = (seed >> 20) % MAX_OFFSET;
+
+		for (y = 0; y < h; y++)
+			memcpy(ref + (dy + y) * SURFACE_PITCH + dx * cpp,
+			       src + (sy + y) * SURFACE_PITCH + sx * cpp,
+			       w * cpp);
+		memcpy_blt(src, dst, bpp, SURFACE_PITCH, SURFACE_PITCH,
+			   sx, sy, dx, dy, w, h);
+
+		if (memcmp(ref, dst, SURFACE_SIZE)) {
+			fail("memcpy_blt", "-", "-", bpp, dx, dy, w, h);
+			return;
+		}
+	}
+}
+
+static void check_xor(int bpp)
+{
+	unsigned seed = 0x87654321;
+	int cpp = bpp / 8;
+	int n, x, y;
+
+	surface_fill(src, seed);
+	surface_fill(dst, ~seed);
+	memcpy(ref, dst, SURFACE_SIZE);
+
+	for (n = 0; n < 64; n++) {
+		uint32_t and, or;
+		int w, h, sx, sy, dx, dy;
+
+		seed = seed * 1103515245 + 12345;
+		w = 1 + (seed >> 8) % MAX_SIZE;
+		h = 1 + (seed >> 20) % 64;
+		seed = seed * 1103515245 + 12345;
+		sx = (seed >> 8) % MAX_OFFSET;
+		dx = (seed >> 12) % MAX_OFFSET;
+		sy = (seed >> 16) % MAX_OFFSET;
+		dy = (seed >> 20) % MAX_OFFSET;
+		seed = seed * 1103515245 + 12345;
+		or = seed;
+		and = n & 1 ? 0xffffffff : ~seed;
+		if (bpp < 32)
+			or &= (1 << bpp) - 1;
+
+		for (y = 0; y < h; y++) {
+			const uint8_t *s = src + (sy + y) * SURFACE_PITCH + sx * cpp;
+			uint8_t *d = ref + (dy + y) * SURFACE_PITCH + dx * cpp;
+
+			for (x = 0; x < w; x++) {
+				switch (cpp) {
+				case 1:
+					((uint8_t *)d)[x] = (((const uint8_t *)s)[x] & and) | or;
+					break;
+				case 2:
+					((uint16_t *)d)[x] = (((const uint16_t *)s)[x] & and) | or;
+					break;
+				case 4:
+					((uint32_t *)d)[x] = (((const uint32_t *)s)[x] & and) | or;
+					break;
+				}
+			}
+		}
+		memcpy_xor(src, dst, bpp, SURFACE_PITCH, SURFACE_PITCH,
+			   sx, sy, dx, dy, w, h, and, or);
+
+		if (memcmp(ref, dst, SURFACE_SIZE)) {
+			fail("memcpy_xor", "-", "-", bpp, dx, dy, w, h);
+			return;
+		}
+	}
+}
+
+static void check_memmove(int bpp)
+{
+	unsigned seed = 0x2468ace0;
+	int cpp = bpp / 8;
+	int n, y;
+
+	surface_fill(dst, seed);
+	memcpy(ref, dst, SURFACE_SIZE);
+
+	for (n = 0; n < 64; n++) {
+		BoxRec box;
+		int dx, dy;
+
+		seed = seed * 1103515245 + 12345;
+		box.x1 = MAX_OFFSET + (seed >> 8) % 64;
+		box.y1 = MAX_OFFSET + (seed >> 16) % 64;
+		seed = seed * 1103515245 + 12345;
+		box.x2 = box.x1 + 1 + (seed >> 8) % (MAX_SIZE - 64);
+		box.y2 = box.y1 + 1 + (seed >> 20) % 64;
+		seed = seed * 1103515245 + 12345;
+		dx = (int)((seed >> 8) % (2*MAX_OFFSET + 1)) - MAX_OFFSET;
+		dy = (int)((seed >> 16) % (2*MAX_OFFSET + 1)) - MAX_OFFSET;
+		if (dx == 0 && dy == 0)
+			dx = 1;
+
+		memcpy(src, dst, SURFACE_SIZE);
+
+		/* the box is in destination space, the source lies at (dx, dy) */
+		for (y = box.y1; y < box.y2; y++)
+			memcpy(ref + y * SURFACE_PITCH + box.x1 * cpp,
+			       src + (y + dy) * SURFACE_PITCH + (box.x1 + dx) * cpp,
+			       (box.x2 - box.x1) * cpp);
+		memmove_box(dst + dy * SURFACE_PITCH + dx * cpp, dst,
+			    bpp, SURFACE_PITCH, &box, dx, dy);
+
+		if (memcmp(ref, dst, SURFACE_SIZE)) {
+			fail("memmove_box", "-", "-", bpp,
+			     box.x1, box.y1, box.x2 - box.x1, box.y2 - box.y1);
+			return;
+		}
+	}
+}
+
+static void bench_linear(void)
+{
+	unsigned b, size, offset;
+
+	for (b = 0; b < ARRAY_SIZE(bpps); b++) {
+		check_blt(bpps[b]);
+		check_xor(bpps[b]);
+		check_memmove(bpps[b]);
+	}
+	if (check_only)
+		return;
+
+	for (b = 0; b < ARRAY_SIZE(bpps); b++) {
+		for (size = 0; size < ARRAY_SIZE(sizes); size++) {
+			for (offset = 0; offset < ARRAY_SIZE(offsets); offset++) {
+				int bpp = bpps[b];
+				int sz = sizes[size];
+				int x = offsets[offset];
+				double gbps;
+
+				BENCH(gbps, sz * sz * bpp / 8,
+				      memcpy_blt(src, dst, bpp,
+						 SURFACE_PITCH, SURFACE_PITCH,
+						 x, 0, 0, 0, sz, sz));
+				report("memcpy_blt", "-", "-", bpp, sz, x, gbps);
+			}
+		}
+	}
+	fprintf(stdout, "\n");
+
+	for (b = 0; b < ARRAY_SIZE(bpps); b++) {
+		for (size = 0; size < ARRAY_SIZE(sizes); size++) {
+			for (offset = 0; offset < ARRAY_SIZE(offsets); offset++) {
+				int bpp = bpps[b];
+				int sz = sizes[size];
+				int x = offsets[offset];
+				double gbps;
+
+				BENCH(gbps, sz * sz * bpp / 8,
+				      memcpy_xor(src, dst, bpp,
+						 SURFACE_PITCH, SURFACE_PITCH,
+						 x, 0, 0, 0, sz, sz,
+						 0xffffffff, 0xff000000));
+				report("memcpy_xor", "-", "-", bpp, sz, x, gbps);
+			}
+		}
+	}
+	fprintf(stdout, "\n");
+
+	for (b = 0; b < ARRAY_SIZE(bpps); b++) {
+		for (size = 0; size < ARRAY_SIZE(sizes); size++) {
+			for (offset = 0; offset < ARRAY_SIZE(offsets); offset++) {
+				int bpp = bpps[b];
+				int sz = sizes[size];
+				int x = offsets[offset];
+				BoxRec box;
+				double gbps;
+
+				box.x1 = MAX_OFFSET;
+				box.y1 = MAX_OFFSET;
+				box.x2 = box.x1 + sz;
+				box.y2 = box.y1 + sz;
+
+				BENCH(gbps, sz * sz * bpp / 8,
+				      memmove_box(src + x * bpp / 8 + SURFACE_PITCH, src,
+						  bpp, SURFACE_PITCH, &box, x, 1));
+				report("memmove_box", "-", "-", bpp, sz, x, gbps);
+			}
+		}
+	}
+	fprintf(stdout, "\n");
+}
+
+static void bench_affine(void)
+{
+	static const struct transform {
+		const char *name;
+		double m[3][3];
+	} transforms[] = {
+		{ "identity", {{ 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }} },
+		{ "scale", {{ .75, 0, 0 }, { 0, .75, 0 }, { 0, 0, 1 }} },
+		{ "rotate", {{ .866, -.5, 0 }, { .5, .866, 0 }, { 0, 0, 1 }} },
+	};
+	unsigned t, size;
+
+	if (check_only)
+		return;
+
+	for (t = 0; t < ARRAY_SIZE(transforms); t++) {
+		struct pixman_f_transform f;
+
+		memcpy(f.m, transforms[t].m, sizeof(f.m));
+		for (size = 0; size < ARRAY_SIZE(sizes); size++) {
+			int sz = sizes[size];
+			double gbps;
+
+			BENCH(gbps, sz * sz * 4,
+			      affine_blt(src, dst, 32,
+					 0, 0, sz, sz, SURFACE_PITCH,
+					 0, 0, sz, sz, SURFACE_PITCH,
+					 &f));
+			report("affine_blt", transforms[t].name, "-",
+			       32, sz, 0, gbps);
+		}
+	}
+	fprintf(stdout, "\n");
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [-c] [-t seconds] [-f features]\n"
+		"  -c  only check the SIMD variants against the scalar routines\n"
+		"  -t  minimum time to spend on each measurement (default %.2fs)\n"
+		"  -f  restrict the CPU feature mask (hex, as reported by sna_cpu_detect)\n",
+		argv0, min_time);
+}
+
+int main(int argc, char **argv)
+{
+	char buf[1024];
+	int c;
+
+	cpu = sna_cpu_detect();
+	while ((c = getopt(argc, argv, "ct:f:h")) != -1) {
+		switch (c) {
+		case 'c':
+			check_only = 1;
+			break;
+		case 't':
+			min_time = atof(optarg);
+			break;
+		case 'f':
+			cpu &= strtoul(optarg, NULL, 16);
+			break;
+		default:
+			usage(argv[0]);
+			return c != 'h';
+		}
+	}
+
+	fprintf(stdout, "CPU: %s\n\n", sna_cpu_features_to_string(cpu, buf));
+
+	src = surface_create();
+	dst = surface_create();
+	ref = surface_create();
+	surface_fill(src, 0);
+
+	bench_tiled();
+	bench_linear();
+	bench_affine();
+
+	free(ref);
+	free(dst);
+	free(src);
+
+	if (failures)
+		fprintf(stdout, "%d checks FAILED\n", failures);
+
+	return failures != 0;
+}
@@ -0,0 +1,3 @@
+#!/bin/sh
+# Check the SIMD blt routines against their scalar references
+exec ./sna-cpu-bench -c
@@ -0,0 +1,507 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* Headless test and benchmark for the damage tracking in src/sna/sna_damage.c.
+ *
+ * The damage code is linked in directly, so this runs without an X server
+ * or a GPU. Each stream of damage operations, either synthetic or read
+ * from a file, is first replayed against a reference pixman region to
+ * check every query, and then replayed again to be timed. Both the
+ * batching and the tiled backends are exercised.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sna.h"
+#include <pixman.h>
+#include "sna-stubs.h"
+
+#define MAX_BOXES 4
+
+/*
+ * A stream is a sequence of the operations below, each applied to a
+ * single damage. In a recorded stream, every line holds one operation
+ * as its letter followed by the boxes as x1 y1 x2 y2:
+ *
+ *   a  sna_damage_add_box		s  sna_damage_subtract_box
+ *   A  sna_damage_add (region)		S  sna_damage_subtract (region)
+ *   b  sna_damage_add_boxes		t  sna_damage_subtract_boxes
+ *   c  sna_damage_contains_box		g  sna_damage_get_boxes
+ *   r  sna_damage_destroy
+ *
+ * Lines starting with '#' are ignored.
+ */
+struct op {
+	char type;
+	int n;
+	BoxRec box[MAX_BOXES];
+};
+
+struct stream {
+	const char *name;
+	struct op *op;
+	int count, size;
+};
+
+static const struct backend {
+	const char *name;
+	bool tiled;
+} backends[] = {
+	{ "batch", false },
+	{ "tiled", true },
+};
+
+static int failures;
+
+static struct op *stream_add(struct stream *s, char type)
+{
+	struct op *op;
+
+	if (s->count == s->size) {
+		s->size = s->size ? 2 * s->size : 1024;
+		s->op = realloc(s->op, s->size * sizeof(*s->op));
+		if (s->op == NULL)
+			abort();
+	}
+
+	op = &s->op[s->count++];
+	op->type = type;
+	op->n = 0;
+	return op;
+}
+
+static void op_box(struct op *op, int x, int y, int w, int h)
+{
+	BoxRec *b = &op->box[op->n++];
+
+	assert(op->n <= MAX_BOXES);
+	b->x1 = x;
+	b->y1 = y;
+	b->x2 = x + w;
+	b->y2 = y + h;
+}
+
+static unsigned rnd(unsigned *seed, unsigned max)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 8) % max;
+}
+
+/* Many small, scattered updates, such as a busy desktop of clients */
+static void stream_scatter(struct stream *s, int width, int height)
+{
+	unsigned seed = 0x13579bdf;
+	int n;
+
+	for (n = 0; n < 65536; n++) {
+		int w = 1 + rnd(&seed, 32), h = 1 + rnd(&seed, 32);
+		struct op *op;
+
+		op = stream_add(s, 'a');
+		op_box(op, rnd(&seed, width - w), rnd(&seed, height - h), w, h);
+
+		if ((n & 15) == 15) {
+			w = 1 + rnd(&seed, 64), h = 1 + rnd(&seed, 64);
+			op = stream_add(s, 'c');
+			op_box(op, rnd(&seed, width - w), rnd(&seed, height - h), w, h);
+		}
+		if ((n & 1023) == 1023)
+			stream_add(s, 'g');
+	}
+	stream_add(s, 'g');
+}
+
+/* Lines of glyphs, queried per line and scrolled away a line at a time */
+static void stream_text(struct stream *s, int width, int height)
+{
+	unsigned seed = 0x2468ace0;
+	int x, y, line = 0;
+
+	for (y = 0; y + 16 <= height; y += 16, line++) {
+		struct op *op;
+
+		for (x = 0; x + 8 <= width; x += 8) {
+			if (rnd(&seed, 8) == 0)
+				continue;
+
+			op = stream_add(s, 'a');
+			op_box(op, x, y, 8, 16);
+		}
+
+		op = stream_add(s, 'c');
+		op_box(op, rnd(&seed, width / 2), y, width / 2, 16);
+
+		if (line >= 8) {
+			op = stream_add(s, 's');
+			op_box(op, 0, y - 8 * 16, width, 16);
+		}
+	}
+	stream_add(s, 'g');
+}
+
+/* Interleaved rendering and migration, as when sharing the CPU and GPU */
+static void stream_mixed(struct stream *s, int width, int height)
+{
+	static const char types[] = "AbSt";
+	unsigned seed = 0x87654321;
+	int n, i;
+
+	for (n = 0; n < 16384; n++) {
+		struct op *op;
+
+		op = stream_add(s, types[rnd(&seed, 4)]);
+		for (i = 1 + rnd(&seed, MAX_BOXES); i--; ) {
+			int w = 1 + rnd(&seed, width / 8);
+			int h = 1 + rnd(&seed, height / 8);
+			op_box(op, rnd(&seed, width - w), rnd(&seed, height - h), w, h);
+		}
+
+		op = stream_add(s, 'c');
+		op_box(op, rnd(&seed, width - 64), rnd(&seed, height - 64), 64, 64);
+
+		if ((n & 255) == 255)
+			stream_add(s, 'g');
+		if ((n & 4095) == 4095)
+			stream_add(s, 'r');
+	}
+	stream_add(s, 'g');
+}
+
+static bool stream_load(struct stream *s, const char *filename)
+{
+	char line[1024];
+	FILE *file;
+	int lineno = 0;
+
+	file = fopen(filename, "r");
+	if (file == NULL) {
+		fprintf(stderr, "unable to open %s\n", filename);
+		return false;
+	}
+
+	while (fgets(line, sizeof(line), file)) {
+		char *ptr = line, *end;
+		struct op *op;
+		char type;
+
+		lineno++;
+		while (*ptr == ' ' || *ptr == '\t')
+			ptr++;
+		if (*ptr == '#' || *ptr == '\n' || *ptr == '\0')
+			continue;
+
+		type = *ptr++;
+		if (strchr("aAbscStgr", type) == NULL) {
+			fprintf(stderr, "%s:%d: unknown operation '%c'\n",
+				filename, lineno, type);
+			fclose(file);
+			return false;
+		}
+
+		op = stream_add(s, type);
+		for (;;) {
+			long v[4];
+			int i;
+
+			for (i = 0; i < 4; i++) {
+				v[i] = strtol(ptr, &end, 0);
+				if (end == ptr)
+					break;
+				ptr = end;
+			}
+			if (i == 0)
+				break;
+
+			if (i != 4 || op->n == MAX_BOXES ||
+			    v[2] <= v[0] || v[3] <= v[1]) {
+				fprintf(stderr, "%s:%d: invalid box\n",
+					filename, lineno);
+				fclose(file);
+				return false;
+			}
+
+			op->box[op->n].x1 = v[0];
+			op->box[op->n].y1 = v[1];
+			op->box[op->n].x2 = v[2];
+			op->box[op->n].y2 = v[3];
+			op->n++;
+		}
+
+		if ((op->n == 0) != (type == 'g' || type == 'r') ||
+		    (op->n > 1 && strchr("asc", type))) {
+			fprintf(stderr, "%s:%d: wrong number of boxes\n",
+				filename, lineno);
+			fclose(file);
+			return false;
+		}
+	}
+
+	fclose(file);
+	return true;
+}
+
+struct result {
+	unsigned long ops;
+	int peak;
+	int boxes;
+};
+
+static bool check_boxes(struct sna_damage *damage, pixman_region16_t *ref)
+{
+	const BoxRec *boxes;
+	const pixman_box16_t *r;
+	int n, count;
+
+	n = damage ? sna_damage_get_boxes(damage, &boxes) : 0;
+	r = pixman_region_rectangles(ref, &count);
+
+	return n == count && memcmp(boxes, r, n * sizeof(BoxRec)) == 0;
+}
+
+static void run(const struct stream *s, struct result *result,
+		pixman_region16_t *ref)
+{
+	struct sna_damage *damage = NULL;
+	const struct op *op = s->op;
+	int n;
+
+	result->peak = 0;
+	result->boxes = 0;
+	for (n = 0; n < s->count; n++, op++) {
+		pixman_region16_t region;
+		const BoxRec *boxes;
+		int ret;
+
+		switch (op->type) {
+		case 'a':
+			sna_damage_add_box(&damage, &op->box[0]);
+			if (ref)
+				pixman_region_union_rect(ref, ref,
+							 op->box[0].x1, op->box[0].y1,
+							 op->box[0].x2 - op->box[0].x1,
+							 op->box[0].y2 - op->box[0].y1);
+			break;
+
+		case 'A':
+			pixman_region_init_rects(&region, op->box, op->n);
+			sna_damage_add(&damage, &region);
+			if (ref)
+				pixman_region_union(ref, ref, &region);
+			pixman_region_fini(&region);
+			break;
+
+		case 'b':
+			sna_damage_add_boxes(&damage, op->box, op->n, 0, 0);
+			if (ref) {
+				pixman_region_init_rects(&region, op->box, op->n);
+				pixman_region_union(ref, ref, &region);
+				pixman_region_fini(&region);
+			}
+			break;
+
+		case 's':
+			sna_damage_subtract_box(&damage, &op->box[0]);
+			if (ref) {
+				pixman_region_init_rects(&region, op->box, 1);
+				pixman_region_subtract(ref, ref, &region);
+				pixman_region_fini(&region);
+			}
+			break;
+
+		case 'S':
+			pixman_region_init_rects(&region, op->box, op->n);
+			sna_damage_subtract(&damage, &region);
+			if (ref)
+				pixman_region_subtract(ref, ref, &region);
+			pixman_region_fini(&region);
+			break;
+
+		case 't':
+			sna_damage_subtract_boxes(&damage, op->box, op->n, 0, 0);
+			if (ref) {
+				pixman_region_init_rects(&region, op->box, op->n);
+				pixman_region_subtract(ref, ref, &region);
+				pixman_region_fini(&region);
+			}
+			break;
+
+		case 'c':
+			ret = sna_damage_contains_box(&damage, &op->box[0]);
+			if (ref &&
+			    ret != pixman_region_contains_rectangle(ref, (BoxPtr)&op->box[0])) {
+				fprintf(stdout, "%s: contains_box (%d, %d), (%d, %d) at op %d: FAIL\n",
+					s->name,
+					op->box[0].x1, op->box[0].y1,
+					op->box[0].x2, op->box[0].y2,
+					n);
+				failures++;
+				ref = NULL;
+			}
+			break;
+
+		case 'g':
+			if (damage == NULL)
+				break;
+
+			result->boxes = sna_damage_get_boxes(damage, &boxes);
+			if (result->boxes > result->peak)
+				result->peak = result->boxes;
+			if (ref && !check_boxes(damage, ref)) {
+				fprintf(stdout, "%s: get_boxes at op %d: FAIL\n",
+					s->name, n);
+				failures++;
+				ref = NULL;
+			}
+			break;
+
+		case 'r':
+			sna_damage_destroy(&damage);
+			if (ref) {
+				pixman_region_fini(ref);
+				pixman_region_init(ref);
+			}
+			break;
+		}
+	}
+
+	if (ref && !check_boxes(damage, ref)) {
+		fprintf(stdout, "%s: final damage: FAIL\n", s->name);
+		failures++;
+	}
+
+	sna_damage_destroy(&damage);
+	result->ops = s->count;
+}
+
+static void bench(const struct stream *s)
+{
+	unsigned b;
+
+	for (b = 0; b < ARRAY_SIZE(backends); b++) {
+		struct timespec start, now;
+		struct result result;
+		unsigned long loops = 0;
+		pixman_region16_t ref;
+		double t;
+
+		sna_damage_set_tiled(backends[b].tiled);
+
+		pixman_region_init(&ref);
+		run(s, &result, &ref);
+		pixman_region_fini(&ref);
+		if (check_only)
+			continue;
+
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		do {
+			run(s, &result, NULL);
+			loops++;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			t = elapsed(&start, &now);
+		} while (t < min_time);
+
+		fprintf(stdout, "%12s %-6s %8d ops: %10.0f ops/s, peak %d boxes, final %d\n",
+			s->name, backends[b].name, s->count,
+			result.ops * loops / t, result.peak, result.boxes);
+	}
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [-c] [-t seconds] [-s WxH] [stream...]\n"
+		"  -c  only check the damage against the reference region\n"
+		"  -t  minimum time to spend on each measurement (default %.2fs)\n"
+		"  -s  size of the synthetic streams (default 3840x2160)\n"
+		"Each additional argument is a file containing a recorded stream.\n",
+		argv0, min_time);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct synthetic {
+		const char *name;
+		void (*func)(struct stream *s, int width, int height);
+	} synthetic[] = {
+		{ "scatter", stream_scatter },
+		{ "text", stream_text },
+		{ "mixed", stream_mixed },
+	};
+	int width = 3840, height = 2160;
+	unsigned n;
+	int c;
+
+	while ((c = getopt(argc, argv, "ct:s:h")) != -1) {
+		switch (c) {
+		case 'c':
+			check_only = 1;
+			break;
+		case 't':
+			min_time = atof(optarg);
+			break;
+		case 's':
+			if (sscanf(optarg, "%dx%d", &width, &height) != 2 ||
+			    width < 128 || height < 128 ||
+			    width > MAXSHORT || height > MAXSHORT) {
+				usage(argv[0]);
+				return 1;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return c != 'h';
+		}
+	}
+
+	for (n = 0; n < ARRAY_SIZE(synthetic); n++) {
+		struct stream s = { synthetic[n].name };
+
+		synthetic[n].func(&s, width, height);
+		bench(&s);
+		free(s.op);
+	}
+
+	for (; optind < argc; optind++) {
+		struct stream s = { argv[optind] };
+
+		if (stream_load(&s, argv[optind]))
+			bench(&s);
+		else
+			failures++;
+		free(s.op);
+	}
+
+	if (failures)
+		fprintf(stdout, "%d checks FAILED\n", failures);
+
+	return failures != 0;
+}
@@ -0,0 +1,3 @@
+#!/bin/sh
+# Check the tracked damage against a reference region on the synthetic streams
+exec ./sna-damage-bench -c
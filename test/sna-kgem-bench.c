@@ -0,0 +1,535 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* Headless test and benchmark for the buffer management in src/sna/kgem.c.
+ *
+ * kgem is linked in directly and talks to the userspace i915 in
+ * fake_i915.c instead of a device, so this runs without an X server or a
+ * GPU. Each workload hammers one part of kgem -- the bo caches, batch
+ * construction and submission, retirement and throttling against a GPU
+ * with the given latency -- and then checks that kgem and the "kernel"
+ * still agree on which objects exist and which are idle.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "sna.h"
+#include "sna_reg.h"
+#include "fake_i915.h"
+#include "sna-stubs.h"
+
+static void no_render(struct sna *sna)
+{
+	(void)sna;
+}
+
+#define POOL_SIZE 64
+
+static struct fake_i915_params params = {
+	.gen = 0110,
+	.llc = true,
+	.latency_us = 100,
+};
+static int failures;
+static const char *capture;
+
+#define check(expr) do { \
+	if (!(expr)) { \
+		fprintf(stdout, "%s:%d: check '%s' failed\n", \
+			__FUNCTION__, __LINE__, #expr); \
+		failures++; \
+	} \
+} while (0)
+
+static unsigned rnd(unsigned *seed, unsigned max)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return (*seed >> 8) % max;
+}
+
+static struct sna *setup(void)
+{
+	struct sna *sna;
+	int fd;
+
+	fd = fake_i915_open(&params);
+	if (fd < 0) {
+		perror("fake_i915_open");
+		exit(1);
+	}
+	kgem_set_ioctl(fake_i915_ioctl);
+
+	sna = calloc(1, sizeof(*sna));
+	sna->scrn = calloc(1, sizeof(*sna->scrn));
+	sna->cpu_features = sna_cpu_detect();
+	sna->render.reset = no_render;
+	sna->render.flush = no_render;
+
+	kgem_init(&sna->kgem, fd, NULL, params.gen);
+	if (sna->kgem.wedged) {
+		fprintf(stderr, "kgem refused the fake device\n");
+		exit(1);
+	}
+
+	return sna;
+}
+
+static void teardown(struct sna *sna)
+{
+	struct kgem *kgem = &sna->kgem;
+	struct fake_i915_stats st;
+
+	kgem_submit(kgem);
+	kgem_cleanup_cache(kgem);
+	check(!kgem->wedged);
+
+	/* Every object kgem still holds (e.g. the batch) must exist, and
+	 * nothing else may have been leaked.
+	 */
+	fake_i915_get_stats(kgem->fd, &st);
+	check(st.objects == kgem->stats.bo_create - kgem->stats.bo_close);
+
+	kgem_set_ioctl(NULL);
+	fake_i915_close(kgem->fd);
+	free(sna->scrn);
+	free(sna);
+}
+
+/* Churn through linear bos of mixed sizes, as for uploads and vbo */
+static unsigned run_linear(struct sna *sna, unsigned *seed)
+{
+	struct kgem *kgem = &sna->kgem;
+	struct kgem_bo *pool[POOL_SIZE] = { NULL };
+	unsigned n, ops = 0;
+
+	for (n = 0; n < 16 * POOL_SIZE; n++) {
+		struct kgem_bo **bo = &pool[n % POOL_SIZE];
+		int size = PAGE_SIZE << rnd(seed, 8);
+
+		size += rnd(seed, size) & ~(PAGE_SIZE - 1);
+
+		if (*bo)
+			kgem_bo_destroy(kgem, *bo);
+		*bo = kgem_create_linear(kgem, size, 0);
+		check(*bo && kgem_bo_size(*bo) >= size);
+		ops++;
+	}
+
+	for (n = 0; n < POOL_SIZE; n++)
+		if (pool[n])
+			kgem_bo_destroy(kgem, pool[n]);
+
+	kgem_retire(kgem);
+	return ops;
+}
+
+/* Churn through tiled surfaces, as for pixmaps */
+static unsigned run_2d(struct sna *sna, unsigned *seed)
+{
+	struct kgem *kgem = &sna->kgem;
+	struct kgem_bo *pool[POOL_SIZE] = { NULL };
+	unsigned n, ops = 0;
+
+	for (n = 0; n < 16 * POOL_SIZE; n++) {
+		struct kgem_bo **bo = &pool[n % POOL_SIZE];
+		int width = 16 << rnd(seed, 8);
+		int height = 16 << rnd(seed, 8);
+
+		if (*bo)
+			kgem_bo_destroy(kgem, *bo);
+		*bo = kgem_create_2d(kgem, width, height, 32,
+				     I915_TILING_X, 0);
+		check(*bo && (*bo)->pitch >= 4 * width);
+		ops++;
+	}
+
+	for (n = 0; n < POOL_SIZE; n++)
+		if (pool[n])
+			kgem_bo_destroy(kgem, pool[n]);
+
+	kgem_retire(kgem);
+	return ops;
+}
+
+static void emit_fill(struct kgem *kgem, struct kgem_bo *bo,
+		      const BoxRec *box, uint32_t color)
+{
+	uint32_t br13, cmd, *b;
+
+	cmd = XY_COLOR_BLT | (kgem->gen >= 0100 ? 5 : 4);
+	cmd |= BLT_WRITE_ALPHA | BLT_WRITE_RGB;
+	br13 = bo->pitch;
+	if (kgem->gen >= 040 && bo->tiling) {
+		cmd |= BLT_DST_TILED;
+		br13 >>= 2;
+	}
+	br13 |= 0xf0 << 16 | sna_br13_color_depth(32);
+
+	kgem_set_mode(kgem, KGEM_BLT, bo);
+	if (!kgem_check_batch(kgem, 7) ||
+	    !kgem_check_reloc(kgem, 1) ||
+	    !kgem_check_bo_fenced(kgem, bo)) {
+		kgem_submit(kgem);
+		_kgem_set_mode(kgem, KGEM_BLT);
+	}
+	kgem_bcs_set_tiling(kgem, NULL, bo);
+
+	b = kgem->batch + kgem->nbatch;
+	b[0] = cmd;
+	b[1] = br13;
+	*(uint64_t *)(b+2) = *(const uint64_t *)box;
+	if (kgem->gen >= 0100) {
+		*(uint64_t *)(b+4) =
+			kgem_add_reloc64(kgem, kgem->nbatch + 4, bo,
+					 I915_GEM_DOMAIN_RENDER << 16 |
+					 I915_GEM_DOMAIN_RENDER |
+					 KGEM_RELOC_FENCED,
+					 0);
+		b[6] = color;
+		kgem->nbatch += 7;
+	} else {
+		b[4] = kgem_add_reloc(kgem, kgem->nbatch + 4, bo,
+				      I915_GEM_DOMAIN_RENDER << 16 |
+				      I915_GEM_DOMAIN_RENDER |
+				      KGEM_RELOC_FENCED,
+				      0);
+		b[5] = color;
+		kgem->nbatch += 6;
+	}
+}
+
+/* Fill random boxes into a working set of surfaces, retiring and
+ * throttling as the block handler would every so often.
+ */
+static unsigned run_blt(struct sna *sna, unsigned *seed)
+{
+	struct kgem *kgem = &sna->kgem;
+	struct kgem_bo *pool[POOL_SIZE];
+	unsigned n, ops = 0;
+
+	for (n = 0; n < POOL_SIZE; n++) {
+		pool[n] = kgem_create_2d(kgem, 512, 512, 32, I915_TILING_X, 0);
+		check(pool[n]);
+	}
+
+	for (n = 0; n < 64 * POOL_SIZE; n++) {
+		struct kgem_bo *bo = pool[rnd(seed, POOL_SIZE)];
+		BoxRec box;
+
+		box.x1 = rnd(seed, 256);
+		box.y1 = rnd(seed, 256);
+		box.x2 = box.x1 + 1 + rnd(seed, 256);
+		box.y2 = box.y1 + 1 + rnd(seed, 256);
+		emit_fill(kgem, bo, &box, n);
+		ops++;
+
+		if ((n & 255) == 255) {
+			kgem_submit(kgem);
+			kgem_retire(kgem);
+			kgem_throttle(kgem);
+		}
+	}
+	kgem_submit(kgem);
+
+	for (n = 0; n < POOL_SIZE; n++)
+		kgem_bo_destroy(kgem, pool[n]);
+
+	kgem_retire(kgem);
+	return ops;
+}
+
+/* Look up and record surface state offsets as the render backends do,
+ * with every surface sampled in several formats; nothing may survive the
+ * batch it was emitted into.
+ */
+static unsigned run_binding(struct sna *sna, unsigned *seed)
+{
+	struct kgem *kgem = &sna->kgem;
+	struct kgem_bo *pool[POOL_SIZE];
+	uint16_t shadow[POOL_SIZE][8];
+	uint64_t hits = kgem->stats.binding_hit;
+	unsigned n, i, ops = 0;
+
+	for (n = 0; n < POOL_SIZE; n++) {
+		pool[n] = kgem_create_2d(kgem, 64, 64, 32, I915_TILING_X, 0);
+		check(pool[n]);
+		if (pool[n] == NULL)
+			return 0;
+	}
+
+	for (i = 0; i < 16; i++) {
+		BoxRec box = { 0, 0, 1, 1 };
+		uint16_t offset = 0;
+
+		memset(shadow, 0, sizeof(shadow));
+		for (n = 0; n < 8 * POOL_SIZE; n++) {
+			unsigned b = rnd(seed, POOL_SIZE);
+			unsigned f = rnd(seed, 8);
+			uint32_t format = (f & 1) << 30 | f >> 1;
+			uint32_t ret;
+
+			ret = kgem_bo_get_binding(kgem, pool[b], format);
+			check(ret == 0 || ret == shadow[b][f]);
+			if (ret == 0) {
+				offset += 16;
+				kgem_bo_set_binding(kgem, pool[b], format, offset);
+				shadow[b][f] = offset;
+			}
+			ops++;
+		}
+
+		emit_fill(kgem, pool[i % POOL_SIZE], &box, i);
+		kgem_submit(kgem);
+
+		for (n = 0; n < POOL_SIZE; n++)
+			check(kgem_bo_get_binding(kgem, pool[n], 0) == 0);
+	}
+	check(kgem->stats.binding_hit > hits);
+
+	for (n = 0; n < POOL_SIZE; n++)
+		kgem_bo_destroy(kgem, pool[n]);
+
+	kgem_retire(kgem);
+	return ops;
+}
+
+static uint64_t inactive_bytes(struct kgem *kgem)
+{
+	struct kgem_bo *bo;
+	uint64_t size = 0;
+	unsigned i;
+
+	list_for_each_entry(bo, &kgem->large_inactive, list)
+		size += kgem_bo_size(bo);
+	for (i = 0; i < ARRAY_SIZE(kgem->inactive); i++)
+		list_for_each_entry(bo, &kgem->inactive[i], list)
+			size += kgem_bo_size(bo);
+
+	return size;
+}
+
+/* Fill the inactive cache and hold it to a shrinking budget */
+static unsigned run_trim(struct sna *sna, unsigned *seed)
+{
+	struct kgem *kgem = &sna->kgem;
+	struct kgem_bo *pool[POOL_SIZE];
+	uint64_t before, target, freed;
+	unsigned n, ops = 0;
+
+	for (n = 0; n < POOL_SIZE; n++) {
+		int size = PAGE_SIZE << rnd(seed, 6);
+
+		pool[n] = kgem_create_linear(kgem, size, 0);
+		check(pool[n]);
+	}
+	for (n = 0; n < POOL_SIZE; n++)
+		if (pool[n])
+			kgem_bo_destroy(kgem, pool[n]);
+	kgem_retire(kgem);
+
+	for (target = inactive_bytes(kgem); target; target /= 2) {
+		before = inactive_bytes(kgem);
+		freed = kgem_trim_cache(kgem, target / 2);
+		check(before - freed == inactive_bytes(kgem));
+		check(inactive_bytes(kgem) <= target / 2);
+		ops++;
+	}
+	check(inactive_bytes(kgem) == 0);
+	check(kgem_trim_cache(kgem, 0) == 0);
+
+	return ops;
+}
+
+/* Write, render and read back: the CPU must never see a busy object */
+static unsigned run_sync(struct sna *sna, unsigned *seed)
+{
+	struct kgem *kgem = &sna->kgem;
+	uint32_t data[1024];
+	unsigned n, ops = 0;
+
+	for (n = 0; n < 64; n++) {
+		struct kgem_bo *bo;
+		BoxRec box = { 0, 0, 16, 16 };
+		uint32_t *ptr;
+		unsigned i;
+
+		for (i = 0; i < ARRAY_SIZE(data); i++)
+			data[i] = rnd(seed, ~0u);
+
+		bo = kgem_create_linear(kgem, sizeof(data), 0);
+		check(bo);
+		if (bo == NULL)
+			continue;
+
+		check(kgem_bo_write(kgem, bo, data, sizeof(data)));
+
+		bo->pitch = 64;
+		emit_fill(kgem, bo, &box, n);
+		kgem_submit(kgem);
+
+		ptr = kgem_bo_map__cpu(kgem, bo);
+		check(ptr);
+		if (ptr) {
+			kgem_bo_sync__cpu(kgem, bo);
+			check(!fake_i915_is_busy(kgem->fd, bo->handle));
+			check(memcmp(ptr, data, sizeof(data)) == 0);
+		}
+
+		kgem_bo_destroy(kgem, bo);
+		ops++;
+	}
+
+	return ops;
+}
+
+static void bench(const char *name,
+		  unsigned (*func)(struct sna *sna, unsigned *seed))
+{
+	struct timespec start, now;
+	struct fake_i915_stats st;
+	struct sna *sna;
+	unsigned long ops = 0;
+	unsigned seed = 0;
+	char path[1024];
+	double t;
+
+	sna = setup();
+	if (capture) {
+		snprintf(path, sizeof(path), "%s-%s.trace", capture, name);
+		if (!kgem_capture_open(&sna->kgem, path, false)) {
+			perror(path);
+			exit(1);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		ops += func(sna, &seed);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		t = elapsed(&start, &now);
+	} while (!check_only && t < min_time);
+
+	kgem_submit(&sna->kgem);
+	kgem_submit_wait(&sna->kgem);
+	fake_i915_get_stats(sna->kgem.fd, &st);
+	if (capture) {
+		/* Leave no empty traces behind for sna-replay to reject */
+		kgem_capture_close(&sna->kgem);
+		if (st.execbuf == 0)
+			unlink(path);
+	}
+	if (!check_only)
+		fprintf(stdout, "%8s: %10.0f ops/s, %llu gem objects (peak %u, %llu MiB), %llu batches, %llu relocs (%llu written), waited %.1fms\n",
+			name, ops / t,
+			(unsigned long long)st.created,
+			st.max_objects,
+			(unsigned long long)st.max_bytes >> 20,
+			(unsigned long long)st.execbuf,
+			(unsigned long long)st.relocs,
+			(unsigned long long)st.relocs_written,
+			st.wait_us / 1000.);
+
+	teardown(sna);
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [-c] [-t seconds] [-g gen] [-l latency] [-n] [-p] [-o prefix]\n"
+		"  -c  only run each workload once and check the results\n"
+		"  -t  minimum time to spend on each measurement (default %.2fs)\n"
+		"  -g  generation to pretend to be, e.g. 7.5 (default 9)\n"
+		"  -l  GPU time per batch in microseconds (default %u)\n"
+		"  -n  pretend not to have a shared last-level cache\n"
+		"  -p  pretend to have full-ppgtt, and so softpin on gen8+\n"
+		"  -o  capture each workload's batches to <prefix>-<workload>.trace\n",
+		argv0, min_time, params.latency_us);
+}
+
+int main(int argc, char **argv)
+{
+	static const struct workload {
+		const char *name;
+		unsigned (*func)(struct sna *sna, unsigned *seed);
+	} workloads[] = {
+		{ "linear", run_linear },
+		{ "2d", run_2d },
+		{ "blt", run_blt },
+		{ "binding", run_binding },
+		{ "trim", run_trim },
+		{ "sync", run_sync },
+	};
+	unsigned n;
+	int c;
+
+	while ((c = getopt(argc, argv, "ct:g:l:npo:h")) != -1) {
+		switch (c) {
+		case 'c':
+			check_only = 1;
+			break;
+		case 't':
+			min_time = atof(optarg);
+			break;
+		case 'g':
+			n = 10 * atof(optarg) + .5;
+			if (n < 20 || n > 99) {
+				usage(argv[0]);
+				return 1;
+			}
+			params.gen = (n / 10) << 3 | n % 10;
+			break;
+		case 'l':
+			params.latency_us = atoi(optarg);
+			break;
+		case 'n':
+			params.llc = false;
+			break;
+		case 'p':
+			params.full_ppgtt = true;
+			break;
+		case 'o':
+			capture = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return c != 'h';
+		}
+	}
+
+	for (n = 0; n < ARRAY_SIZE(workloads); n++)
+		bench(workloads[n].name, workloads[n].func);
+
+	if (failures)
+		fprintf(stdout, "%d checks FAILED\n", failures);
+
+	return failures != 0;
+}
@@ -0,0 +1,3 @@
+#!/bin/sh
+# Check that kgem and the fake i915 agree after each workload
+exec ./sna-kgem-bench -c
@@ -0,0 +1,8 @@
+#!/bin/sh
+# Capture the sna-kgem-bench workloads and check that sna-replay can
+# decode and rebuild every batch in them
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+./sna-kgem-bench -c -o "$dir/kgem" || exit 1
+./sna-replay -n 1 "$dir"/kgem-*.trace
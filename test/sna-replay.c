@@ -0,0 +1,489 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+/* Offline analysis of a batch trace written with Option "BatchCapture".
+ *
+ * Each captured batch is first decoded for statistics: the bytes of
+ * commands and of indirect state, the number of primitives (3DPRIMITIVE
+ * on gen4+, blits on the BLT ring), the relocations and how many of them
+ * write, and the number of state packets that repeat the previous packet
+ * of the same type within the batch. The render batches of gen2/3 are
+ * not decoded and only counted.
+ *
+ * The batches are then rebuilt through src/sna/kgem.c against the fake
+ * i915, with a stand-in bo for every object in the exec list, to time the
+ * CPU side of emitting and submitting them without the rendering code
+ * that originally generated them.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "sna.h"
+#include "kgem_capture.h"
+#include "fake_i915.h"
+#include "sna-stubs.h"
+
+static void no_render(struct sna *sna)
+{
+	(void)sna;
+}
+
+#define MI_NOOP			0
+#define MI_BATCH_BUFFER_END	(0xA << 23)
+
+struct stats {
+	unsigned long batches, undecoded;
+	uint64_t commands, state;
+	uint64_t packets, primitives;
+	uint64_t redundant, redundant_bytes;
+	uint64_t relocs, writes;
+	uint64_t buffers, buffer_bytes;
+	double build, submit;
+};
+
+static struct fake_i915_params params;
+static int verbose;
+static int loops = 1;
+
+static const void *
+next_record(const char **ptr, const char *end,
+	    const struct kgem_capture_record **record)
+{
+	const struct kgem_capture_record *r;
+
+	if (end - *ptr < (long)sizeof(*r))
+		return NULL;
+
+	r = (const struct kgem_capture_record *)*ptr;
+	if (r->length > end - *ptr - sizeof(*r)) {
+		fprintf(stderr, "truncated record, ignoring the remainder of the trace\n");
+		return NULL;
+	}
+
+	*record = r;
+	*ptr += sizeof(*r) + r->length;
+	return r + 1;
+}
+
+/* Length in dwords of the packet starting with dw, or 0 if unknown */
+static unsigned packet_length(unsigned gen, int ring, uint32_t dw)
+{
+	switch (dw >> 29) {
+	case 0: /* MI */
+		if (((dw >> 23) & 0x3f) < 0x10)
+			return 1;
+		return (dw & 0x3f) + 2;
+	case 2: /* 2D */
+		return (dw & 0xff) + 2;
+	case 3: /* 3D, media */
+		if (ring == KGEM_BLT || gen < 040)
+			return 0;
+		if (((dw >> 27) & 3) == 1 && ((dw >> 24) & 7) == 1)
+			return 1; /* single dword, e.g. PIPELINE_SELECT */
+		return (dw & 0xff) + 2;
+	default:
+		return 0;
+	}
+}
+
+static void decode_batch(unsigned gen,
+			 const struct kgem_capture_batch *batch,
+			 const uint32_t *cmd,
+			 struct stats *s)
+{
+	static const uint32_t *last[1 << 13];
+	unsigned n, len;
+
+	if (batch->ring == KGEM_RENDER && gen < 040) {
+		s->undecoded++;
+		return;
+	}
+
+	memset(last, 0, sizeof(last));
+	for (n = 0; n < batch->nbatch; n += len) {
+		uint32_t dw = cmd[n];
+
+		len = packet_length(gen, batch->ring, dw);
+		if (len == 0 || n + len > batch->nbatch) {
+			s->undecoded++;
+			return;
+		}
+		s->packets++;
+
+		switch (dw >> 29) {
+		case 2:
+			s->primitives++;
+			break;
+		case 3:
+			if (dw >> 16 == 0x7b00) {
+				s->primitives++;
+			} else {
+				const uint32_t **prev = &last[(dw >> 16) & 0x1fff];
+
+				if (*prev && (*prev)[0] == dw &&
+				    memcmp(*prev, cmd + n, 4*len) == 0) {
+					s->redundant++;
+					s->redundant_bytes += 4*len;
+				}
+				*prev = cmd + n;
+			}
+			break;
+		}
+	}
+}
+
+/* Rebuild a captured batch through kgem and submit it */
+static bool replay_batch(struct kgem *kgem,
+			 const struct kgem_capture_batch *batch,
+			 const struct kgem_capture_exec *exec,
+			 const struct kgem_capture_reloc *reloc,
+			 const uint32_t *cmd,
+			 const uint32_t *state,
+			 struct stats *s)
+{
+	struct kgem_bo **bo;
+	struct timespec t0, t1, t2;
+	unsigned nbatch, nstate, n;
+	int shift;
+
+	nbatch = batch->nbatch;
+	if (nbatch && cmd[nbatch-1] == MI_BATCH_BUFFER_END)
+		nbatch--;
+	if (nbatch && cmd[nbatch-1] == MI_NOOP)
+		nbatch--;
+
+	nstate = batch->batch_size - batch->surface;
+	if (nbatch + nstate > kgem->batch_size) {
+		fprintf(stderr, "captured batch does not fit, %d + %d > %d dwords\n",
+			nbatch, nstate, kgem->batch_size);
+		return false;
+	}
+	shift = 4 * ((int)(kgem->batch_size - nstate) - (int)batch->surface);
+
+	bo = calloc(batch->nexec + 1, sizeof(*bo));
+	if (bo == NULL)
+		return false;
+
+	for (n = 0; n < batch->nexec; n++) {
+		bo[n] = kgem_create_linear(kgem,
+					   exec[n].size ? exec[n].size : PAGE_SIZE,
+					   0);
+		if (bo[n] == NULL) {
+			while (n--)
+				kgem_bo_destroy(kgem, bo[n]);
+			free(bo);
+			return false;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	_kgem_set_mode(kgem, batch->ring == KGEM_BLT ? KGEM_BLT : KGEM_RENDER);
+	memcpy(kgem->batch, cmd, 4*nbatch);
+	kgem->nbatch = nbatch;
+	kgem->surface = kgem->batch_size - nstate;
+	memcpy(kgem->batch + kgem->surface, state, 4*nstate);
+
+	for (n = 0; n < batch->nreloc; n++) {
+		uint32_t offset = reloc[n].offset;
+		uint64_t delta = reloc[n].delta;
+		struct kgem_bo *target = NULL;
+		uint32_t domains;
+
+		if (offset >= 4*batch->surface)
+			offset += shift;
+
+		if (reloc[n].target < batch->nexec)
+			target = bo[reloc[n].target];
+		else if (delta >= 4*batch->surface)
+			delta += shift;
+
+		domains = reloc[n].read_domains << 16 | reloc[n].write_domain;
+		if (kgem->gen >= 0100)
+			*(uint64_t *)(kgem->batch + offset/4) =
+				kgem_add_reloc64(kgem, offset/4, target,
+						 domains, delta);
+		else
+			kgem->batch[offset/4] =
+				kgem_add_reloc(kgem, offset/4, target,
+					       domains, delta);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	kgem_submit(kgem);
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	s->build += elapsed(&t0, &t1);
+	s->submit += elapsed(&t1, &t2);
+
+	for (n = 0; n < batch->nexec; n++)
+		kgem_bo_destroy(kgem, bo[n]);
+	free(bo);
+
+	kgem_retire(kgem);
+	return !kgem->wedged;
+}
+
+static struct sna *setup(void)
+{
+	struct sna *sna;
+	int fd;
+
+	fd = fake_i915_open(&params);
+	if (fd < 0) {
+		perror("fake_i915_open");
+		exit(1);
+	}
+	kgem_set_ioctl(fake_i915_ioctl);
+
+	sna = calloc(1, sizeof(*sna));
+	sna->scrn = calloc(1, sizeof(*sna->scrn));
+	sna->cpu_features = sna_cpu_detect();
+	sna->render.reset = no_render;
+	sna->render.flush = no_render;
+
+	kgem_init(&sna->kgem, fd, NULL, params.gen);
+	if (sna->kgem.wedged) {
+		fprintf(stderr, "kgem refused the fake device\n");
+		exit(1);
+	}
+
+	return sna;
+}
+
+static void teardown(struct sna *sna)
+{
+	kgem_submit(&sna->kgem);
+	kgem_cleanup_cache(&sna->kgem);
+
+	kgem_set_ioctl(NULL);
+	fake_i915_close(sna->kgem.fd);
+	free(sna->scrn);
+	free(sna);
+}
+
+static int replay(const char *path)
+{
+	const struct kgem_capture_header *header;
+	const struct kgem_capture_record *record;
+	const char *base, *ptr, *end;
+	const void *payload;
+	struct stats s;
+	struct sna *sna = NULL;
+	struct stat st;
+	uint64_t first = 0, last = 0;
+	int loop, fd, ret = 1;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st)) {
+		perror(path);
+		return 1;
+	}
+
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		perror(path);
+		return 1;
+	}
+	end = base + st.st_size;
+
+	header = (const struct kgem_capture_header *)base;
+	if (st.st_size < (off_t)sizeof(*header) ||
+	    header->magic != KGEM_CAPTURE_MAGIC ||
+	    header->version != KGEM_CAPTURE_VERSION) {
+		fprintf(stderr, "%s: not a batch capture\n", path);
+		goto out;
+	}
+
+	params.gen = header->gen;
+	params.llc = header->flags & KGEM_CAPTURE_LLC;
+	params.full_ppgtt = header->flags & KGEM_CAPTURE_SOFTPIN;
+	sna = setup();
+
+	for (loop = 0; loop < loops; loop++) {
+		unsigned long count = 0;
+
+		memset(&s, 0, sizeof(s));
+		ptr = base + sizeof(*header);
+		while ((payload = next_record(&ptr, end, &record))) {
+			const struct kgem_capture_batch *batch;
+			const struct kgem_capture_exec *exec;
+			const struct kgem_capture_reloc *reloc;
+			const uint32_t *cmd, *state;
+			unsigned n;
+
+			if (record->type == KGEM_CAPTURE_BUFFER) {
+				const struct kgem_capture_buffer *buffer = payload;
+
+				s.buffers++;
+				s.buffer_bytes += buffer->size;
+				continue;
+			}
+			if (record->type != KGEM_CAPTURE_BATCH)
+				continue;
+
+			batch = payload;
+			exec = (const void *)(batch + 1);
+			reloc = (const void *)(exec + batch->nexec);
+			cmd = (const void *)(reloc + batch->nreloc);
+			state = cmd + batch->nbatch;
+			if ((const char *)(state + batch->batch_size - batch->surface) >
+			    (const char *)payload + record->length) {
+				fprintf(stderr, "%s: corrupt batch %lu\n", path, count);
+				goto out;
+			}
+
+			if (count++ == 0)
+				first = batch->timestamp;
+			last = batch->timestamp;
+
+			s.batches++;
+			s.commands += 4*batch->nbatch;
+			s.state += 4*(batch->batch_size - batch->surface);
+			s.relocs += batch->nreloc;
+			for (n = 0; n < batch->nreloc; n++)
+				s.writes += reloc[n].write_domain != 0;
+
+			if (verbose && loop == 0) {
+				struct stats b;
+
+				memset(&b, 0, sizeof(b));
+				decode_batch(header->gen, batch, cmd, &b);
+				fprintf(stdout, "batch %lu: +%.3fms %s, %u bytes of commands, %u of state, %u objects, %u relocs, %llu packets, %llu primitives, %llu redundant%s\n",
+					count - 1,
+					(batch->timestamp - first) / 1000.,
+					batch->ring == KGEM_BLT ? "blt" : "render",
+					4*batch->nbatch,
+					4*(batch->batch_size - batch->surface),
+					batch->nexec, batch->nreloc,
+					(unsigned long long)b.packets,
+					(unsigned long long)b.primitives,
+					(unsigned long long)b.redundant,
+					b.undecoded ? " (undecoded)" : "");
+			}
+			decode_batch(header->gen, batch, cmd, &s);
+
+			if (!replay_batch(&sna->kgem, batch, exec, reloc,
+					  cmd, state, &s)) {
+				fprintf(stderr, "%s: failed to replay batch %lu\n",
+					path, count - 1);
+				goto out;
+			}
+		}
+	}
+
+	if (s.batches == 0) {
+		fprintf(stderr, "%s: no batches\n", path);
+		goto out;
+	}
+
+	fprintf(stdout, "%s: gen %d.%d%s%s, %lu batches over %.1fms\n",
+		path, header->gen >> 3, header->gen & 7,
+		params.llc ? ", llc" : "",
+		params.full_ppgtt ? ", softpin" : "",
+		s.batches, (last - first) / 1000.);
+	fprintf(stdout, "  commands: %llu bytes (%.0f per batch), %llu packets, %llu primitives\n",
+		(unsigned long long)s.commands, (double)s.commands / s.batches,
+		(unsigned long long)s.packets,
+		(unsigned long long)s.primitives);
+	fprintf(stdout, "  state: %llu bytes (%.0f per batch), %llu redundant packets (%llu bytes)\n",
+		(unsigned long long)s.state, (double)s.state / s.batches,
+		(unsigned long long)s.redundant,
+		(unsigned long long)s.redundant_bytes);
+	fprintf(stdout, "  relocations: %llu (%.1f per batch), %llu writes\n",
+		(unsigned long long)s.relocs, (double)s.relocs / s.batches,
+		(unsigned long long)s.writes);
+	if (s.buffers)
+		fprintf(stdout, "  buffers: %llu captured, %llu MiB\n",
+			(unsigned long long)s.buffers,
+			(unsigned long long)s.buffer_bytes >> 20);
+	if (s.undecoded)
+		fprintf(stdout, "  %lu batches could not be decoded\n",
+			s.undecoded);
+	fprintf(stdout, "  replay: %.2fus to build and %.2fus to submit per batch\n",
+		1e6 * s.build / s.batches, 1e6 * s.submit / s.batches);
+	ret = 0;
+
+out:
+	if (sna)
+		teardown(sna);
+	munmap((void *)base, st.st_size);
+	return ret;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr,
+		"usage: %s [-v] [-n loops] [-l latency] trace...\n"
+		"  -v  report every batch\n"
+		"  -n  number of times to replay the trace (default %d)\n"
+		"  -l  GPU time per batch in microseconds (default %u)\n",
+		argv0, loops, params.latency_us);
+}
+
+int main(int argc, char **argv)
+{
+	int c, ret = 0;
+
+	while ((c = getopt(argc, argv, "vn:l:h")) != -1) {
+		switch (c) {
+		case 'v':
+			verbose = 1;
+			break;
+		case 'n':
+			loops = atoi(optarg);
+			if (loops < 1)
+				loops = 1;
+			break;
+		case 'l':
+			params.latency_us = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return c != 'h';
+		}
+	}
+
+	if (optind == argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	for (; optind < argc; optind++)
+		ret |= replay(argv[optind]);
+
+	return ret;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#include "sna.h"
+#include "sna-stubs.h"
+
+double min_time = .1;
+int check_only;
+
+double elapsed(const struct timespec *start,
+	       const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+		1e-9*(end->tv_nsec - start->tv_nsec);
+}
+
+/* The server's assertion and logging hooks */
+void FatalError(const char *f, ...)
+{
+	va_list ap;
+
+	va_start(ap, f);
+	vfprintf(stderr, f, ap);
+	va_end(ap);
+	abort();
+}
+
+void ErrorF(const char *f, ...)
+{
+	va_list ap;
+
+	va_start(ap, f);
+	vfprintf(stderr, f, ap);
+	va_end(ap);
+}
+
+void xf86DrvMsg(int scrnIndex, MessageType type, const char *f, ...)
+{
+	va_list ap;
+
+	(void)scrnIndex;
+	(void)type;
+
+	va_start(ap, f);
+	vfprintf(stderr, f, ap);
+	va_end(ap);
+}
+
+#if XORG_VERSION_CURRENT >= XORG_VERSION_NUMERIC(1,6,0,0,0)
+void xorg_backtrace(void)
+{
+}
+#endif
+
+#if HAS_DEBUG_FULL
+void LogF(const char *f, ...)
+{
+	va_list ap;
+
+	va_start(ap, f);
+	vfprintf(stdout, f, ap);
+	va_end(ap);
+}
+
+void __kgem_batch_debug(struct kgem *kgem, uint32_t nbatch)
+{
+	(void)kgem;
+	(void)nbatch;
+}
+#endif
+
+/* The rest of the driver, as called from kgem.c */
+void sna_render_mark_wedged(struct sna *sna)
+{
+	(void)sna;
+}
+
+void sna_render_flush_solid(struct sna *sna)
+{
+	(void)sna;
+}
+
+bool sna_mode_disable(struct sna *sna)
+{
+	(void)sna;
+	return false;
+}
+
+void sna_mode_enable(struct sna *sna)
+{
+	(void)sna;
+}